@@ -11,6 +11,20 @@
 #include <rtthread.h>
 #include "board.h"
 #include "cyw43_arch.h"
+#include "cyw43_arch_datapath.h"
+#include "cyw43_arch_stats.h"
+#include "cyw43_arch_ioctl.h"
+#include "cyw43_arch_info.h"
+#include "cyw43_frame_pool.h"
+#include "cyw43_pmk_cache.h"
+#include "cyw43_dhcp_cache.h"
+#include "cyw43_arch_ap.h"
+#include "cyw43_arch_acs.h"
+#include "cyw43_arch_offload.h"
+#include "cyw43_arch_mcast.h"
+#include "cyw43_arch_health.h"
+#include "async_context_rtthread.h"
+#include "hardware/sync.h"
 
 #ifdef PKG_USING_WLAN_CYW43439
 
@@ -26,6 +40,170 @@ struct ifx_wifi
 
 static struct ifx_wifi wifi_sta, wifi_ap;
 
+#define SCAN_BSSI_ARR_MAX 30
+
+/* room for the report of every network in a full scan, its scan done and a few link events */
+#ifndef CYW43_EVENT_RING_LEN
+#define CYW43_EVENT_RING_LEN            64
+#endif
+
+#if CYW43_EVENT_RING_LEN & (CYW43_EVENT_RING_LEN - 1)
+#error CYW43_EVENT_RING_LEN must be a power of two
+#endif
+#if CYW43_EVENT_RING_LEN < SCAN_BSSI_ARR_MAX + 2
+#error CYW43_EVENT_RING_LEN must hold the results of a full scan
+#endif
+
+#ifndef CYW43_EVENT_THREAD_STACK_SIZE
+#define CYW43_EVENT_THREAD_STACK_SIZE   2048
+#endif
+
+#ifndef CYW43_EVENT_THREAD_PRIORITY
+#define CYW43_EVENT_THREAD_PRIORITY     (RT_THREAD_PRIORITY_MAX - 4)
+#endif
+
+struct cyw43_event
+{
+    struct rt_wlan_device *wlan;
+    rt_wlan_dev_event_t event;
+    rt_bool_t has_info;
+    struct rt_wlan_info info;
+};
+
+/*
+ * wlan events are handed to the wlan framework from a dispatch thread, so that slow user handlers
+ * never run with the cyw43 lock held. Events come from driver callbacks and workers, which already
+ * run with the cyw43 lock held, so the producer side is never contended and the ring needs no lock
+ * of its own: the head is only written by the producer, the tail only by the dispatch thread.
+ * Threads outside the async_context flag their events for event_deferred_worker to post instead.
+ */
+static struct cyw43_event event_ring[CYW43_EVENT_RING_LEN];
+static volatile rt_uint32_t event_head;   /* only written by producers */
+static volatile rt_uint32_t event_tail;   /* only written by the dispatch thread */
+static rt_uint32_t event_dropped;
+static struct rt_semaphore event_sem;
+static struct rt_thread event_thread;
+static rt_uint8_t event_thread_stack[CYW43_EVENT_THREAD_STACK_SIZE] __attribute__((aligned(8)));
+
+static volatile rt_bool_t scan_done_pending;
+static volatile rt_bool_t ap_start_pending;
+static rt_bool_t event_worker_added;
+
+static void event_deferred_func(async_context_t *context, async_when_pending_worker_t *worker);
+
+static async_when_pending_worker_t event_deferred_worker =
+{
+    .do_work = event_deferred_func
+};
+
+/* must be called with the cyw43 lock held */
+static void event_post(struct rt_wlan_device *wlan, rt_wlan_dev_event_t event, const struct rt_wlan_info *info)
+{
+    struct cyw43_event *e;
+    rt_uint32_t head;
+
+    async_context_lock_check(cyw43_arch_async_context());
+    head = event_head;
+    if (head - event_tail >= CYW43_EVENT_RING_LEN)
+    {
+        event_dropped++;
+        return;
+    }
+    e = &event_ring[head % CYW43_EVENT_RING_LEN];
+    e->wlan = wlan;
+    e->event = event;
+    e->has_info = info != RT_NULL;
+    if (info)
+    {
+        e->info = *info;
+    }
+    /* the entry must be complete before the dispatch thread can see it */
+    __dmb();
+    event_head = head + 1;
+    rt_sem_release(&event_sem);
+}
+
+static void event_deferred_func(async_context_t *context, async_when_pending_worker_t *worker)
+{
+    if (scan_done_pending)
+    {
+        scan_done_pending = RT_FALSE;
+        event_post(wifi_sta.wlan, RT_WLAN_DEV_EVT_SCAN_DONE, RT_NULL);
+    }
+    if (ap_start_pending)
+    {
+        ap_start_pending = RT_FALSE;
+        event_post(wifi_ap.wlan, RT_WLAN_DEV_EVT_AP_START, RT_NULL);
+    }
+}
+
+/* post an event from a thread which doesn't hold the cyw43 lock, without taking it */
+static void event_post_deferred(volatile rt_bool_t *pending)
+{
+    *pending = RT_TRUE;
+    async_context_set_work_pending(cyw43_arch_async_context(), &event_deferred_worker);
+}
+
+static void event_thread_entry(void *parameter)
+{
+    struct rt_wlan_buff buff;
+    struct cyw43_event *e;
+
+    while (1)
+    {
+        rt_sem_take(&event_sem, RT_WAITING_FOREVER);
+        while (event_tail != event_head)
+        {
+            __dmb();
+            e = &event_ring[event_tail % CYW43_EVENT_RING_LEN];
+            if (e->has_info)
+            {
+                buff.data = &e->info;
+                buff.len = sizeof(e->info);
+                rt_wlan_dev_indicate_event_handle(e->wlan, e->event, &buff);
+            }
+            else
+            {
+                rt_wlan_dev_indicate_event_handle(e->wlan, e->event, RT_NULL);
+            }
+            /* finish with the entry before handing it back to the producers */
+            __dmb();
+            event_tail = event_tail + 1;
+        }
+    }
+}
+
+#if CYW43_PMK_CACHE
+static rt_uint32_t join_start_us;
+static rt_bool_t join_pending;
+static rt_bool_t join_cached;
+#endif
+
+/* called from the async context whenever the station joins or leaves an access point */
+static void link_changed(bool connected)
+{
+#if CYW43_PMK_CACHE
+    if (connected && join_pending)
+    {
+        join_pending = RT_FALSE;
+        cyw43_pmk_cache_note_join(join_cached, time_us_32() - join_start_us);
+    }
+#endif
+    event_post(wifi_sta.wlan, connected ? RT_WLAN_DEV_EVT_CONNECT : RT_WLAN_DEV_EVT_DISCONNECT, RT_NULL);
+}
+
+#if CYW43_ARCH_AP_STATIONS
+/* called from the async context as stations come and go from the access point */
+static void ap_sta_changed(const uint8_t mac[6], bool associated)
+{
+    struct rt_wlan_info info;
+
+    rt_memset(&info, 0, sizeof(info));
+    rt_memcpy(info.bssid, mac, RT_WLAN_BSSID_MAX_LENGTH);
+    event_post(wifi_ap.wlan, associated ? RT_WLAN_DEV_EVT_AP_ASSOCIATED : RT_WLAN_DEV_EVT_AP_DISASSOCIATED, &info);
+}
+#endif
+
 rt_inline struct ifx_wifi *_GET_DEV(struct rt_wlan_device *wlan)
 {
     if (wlan == wifi_sta.wlan)
@@ -91,7 +269,6 @@ static int _ifx_scan_info2rtt(const cyw43_ev_scan_result_t *result_ptr, struct r
     return 0;
 }
 
-#define SCAN_BSSI_ARR_MAX 30
 
 #define CMP_MAC( a, b )  (((((unsigned char*)a)[0])==(((unsigned char*)b)[0]))&& \
                           ((((unsigned char*)a)[1])==(((unsigned char*)b)[1]))&& \
@@ -133,17 +310,13 @@ int scan_callback(void *env, const cyw43_ev_scan_result_t *result)
     if (result->ssid_len != 0)
     {
         /* parse scan report event data */
-        struct rt_wlan_buff buff;
         struct rt_wlan_info wlan_info;
         if (scan_bssi_has(result->bssid) == false)
         {
             _ifx_scan_info2rtt(result, &wlan_info);
 
-            buff.data = &wlan_info;
-            buff.len = sizeof(struct rt_wlan_info);
-
             /* indicate scan report event */
-            rt_wlan_dev_indicate_event_handle(wifi_sta.wlan, RT_WLAN_DEV_EVT_SCAN_REPORT, &buff);
+            event_post(wifi_sta.wlan, RT_WLAN_DEV_EVT_SCAN_REPORT, &wlan_info);
         }
     }
     return RT_EOK;
@@ -155,6 +328,12 @@ static rt_err_t wlan_init(struct rt_wlan_device *wlan)
 
     if (res == 0)
     {
+        cyw43_thread_enter();
+        if (!event_worker_added)
+        {
+            event_worker_added = async_context_add_when_pending_worker(cyw43_arch_async_context(), &event_deferred_worker);
+        }
+        cyw43_thread_exit();
         return RT_EOK;
     }
     LOG_E("cyw43_arch_init failed...! error code: %d\n", res);
@@ -163,13 +342,15 @@ static rt_err_t wlan_init(struct rt_wlan_device *wlan)
 
 static rt_err_t wlan_scan(struct rt_wlan_device *wlan, struct rt_scan_info *scan_info)
 {
+    cyw43_arch_set_stack_phase(CYW43_ARCH_STACK_SCAN);
     memset(mac_addr_arr, 0, sizeof(_mac_t) * SCAN_BSSI_ARR_MAX);
     cyw43_wifi_scan_options_t scan_options = {0};
-    int err = cyw43_wifi_scan(&cyw43_state, &scan_options, NULL, scan_callback);
+    uint32_t start_us = time_us_32();
+    int err = cyw43_arch_stats_ioctl(start_us, cyw43_wifi_scan(&cyw43_state, &scan_options, NULL, scan_callback));
 
     if (err == 0)
     {
-        rt_wlan_dev_indicate_event_handle(wifi_sta.wlan, RT_WLAN_DEV_EVT_SCAN_DONE, 0);
+        event_post_deferred(&scan_done_pending);
         return RT_EOK;
     }
     return -RT_ERROR;
@@ -178,8 +359,34 @@ static rt_err_t wlan_scan(struct rt_wlan_device *wlan, struct rt_scan_info *scan
 static rt_err_t wlan_join(struct rt_wlan_device *wlan, struct rt_sta_info *sta_info)
 {
     uint32_t res;
+    uint32_t start_us;
+    size_t key_len = sta_info->key.len;
+    const uint8_t *key = sta_info->key.val;
+#if CYW43_PMK_CACHE
+    uint8_t pmk_hex[CYW43_PMK_HEX_LEN];
+
+    /* hand the firmware a cached PMK rather than making it derive one from the passphrase */
+    key = cyw43_pmk_cache_join_key(sta_info->ssid.val, sta_info->ssid.len, key, &key_len, pmk_hex);
+    join_cached = key == pmk_hex;
+    join_pending = RT_TRUE;
+    join_start_us = time_us_32();
+#endif
+#if CYW43_DHCP_CACHE
+    cyw43_dhcp_cache_join(sta_info->ssid.val, sta_info->ssid.len);
+#endif
+    cyw43_arch_set_stack_phase(CYW43_ARCH_STACK_JOIN);
+    cyw43_arch_info_note_join(CYW43_AUTH_WPA2_AES_PSK);
+#if CYW43_ARCH_HEALTH
+    cyw43_arch_health_note_join(sta_info->ssid.val, sta_info->ssid.len, key, key_len, CYW43_AUTH_WPA2_AES_PSK, RT_NULL);
+#endif
+    /* time the join and the address as the blocking connect functions do, for cyw43_info */
+    cyw43_arch_wifi_time_connect();
+    start_us = time_us_32();
     /** Join to Wi-Fi AP **/
-    res = cyw43_wifi_join(&cyw43_state, sta_info->ssid.len, sta_info->ssid.val, sta_info->key.len, sta_info->key.val, CYW43_AUTH_WPA2_AES_PSK, RT_NULL, RT_NULL);
+    res = cyw43_arch_stats_ioctl(start_us, cyw43_wifi_join(&cyw43_state, sta_info->ssid.len, sta_info->ssid.val, key_len, key, CYW43_AUTH_WPA2_AES_PSK, RT_NULL, RT_NULL));
+#if CYW43_PMK_CACHE
+    rt_memset(pmk_hex, 0, sizeof(pmk_hex));
+#endif
 
     if (res == 0)
     {
@@ -192,13 +399,40 @@ rt_err_t wlan_mode(struct rt_wlan_device *wlan, rt_wlan_mode_t mode)
 {
     switch (mode)
     {
+    case RT_WLAN_NONE:
+        LOG_D("wlan_mode RT_WLAN_NONE\n");
+        /* take down whichever interface belongs to the device */
+        if (wlan == wifi_ap.wlan)
+        {
+            if (cyw43_state.itf_state & (1 << CYW43_ITF_AP))
+            {
+                cyw43_arch_disable_ap_mode();
+            }
+        }
+        else
+        {
+            cyw43_arch_disable_sta_mode();
+        }
+        break;
     case RT_WLAN_STATION:
         LOG_D("wlan_mode RT_WLAN_STATION\n");
+        /* the station and the access point are separate interfaces of the chip, each with its own device */
+        if (wlan != wifi_sta.wlan)
+        {
+            return -RT_EINVAL;
+        }
         cyw43_arch_enable_sta_mode();
         break;
     case RT_WLAN_AP:
         LOG_D("wlan_mode RT_WLAN_AP\n");
+        /* the access point needs an SSID, so it is started by wlan_softap */
+        if (wlan != wifi_ap.wlan)
+        {
+            return -RT_EINVAL;
+        }
         break;
+    default:
+        return -RT_EINVAL;
     }
 
     return 0;
@@ -206,50 +440,167 @@ rt_err_t wlan_mode(struct rt_wlan_device *wlan, rt_wlan_mode_t mode)
 
 rt_err_t wlan_softap(struct rt_wlan_device *wlan, struct rt_ap_info *ap_info)
 {
+#if CYW43_ARCH_ACS
+    cyw43_arch_acs_result_t acs;
+    cyw43_arch_info_t info;
+
+    cyw43_arch_info_get(&info);
+    if (info.sta_connected && cyw43_arch_get_ap_channel_policy() == CYW43_ARCH_AP_CHANNEL_FOLLOW_STA)
+    {
+        /* the access point starts on the station's channel, whatever was asked for */
+        LOG_D("access point follows the station to channel %d", info.sta_channel);
+    }
+    /* channel 0 asks for the quietest channel */
+    else if (ap_info->channel == 0)
+    {
+        if (cyw43_arch_acs_select(&acs) == 0)
+        {
+            LOG_D("acs picked channel %d of %d networks", acs.channel, acs.networks);
+            cyw43_wifi_ap_set_channel(&cyw43_state, acs.channel);
+        }
+        else
+        {
+            LOG_E("channel survey failed, staying on channel %d", cyw43_state.ap_channel);
+        }
+    }
+    else
+    {
+        cyw43_wifi_ap_set_channel(&cyw43_state, ap_info->channel);
+    }
+#endif
     LOG_D("wlan_softap");
+    cyw43_arch_info_note_ap(get_security(ap_info->security));
     cyw43_arch_enable_ap_mode(ap_info->ssid.val, ap_info->key.val, get_security(ap_info->security));
     LOG_D("ap start ok");
-    rt_wlan_dev_indicate_event_handle(wifi_ap.wlan, RT_WLAN_DEV_EVT_AP_START, 0);
+    event_post_deferred(&ap_start_pending);
 
     return RT_EOK;
 }
 
 rt_err_t wlan_disconnect(struct rt_wlan_device *wlan)
 {
+    uint32_t start_us = time_us_32();
     LOG_D("wlan_disconnect");
-    cyw43_wifi_leave(&cyw43_state, CYW43_ITF_STA);
+    cyw43_arch_stats_ioctl(start_us, cyw43_wifi_leave(&cyw43_state, CYW43_ITF_STA));
+#if CYW43_ARCH_HEALTH
+    cyw43_arch_health_note_leave();
+#endif
     return RT_EOK;
 }
 
 rt_err_t wlan_ap_stop(struct rt_wlan_device *wlan)
 {
+    uint32_t start_us = time_us_32();
     LOG_D("wlan_ap_stop");
-    cyw43_wifi_leave(&cyw43_state, CYW43_ITF_AP);
+    cyw43_arch_stats_ioctl(start_us, cyw43_wifi_leave(&cyw43_state, CYW43_ITF_AP));
+#if CYW43_ARCH_AP_STATIONS
+    cyw43_arch_ap_detach();
+#endif
+#if CYW43_ARCH_HEALTH
+    cyw43_arch_health_note_ap(RT_FALSE);
+#endif
     return RT_EOK;
 }
 
 int wlan_get_rssi(struct rt_wlan_device *wlan)
 {
-    int32_t rssi;
-    cyw43_wifi_get_rssi(&cyw43_state, &rssi);
+    int32_t rssi = 0;
+    /* goes through the ioctl queue, behind any requests already waiting */
+    cyw43_arch_ioctl_req_t req =
+    {
+        .cmd = CYW43_WLC_GET(CYW43_WLC_GET_RSSI),
+        .buf = &rssi,
+        .len = sizeof(rssi),
+        .itf = CYW43_ITF_STA,
+    };
+    cyw43_arch_ioctl_submit(&req);
+    cyw43_arch_ioctl_wait(&req);
     return rssi;
 }
+rt_err_t wlan_set_powersave(struct rt_wlan_device *wlan, int level)
+{
+    cyw43_arch_pm_mode_t mode;
+
+    /* level 0 disables power save, higher levels save more power */
+    if (level <= 0)
+    {
+        mode = CYW43_ARCH_PM_NONE;
+    }
+    else if (level == 1)
+    {
+        mode = CYW43_ARCH_PM_PERFORMANCE;
+    }
+    else
+    {
+        mode = CYW43_ARCH_PM_AGGRESSIVE;
+    }
+    LOG_D("wlan_set_powersave %d", level);
+    if (cyw43_arch_set_pm_mode(mode) == 0)
+    {
+        return RT_EOK;
+    }
+    return -RT_ERROR;
+}
+
+int wlan_get_powersave(struct rt_wlan_device *wlan)
+{
+    switch (cyw43_arch_get_pm_mode())
+    {
+    case CYW43_ARCH_PM_NONE:
+        return 0;
+    case CYW43_ARCH_PM_AGGRESSIVE:
+        return 2;
+    default:
+        return 1;
+    }
+}
+
 rt_err_t wlan_set_channel(struct rt_wlan_device *wlan, int channel)
 {
     LOG_D("wlan_set_channel");
     cyw43_wifi_ap_set_channel(&cyw43_state, channel);
+    cyw43_arch_info_refresh();
     return 0;
 }
 int wlan_get_channel(struct rt_wlan_device *wlan)
 {
+    cyw43_arch_info_t info;
+
     LOG_D("wlan_get_channel");
-    return cyw43_state.ap_channel;
+    cyw43_arch_info_get(&info);
+    if (wlan == wifi_ap.wlan)
+    {
+        return info.ap_channel;
+    }
+    return info.sta_channel;
 }
 rt_err_t wlan_get_mac(struct rt_wlan_device *wlan, rt_uint8_t mac[])
 {
-    int res = cyw43_wifi_get_mac(&cyw43_state, CYW43_ITF_STA, mac);
+    cyw43_arch_info_t info;
+    /* the iovar name goes out in the buffer and the address comes back at its start */
+    rt_uint8_t buf[16] = "cur_etheraddr";
+    cyw43_arch_ioctl_req_t req =
+    {
+        .cmd = CYW43_IOCTL_GET_VAR,
+        .buf = buf,
+        .len = sizeof(buf),
+        .itf = CYW43_ITF_STA,
+    };
+    int res;
+
+    /* the MAC never changes, so only go to the chip if the cache hasn't been filled in yet */
+    cyw43_arch_info_get(&info);
+    if (info.mac_valid)
+    {
+        memcpy(mac, info.mac, sizeof(info.mac));
+        return RT_EOK;
+    }
+    /* goes through the ioctl queue like wlan_get_rssi */
+    cyw43_arch_ioctl_submit(&req);
+    res = cyw43_arch_ioctl_wait(&req);
     if (res == 0)
     {
+        memcpy(mac, buf, 6);
         LOG_D("WLAN MAC Address : %02X:%02X:%02X:%02X:%02X:%02X", mac[0], mac[1], mac[2],
                 mac[3], mac[4], mac[5]);
         return RT_EOK;
@@ -275,14 +626,22 @@ static int wlan_send(struct rt_wlan_device *wlan, void *buff, int len)
         LOG_E("wlan is null!!!");
         return -RT_ERROR;
     }
+    if (cyw43_arch_get_stack_phase() != CYW43_ARCH_STACK_DATA)
+    {
+        cyw43_arch_set_stack_phase(CYW43_ARCH_STACK_DATA);
+    }
 
     if (wlan == wifi_sta.wlan)
     {
-        cyw43_send_ethernet(&cyw43_state, CYW43_ITF_STA, len, buff, false);
+        cyw43_arch_datapath_send(CYW43_ITF_STA, len, buff);
     }
     else
     {
-        cyw43_send_ethernet(&cyw43_state, CYW43_ITF_AP, len, buff, false);
+#if CYW43_ARCH_AP_STATIONS
+        cyw43_arch_ap_send(len, buff);
+#else
+        cyw43_arch_datapath_send(CYW43_ITF_AP, len, buff);
+#endif
     }
     return len;
 }
@@ -297,6 +656,8 @@ const static struct rt_wlan_dev_ops ops =
     .wlan_disconnect    = wlan_disconnect,
     .wlan_ap_stop       = wlan_ap_stop,
     .wlan_get_rssi      = wlan_get_rssi,
+    .wlan_set_powersave = wlan_set_powersave,
+    .wlan_get_powersave = wlan_get_powersave,
     .wlan_set_channel   = wlan_set_channel,
     .wlan_get_channel   = wlan_get_channel,
     .wlan_set_country   = wlan_set_country,
@@ -305,6 +666,46 @@ const static struct rt_wlan_dev_ops ops =
     .wlan_send          = wlan_send,
 };
 
+static struct rt_device cyw43_dev;
+
+static rt_err_t cyw43_dev_control(rt_device_t dev, int cmd, void *args)
+{
+    switch (cmd)
+    {
+    case CYW43_CTRL_GET_STATS:
+        if (args == RT_NULL)
+        {
+            return -RT_EINVAL;
+        }
+        cyw43_arch_stats_get((cyw43_arch_stats_t *)args);
+        return RT_EOK;
+    case CYW43_CTRL_RESET_STATS:
+        cyw43_arch_stats_reset();
+        return RT_EOK;
+    case CYW43_CTRL_GET_INFO:
+        if (args == RT_NULL)
+        {
+            return -RT_EINVAL;
+        }
+        cyw43_arch_info_get((cyw43_arch_info_t *)args);
+        return RT_EOK;
+    default:
+        return -RT_EINVAL;
+    }
+}
+
+#ifdef RT_USING_DEVICE_OPS
+const static struct rt_device_ops cyw43_dev_ops =
+{
+    RT_NULL,
+    RT_NULL,
+    RT_NULL,
+    RT_NULL,
+    RT_NULL,
+    cyw43_dev_control,
+};
+#endif
+
 int rt_hw_wifi_init(void)
 {
     static struct rt_wlan_device wlan_sta, wlan_ap;
@@ -312,6 +713,16 @@ int rt_hw_wifi_init(void)
     wifi_sta.wlan = &wlan_sta;
     wifi_ap.wlan = &wlan_ap;
 
+    /* start the wlan event dispatch thread */
+    rt_sem_init(&event_sem, "cyw43_evt", 0, RT_IPC_FLAG_FIFO);
+    rt_thread_init(&event_thread, "cyw43_evt", event_thread_entry, RT_NULL, event_thread_stack,
+                   sizeof(event_thread_stack), CYW43_EVENT_THREAD_PRIORITY, 10);
+    rt_thread_startup(&event_thread);
+    cyw43_arch_info_set_link_callback(link_changed);
+#if CYW43_ARCH_AP_STATIONS
+    cyw43_arch_ap_set_sta_callback(ap_sta_changed);
+#endif
+
     /* register wlan device for ap */
     ret = rt_wlan_dev_register(&wlan_ap, RT_WLAN_DEVICE_AP_NAME, &ops, 0, &wifi_ap);
     if (ret != RT_EOK)
@@ -326,7 +737,430 @@ int rt_hw_wifi_init(void)
         return ret;
     }
 
+    /* register the "cyw43" device for driver statistics and cached chip information */
+    cyw43_dev.type = RT_Device_Class_Miscellaneous;
+#ifdef RT_USING_DEVICE_OPS
+    cyw43_dev.ops = &cyw43_dev_ops;
+#else
+    cyw43_dev.control = cyw43_dev_control;
+#endif
+    cyw43_arch_stats_reset();
+    return rt_device_register(&cyw43_dev, "cyw43", RT_DEVICE_FLAG_RDWR);
+
 }
 INIT_DEVICE_EXPORT(rt_hw_wifi_init);
 
+#ifdef RT_USING_FINSH
+#include <stdlib.h>
+#include "cyw43_stats.h"
+
+static void cyw43_pm(int argc, char **argv)
+{
+    static const char *mode_name[] = {"none", "performance", "aggressive", "custom"};
+    int res = 0;
+
+    if (argc < 2)
+    {
+        rt_kprintf("power mode: %s\n", mode_name[cyw43_arch_get_pm_mode()]);
+        rt_kprintf("usage: cyw43_pm none|performance|aggressive\n");
+        rt_kprintf("       cyw43_pm custom <sleep_ret_ms> <listen_interval> <dtim_period>\n");
+        rt_kprintf("       cyw43_pm boost on|off\n");
+        rt_kprintf("       cyw43_pm governor [<frame_us> <burst_packets> <idle_ms>]\n");
+#if CYW43_ARCH_PM_TRACE_LEN
+        rt_kprintf("       cyw43_pm trace reset|dump|replay [<frame_us> <burst_packets> <idle_ms>]\n");
+#endif
+        return;
+    }
+    if (!rt_strcmp(argv[1], "none"))
+    {
+        res = cyw43_arch_set_pm_mode(CYW43_ARCH_PM_NONE);
+    }
+    else if (!rt_strcmp(argv[1], "performance"))
+    {
+        res = cyw43_arch_set_pm_mode(CYW43_ARCH_PM_PERFORMANCE);
+    }
+    else if (!rt_strcmp(argv[1], "aggressive"))
+    {
+        res = cyw43_arch_set_pm_mode(CYW43_ARCH_PM_AGGRESSIVE);
+    }
+    else if (!rt_strcmp(argv[1], "custom") && argc == 5)
+    {
+        res = cyw43_arch_set_pm_custom(atoi(argv[2]), atoi(argv[3]), atoi(argv[4]));
+    }
+    else if (!rt_strcmp(argv[1], "boost") && argc == 3)
+    {
+        cyw43_arch_set_pm_auto_boost(!rt_strcmp(argv[2], "on"));
+    }
+    else if (!rt_strcmp(argv[1], "governor") && argc == 2)
+    {
+        cyw43_pm_policy_t policy;
+
+        cyw43_arch_get_pm_governor(&policy);
+        rt_kprintf("frame %uus, burst %u packets, queue depth %u, idle %ums\n", policy.config.frame_us,
+                policy.config.burst_packets, policy.config.queue_depth, policy.config.idle_us / 1000);
+        rt_kprintf("tx %u, rx %u, boosts %u, boosted %s\n", policy.tx_packets, policy.rx_packets,
+                policy.boosts, policy.boosted ? "yes" : "no");
+    }
+    else if (!rt_strcmp(argv[1], "governor") && argc == 5)
+    {
+        cyw43_pm_policy_config_t config = cyw43_pm_policy_default_config();
+
+        config.frame_us = atoi(argv[2]);
+        config.burst_packets = atoi(argv[3]);
+        config.idle_us = atoi(argv[4]) * 1000;
+        res = cyw43_arch_set_pm_governor_config(&config);
+    }
+#if CYW43_ARCH_PM_TRACE_LEN
+    else if (!rt_strcmp(argv[1], "trace") && argc >= 3 && !rt_strcmp(argv[2], "reset"))
+    {
+        cyw43_arch_pm_trace_reset();
+    }
+    else if (!rt_strcmp(argv[1], "trace") && argc == 3 && !rt_strcmp(argv[2], "dump"))
+    {
+        const uint64_t *trace;
+        rt_uint32_t count = cyw43_arch_pm_trace_get(&trace);
+        rt_uint32_t i;
+
+        /* relative to the first packet, for tests/host/pm_replay */
+        for (i = 0; i < count; i++)
+        {
+            rt_kprintf("%u\n", (rt_uint32_t)(trace[i] - trace[0]));
+        }
+    }
+    else if (!rt_strcmp(argv[1], "trace") && (argc == 3 || argc == 6) && !rt_strcmp(argv[2], "replay"))
+    {
+        cyw43_pm_policy_config_t config = cyw43_pm_policy_default_config();
+        cyw43_pm_policy_replay_report_t report;
+
+        if (argc == 6)
+        {
+            config.frame_us = atoi(argv[3]);
+            config.burst_packets = atoi(argv[4]);
+            config.idle_us = atoi(argv[5]) * 1000;
+        }
+        cyw43_arch_pm_trace_replay(&config, RT_NULL, &report);
+        rt_kprintf("packets %u (%u in power save), boosts %u\n", report.packets, report.packets_in_ps, report.boosts);
+        rt_kprintf("added latency %uus total, %uus max\n", (rt_uint32_t)report.added_latency_us, report.max_added_latency_us);
+        rt_kprintf("radio on %ums of %ums\n", (rt_uint32_t)(report.radio_on_us / 1000), (rt_uint32_t)(report.duration_us / 1000));
+    }
+#endif
+    else
+    {
+        rt_kprintf("invalid arguments\n");
+        return;
+    }
+    if (res != 0)
+    {
+        rt_kprintf("failed to set power mode: %d\n", res);
+    }
+}
+MSH_CMD_EXPORT(cyw43_pm, cyw43 wifi power management);
+
+static void cyw43_stats(int argc, char **argv)
+{
+    static const char *itf_name[] = {"sta", "ap"};
+    cyw43_arch_stats_t stats;
+    rt_uint32_t period_ms;
+
+    if (argc > 1 && !rt_strcmp(argv[1], "reset"))
+    {
+        cyw43_arch_stats_reset();
+#if CYW43_FRAME_POOL
+        cyw43_frame_pool_reset_stats();
+#endif
+        return;
+    }
+    cyw43_arch_stats_get(&stats);
+    period_ms = (rt_uint32_t)(stats.period_us / 1000);
+    rt_kprintf("itf  tx packets   tx bytes  dropped  rx packets   rx bytes  chained\n");
+    for (int itf = 0; itf <= CYW43_ITF_AP; itf++)
+    {
+        rt_kprintf("%-4s %10u %10u %8u  %10u %10u %8u\n", itf_name[itf], stats.itf[itf].tx_packets,
+                stats.itf[itf].tx_bytes, stats.itf[itf].tx_dropped, stats.itf[itf].rx_packets, stats.itf[itf].rx_bytes,
+                stats.itf[itf].rx_chained);
+    }
+    rt_kprintf("tx queued %u (max %u), stalls %u, slowest send %uus\n", stats.tx_queued, stats.tx_queued_max,
+            stats.tx_stalls, stats.tx_max_us);
+    for (int itf = 0; itf <= CYW43_ITF_AP; itf++)
+    {
+        rt_kprintf("%-4s tx queued %u (max %u), stalls %u\n", itf_name[itf], stats.itf[itf].tx_queued,
+                stats.itf[itf].tx_queued_max, stats.itf[itf].tx_stalls);
+    }
+    rt_kprintf("ioctls %u (%u failed), avg %uus, max %uus\n", stats.ioctls, stats.ioctl_errors,
+            stats.ioctls ? (rt_uint32_t)(stats.ioctl_us / stats.ioctls) : 0, stats.ioctl_max_us);
+    rt_kprintf("wakeups %u in %ums, %u/s\n", stats.wakeups, period_ms,
+            period_ms ? (rt_uint32_t)((rt_uint64_t)stats.wakeups * 1000 / period_ms) : 0);
+    rt_kprintf("wlan events dropped %u\n", event_dropped);
+    if (cyw43_arch_async_context())
+    {
+        async_context_rtthread_poll_stats_t poll;
+
+        async_context_rtthread_get_poll_stats((async_context_rtthread_t *)cyw43_arch_async_context(), &poll);
+        rt_kprintf("irq %s mode, entered polling %u times, left %u times, %u irqs deferred\n",
+                poll.polling ? "polling" : "interrupt", poll.enters, poll.exits, poll.irqs_deferred);
+    }
+#if CYW43_FRAME_POOL
+    for (int i = 0; i < CYW43_FRAME_CLASS_COUNT; i++)
+    {
+        cyw43_frame_pool_stats_t pool;
+
+        cyw43_frame_pool_get_stats((cyw43_frame_class_t)i, &pool);
+        rt_kprintf("%s frames %u/%u in use, high water %u, allocs %u, failures %u\n", i == CYW43_FRAME_RX ? "rx" : "tx",
+                pool.in_use, pool.size, pool.high_water, pool.allocs, pool.failures);
+    }
+#endif
+#if CYW43_ARCH_GPIO_SHADOW
+    {
+        cyw43_arch_gpio_stats_t gpio;
+
+        cyw43_arch_gpio_get_stats(&gpio);
+        rt_kprintf("wl gpio puts %u (%u unchanged), %u writes (%u failed), gets %u (%u from shadow)\n", gpio.puts,
+                gpio.puts_skipped, gpio.writes, gpio.write_errors, gpio.gets, gpio.gets_cached);
+    }
+#endif
+#if CYW43_USE_STATS
+    cyw43_dump_stats();
+#endif
+}
+MSH_CMD_EXPORT(cyw43_stats, show cyw43 wifi driver statistics: [reset]);
+
+static void cyw43_info(int argc, char **argv)
+{
+    cyw43_arch_info_t info;
+    cyw43_arch_connect_times_t times;
+#if CYW43_DHCP_CACHE
+    cyw43_dhcp_cache_stats_t dhcp;
+#endif
+
+    cyw43_arch_info_get(&info);
+    if (!info.mac_valid)
+    {
+        rt_kprintf("not read yet\n");
+        return;
+    }
+    rt_kprintf("mac %02x:%02x:%02x:%02x:%02x:%02x\n", info.mac[0], info.mac[1], info.mac[2], info.mac[3],
+            info.mac[4], info.mac[5]);
+    rt_kprintf("firmware %s\n", info.fw_version);
+    rt_kprintf("country %c%c rev %u\n", (char)(info.country & 0xff), (char)((info.country >> 8) & 0xff),
+            (info.country >> 16) & 0xffff);
+    if (info.sta_connected)
+    {
+        rt_kprintf("sta connected to %02x:%02x:%02x:%02x:%02x:%02x, channel %u, auth 0x%08x\n", info.bssid[0],
+                info.bssid[1], info.bssid[2], info.bssid[3], info.bssid[4], info.bssid[5], info.sta_channel,
+                info.sta_auth);
+    }
+    else
+    {
+        rt_kprintf("sta not connected\n");
+    }
+    if (info.ap_channel)
+    {
+        rt_kprintf("ap channel %u, auth 0x%08x, %s the station, moved %u times\n", info.ap_channel, info.ap_auth,
+                cyw43_arch_get_ap_channel_policy() == CYW43_ARCH_AP_CHANNEL_FOLLOW_STA ? "follows" : "ignores",
+                cyw43_arch_get_ap_channel_follows());
+    }
+    rt_kprintf("refreshed %u times\n", info.generation);
+    cyw43_arch_wifi_get_connect_times(&times);
+    if (times.join_us)
+    {
+        rt_kprintf("last connect: join %ums, address %ums\n", times.join_us / 1000, times.ip_us / 1000);
+    }
+#if CYW43_DHCP_CACHE
+    cyw43_dhcp_cache_get_stats(&dhcp);
+    rt_kprintf("dhcp lease cache hits %u, misses %u, expired %u\n", dhcp.hits, dhcp.misses, dhcp.expired);
+#endif
+}
+MSH_CMD_EXPORT(cyw43_info, show cached cyw43 chip and association information);
+
+#if CYW43_ARCH_AP_STATIONS
+static void cyw43_stas(int argc, char **argv)
+{
+    cyw43_arch_ap_sta_t stas[CYW43_ARCH_AP_MAX_STAS];
+    rt_uint32_t now_ms = to_ms_since_boot(get_absolute_time());
+    int count = cyw43_arch_ap_get_stas(stas, CYW43_ARCH_AP_MAX_STAS);
+
+    rt_kprintf("mac                rssi  rate(kbps)  tx packets   tx bytes  dropped  queued  rx packets   rx bytes  idle(ms)\n");
+    for (int i = 0; i < count; i++)
+    {
+        int32_t rssi;
+        uint32_t rate;
+
+        /* the link figures are read from the firmware now, rather than polled */
+        cyw43_arch_ap_get_sta_link(stas[i].mac, &rssi, &rate);
+        rt_kprintf("%02x:%02x:%02x:%02x:%02x:%02x %5d %11u %11u %10u %8u %7u %11u %10u %9u\n", stas[i].mac[0],
+                stas[i].mac[1], stas[i].mac[2], stas[i].mac[3], stas[i].mac[4], stas[i].mac[5], rssi,
+                rate, stas[i].tx_packets, stas[i].tx_bytes, stas[i].tx_dropped, stas[i].tx_queued,
+                stas[i].rx_packets, stas[i].rx_bytes, now_ms - stas[i].last_seen_ms);
+    }
+}
+MSH_CMD_EXPORT(cyw43_stas, show the stations associated with the cyw43 access point);
+#endif
+
+#if CYW43_ARCH_ACS
+static void cyw43_acs(int argc, char **argv)
+{
+    cyw43_arch_acs_result_t result;
+
+    if (argc == 3 && !rt_strcmp(argv[1], "interval"))
+    {
+        cyw43_arch_acs_set_interval(atoi(argv[2]));
+        return;
+    }
+    if (argc == 2 && !rt_strcmp(argv[1], "scan"))
+    {
+        if (cyw43_arch_acs_select(&result) != 0)
+        {
+            rt_kprintf("channel survey failed\n");
+            return;
+        }
+    }
+    else if (!cyw43_arch_acs_get_last(&result))
+    {
+        rt_kprintf("no channel survey yet\n");
+        rt_kprintf("usage: cyw43_acs [scan|interval <ms>]\n");
+        return;
+    }
+    rt_kprintf("channel  networks  load\n");
+    for (int c = 1; c <= CYW43_ARCH_ACS_MAX_CHANNEL; c++)
+    {
+        rt_kprintf("%7d %9u %5u%s\n", c, result.networks_on[c], result.load[c], c == (int)result.channel ? "  <- best" : "");
+    }
+    rt_kprintf("%u networks, ap on channel %u\n", result.networks, cyw43_state.ap_channel);
+}
+MSH_CMD_EXPORT(cyw43_acs, cyw43 access point channel survey: [scan|interval <ms>]);
+#endif
+
+#if CYW43_PMK_CACHE
+static void cyw43_pmk(int argc, char **argv)
+{
+    static const char *join_name[] = {"passphrase", "cached pmk"};
+    cyw43_pmk_cache_stats_t stats;
+
+    if (argc > 1 && !rt_strcmp(argv[1], "clear"))
+    {
+        cyw43_pmk_cache_clear();
+        return;
+    }
+    if (argc > 1 && !rt_strcmp(argv[1], "bench"))
+    {
+        /* IEEE 802.11i test vector */
+        static const rt_uint8_t expected[4] = {0xf4, 0x2c, 0x6f, 0xc5};
+        rt_uint8_t pmk[CYW43_PMK_LEN];
+        rt_uint32_t start_us = time_us_32();
+
+        cyw43_pmk_derive((const rt_uint8_t *)"IEEE", 4, (const rt_uint8_t *)"password", 8, pmk);
+        rt_kprintf("pbkdf2-sha1 4096 iterations: %uus, %s\n", time_us_32() - start_us,
+                rt_memcmp(pmk, expected, sizeof(expected)) ? "WRONG RESULT" : "ok");
+        return;
+    }
+    cyw43_pmk_cache_get_stats(&stats);
+    rt_kprintf("hits %u, misses %u, derivations %u, last derivation %uus\n", stats.hits, stats.misses,
+            stats.derivations, stats.derive_us);
+    for (int i = 0; i < 2; i++)
+    {
+        rt_kprintf("join with %-10s %4u joins, last %ums, avg %ums, max %ums\n", join_name[i], stats.join[i].joins,
+                stats.join[i].last_us / 1000,
+                stats.join[i].joins ? (rt_uint32_t)(stats.join[i].total_us / stats.join[i].joins / 1000) : 0,
+                stats.join[i].max_us / 1000);
+    }
+}
+MSH_CMD_EXPORT(cyw43_pmk, cyw43 wpa2 pmk cache: [clear|bench]);
+#endif
+
+#if CYW43_ARCH_OFFLOAD
+static void cyw43_offload(int argc, char **argv)
+{
+    static const char *filter_name[CYW43_ARCH_OFFLOAD_FILTER_COUNT] = {"mdns", "ssdp", "ipv6 multicast", "netbios"};
+    cyw43_arch_offload_stats_t stats;
+
+    if (argc == 3 && !rt_strcmp(argv[1], "arp"))
+    {
+        cyw43_arch_offload_set_arp(!rt_strcmp(argv[2], "on"));
+        return;
+    }
+    if (argc == 3 && !rt_strcmp(argv[1], "filters"))
+    {
+        cyw43_arch_offload_set_filters(strtoul(argv[2], RT_NULL, 0));
+        return;
+    }
+    if (argc != 1)
+    {
+        rt_kprintf("usage: cyw43_offload [arp on|off] [filters <mask>]\n");
+        return;
+    }
+    if (cyw43_arch_offload_get_stats(&stats) != 0)
+    {
+        rt_kprintf("some firmware counters could not be read\n");
+    }
+    rt_kprintf("arp requests answered %u, dropped %u\n", stats.arp_replies, stats.arp_dropped);
+    for (int i = 0; i < CYW43_ARCH_OFFLOAD_FILTER_COUNT; i++)
+    {
+        rt_kprintf("%s dropped %u\n", filter_name[i], stats.filter_dropped[i]);
+    }
+    rt_kprintf("keep-alives %u, reprogrammed %u times\n", stats.keepalives, stats.reconfigs);
+    rt_kprintf("host wakeups avoided %u\n", stats.wakeups_avoided);
+}
+MSH_CMD_EXPORT(cyw43_offload, cyw43 firmware offloads: [arp on|off] [filters <mask>]);
+#endif
+
+#if CYW43_ARCH_MCAST_FILTER
+static void cyw43_mcast(int argc, char **argv)
+{
+    static const char *itf_name[] = {"sta", "ap"};
+    rt_uint8_t macs[CYW43_ARCH_MCAST_MAX_GROUPS][6];
+    cyw43_arch_mcast_stats_t stats;
+
+    for (int itf = 0; itf <= CYW43_ITF_AP; itf++)
+    {
+        int count = cyw43_arch_mcast_get_groups(itf, macs, CYW43_ARCH_MCAST_MAX_GROUPS);
+
+        cyw43_arch_mcast_get_stats(itf, &stats);
+        rt_kprintf("%s: %u groups, %u filtered by the chip%s%s, %u frames accepted, %u dropped\n", itf_name[itf],
+                stats.groups, stats.chip_groups, stats.all_multicast ? ", chip passes all multicast" : "",
+                stats.overflow ? ", table full" : "", stats.rx_accepted, stats.rx_dropped);
+        for (int i = 0; i < count; i++)
+        {
+            rt_kprintf("  %02x:%02x:%02x:%02x:%02x:%02x\n", macs[i][0], macs[i][1], macs[i][2], macs[i][3],
+                    macs[i][4], macs[i][5]);
+        }
+    }
+}
+MSH_CMD_EXPORT(cyw43_mcast, show the multicast groups joined on the cyw43 interfaces);
+#endif
+
+#if CYW43_ARCH_HEALTH
+static void cyw43_health(int argc, char **argv)
+{
+    static const char *reason_name[] = {"none", "control calls failing", "transmit stalled", "manual"};
+    cyw43_arch_health_stats_t stats;
+
+    if (argc == 2 && !rt_strcmp(argv[1], "recover"))
+    {
+        int err = cyw43_arch_health_recover();
+
+        if (err)
+        {
+            rt_kprintf("recovery failed: %d\n", err);
+        }
+        return;
+    }
+    if (argc != 1)
+    {
+        rt_kprintf("usage: cyw43_health [recover]\n");
+        return;
+    }
+    cyw43_arch_health_get_stats(&stats);
+    rt_kprintf("recoveries %u (%u failed, %u over the %ums budget)%s\n", stats.recoveries, stats.failures,
+            stats.over_budget, CYW43_ARCH_HEALTH_BUDGET_MS, stats.gave_up ? ", monitor gave up" : "");
+    if (stats.recoveries)
+    {
+        rt_kprintf("last: %s, reset %ums, recovery %ums%s, longest %ums\n", reason_name[stats.last_reason],
+                stats.last_reset_us / 1000, stats.last_recovery_us / 1000,
+                stats.last_recovery_us ? "" : " (in progress or not completed)", stats.max_recovery_us / 1000);
+    }
+}
+MSH_CMD_EXPORT(cyw43_health, cyw43 chip health monitor: [recover]);
+#endif
+#endif /* RT_USING_FINSH */
+
 #endif /* PKG_USING_WLAN_CYW43439 */
@@ -17,4 +17,64 @@
 #define CYW43_TASK_PRIORITY 8
 #endif
 
+#ifndef __ASSEMBLER__
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*!
+ * \brief Return whether the caller is the task of the default async_context
+ * \ingroup pico_cyw43_arch
+ *
+ * This is the case in workers and in callbacks from the driver. It is false when the async_context
+ * was provided with \ref cyw43_arch_set_async_context.
+ */
+bool cyw43_arch_in_async_context_task(void);
+
+/**
+ * \brief Phases of operation for which the peak stack use of the CYW43 task is tracked
+ * \ingroup pico_cyw43_arch
+ */
+typedef enum cyw43_arch_stack_phase {
+    CYW43_ARCH_STACK_INIT, ///< from initialization until the first scan or join
+    CYW43_ARCH_STACK_SCAN, ///< a scan, including the scan result callbacks
+    CYW43_ARCH_STACK_JOIN, ///< joining a network
+    CYW43_ARCH_STACK_DATA, ///< passing traffic
+    CYW43_ARCH_STACK_PHASE_COUNT
+} cyw43_arch_stack_phase_t;
+
+/*!
+ * \brief Start a new phase of the CYW43 task stack tracking
+ * \ingroup pico_cyw43_arch
+ *
+ * The peak stack use so far is charged to the phase that is ending, and the measurement restarts
+ * for the new one. This must not be called from the async_context task.
+ *
+ * \param phase the phase which is starting
+ */
+void cyw43_arch_set_stack_phase(cyw43_arch_stack_phase_t phase);
+
+/*!
+ * \brief Return the current phase of the CYW43 task stack tracking
+ * \ingroup pico_cyw43_arch
+ */
+cyw43_arch_stack_phase_t cyw43_arch_get_stack_phase(void);
+
+/*!
+ * \brief Return the peak stack use of the CYW43 task during a phase
+ * \ingroup pico_cyw43_arch
+ *
+ * \param phase the phase
+ * \return the peak stack use in bytes
+ */
+uint32_t cyw43_arch_get_stack_high_water(cyw43_arch_stack_phase_t phase);
+
+#ifdef __cplusplus
+}
+#endif
+#endif
+
 #endif
@@ -35,6 +35,31 @@ extern "C" {
 #define ASYNC_CONTEXT_DEFAULT_RTTHREAD_TASK_STACK_SIZE 2048
 #endif
 
+// PICO_CONFIG: ASYNC_CONTEXT_RTTHREAD_STATIC, Embed the kernel objects and the task stack in async_context_rtthread_t instead of allocating them from the heap, type=bool, default=0, group=async_context_rtthread
+#ifndef ASYNC_CONTEXT_RTTHREAD_STATIC
+#define ASYNC_CONTEXT_RTTHREAD_STATIC 0
+#endif
+
+// PICO_CONFIG: ASYNC_CONTEXT_RTTHREAD_STATIC_STACK_SIZE, Size in bytes of the task stack embedded in async_context_rtthread_t when ASYNC_CONTEXT_RTTHREAD_STATIC is set, type=int, default=ASYNC_CONTEXT_DEFAULT_RTTHREAD_TASK_STACK_SIZE, group=async_context_rtthread
+#ifndef ASYNC_CONTEXT_RTTHREAD_STATIC_STACK_SIZE
+#define ASYNC_CONTEXT_RTTHREAD_STATIC_STACK_SIZE ASYNC_CONTEXT_DEFAULT_RTTHREAD_TASK_STACK_SIZE
+#endif
+
+// PICO_CONFIG: ASYNC_CONTEXT_DEFAULT_RTTHREAD_IRQ_POLL_TICKS, Interval in ticks at which deferred interrupts are handled while in IRQ polling mode, type=int, default=1, group=async_context_rtthread
+#ifndef ASYNC_CONTEXT_DEFAULT_RTTHREAD_IRQ_POLL_TICKS
+#define ASYNC_CONTEXT_DEFAULT_RTTHREAD_IRQ_POLL_TICKS 1
+#endif
+
+// PICO_CONFIG: ASYNC_CONTEXT_RTTHREAD_LOCK_PROFILE, Enable the async_context lock contention profiler, type=bool, default=0, group=async_context_rtthread
+#ifndef ASYNC_CONTEXT_RTTHREAD_LOCK_PROFILE
+#define ASYNC_CONTEXT_RTTHREAD_LOCK_PROFILE 0
+#endif
+
+// PICO_CONFIG: ASYNC_CONTEXT_RTTHREAD_LOCK_PROFILE_THREADS, Number of threads tracked individually by the lock profiler, type=int, default=8, group=async_context_rtthread
+#ifndef ASYNC_CONTEXT_RTTHREAD_LOCK_PROFILE_THREADS
+#define ASYNC_CONTEXT_RTTHREAD_LOCK_PROFILE_THREADS 8
+#endif
+
 typedef struct async_context_rtthread async_context_rtthread_t;
 
 /**
@@ -46,9 +71,14 @@ typedef struct async_context_rtthread_config {
      */
     rt_uint8_t task_priority;
     /**
-     * Stack size for the async_context task
+     * Stack size for the async_context task. This is ignored when \ref ASYNC_CONTEXT_RTTHREAD_STATIC
+     * is set, as the stack is then embedded in the instance
      */
     rt_uint32_t task_stack_size;
+    /**
+     * Interval in ticks at which interrupts are handled while in IRQ polling mode
+     */
+    rt_uint32_t irq_poll_ticks;
     /**
      * the core ID (see \ref portGET_CORE_ID()) to pin the task to.
      * This is only relevant in SMP mode.
@@ -58,15 +88,70 @@ typedef struct async_context_rtthread_config {
 #endif
 } async_context_rtthread_config_t;
 
+/**
+ * \brief Lock usage of a single thread, as recorded by the lock profiler
+ * \ingroup async_context_rtthread
+ *
+ * Threads beyond \ref ASYNC_CONTEXT_RTTHREAD_LOCK_PROFILE_THREADS are accumulated in a final
+ * entry with a NULL thread.
+ */
+typedef struct async_context_rtthread_lock_stats {
+    rt_thread_t thread;
+    char name[RT_NAME_MAX];
+    uint32_t acquires;      ///< outermost acquisitions
+    uint32_t nested;        ///< acquisitions while already holding the lock
+    uint32_t contended;     ///< acquisitions which found the lock held by another thread
+    uint32_t max_wait_us;
+    uint32_t max_hold_us;
+    uint64_t wait_us;
+    uint64_t hold_us;
+} async_context_rtthread_lock_stats_t;
+
+/**
+ * \brief IRQ polling mode state and counters
+ * \ingroup async_context_rtthread
+ */
+typedef struct async_context_rtthread_poll_stats {
+    bool polling;           ///< true while interrupts are being deferred
+    uint32_t enters;        ///< switches from interrupt to polling mode
+    uint32_t exits;         ///< switches from polling back to interrupt mode
+    uint32_t irqs_deferred; ///< interrupt wakeups folded into the next poll
+} async_context_rtthread_poll_stats_t;
+
 struct async_context_rtthread {
     async_context_t core;
     rt_mutex_t lock_mutex;
     rt_sem_t work_needed_sem;
     rt_event_t notify_event;
     rt_timer_t timer_handle;
+    rt_timer_t poll_timer;
     rt_thread_t task_handle;
+    rt_sem_t task_exit_sem; // released by the task as the last thing it does
+    absolute_time_t next_deadline;
+    uint64_t busy_us;
+    uint32_t wakeups;
+    volatile bool irq_polling;
+    volatile bool irq_pending;
+    uint32_t poll_enters;
+    uint32_t poll_exits;
+    uint32_t irqs_deferred;
     uint8_t nesting;
     volatile bool task_should_exit;
+#if ASYNC_CONTEXT_RTTHREAD_LOCK_PROFILE
+    uint32_t hold_start_us;
+    async_context_rtthread_lock_stats_t lock_stats[ASYNC_CONTEXT_RTTHREAD_LOCK_PROFILE_THREADS + 1];
+#endif
+#if ASYNC_CONTEXT_RTTHREAD_STATIC
+    // the handles above point at these; they are kept last, as deinit leaves them to the kernel
+    struct rt_mutex lock_mutex_obj;
+    struct rt_semaphore work_needed_sem_obj;
+    struct rt_event notify_event_obj;
+    struct rt_timer timer_obj;
+    struct rt_timer poll_timer_obj;
+    struct rt_thread task_obj;
+    struct rt_semaphore task_exit_sem_obj;
+    rt_uint8_t task_stack[ASYNC_CONTEXT_RTTHREAD_STATIC_STACK_SIZE] __attribute__((aligned(8)));
+#endif
 };
 
 /*!
@@ -93,6 +178,7 @@ bool async_context_rtthread_init(async_context_rtthread_t *self, async_context_r
     async_context_rtthread_config_t config = {
             .task_priority = ASYNC_CONTEXT_DEFAULT_RTTHREAD_TASK_PRIORITY,
             .task_stack_size = ASYNC_CONTEXT_DEFAULT_RTTHREAD_TASK_STACK_SIZE,
+            .irq_poll_ticks = ASYNC_CONTEXT_DEFAULT_RTTHREAD_IRQ_POLL_TICKS,
 #if configUSE_CORE_AFFINITY && configNUM_CORES > 1
             .task_core_id = (rt_uint8_t)-1, // none
 #endif
@@ -116,6 +202,113 @@ bool async_context_rtthread_init(async_context_rtthread_t *self, async_context_r
     return async_context_rtthread_init(self, &config);
 }
 
+/*!
+ * \brief Return the time at which the async_context next needs to run
+ * \ingroup async_context_rtthread
+ *
+ * This is the time of the earliest pending at-time worker, as of the last time the async_context
+ * task ran. The task's timer is only armed while there is such a deadline, so when this returns
+ * \ref at_the_end_of_time the async_context will not wake the system up until new work arrives.
+ *
+ * \param self a pointer to the async_context_rtthread instance
+ * \return the next deadline or \ref at_the_end_of_time if there is none
+ */
+absolute_time_t async_context_rtthread_next_deadline(async_context_rtthread_t *self);
+
+/*!
+ * \brief Return the total time the async_context task has spent processing work
+ * \ingroup async_context_rtthread
+ *
+ * Sampling this at two points in time gives the CPU load of the async_context task.
+ *
+ * \param self a pointer to the async_context_rtthread instance
+ * \return the busy time in microseconds
+ */
+uint64_t async_context_rtthread_get_busy_us(async_context_rtthread_t *self);
+
+/*!
+ * \brief Return the number of times the async_context task has woken up to process work
+ * \ingroup async_context_rtthread
+ *
+ * \param self a pointer to the async_context_rtthread instance
+ * \return the wakeup count, which wraps at 2^32
+ */
+static inline uint32_t async_context_rtthread_get_wakeups(async_context_rtthread_t *self) {
+    return *(volatile uint32_t *)&self->wakeups;
+}
+
+/*!
+ * \brief Return the peak stack use of the async_context task
+ * \ingroup async_context_rtthread
+ *
+ * This scans the task stack for the fill pattern RT-Thread writes into it when the thread is
+ * created, so it reports the deepest point the stack has reached since then, or since the last
+ * call to \ref async_context_rtthread_reset_stack_high_water.
+ *
+ * \param self a pointer to the async_context_rtthread instance
+ * \return the peak stack use in bytes
+ */
+uint32_t async_context_rtthread_get_stack_high_water(async_context_rtthread_t *self);
+
+/*!
+ * \brief Restart the peak stack use measurement of the async_context task
+ * \ingroup async_context_rtthread
+ *
+ * Rewrites the fill pattern below the task's current stack pointer. This must not be called from
+ * the async_context task itself, and it does nothing under RT_USING_SMP, where the task may be
+ * running on the other core.
+ *
+ * \param self a pointer to the async_context_rtthread instance
+ */
+void async_context_rtthread_reset_stack_high_water(async_context_rtthread_t *self);
+
+/*!
+ * \brief Switch to IRQ polling mode
+ * \ingroup async_context_rtthread
+ *
+ * In IRQ polling mode wakeups requested from interrupt handlers no longer wake the async_context
+ * task straight away; they are collected and handled together once per poll interval. Interrupt
+ * sources which mask themselves until their worker has run, like the cyw43 host wake IRQ, then
+ * fire at most once per interval. The context returns to interrupt mode by itself after an
+ * interval in which no interrupt requested a wakeup.
+ *
+ * Wakeups requested from threads are never deferred. Calling this while already in polling mode
+ * does nothing.
+ *
+ * \param self a pointer to the async_context_rtthread instance
+ */
+void async_context_rtthread_enter_irq_polling(async_context_rtthread_t *self);
+
+/*!
+ * \brief Return the IRQ polling mode state and counters
+ * \ingroup async_context_rtthread
+ *
+ * \param self a pointer to the async_context_rtthread instance
+ * \param stats filled in with the state and counters
+ */
+void async_context_rtthread_get_poll_stats(async_context_rtthread_t *self, async_context_rtthread_poll_stats_t *stats);
+
+#if ASYNC_CONTEXT_RTTHREAD_LOCK_PROFILE
+/*!
+ * \brief Return a copy of the lock profiler statistics
+ * \ingroup async_context_rtthread
+ *
+ * \param self a pointer to the async_context_rtthread instance
+ * \param stats buffer for the per thread statistics
+ * \param max maximum number of entries to copy
+ * \return the number of entries copied
+ */
+uint32_t async_context_rtthread_lock_profile_get(async_context_rtthread_t *self, async_context_rtthread_lock_stats_t *stats, uint32_t max);
+
+/*!
+ * \brief Clear the lock profiler statistics
+ * \ingroup async_context_rtthread
+ *
+ * \param self a pointer to the async_context_rtthread instance
+ */
+void async_context_rtthread_lock_profile_reset(async_context_rtthread_t *self);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -16,6 +16,8 @@ extern "C" {
 #include "cyw43.h"
 #include "cyw43_country.h"
 #include "pico/async_context.h"
+#include "cyw43_pm_policy.h"
+#include "cyw43_gpio_shadow.h"
 
 #ifdef PICO_CYW43_ARCH_HEADER
 #include __XSTRING(PICO_CYW43_ARCH_HEADER)
@@ -151,6 +153,41 @@ extern "C" {
 #define PICO_CYW43_ARCH_DEFAULT_COUNTRY_CODE CYW43_COUNTRY_WORLDWIDE
 #endif
 
+// PICO_CONFIG: CYW43_ARCH_PM_AUTO_BOOST, Whether power save is disabled automatically during traffic bursts by default, type=bool, default=1, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_PM_AUTO_BOOST
+#define CYW43_ARCH_PM_AUTO_BOOST 1
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_PM_TRACE_LEN, Number of packet timestamps recorded for cyw43_arch_pm_trace_replay (0 to disable), type=int, default=0, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_PM_TRACE_LEN
+#define CYW43_ARCH_PM_TRACE_LEN 0
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_AP_CHANNEL_POLICY, Default policy for the access point channel while the station is connected, see cyw43_arch_ap_channel_policy_t, type=int, default=CYW43_ARCH_AP_CHANNEL_FOLLOW_STA, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_AP_CHANNEL_POLICY
+#define CYW43_ARCH_AP_CHANNEL_POLICY CYW43_ARCH_AP_CHANNEL_FOLLOW_STA
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_APSTA_POLL_MS, Interval in milliseconds at which the station channel is checked for roams while both interfaces are up, type=int, default=2000, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_APSTA_POLL_MS
+#define CYW43_ARCH_APSTA_POLL_MS 2000
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_CONNECT_POLL_MS, Interval in milliseconds at which a connection is checked while it is being timed, type=int, default=10, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_CONNECT_POLL_MS
+#define CYW43_ARCH_CONNECT_POLL_MS 10
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_CONNECT_TIMING_MAX_MS, Time in milliseconds after which a connection still without an address is no longer timed, type=int, default=30000, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_CONNECT_TIMING_MAX_MS
+#define CYW43_ARCH_CONNECT_TIMING_MAX_MS 30000
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_GPIO_SHADOW, Keep a copy of the wireless chip GPIO outputs so that unchanged puts are skipped and gets of outputs don't go over the bus, type=bool, default=0, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_GPIO_SHADOW
+#define CYW43_ARCH_GPIO_SHADOW 0
+#endif
+
 /*!
  * \brief Initialize the CYW43 architecture
  * \ingroup pico_cyw43_arch
@@ -388,6 +425,54 @@ void cyw43_arch_enable_ap_mode(const char *ssid, const char *password, uint32_t
  */
 void cyw43_arch_disable_ap_mode(void);
 
+/**
+ * \brief What happens to the access point when the station joins or roams to another channel
+ * \ingroup pico_cyw43_arch
+ *
+ * The CYW43439 has a single radio, so while the station is connected the access point can only
+ * operate on the channel of the station's network.
+ */
+typedef enum cyw43_arch_ap_channel_policy {
+    CYW43_ARCH_AP_CHANNEL_FOLLOW_STA, ///< restart the access point on the station's channel; its clients reassociate
+    CYW43_ARCH_AP_CHANNEL_KEEP,       ///< leave the access point alone, and leave the channel to the firmware
+} cyw43_arch_ap_channel_policy_t;
+
+/*!
+ * \brief Select how the access point channel follows the station
+ * \ingroup pico_cyw43_arch
+ *
+ * With \ref CYW43_ARCH_AP_CHANNEL_FOLLOW_STA the access point is started on the station's channel if
+ * the station is already connected, and is moved whenever the station joins or roams to a network
+ * on another channel. Roams are noticed within \ref CYW43_ARCH_APSTA_POLL_MS.
+ *
+ * \param policy the policy to use
+ */
+void cyw43_arch_set_ap_channel_policy(cyw43_arch_ap_channel_policy_t policy);
+
+/*!
+ * \brief Return the policy set by \ref cyw43_arch_set_ap_channel_policy
+ * \ingroup pico_cyw43_arch
+ */
+cyw43_arch_ap_channel_policy_t cyw43_arch_get_ap_channel_policy(void);
+
+/*!
+ * \brief Return the number of times the access point was moved to follow the station
+ * \ingroup pico_cyw43_arch
+ */
+uint32_t cyw43_arch_get_ap_channel_follows(void);
+
+/*!
+ * \brief Inform the access point channel policy about the station's channel
+ * \ingroup pico_cyw43_arch
+ *
+ * This is called by the information cache with the async_context lock held, whenever it has read
+ * the channel of a connected station.
+ *
+ * \param channel the station's channel
+ * \return true if the access point was moved to \p channel
+ */
+bool cyw43_arch_note_sta_channel(uint32_t channel);
+
 /*!
  * \brief Attempt to connect to a wireless access point, blocking until the network is joined or a failure is detected.
  * \ingroup pico_cyw43_arch
@@ -477,12 +562,48 @@ int cyw43_arch_wifi_connect_async(const char *ssid, const char *pw, uint32_t aut
  */
 int cyw43_arch_wifi_connect_bssid_async(const char *ssid, const uint8_t *bssid, const char *pw, uint32_t auth);
 
+/**
+ * \brief Duration of the last successful connection
+ * \ingroup pico_cyw43_arch
+ */
+typedef struct cyw43_arch_connect_times {
+    uint32_t join_us; ///< from starting the connection until the link came up
+    uint32_t ip_us;   ///< from the link coming up until the interface had an address
+} cyw43_arch_connect_times_t;
+
+/*!
+ * \brief Return how long the last connection took
+ * \ingroup pico_cyw43_arch
+ *
+ * Covers every connect function of cyw43_arch, and joins started with cyw43_wifi_join after a call
+ * to \ref cyw43_arch_wifi_time_connect. The connection is checked every
+ * \ref CYW43_ARCH_CONNECT_POLL_MS, which bounds the precision of the times.
+ *
+ * \param times filled in with the durations
+ */
+void cyw43_arch_wifi_get_connect_times(cyw43_arch_connect_times_t *times);
+
+/*!
+ * \brief Start timing a connection made directly with cyw43_wifi_join
+ * \ingroup pico_cyw43_arch
+ *
+ * Called just before the join. The times are available from \ref cyw43_arch_wifi_get_connect_times
+ * once the station interface has an address, which also hands the lease to the DHCP lease cache.
+ */
+void cyw43_arch_wifi_time_connect(void);
+
 /*!
  * \brief Set a GPIO pin on the wireless chip to a given value
  * \ingroup pico_cyw43_arch
  * \note this method does not check for errors setting the GPIO. You can use the lower level \ref cyw43_gpio_set instead if you wish
  * to check for errors.
  *
+ * With \ref CYW43_ARCH_GPIO_SHADOW putting the value the pin already has does nothing. Called from
+ * the async_context task, e.g. from a worker or a driver callback, the pin is written once the
+ * current pass is done, together with any other pins put in the meantime; from any other thread it
+ * is written before this returns. A failed write is counted, and the next put of the pin goes to
+ * the chip whatever its value.
+ *
  * \param wl_gpio the GPIO number on the wireless chip
  * \param value true to set the GPIO, false to clear it.
  */
@@ -494,11 +615,168 @@ void cyw43_arch_gpio_put(uint wl_gpio, bool value);
  * \note this method does not check for errors setting the GPIO. You can use the lower level \ref cyw43_gpio_get instead if you wish
  * to check for errors.
  *
+ * With \ref CYW43_ARCH_GPIO_SHADOW a pin which has been put returns the value put on it, without going
+ * over the bus.
+ *
  * \param wl_gpio the GPIO number on the wireless chip
  * \return true if the GPIO is high, false otherwise
  */
 bool cyw43_arch_gpio_get(uint wl_gpio);
 
+#if CYW43_ARCH_GPIO_SHADOW
+/**
+ * \brief Wireless chip GPIO counters
+ * \ingroup pico_cyw43_arch
+ */
+typedef cyw43_gpio_shadow_stats_t cyw43_arch_gpio_stats_t;
+
+/*!
+ * \brief Forget the values put on the wireless chip GPIO pins
+ * \ingroup pico_cyw43_arch
+ *
+ * To be called when the chip is reset, which returns its pins to their defaults, so that the next
+ * put of each pin is written whatever its value.
+ */
+void cyw43_arch_gpio_forget(void);
+
+/*!
+ * \brief Write the values put on the wireless chip GPIO pins to the chip again
+ * \ingroup pico_cyw43_arch
+ *
+ * For when the chip has been reset but its pins should keep their values.
+ */
+void cyw43_arch_gpio_restore(void);
+
+/*!
+ * \brief Return the wireless chip GPIO counters
+ * \ingroup pico_cyw43_arch
+ *
+ * \param stats filled in with the counters
+ */
+void cyw43_arch_gpio_get_stats(cyw43_arch_gpio_stats_t *stats);
+#endif
+
+/**
+ * \brief Wi-Fi power management modes
+ * \ingroup pico_cyw43_arch
+ */
+typedef enum cyw43_arch_pm_mode {
+    CYW43_ARCH_PM_NONE,        ///< power save disabled; lowest latency, highest power
+    CYW43_ARCH_PM_PERFORMANCE, ///< PM2 power save; radio stays up for a while after traffic
+    CYW43_ARCH_PM_AGGRESSIVE,  ///< PM1 power save; radio sleeps as soon as possible
+    CYW43_ARCH_PM_CUSTOM,      ///< PM2 power save with parameters from \ref cyw43_arch_set_pm_custom
+} cyw43_arch_pm_mode_t;
+
+/*!
+ * \brief Select the Wi-Fi power management mode
+ * \ingroup pico_cyw43_arch
+ *
+ * The mode may be changed at any time; it is remembered and re-applied whenever the STA or AP
+ * interface is brought up.
+ *
+ * \param mode the power management mode to use
+ * \return 0 on success, an error code otherwise \see pico_error_codes
+ */
+int cyw43_arch_set_pm_mode(cyw43_arch_pm_mode_t mode);
+
+/*!
+ * \brief Select PM2 power save with custom parameters
+ * \ingroup pico_cyw43_arch
+ *
+ * \param pm2_sleep_ret_ms time in milliseconds the radio stays awake after traffic (10-2550)
+ * \param listen_interval listen interval in beacon periods (1-15)
+ * \param dtim_period listen interval in DTIM periods (1-15)
+ * \return 0 on success, an error code otherwise \see pico_error_codes
+ */
+int cyw43_arch_set_pm_custom(uint32_t pm2_sleep_ret_ms, uint8_t listen_interval, uint8_t dtim_period);
+
+/*!
+ * \brief Return the power management mode selected by \ref cyw43_arch_set_pm_mode
+ * \ingroup pico_cyw43_arch
+ *
+ * \note this is the configured mode; power save may be temporarily disabled by the automatic boost
+ */
+cyw43_arch_pm_mode_t cyw43_arch_get_pm_mode(void);
+
+/*!
+ * \brief Enable or disable automatic power save boost during traffic bursts
+ * \ingroup pico_cyw43_arch
+ *
+ * When enabled, power save is switched off as soon as the \ref cyw43_pm_policy governor detects a
+ * burst of traffic, and the configured mode is restored after the governor's idle window.
+ *
+ * \param enable true to enable the automatic boost
+ */
+void cyw43_arch_set_pm_auto_boost(bool enable);
+
+/*!
+ * \brief Change the configuration of the power save governor
+ * \ingroup pico_cyw43_arch
+ *
+ * \param config the new configuration
+ * \return 0 on success, an error code otherwise \see pico_error_codes
+ */
+int cyw43_arch_set_pm_governor_config(const cyw43_pm_policy_config_t *config);
+
+/*!
+ * \brief Return a copy of the power save governor state, including its statistics
+ * \ingroup pico_cyw43_arch
+ *
+ * \param policy filled in with the governor state
+ */
+void cyw43_arch_get_pm_governor(cyw43_pm_policy_t *policy);
+
+/*!
+ * \brief Inform the power save governor about a packet
+ * \ingroup pico_cyw43_arch
+ *
+ * This is called from the driver data path with the async_context lock held.
+ *
+ * \param rx true for a received packet, false for a transmitted one
+ */
+void cyw43_arch_pm_note_traffic(bool rx);
+
+/*!
+ * \brief Inform the power save governor about the TX queue depth
+ * \ingroup pico_cyw43_arch
+ *
+ * This is called from the driver data path with the async_context lock held.
+ *
+ * \param depth the number of frames waiting to be sent
+ */
+void cyw43_arch_pm_note_queue_depth(uint32_t depth);
+
+#if CYW43_ARCH_PM_TRACE_LEN
+/*!
+ * \brief Restart recording of packet timestamps for \ref cyw43_arch_pm_trace_replay
+ * \ingroup pico_cyw43_arch
+ */
+void cyw43_arch_pm_trace_reset(void);
+
+/*!
+ * \brief Replay the recorded packet timestamps through a governor with the given configuration
+ * \ingroup pico_cyw43_arch
+ *
+ * \param config the governor configuration to evaluate, or NULL for the defaults
+ * \param model the radio model, or NULL for the default
+ * \param report filled in with the result
+ * \return the number of packets replayed
+ */
+uint32_t cyw43_arch_pm_trace_replay(const cyw43_pm_policy_config_t *config, const cyw43_pm_policy_radio_model_t *model,
+                                    cyw43_pm_policy_replay_report_t *report);
+
+/*!
+ * \brief Return the recorded packet timestamps, e.g. to replay them on a host
+ * \ingroup pico_cyw43_arch
+ *
+ * The returned entries are not written again until \ref cyw43_arch_pm_trace_reset is called.
+ *
+ * \param timestamps_us set to the recorded timestamps in microseconds
+ * \return the number of timestamps recorded
+ */
+uint32_t cyw43_arch_pm_trace_get(const uint64_t **timestamps_us);
+#endif
+
 #ifdef __cplusplus
 }
 #endif
@@ -0,0 +1,104 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _CYW43_ARCH_ACS_H
+#define _CYW43_ARCH_ACS_H
+
+#include "cyw43_arch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file cyw43_arch_acs.h
+ *  \defgroup cyw43_arch_acs cyw43_arch_acs
+ *  \ingroup pico_cyw43_arch
+ *
+ * Automatic channel selection for the access point, based on a quick scan.
+ *
+ * Scan results don't carry the load of the networks found, so the load on a channel is estimated
+ * from the networks heard on it and on the overlapping channels either side: each network adds a
+ * weight which doubles for every 10dB of signal, scaled by how much of its 20MHz it shares with the
+ * channel. Channels 1, 6 and 11 don't overlap each other, so they are preferred unless another
+ * channel is clearly quieter.
+ *
+ * Optionally the choice is re-evaluated every \ref CYW43_ARCH_ACS_INTERVAL_MS while no station is
+ * associated, and the access point moved if a clearly better channel has appeared.
+ */
+
+// PICO_CONFIG: CYW43_ARCH_ACS, Enable automatic channel selection for the access point, type=bool, default=0, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_ACS
+#define CYW43_ARCH_ACS 0
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_ACS_MAX_CHANNEL, Highest channel automatic channel selection may pick, type=int, default=11, min=1, max=13, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_ACS_MAX_CHANNEL
+#define CYW43_ARCH_ACS_MAX_CHANNEL 11
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_ACS_SCAN_TIMEOUT_MS, Longest time to wait for the channel survey scan, type=int, default=4000, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_ACS_SCAN_TIMEOUT_MS
+#define CYW43_ARCH_ACS_SCAN_TIMEOUT_MS 4000
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_ACS_INTERVAL_MS, Interval at which the channel of an idle access point is re-evaluated; 0 disables, type=int, default=0, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_ACS_INTERVAL_MS
+#define CYW43_ARCH_ACS_INTERVAL_MS 0
+#endif
+
+/**
+ * \brief Result of a channel survey
+ * \ingroup cyw43_arch_acs
+ */
+typedef struct cyw43_arch_acs_result {
+    uint32_t channel;                                  ///< the chosen channel
+    uint32_t networks;                                 ///< networks heard in total
+    uint8_t networks_on[CYW43_ARCH_ACS_MAX_CHANNEL + 1]; ///< networks heard on each channel, indexed by channel
+    uint32_t load[CYW43_ARCH_ACS_MAX_CHANNEL + 1];       ///< estimated load of each channel, indexed by channel; lower is better
+} cyw43_arch_acs_result_t;
+
+/*!
+ * \brief Survey the channels and pick the best one for the access point
+ * \ingroup cyw43_arch_acs
+ *
+ * Blocks for the duration of a scan, so must not be called from the async_context. The station
+ * interface is brought up for the scan if no interface is up yet.
+ *
+ * \param result filled in with the survey and the chosen channel
+ * \return 0 on success, an error code otherwise
+ */
+int cyw43_arch_acs_select(cyw43_arch_acs_result_t *result);
+
+/*!
+ * \brief Return the last survey
+ * \ingroup cyw43_arch_acs
+ *
+ * \param result filled in with the last survey, whether started by \ref cyw43_arch_acs_select or periodically
+ * \return true if there has been a survey
+ */
+bool cyw43_arch_acs_get_last(cyw43_arch_acs_result_t *result);
+
+/*!
+ * \brief Start re-evaluating the channel periodically, if an interval is set
+ * \ingroup cyw43_arch_acs
+ *
+ * Called when the access point is brought up.
+ */
+void cyw43_arch_acs_attach(void);
+
+/*!
+ * \brief Set the interval at which the channel of an idle access point is re-evaluated
+ * \ingroup cyw43_arch_acs
+ *
+ * \param interval_ms the interval, or 0 to stop
+ */
+void cyw43_arch_acs_set_interval(uint32_t interval_ms);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
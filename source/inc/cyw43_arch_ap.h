@@ -0,0 +1,163 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _CYW43_ARCH_AP_H
+#define _CYW43_ARCH_AP_H
+
+#include "cyw43_arch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file cyw43_arch_ap.h
+ *  \defgroup cyw43_arch_ap cyw43_arch_ap
+ *  \ingroup pico_cyw43_arch
+ *
+ * A table of the stations associated with the access point, with per station counters, and an
+ * optional per station transmit scheduler.
+ *
+ * The cyw43_driver handles association events internally without passing them on, so the table is
+ * kept up to date by reading the firmware's association list every \ref CYW43_ARCH_AP_POLL_MS from
+ * the async_context, which is a single ioctl however many stations there are. Traffic counters and
+ * the time a station was last heard from are kept by the host as frames pass through; the RSSI and
+ * transmit rate stay in the firmware and are read on demand with \ref cyw43_arch_ap_get_sta_link.
+ *
+ * With \ref CYW43_ARCH_AP_TX_SCHED, frames sent on the access point are copied into the TX
+ * reservation of the frame pool and queued per station. A worker on the async_context then sends
+ * the queued frames in deficit round-robin order, so each station gets an equal share of bytes
+ * however many frames are queued for the others, and a station whose queue is full has its frames
+ * dropped rather than holding up everyone else. Broadcast and multicast frames, and frames for
+ * stations not yet in the table, share a queue of their own.
+ */
+
+// PICO_CONFIG: CYW43_ARCH_AP_STATIONS, Keep a table of the stations associated with the access point, type=bool, default=0, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_AP_STATIONS
+#define CYW43_ARCH_AP_STATIONS 0
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_AP_MAX_STAS, Maximum number of stations in the table, type=int, default=8, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_AP_MAX_STAS
+#define CYW43_ARCH_AP_MAX_STAS 8
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_AP_POLL_MS, Interval at which the association list is read from the firmware, type=int, default=1000, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_AP_POLL_MS
+#define CYW43_ARCH_AP_POLL_MS 1000
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_AP_TX_SCHED, Queue frames sent on the access point per station and send them in deficit round-robin order; requires CYW43_FRAME_POOL, type=bool, default=0, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_AP_TX_SCHED
+#define CYW43_ARCH_AP_TX_SCHED 0
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_AP_TX_QUANTUM, Bytes each station may send per round of the transmit scheduler, type=int, default=1514, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_AP_TX_QUANTUM
+#define CYW43_ARCH_AP_TX_QUANTUM 1514
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_AP_TX_QUEUE_FRAMES, Frames which may be queued for a single station, type=int, default=4, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_AP_TX_QUEUE_FRAMES
+#define CYW43_ARCH_AP_TX_QUEUE_FRAMES 4
+#endif
+
+/**
+ * \brief A station associated with the access point
+ * \ingroup cyw43_arch_ap
+ */
+typedef struct cyw43_arch_ap_sta {
+    uint8_t mac[6];
+    uint32_t tx_packets;
+    uint32_t tx_bytes;
+    uint32_t tx_dropped;    ///< frames dropped because the queue was full or the send failed
+    uint32_t tx_queued;     ///< frames waiting to be sent
+    uint32_t rx_packets;
+    uint32_t rx_bytes;
+    uint32_t assoc_ms;      ///< when the station first appeared in the association list, in ms since boot
+    uint32_t last_seen_ms;  ///< when a frame was last received from the station, in ms since boot
+} cyw43_arch_ap_sta_t;
+
+/*!
+ * \brief Start tracking stations
+ * \ingroup cyw43_arch_ap
+ *
+ * Called when the access point is brought up.
+ */
+void cyw43_arch_ap_attach(void);
+
+/*!
+ * \brief Stop tracking stations and forget them
+ * \ingroup cyw43_arch_ap
+ *
+ * Called when the access point is taken down.
+ */
+void cyw43_arch_ap_detach(void);
+
+/*!
+ * \brief Copy the station table
+ * \ingroup cyw43_arch_ap
+ *
+ * May be called from any thread, and doesn't touch the bus.
+ *
+ * \param stas filled in with the stations
+ * \param max number of entries stas has room for
+ * \return the number of entries filled in
+ */
+int cyw43_arch_ap_get_stas(cyw43_arch_ap_sta_t *stas, int max);
+
+/*!
+ * \brief Read the signal strength and transmit rate of a station from the firmware
+ * \ingroup cyw43_arch_ap
+ *
+ * This queues two ioctls with \ref cyw43_arch_ioctl_submit_group and waits for them, so it is meant
+ * for occasional queries rather than polling. It may be called from any thread.
+ *
+ * \param mac the station
+ * \param rssi filled in with the RSSI in dBm, or 0 on failure
+ * \param tx_rate_kbps filled in with the rate of the last frame sent to the station, or 0 if unknown
+ * \return 0 on success, an error code otherwise
+ */
+int cyw43_arch_ap_get_sta_link(const uint8_t mac[6], int32_t *rssi, uint32_t *tx_rate_kbps);
+
+/*!
+ * \brief Set a function called when a station associates or disassociates
+ * \ingroup cyw43_arch_ap
+ *
+ * The callback is called from the async_context with the lock held, so it must not block.
+ */
+void cyw43_arch_ap_set_sta_callback(void (*callback)(const uint8_t mac[6], bool associated));
+
+/*!
+ * \brief Send a frame on the access point
+ * \ingroup cyw43_arch_ap
+ *
+ * With \ref CYW43_ARCH_AP_TX_SCHED the frame is copied and queued for its station, and returns
+ * before it has been sent; the queues are drained in deficit round-robin order by a worker on the
+ * async_context, so frames queued while the lock is held elsewhere are served fairly. Otherwise
+ * the frame is sent straight away.
+ *
+ * \param len length of the frame
+ * \param buf the frame, starting with the Ethernet header
+ * \return 0 on success, an error code otherwise
+ */
+int cyw43_arch_ap_send(size_t len, const void *buf);
+
+/*!
+ * \brief Account for a frame received on the access point
+ * \ingroup cyw43_arch_ap
+ *
+ * Called from the async_context with the lock held.
+ *
+ * \param frame the start of the frame, at least the Ethernet header
+ * \param len length of the whole frame
+ */
+void cyw43_arch_ap_note_rx(const uint8_t *frame, size_t len);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,90 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _CYW43_ARCH_DATAPATH_H
+#define _CYW43_ARCH_DATAPATH_H
+
+#include "cyw43_arch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file cyw43_arch_datapath.h
+ *  \defgroup cyw43_arch_datapath cyw43_arch_datapath
+ *  \ingroup pico_cyw43_arch
+ *
+ * TX and RX hooks on the cyw43 data path. Frames sent by the driver go through
+ * \ref cyw43_arch_datapath_send, and received frames are observed on their way from the
+ * cyw43_driver into lwIP by wrapping the input function of the cyw43 netif.
+ *
+ * Under sustained downlink traffic the host wake interrupt would wake the async_context once for
+ * every handful of frames. When a single pass of the async_context drains
+ * \ref CYW43_ARCH_IRQ_POLL_FRAMES frames or more, the async_context is switched to IRQ polling
+ * mode (see \ref async_context_rtthread_enter_irq_polling), which handles the interrupt once per
+ * poll interval until an interval passes without one. Polling delays every frame by up to a poll
+ * interval, so it is off unless a threshold is set.
+ */
+
+// PICO_CONFIG: CYW43_ARCH_IRQ_POLL_FRAMES, Received frames in one async_context pass which switch to IRQ polling mode; 0 disables, type=int, default=0, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_IRQ_POLL_FRAMES
+#define CYW43_ARCH_IRQ_POLL_FRAMES 0
+#endif
+
+/*!
+ * \brief Send an ethernet frame on the given interface
+ * \ingroup cyw43_arch_datapath
+ *
+ * \param itf the interface to send on (\ref CYW43_ITF_STA or \ref CYW43_ITF_AP)
+ * \param len length of the frame
+ * \param buf the frame
+ * \return 0 on success, an error code otherwise
+ */
+int cyw43_arch_datapath_send(int itf, size_t len, const void *buf);
+
+/*!
+ * \brief Return the number of frames waiting to be sent
+ * \ingroup cyw43_arch_datapath
+ *
+ * This includes a frame currently being sent, and senders waiting for the async_context lock.
+ */
+uint32_t cyw43_arch_datapath_tx_queued(void);
+
+/*!
+ * \brief Return the number of frames waiting to be sent on the given interface
+ * \ingroup cyw43_arch_datapath
+ *
+ * Both interfaces share the bus to the chip, so a frame of one interface can wait behind frames of
+ * the other; this is the part of \ref cyw43_arch_datapath_tx_queued that belongs to \p itf.
+ *
+ * \param itf the interface (\ref CYW43_ITF_STA or \ref CYW43_ITF_AP)
+ */
+uint32_t cyw43_arch_datapath_tx_queued_itf(int itf);
+
+/*!
+ * \brief Set the number of frames in one pass which switch to IRQ polling mode
+ * \ingroup cyw43_arch_datapath
+ *
+ * \param frames the threshold, or 0 to always stay in interrupt mode
+ */
+void cyw43_arch_datapath_set_irq_poll_frames(uint32_t frames);
+
+/*!
+ * \brief Start observing frames received on the given interface
+ * \ingroup cyw43_arch_datapath
+ *
+ * This must be called after the interface has been brought up, as that (re)creates the netif.
+ * Calling it more than once is harmless.
+ *
+ * \param itf the interface (\ref CYW43_ITF_STA or \ref CYW43_ITF_AP)
+ */
+void cyw43_arch_datapath_attach(int itf);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
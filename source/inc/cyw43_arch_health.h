@@ -0,0 +1,158 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _CYW43_ARCH_HEALTH_H
+#define _CYW43_ARCH_HEALTH_H
+
+#include "cyw43_arch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file cyw43_arch_health.h
+ *  \defgroup cyw43_arch_health cyw43_arch_health
+ *  \ingroup pico_cyw43_arch
+ *
+ * Detection of and recovery from a wedged chip or bus, without tearing down the async_context or
+ * lwIP. Every \ref CYW43_ARCH_HEALTH_POLL_MS the monitor checks that control calls still succeed
+ * and that frames handed to the driver still get sent, rather than being dropped for want of
+ * credits. The firmware is only probed when control calls failed or frames are waiting and nothing
+ * got through since, so an idle chip is left in power save. Once either has been failing for
+ * \ref CYW43_ARCH_HEALTH_STALL_MS the chip is power cycled and its firmware reloaded over a freshly
+ * initialised bus, and the configuration is replayed: country, power management, the access point,
+ * the firmware offloads, the multicast list and the GPIO outputs, then the station rejoins the
+ * network it was last asked to join.
+ *
+ * The reload bypasses the driver's own bring up, which would remove the netifs, so the netifs and
+ * their lwIP state are left in place and the recovery itself closes no sockets. The station's link
+ * goes down until the rejoin and comes back up on the same network; whether a connection survives
+ * that depends on DHCP handing out the same address and on the peer's timeouts, which has not been
+ * measured on a target. Stations of the access point have to reassociate. Each recovery is timed,
+ * from the stall being acted on until the station is connected again, against
+ * \ref CYW43_ARCH_HEALTH_BUDGET_MS. If the bus doesn't come back, or after
+ * \ref CYW43_ARCH_HEALTH_MAX_ATTEMPTS recoveries in a row without the chip becoming healthy, the
+ * monitor gives up, leaving \ref cyw43_arch_deinit and \ref cyw43_arch_init as the last resort.
+ *
+ * The rejoin needs \ref CYW43_PMK_CACHE: the passphrase is never kept, only the PMK, or a hash by
+ * which the PMK the cache derives for the passphrase is found again.
+ */
+
+// PICO_CONFIG: CYW43_ARCH_HEALTH, Enable the chip health monitor and recovery, type=bool, default=0, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_HEALTH
+#define CYW43_ARCH_HEALTH 0
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_HEALTH_POLL_MS, Interval in milliseconds at which the chip health is checked, type=int, default=1000, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_HEALTH_POLL_MS
+#define CYW43_ARCH_HEALTH_POLL_MS 1000
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_HEALTH_STALL_MS, How long in milliseconds control calls or transmits have to keep failing before the chip is reset, type=int, default=3000, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_HEALTH_STALL_MS
+#define CYW43_ARCH_HEALTH_STALL_MS 3000
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_HEALTH_BUDGET_MS, Time in milliseconds a recovery is expected to take including the rejoin; recoveries which take longer are counted, type=int, default=10000, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_HEALTH_BUDGET_MS
+#define CYW43_ARCH_HEALTH_BUDGET_MS 10000
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_HEALTH_MAX_ATTEMPTS, Recoveries in a row without the chip becoming healthy before the monitor gives up, type=int, default=3, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_HEALTH_MAX_ATTEMPTS
+#define CYW43_ARCH_HEALTH_MAX_ATTEMPTS 3
+#endif
+
+/**
+ * \brief Why the chip was reset
+ * \ingroup cyw43_arch_health
+ */
+typedef enum cyw43_arch_health_reason {
+    CYW43_ARCH_HEALTH_NONE,     ///< no recovery yet
+    CYW43_ARCH_HEALTH_IOCTL,    ///< control calls failed or timed out
+    CYW43_ARCH_HEALTH_TX_STALL, ///< frames were dropped without any being sent, for want of credits
+    CYW43_ARCH_HEALTH_MANUAL,   ///< \ref cyw43_arch_health_recover was called
+} cyw43_arch_health_reason_t;
+
+/**
+ * \brief Health monitor counters
+ * \ingroup cyw43_arch_health
+ */
+typedef struct cyw43_arch_health_stats {
+    uint32_t recoveries;       ///< chip resets
+    uint32_t failures;         ///< resets after which the chip didn't come back up
+    uint32_t over_budget;      ///< recoveries which took longer than \ref CYW43_ARCH_HEALTH_BUDGET_MS
+    cyw43_arch_health_reason_t last_reason; ///< why the chip was last reset
+    uint32_t last_reset_us;    ///< time the last reset took, up to the configuration being replayed
+    uint32_t last_recovery_us; ///< time the last recovery took including the rejoin, 0 while it is in progress
+    uint32_t max_recovery_us;  ///< longest recovery
+    bool gave_up;              ///< the monitor has stopped, after \ref CYW43_ARCH_HEALTH_MAX_ATTEMPTS or a failed reset
+} cyw43_arch_health_stats_t;
+
+/*!
+ * \brief Start monitoring the chip
+ * \ingroup cyw43_arch_health
+ *
+ * This is called when an interface is brought up. Calling it more than once is harmless, and it
+ * restarts a monitor which had given up.
+ */
+void cyw43_arch_health_attach(void);
+
+/*!
+ * \brief Record the network the station joins, for the rejoin after a recovery
+ * \ingroup cyw43_arch_health
+ *
+ * \param ssid the network name
+ * \param ssid_len length of the network name
+ * \param key the key passed to the firmware, passphrase or PMK; a passphrase is not kept
+ * \param key_len length of the key
+ * \param auth the authentication type
+ * \param bssid the access point to join, or NULL for any
+ */
+void cyw43_arch_health_note_join(const uint8_t *ssid, size_t ssid_len, const uint8_t *key, size_t key_len,
+                                 uint32_t auth, const uint8_t *bssid);
+
+/*!
+ * \brief Record that the station left its network, so that a recovery doesn't rejoin it
+ * \ingroup cyw43_arch_health
+ *
+ * The key kept for the rejoin is wiped.
+ */
+void cyw43_arch_health_note_leave(void);
+
+/*!
+ * \brief Record whether the access point is started, so that a recovery starts it again
+ * \ingroup cyw43_arch_health
+ *
+ * \param up true if the access point was started, false if it was stopped
+ */
+void cyw43_arch_health_note_ap(bool up);
+
+/*!
+ * \brief Reset the chip and replay its configuration now
+ * \ingroup cyw43_arch_health
+ *
+ * The data path is held up for the firmware reload, which takes a few hundred milliseconds; the
+ * station's rejoin completes in the background. A monitor which had given up runs again once the
+ * chip is back; if it doesn't come back, the monitor stays stopped.
+ *
+ * \return 0 if the chip came back up, an error code otherwise
+ */
+int cyw43_arch_health_recover(void);
+
+/*!
+ * \brief Return the health monitor counters
+ * \ingroup cyw43_arch_health
+ *
+ * \param stats filled in with the counters
+ */
+void cyw43_arch_health_get_stats(cyw43_arch_health_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _CYW43_ARCH_INFO_H
+#define _CYW43_ARCH_INFO_H
+
+#include "cyw43_arch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file cyw43_arch_info.h
+ *  \defgroup cyw43_arch_info cyw43_arch_info
+ *  \ingroup pico_cyw43_arch
+ *
+ * A cache of values which rarely or never change: the MAC address, the firmware version, the
+ * country code, and the channel, BSSID and security of the current association and of the access
+ * point. Reading the cache never takes the async_context lock and never touches the bus.
+ *
+ * The cache is refreshed from the async_context whenever the link of either interface changes,
+ * and when an interface is brought up.
+ */
+
+// PICO_CONFIG: CYW43_ARCH_INFO_POLL_MS, Interval at which the link state is polled when lwIP has no link callback, type=int, default=500, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_INFO_POLL_MS
+#define CYW43_ARCH_INFO_POLL_MS 500
+#endif
+
+/**
+ * \brief Control command of the "cyw43" RT-Thread device
+ * \ingroup cyw43_arch_info
+ */
+#define CYW43_CTRL_GET_INFO 0x62 ///< fill in the \ref cyw43_arch_info_t passed as the argument
+
+/**
+ * \brief Snapshot of the cached values
+ * \ingroup cyw43_arch_info
+ */
+typedef struct cyw43_arch_info {
+    uint8_t mac[6];
+    bool mac_valid;
+    char fw_version[80];    ///< firmware version string, empty until read
+    uint32_t country;       ///< country code, see CYW43_COUNTRY
+    bool sta_connected;     ///< the station interface is joined to an access point
+    uint8_t bssid[6];       ///< BSSID of the current association
+    uint32_t sta_channel;   ///< channel of the current association
+    uint32_t sta_auth;      ///< security requested when joining, see CYW43_AUTH_OPEN etc
+    uint32_t ap_channel;
+    uint32_t ap_auth;
+    uint32_t generation;    ///< incremented every time the cache is refreshed
+} cyw43_arch_info_t;
+
+/*!
+ * \brief Copy the cached values
+ * \ingroup cyw43_arch_info
+ *
+ * May be called from any thread.
+ *
+ * \param info filled in with the cached values
+ */
+void cyw43_arch_info_get(cyw43_arch_info_t *info);
+
+/*!
+ * \brief Ask for the cache to be refreshed from the async_context
+ * \ingroup cyw43_arch_info
+ *
+ * May be called from any thread, including with the async_context lock held.
+ */
+void cyw43_arch_info_refresh(void);
+
+/*!
+ * \brief Start tracking the link of an interface
+ * \ingroup cyw43_arch_info
+ *
+ * Called when the interface is brought up, after its netif has been added.
+ *
+ * \param itf the interface
+ */
+void cyw43_arch_info_attach(int itf);
+
+/*!
+ * \brief Record the security requested for a join
+ * \ingroup cyw43_arch_info
+ *
+ * The firmware reports the security of an association in terms which don't map back onto
+ * CYW43_AUTH_*, so the value passed to the join is remembered instead.
+ */
+void cyw43_arch_info_note_join(uint32_t auth);
+
+/*!
+ * \brief Record the security the access point was started with
+ * \ingroup cyw43_arch_info
+ */
+void cyw43_arch_info_note_ap(uint32_t auth);
+
+/*!
+ * \brief Set a function called when the station connects to or disconnects from an access point
+ * \ingroup cyw43_arch_info
+ *
+ * The callback is called from the async_context with the lock held, after the cache has been
+ * refreshed, so it must not block.
+ */
+void cyw43_arch_info_set_link_callback(void (*callback)(bool connected));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,197 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _CYW43_ARCH_IOCTL_H
+#define _CYW43_ARCH_IOCTL_H
+
+#include "cyw43_arch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file cyw43_arch_ioctl.h
+ *  \defgroup cyw43_arch_ioctl cyw43_arch_ioctl
+ *  \ingroup pico_cyw43_arch
+ *
+ * Helpers for firmware ioctls and iovars which the cyw43_driver has no dedicated function for.
+ * All of them must be called with the async_context lock held, and are accounted in the
+ * control operation statistics.
+ *
+ * Requests can also be queued from any thread without taking the async_context lock, see
+ * \ref cyw43_arch_ioctl_submit. The driver has one ioctl in flight at a time and waits for each
+ * reply, handling received frames while it waits, so the queue can't overlap requests on the bus.
+ * What it does is take the waiting off the callers: requests queued by several threads, or a
+ * group of requests queued together, are issued back to back by whichever thread next holds the
+ * lock (normally the async_context itself), at most \ref CYW43_ARCH_IOCTL_BURST at a time so that
+ * senders waiting for the lock get their turn in between. Each ioctl holds the lock until the
+ * firmware replies, so the burst is kept short.
+ */
+
+// PICO_CONFIG: CYW43_ARCH_IOCTL_BUF_SIZE, Size of the scratch buffer used for iovar requests, type=int, default=128, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_IOCTL_BUF_SIZE
+#define CYW43_ARCH_IOCTL_BUF_SIZE 128
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_IOCTL_BURST, Queued requests or groups of requests issued in one pass of the async_context before others get a turn with the lock, type=int, default=2, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_IOCTL_BURST
+#define CYW43_ARCH_IOCTL_BURST 2
+#endif
+
+/**
+ * \brief Encode a firmware WLC ioctl number as a cyw43_ioctl command
+ * \ingroup cyw43_arch_ioctl
+ */
+#define CYW43_WLC_GET(wlc) ((uint32_t)(wlc) << 1)
+#define CYW43_WLC_SET(wlc) (((uint32_t)(wlc) << 1) | 1)
+
+#define CYW43_WLC_GET_BSSID   23
+#define CYW43_WLC_GET_CHANNEL 29
+#define CYW43_WLC_GET_RSSI    127
+
+/*!
+ * \brief Issue a firmware ioctl
+ * \ingroup cyw43_arch_ioctl
+ *
+ * \param cmd the command, see \ref CYW43_WLC_GET and \ref CYW43_WLC_SET
+ * \param buf data for the ioctl, overwritten with the result
+ * \param len length of buf
+ * \param itf the interface
+ * \return 0 on success, an error code otherwise
+ */
+int cyw43_arch_ioctl(uint32_t cmd, void *buf, size_t len, int itf);
+
+/*!
+ * \brief Read an iovar
+ * \ingroup cyw43_arch_ioctl
+ *
+ * \param name the iovar name
+ * \param buf filled in with the value
+ * \param len length of the value
+ * \param itf the interface
+ * \return 0 on success, an error code otherwise
+ */
+int cyw43_arch_ioctl_get_var(const char *name, void *buf, size_t len, int itf);
+
+/*!
+ * \brief Read an iovar which takes a parameter, such as the address of a station
+ * \ingroup cyw43_arch_ioctl
+ *
+ * \param name the iovar name
+ * \param param the parameter, placed after the name
+ * \param param_len length of the parameter
+ * \param buf filled in with the value
+ * \param len length of the value
+ * \param itf the interface
+ * \return 0 on success, an error code otherwise
+ */
+int cyw43_arch_ioctl_get_var_param(const char *name, const void *param, size_t param_len, void *buf, size_t len, int itf);
+
+/*!
+ * \brief Write an iovar
+ * \ingroup cyw43_arch_ioctl
+ *
+ * \param name the iovar name
+ * \param data the value
+ * \param len length of the value
+ * \param itf the interface
+ * \return 0 on success, an error code otherwise
+ */
+int cyw43_arch_ioctl_set_var(const char *name, const void *data, size_t len, int itf);
+
+/*!
+ * \brief Write a 32 bit iovar
+ * \ingroup cyw43_arch_ioctl
+ */
+static inline int cyw43_arch_ioctl_set_var_u32(const char *name, uint32_t value, int itf) {
+    return cyw43_arch_ioctl_set_var(name, &value, sizeof(value), itf);
+}
+
+typedef struct cyw43_arch_ioctl_req cyw43_arch_ioctl_req_t;
+
+/**
+ * \brief A queued firmware ioctl
+ * \ingroup cyw43_arch_ioctl
+ *
+ * The request and its buffer belong to the queue from \ref cyw43_arch_ioctl_submit until it is
+ * complete.
+ */
+struct cyw43_arch_ioctl_req {
+    uint32_t cmd;  ///< the command, see \ref CYW43_WLC_GET and \ref CYW43_WLC_SET, or \ref CYW43_IOCTL_GET_VAR and \ref CYW43_IOCTL_SET_VAR with the iovar name at the start of buf
+    void *buf;     ///< data for the ioctl, overwritten with the result
+    size_t len;    ///< length of buf
+    int itf;       ///< the interface
+    void (*done)(cyw43_arch_ioctl_req_t *req); ///< called with the async_context lock held once complete, or NULL
+    void *user;    ///< for the use of the submitter
+    int err;       ///< the result, once complete
+    volatile bool complete; ///< set once the request has been issued
+    // private
+    cyw43_arch_ioctl_req_t *next;
+    bool group_end;
+};
+
+/*!
+ * \brief Start issuing queued requests from an async_context
+ * \ingroup cyw43_arch_ioctl
+ *
+ * This is called by \ref cyw43_arch_init for the context it uses.
+ *
+ * \param context the async_context to issue requests from
+ */
+void cyw43_arch_ioctl_init(async_context_t *context);
+
+/*!
+ * \brief Stop issuing queued requests from an async_context
+ * \ingroup cyw43_arch_ioctl
+ *
+ * This is called by \ref cyw43_arch_deinit before its context goes away. Requests still queued
+ * are issued by \ref cyw43_arch_ioctl_wait, or once the queue is initialized again.
+ *
+ * \param context the async_context passed to \ref cyw43_arch_ioctl_init
+ */
+void cyw43_arch_ioctl_deinit(async_context_t *context);
+
+/*!
+ * \brief Queue a firmware ioctl
+ * \ingroup cyw43_arch_ioctl
+ *
+ * May be called from any thread, with or without the async_context lock held. The request is
+ * issued from the async_context; wait for it with \ref cyw43_arch_ioctl_wait, or have its done
+ * function called.
+ *
+ * \param req the request, with cmd, buf, len, itf and optionally done and user filled in
+ */
+void cyw43_arch_ioctl_submit(cyw43_arch_ioctl_req_t *req);
+
+/*!
+ * \brief Queue a group of firmware ioctls to be issued back to back
+ * \ingroup cyw43_arch_ioctl
+ *
+ * The requests are issued in order, and no other control operation comes between them.
+ *
+ * \param reqs the requests
+ * \param count the number of requests
+ */
+void cyw43_arch_ioctl_submit_group(cyw43_arch_ioctl_req_t *reqs, uint count);
+
+/*!
+ * \brief Wait for a queued request to complete
+ * \ingroup cyw43_arch_ioctl
+ *
+ * Rather than sleeping until the async_context gets round to it, this takes the lock and issues
+ * queued requests up to and including this one itself, a group at a time, letting others have the
+ * lock in between. It may be called with the lock held.
+ *
+ * \param req a submitted request
+ * \return the result of the request
+ */
+int cyw43_arch_ioctl_wait(cyw43_arch_ioctl_req_t *req);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,115 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _CYW43_ARCH_MCAST_H
+#define _CYW43_ARCH_MCAST_H
+
+#include "cyw43_arch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file cyw43_arch_mcast.h
+ *  \defgroup cyw43_arch_mcast cyw43_arch_mcast
+ *  \ingroup pico_cyw43_arch
+ *
+ * Multicast MAC filtering, so that the host only receives the groups lwIP has joined. The lwIP
+ * IGMP and MLD MAC filter hooks of each cyw43 netif keep a reference counted table of group MAC
+ * addresses (several IPv4 groups share one MAC address), which is programmed into the chip's
+ * multicast list for the station interface.
+ *
+ * The chip list holds \ref CYW43_ARCH_MCAST_CHIP_GROUPS addresses and has no counterpart for the
+ * access point interface. Where the chip can't filter, it is set to receive all multicast and the
+ * frames are filtered against the table before they enter lwIP, which still saves the
+ * allocation and the trip through the stack. Broadcast is always accepted.
+ */
+
+// PICO_CONFIG: CYW43_ARCH_MCAST_FILTER, Enable multicast MAC filtering, type=bool, default=0, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_MCAST_FILTER
+#define CYW43_ARCH_MCAST_FILTER 0
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_MCAST_MAX_GROUPS, Number of multicast MAC addresses tracked per interface; beyond this all multicast is accepted, type=int, default=16, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_MCAST_MAX_GROUPS
+#define CYW43_ARCH_MCAST_MAX_GROUPS 16
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_MCAST_CHIP_GROUPS, Size of the multicast list of the firmware, type=int, default=10, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_MCAST_CHIP_GROUPS
+#define CYW43_ARCH_MCAST_CHIP_GROUPS 10
+#endif
+
+/**
+ * \brief Multicast filter state and counters of one interface
+ * \ingroup cyw43_arch_mcast
+ */
+typedef struct cyw43_arch_mcast_stats {
+    uint32_t groups;      ///< multicast MAC addresses joined
+    uint32_t chip_groups; ///< of which the chip filters
+    bool all_multicast;   ///< the chip passes all multicast, and only the host filters
+    bool overflow;        ///< more groups were joined than can be tracked, so all multicast is accepted
+    uint32_t rx_accepted; ///< multicast frames passed to lwIP
+    uint32_t rx_dropped;  ///< multicast frames dropped before lwIP
+} cyw43_arch_mcast_stats_t;
+
+/*!
+ * \brief Install the multicast filter hooks on an interface
+ * \ingroup cyw43_arch_mcast
+ *
+ * This must be called after the interface has been brought up, as that (re)creates the netif.
+ * Groups the netif had already joined are picked up. Calling it more than once is harmless.
+ *
+ * \param itf the interface (\ref CYW43_ITF_STA or \ref CYW43_ITF_AP)
+ */
+void cyw43_arch_mcast_attach(int itf);
+
+/*!
+ * \brief Program the joined groups into the chip again
+ * \ingroup cyw43_arch_mcast
+ *
+ * For when the firmware has been restarted without the netif being recreated, which loses the
+ * chip's multicast list but leaves the hooks in place.
+ */
+void cyw43_arch_mcast_reprogram(void);
+
+/*!
+ * \brief Decide whether a received frame is for a joined group
+ * \ingroup cyw43_arch_mcast
+ *
+ * This is called from the driver data path with the async_context lock held.
+ *
+ * \param itf the interface the frame was received on
+ * \param frame the ethernet frame
+ * \return false if the frame is multicast to a group which wasn't joined
+ */
+bool cyw43_arch_mcast_accept(int itf, const uint8_t *frame);
+
+/*!
+ * \brief Return the multicast MAC addresses joined on an interface
+ * \ingroup cyw43_arch_mcast
+ *
+ * \param itf the interface
+ * \param macs filled in with up to \p max addresses
+ * \param max the number of addresses macs has room for
+ * \return the number of addresses filled in
+ */
+int cyw43_arch_mcast_get_groups(int itf, uint8_t (*macs)[6], int max);
+
+/*!
+ * \brief Return the filter state and counters of an interface
+ * \ingroup cyw43_arch_mcast
+ *
+ * \param itf the interface
+ * \param stats filled in with the state and counters
+ */
+void cyw43_arch_mcast_get_stats(int itf, cyw43_arch_mcast_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
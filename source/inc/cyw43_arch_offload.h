@@ -0,0 +1,198 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _CYW43_ARCH_OFFLOAD_H
+#define _CYW43_ARCH_OFFLOAD_H
+
+#include "cyw43_arch.h"
+#include "lwip/ip4_addr.h"
+
+struct tcp_pcb;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file cyw43_arch_offload.h
+ *  \defgroup cyw43_arch_offload cyw43_arch_offload
+ *  \ingroup pico_cyw43_arch
+ *
+ * Firmware offloads for the station interface, which keep background LAN traffic from waking the
+ * host. Every frame that reaches the host costs a host wake interrupt and a pass of the
+ * async_context, so the firmware is asked to:
+ *
+ * - answer ARP requests for the station's address, and drop ARP requests for other addresses
+ * - drop group addressed frames the host has no use for, by packet filter pattern
+ * - send keep-alives on its own, so idle UDP flows and TCP connections through a NAT don't need the host
+ *
+ * The ARP responder and the keep-alive frames contain the station's address, so they are
+ * reprogrammed whenever the address changes; TCP keep-alives are stopped then, as the connection
+ * doesn't survive the change. This happens from the lwIP netif status callback (or by polling
+ * the address every \ref CYW43_ARCH_OFFLOAD_POLL_MS when lwIP has no status callback). The
+ * firmware counts what it answered and dropped in place of the host; \ref cyw43_arch_offload_get_stats
+ * adds these up into the number of host wakeups avoided.
+ */
+
+// PICO_CONFIG: CYW43_ARCH_OFFLOAD, Enable the ARP, keep-alive and packet filter offloads, type=bool, default=0, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_OFFLOAD
+#define CYW43_ARCH_OFFLOAD 0
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_OFFLOAD_ARP_MODE, Firmware ARP offload mode flags (agent 0x1, snoop 0x2, host auto reply 0x4, peer auto reply 0x8), type=int, default=0x9, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_OFFLOAD_ARP_MODE
+#define CYW43_ARCH_OFFLOAD_ARP_MODE 0x9
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_OFFLOAD_KEEPALIVES, Number of keep-alive frames the firmware sends on behalf of the host, type=int, default=2, max=4, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_OFFLOAD_KEEPALIVES
+#define CYW43_ARCH_OFFLOAD_KEEPALIVES 2
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_OFFLOAD_KEEPALIVE_PAYLOAD, Largest payload of a UDP keep-alive in bytes, type=int, default=32, max=48, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_OFFLOAD_KEEPALIVE_PAYLOAD
+#define CYW43_ARCH_OFFLOAD_KEEPALIVE_PAYLOAD 32
+#endif
+
+// PICO_CONFIG: CYW43_ARCH_OFFLOAD_POLL_MS, Interval in milliseconds at which the address is checked when lwIP has no netif status callback, type=int, default=1000, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_OFFLOAD_POLL_MS
+#define CYW43_ARCH_OFFLOAD_POLL_MS 1000
+#endif
+
+/**
+ * \brief Group addressed traffic which can be dropped by the firmware
+ * \ingroup cyw43_arch_offload
+ */
+#define CYW43_ARCH_OFFLOAD_DROP_MDNS       (1u << 0) ///< IPv4 mDNS, 224.0.0.251
+#define CYW43_ARCH_OFFLOAD_DROP_SSDP       (1u << 1) ///< UPnP discovery, 239.255.255.250
+#define CYW43_ARCH_OFFLOAD_DROP_IPV6_MCAST (1u << 2) ///< all IPv6 multicast, including neighbour discovery
+#define CYW43_ARCH_OFFLOAD_DROP_NETBIOS    (1u << 3) ///< NetBIOS name and datagram broadcasts
+#define CYW43_ARCH_OFFLOAD_FILTER_COUNT    4
+
+// PICO_CONFIG: CYW43_ARCH_OFFLOAD_FILTERS, Traffic dropped by the firmware by default, a mask of CYW43_ARCH_OFFLOAD_DROP_ flags, type=int, default=SSDP and NetBIOS plus mDNS and IPv6 multicast when lwIP doesn't use them, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_OFFLOAD_FILTERS
+#if LWIP_MDNS_RESPONDER && LWIP_IPV6
+#define CYW43_ARCH_OFFLOAD_FILTERS (CYW43_ARCH_OFFLOAD_DROP_SSDP | CYW43_ARCH_OFFLOAD_DROP_NETBIOS)
+#elif LWIP_MDNS_RESPONDER
+#define CYW43_ARCH_OFFLOAD_FILTERS (CYW43_ARCH_OFFLOAD_DROP_SSDP | CYW43_ARCH_OFFLOAD_DROP_NETBIOS | \
+                                    CYW43_ARCH_OFFLOAD_DROP_IPV6_MCAST)
+#elif LWIP_IPV6
+#define CYW43_ARCH_OFFLOAD_FILTERS (CYW43_ARCH_OFFLOAD_DROP_SSDP | CYW43_ARCH_OFFLOAD_DROP_NETBIOS | \
+                                    CYW43_ARCH_OFFLOAD_DROP_MDNS)
+#else
+#define CYW43_ARCH_OFFLOAD_FILTERS (CYW43_ARCH_OFFLOAD_DROP_SSDP | CYW43_ARCH_OFFLOAD_DROP_NETBIOS | \
+                                    CYW43_ARCH_OFFLOAD_DROP_MDNS | CYW43_ARCH_OFFLOAD_DROP_IPV6_MCAST)
+#endif
+#endif
+
+/**
+ * \brief Offload counters
+ * \ingroup cyw43_arch_offload
+ */
+typedef struct cyw43_arch_offload_stats {
+    uint32_t arp_replies;  ///< ARP requests for the station's address answered by the firmware
+    uint32_t arp_dropped;  ///< ARP requests for other addresses dropped by the firmware
+    uint32_t filter_dropped[CYW43_ARCH_OFFLOAD_FILTER_COUNT]; ///< frames dropped by each filter, in flag order
+    uint32_t keepalives;   ///< keep-alive frames currently sent by the firmware
+    uint32_t reconfigs;    ///< times the offloads were reprogrammed for a new address
+    uint32_t wakeups_avoided; ///< frames handled by the firmware which would otherwise have woken the host
+} cyw43_arch_offload_stats_t;
+
+/*!
+ * \brief Start managing the offloads of the station interface
+ * \ingroup cyw43_arch_offload
+ *
+ * This is called when the station interface is brought up, as bringing the first interface up
+ * starts the firmware afresh, without any offloads. Calling it more than once is harmless.
+ */
+void cyw43_arch_offload_attach(void);
+
+/*!
+ * \brief Enable or disable the ARP offload
+ * \ingroup cyw43_arch_offload
+ *
+ * The ARP offload is enabled by default.
+ *
+ * \param enable true to have the firmware answer ARP requests while the station has an address
+ */
+void cyw43_arch_offload_set_arp(bool enable);
+
+/*!
+ * \brief Select the group addressed traffic dropped by the firmware
+ * \ingroup cyw43_arch_offload
+ *
+ * A filter which would drop traffic for a group the station has joined in lwIP is left off for as
+ * long as the group is joined: mDNS or SSDP while 224.0.0.251 or 239.255.255.250 (or another group
+ * with the same MAC address) is joined, and IPv6 multicast while MLD has joined any group.
+ *
+ * \param filters a mask of CYW43_ARCH_OFFLOAD_DROP_ flags, initially \ref CYW43_ARCH_OFFLOAD_FILTERS
+ */
+void cyw43_arch_offload_set_filters(uint32_t filters);
+
+/*!
+ * \brief Re-evaluate the filters after the station joined or left a multicast group
+ * \ingroup cyw43_arch_offload
+ *
+ * The IGMP and MLD hooks of \ref CYW43_ARCH_MCAST_FILTER call this; without them it has to be
+ * called after joining or leaving a group for the filters to follow.
+ */
+void cyw43_arch_offload_groups_changed(void);
+
+/*!
+ * \brief Have the firmware send a UDP keep-alive
+ * \ingroup cyw43_arch_offload
+ *
+ * The firmware sends the datagram from the station's address every \p period_ms, which keeps the
+ * NAT mapping of a flow alive while the host sleeps. The frame is rebuilt when the address changes,
+ * and is addressed to the gateway unless \p dest is on the local subnet, in which case \p dest must
+ * be in the ARP table.
+ *
+ * \param slot the keep-alive, less than \ref CYW43_ARCH_OFFLOAD_KEEPALIVES
+ * \param dest the destination address
+ * \param src_port the local port
+ * \param dest_port the destination port
+ * \param payload the datagram contents
+ * \param len length of the payload, up to \ref CYW43_ARCH_OFFLOAD_KEEPALIVE_PAYLOAD
+ * \param period_ms the interval between keep-alives, or 0 to stop sending this keep-alive
+ * \return 0 on success, an error code otherwise \see pico_error_codes
+ */
+int cyw43_arch_offload_set_udp_keepalive(uint slot, const ip4_addr_t *dest, uint16_t src_port, uint16_t dest_port,
+                                         const void *payload, size_t len, uint32_t period_ms);
+
+/*!
+ * \brief Have the firmware send TCP keep-alives for a connection
+ * \ingroup cyw43_arch_offload
+ *
+ * The firmware sends a keep-alive probe (an empty ACK one byte behind the connection) every
+ * \p period_ms, like lwIP's own keep-alive but without waking the host to do it. The probe is built
+ * from the sequence numbers at the time of the call, so this is meant for connections which then
+ * stay idle; should data flow again, the peer still answers the outdated probe with an ACK, which
+ * is all a NAT needs to see. Must be called with the async_context lock held, which is the lwIP
+ * core lock.
+ *
+ * \param slot the keep-alive, less than \ref CYW43_ARCH_OFFLOAD_KEEPALIVES
+ * \param pcb an established IPv4 connection on the station interface
+ * \param period_ms the interval between keep-alives, or 0 to stop sending this keep-alive
+ * \return 0 on success, an error code otherwise \see pico_error_codes
+ */
+int cyw43_arch_offload_set_tcp_keepalive(uint slot, const struct tcp_pcb *pcb, uint32_t period_ms);
+
+/*!
+ * \brief Read the offload counters
+ * \ingroup cyw43_arch_offload
+ *
+ * The firmware counters are read over the bus, so this takes the async_context lock. They start
+ * over whenever the firmware is reloaded.
+ *
+ * \param stats filled in with the counters
+ * \return 0 on success, an error code otherwise
+ */
+int cyw43_arch_offload_get_stats(cyw43_arch_offload_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,136 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _CYW43_ARCH_STATS_H
+#define _CYW43_ARCH_STATS_H
+
+#include "cyw43_arch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file cyw43_arch_stats.h
+ *  \defgroup cyw43_arch_stats cyw43_arch_stats
+ *  \ingroup pico_cyw43_arch
+ *
+ * Data path and control path counters. Every core updates its own copy of the counters with
+ * interrupts briefly disabled, so counting never takes the async_context lock and never contends
+ * with the other core; \ref cyw43_arch_stats_get sums the copies into a snapshot.
+ *
+ * The SDPCM credit handling and the bus protocol live inside the cyw43_driver, so they are
+ * observed from the outside: a send which spends longer than \ref CYW43_ARCH_STATS_STALL_US in the
+ * driver was waiting for the chip to grant credits, and is counted as a stall.
+ */
+
+// PICO_CONFIG: CYW43_ARCH_STATS_STALL_US, A send taking longer than this many microseconds inside the driver is counted as a credit stall, type=int, default=1000, group=pico_cyw43_arch
+#ifndef CYW43_ARCH_STATS_STALL_US
+#define CYW43_ARCH_STATS_STALL_US 1000
+#endif
+
+/**
+ * \brief Control commands of the "cyw43" RT-Thread device
+ * \ingroup cyw43_arch_stats
+ */
+#define CYW43_CTRL_GET_STATS   0x60 ///< fill in the \ref cyw43_arch_stats_t passed as the argument
+#define CYW43_CTRL_RESET_STATS 0x61 ///< reset all counters
+
+/**
+ * \brief Per interface counters
+ * \ingroup cyw43_arch_stats
+ */
+typedef struct cyw43_arch_itf_stats {
+    uint32_t tx_packets;
+    uint32_t tx_bytes;
+    uint32_t tx_dropped; ///< frames the driver failed to send
+    uint32_t rx_packets;
+    uint32_t rx_bytes;
+    uint32_t rx_chained; ///< received frames which did not fit in a single pbuf
+    uint32_t tx_queued;     ///< frames of this interface waiting to be sent when the snapshot was taken
+    uint32_t tx_queued_max; ///< largest number of frames of this interface waiting to be sent
+    uint32_t tx_stalls;     ///< sends of this interface which waited longer than \ref CYW43_ARCH_STATS_STALL_US
+} cyw43_arch_itf_stats_t;
+
+/**
+ * \brief Snapshot of the counters
+ * \ingroup cyw43_arch_stats
+ */
+typedef struct cyw43_arch_stats {
+    cyw43_arch_itf_stats_t itf[CYW43_ITF_AP + 1]; ///< indexed by \ref CYW43_ITF_STA and \ref CYW43_ITF_AP
+    uint32_t tx_queued;     ///< frames waiting to be sent when the snapshot was taken
+    uint32_t tx_queued_max; ///< largest number of frames waiting to be sent
+    uint32_t tx_stalls;     ///< sends which waited longer than \ref CYW43_ARCH_STATS_STALL_US
+    uint32_t tx_max_us;     ///< longest time spent sending a single frame
+    uint32_t ioctls;        ///< control operations issued to the chip
+    uint32_t ioctl_errors;  ///< control operations which failed
+    uint32_t ioctl_max_us;  ///< longest control operation
+    uint64_t ioctl_us;      ///< total time spent in control operations
+    uint32_t wakeups;       ///< async_context wakeups, or 0 if the context doesn't count them
+    uint64_t period_us;     ///< time covered by the counters
+} cyw43_arch_stats_t;
+
+/*!
+ * \brief Account for a frame handed to the driver
+ * \ingroup cyw43_arch_stats
+ *
+ * \param itf the interface the frame was sent on
+ * \param len length of the frame
+ * \param err the result of the send
+ * \param send_us time spent inside the driver
+ * \param depth number of frames waiting to be sent, including this one
+ * \param itf_depth number of frames of \p itf waiting to be sent, including this one
+ */
+void cyw43_arch_stats_tx(int itf, size_t len, int err, uint32_t send_us, uint32_t depth, uint32_t itf_depth);
+
+/*!
+ * \brief Account for a frame received from the driver
+ * \ingroup cyw43_arch_stats
+ *
+ * \param itf the interface the frame was received on
+ * \param len length of the frame
+ * \param chained true if the frame is spread over more than one buffer
+ */
+void cyw43_arch_stats_rx(int itf, size_t len, bool chained);
+
+/*!
+ * \brief Account for a control operation
+ * \ingroup cyw43_arch_stats
+ *
+ * This is meant to wrap the call. The start time must be taken in a separate statement, as the
+ * order in which function arguments are evaluated is unspecified:
+ * \code
+ * uint32_t start_us = time_us_32();
+ * err = cyw43_arch_stats_ioctl(start_us, cyw43_wifi_pm(&cyw43_state, value));
+ * \endcode
+ *
+ * \param start_us the value of time_us_32() when the operation started
+ * \param err the result of the operation
+ * \return err
+ */
+int cyw43_arch_stats_ioctl(uint32_t start_us, int err);
+
+/*!
+ * \brief Take a snapshot of the counters
+ * \ingroup cyw43_arch_stats
+ *
+ * The counters of each core are read without stopping the other core, so a snapshot taken under
+ * heavy traffic may be a packet or two out of step between fields.
+ *
+ * \param stats filled in with the snapshot
+ */
+void cyw43_arch_stats_get(cyw43_arch_stats_t *stats);
+
+/*!
+ * \brief Reset all counters
+ * \ingroup cyw43_arch_stats
+ */
+void cyw43_arch_stats_reset(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
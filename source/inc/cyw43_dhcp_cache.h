@@ -0,0 +1,137 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _CYW43_DHCP_CACHE_H
+#define _CYW43_DHCP_CACHE_H
+
+#include "cyw43_arch.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file cyw43_dhcp_cache.h
+ *  \defgroup cyw43_dhcp_cache cyw43_dhcp_cache
+ *  \ingroup pico_cyw43_arch
+ *
+ * A cache of the DHCP leases of the station interface, one per network. lwIP confirms a lease it
+ * still holds with a single REQUEST when the link comes back up (INIT-REBOOT), but it only holds
+ * the lease of the last network, and after a reboot it holds none.
+ *
+ * When a join starts, the lease of the network being left is saved, and the cached lease of the
+ * network being joined, if it hasn't expired, is loaded into the lwIP DHCP client. When the link
+ * comes up lwIP then asks to keep the address rather than starting over with a DISCOVER. Joining a
+ * network with no cached lease drops the previous address, so lwIP goes straight to DISCOVER rather
+ * than first timing out asking a different network's server for it.
+ *
+ * Networks are told apart by SSID, as the BSSID isn't known until the join has completed and the
+ * access points of one network share a DHCP server.
+ *
+ * The cache itself is in RAM. To keep leases across a reboot, set a store callback with
+ * \ref cyw43_dhcp_cache_set_store_callback to persist each lease as it is bound, and hand the stored
+ * entries back with \ref cyw43_dhcp_cache_add after starting up.
+ */
+
+// PICO_CONFIG: CYW43_DHCP_CACHE, Enable the DHCP lease cache, type=bool, default=0, group=pico_cyw43_arch
+#ifndef CYW43_DHCP_CACHE
+#define CYW43_DHCP_CACHE 0
+#endif
+
+// PICO_CONFIG: CYW43_DHCP_CACHE_ENTRIES, Number of networks the DHCP lease cache remembers, type=int, default=4, group=pico_cyw43_arch
+#ifndef CYW43_DHCP_CACHE_ENTRIES
+#define CYW43_DHCP_CACHE_ENTRIES 4
+#endif
+
+// PICO_CONFIG: CYW43_DHCP_CACHE_USE_ADDRESS, Configure the cached address as soon as the join starts rather than waiting for the server to confirm it, type=bool, default=0, group=pico_cyw43_arch
+#ifndef CYW43_DHCP_CACHE_USE_ADDRESS
+#define CYW43_DHCP_CACHE_USE_ADDRESS 0
+#endif
+
+/**
+ * \brief A cached lease, as handed to the store callback and back to \ref cyw43_dhcp_cache_add
+ * \ingroup cyw43_dhcp_cache
+ */
+typedef struct cyw43_dhcp_cache_entry {
+    uint8_t ssid_len;
+    uint8_t ssid[32];
+    ip4_addr_t ip;
+    ip4_addr_t netmask;
+    ip4_addr_t gw;
+    ip4_addr_t server;
+    uint32_t lease_s;   ///< lease time granted by the server, 0xffffffff for an infinite lease
+    uint32_t renew_s;
+    uint32_t rebind_s;
+    uint32_t used_s;    ///< seconds of the lease already used when the entry was handed out
+} cyw43_dhcp_cache_entry_t;
+
+/**
+ * \brief DHCP lease cache counters
+ * \ingroup cyw43_dhcp_cache
+ */
+typedef struct cyw43_dhcp_cache_stats {
+    uint32_t hits;     ///< joins which loaded a cached lease
+    uint32_t misses;   ///< joins of a network with no cached lease
+    uint32_t expired;  ///< joins whose cached lease had run out
+} cyw43_dhcp_cache_stats_t;
+
+/*!
+ * \brief Prepare the DHCP client of the station interface for a join
+ * \ingroup cyw43_dhcp_cache
+ *
+ * Called before starting a join.
+ *
+ * \param ssid the network being joined
+ * \param ssid_len length of ssid
+ */
+void cyw43_dhcp_cache_join(const uint8_t *ssid, size_t ssid_len);
+
+/*!
+ * \brief Save the lease of the station interface once it has been bound
+ * \ingroup cyw43_dhcp_cache
+ *
+ * Called when the station interface gets its address, so the lease reaches the store callback
+ * without waiting for the next join.
+ */
+void cyw43_dhcp_cache_note_bound(void);
+
+/*!
+ * \brief Add a lease, for example one restored from flash
+ * \ingroup cyw43_dhcp_cache
+ *
+ * The time spent powered off isn't known to the cache, so if the application knows it, it should be
+ * added to used_s before the entry is added. A lease which has in fact run out is refused by the
+ * server, and the client then starts over with a DISCOVER.
+ *
+ * \param entry the lease, replacing any cached lease of the same network
+ */
+void cyw43_dhcp_cache_add(const cyw43_dhcp_cache_entry_t *entry);
+
+/*!
+ * \brief Set a function to be called with every lease saved in the cache, so it can be persisted
+ * \ingroup cyw43_dhcp_cache
+ *
+ * The callback is called with the async_context lock held, so it should copy the entry and leave
+ * writing it out to another thread.
+ */
+void cyw43_dhcp_cache_set_store_callback(void (*store)(const cyw43_dhcp_cache_entry_t *entry));
+
+/*!
+ * \brief Forget every cached lease
+ * \ingroup cyw43_dhcp_cache
+ */
+void cyw43_dhcp_cache_clear(void);
+
+/*!
+ * \brief Return the cache counters
+ * \ingroup cyw43_dhcp_cache
+ */
+void cyw43_dhcp_cache_get_stats(cyw43_dhcp_cache_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,126 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _CYW43_FRAME_POOL_H
+#define _CYW43_FRAME_POOL_H
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file cyw43_frame_pool.h
+ *  \defgroup cyw43_frame_pool cyw43_frame_pool
+ *  \ingroup pico_cyw43_arch
+ *
+ * Fixed size frame buffers owned by the WiFi driver, so that frames don't compete with the rest
+ * of the system for heap and lwIP pool memory. The pool is statically allocated and split into an
+ * RX and a TX reservation; one side running dry never takes buffers from the other.
+ *
+ * Received frames which lwIP would otherwise hold as a pbuf chain are copied into the RX
+ * reservation. The only user of the TX reservation is the access point transmit scheduler
+ * (\ref CYW43_ARCH_AP_TX_SCHED), so it is empty unless that is enabled.
+ *
+ * Allocation and release are O(1) pops and pushes on a free list. They are protected by a hardware
+ * spin lock rather than the async_context lock, as received frames are released by whichever
+ * thread lwIP or the application happens to free them from.
+ */
+
+// PICO_CONFIG: CYW43_FRAME_POOL, Enable the driver owned frame pool, type=bool, default=0, group=pico_cyw43_arch
+#ifndef CYW43_FRAME_POOL
+#define CYW43_FRAME_POOL 0
+#endif
+
+// PICO_CONFIG: CYW43_FRAME_POOL_RX_FRAMES, Number of frames reserved for received frames, type=int, default=8, group=pico_cyw43_arch
+#ifndef CYW43_FRAME_POOL_RX_FRAMES
+#define CYW43_FRAME_POOL_RX_FRAMES 8
+#endif
+
+// PICO_CONFIG: CYW43_FRAME_POOL_TX_FRAMES, Number of frames reserved for frames waiting to be sent, type=int, default=4 with CYW43_ARCH_AP_TX_SCHED and 0 otherwise, group=pico_cyw43_arch
+#ifndef CYW43_FRAME_POOL_TX_FRAMES
+#if CYW43_ARCH_AP_TX_SCHED
+#define CYW43_FRAME_POOL_TX_FRAMES 4
+#else
+#define CYW43_FRAME_POOL_TX_FRAMES 0
+#endif
+#endif
+
+// PICO_CONFIG: CYW43_FRAME_POOL_FRAME_SIZE, Size in bytes of each frame, including any bookkeeping the user of the frame keeps in it, type=int, default=1600, group=pico_cyw43_arch
+#ifndef CYW43_FRAME_POOL_FRAME_SIZE
+#define CYW43_FRAME_POOL_FRAME_SIZE 1600
+#endif
+
+// PICO_CONFIG: PARAM_ASSERTIONS_ENABLED_CYW43_FRAME_POOL, Enable/disable assertions in the cyw43_frame_pool module, type=bool, default=0, group=pico_cyw43_arch
+#ifndef PARAM_ASSERTIONS_ENABLED_CYW43_FRAME_POOL
+#define PARAM_ASSERTIONS_ENABLED_CYW43_FRAME_POOL 0
+#endif
+
+typedef enum cyw43_frame_class {
+    CYW43_FRAME_RX,
+    CYW43_FRAME_TX,
+    CYW43_FRAME_CLASS_COUNT
+} cyw43_frame_class_t;
+
+/**
+ * \brief Statistics of one reservation
+ * \ingroup cyw43_frame_pool
+ */
+typedef struct cyw43_frame_pool_stats {
+    uint32_t size;       ///< number of frames in the reservation
+    uint32_t in_use;     ///< frames currently allocated
+    uint32_t high_water; ///< largest number of frames allocated at once
+    uint32_t allocs;     ///< successful allocations
+    uint32_t failures;   ///< allocations which found the reservation empty
+} cyw43_frame_pool_stats_t;
+
+/*!
+ * \brief Initialize the frame pool
+ * \ingroup cyw43_frame_pool
+ *
+ * Safe to call more than once; later calls do nothing.
+ */
+void cyw43_frame_pool_init(void);
+
+/*!
+ * \brief Allocate a frame
+ * \ingroup cyw43_frame_pool
+ *
+ * \param frame_class the reservation to allocate from
+ * \return a word aligned buffer of \ref CYW43_FRAME_POOL_FRAME_SIZE bytes, or NULL if the reservation is empty
+ */
+void *cyw43_frame_alloc(cyw43_frame_class_t frame_class);
+
+/*!
+ * \brief Return a frame to its reservation
+ * \ingroup cyw43_frame_pool
+ *
+ * May be called from any thread or IRQ.
+ *
+ * \param frame a frame returned by \ref cyw43_frame_alloc
+ */
+void cyw43_frame_free(void *frame);
+
+/*!
+ * \brief Return the statistics of a reservation
+ * \ingroup cyw43_frame_pool
+ *
+ * \param frame_class the reservation
+ * \param stats filled in with the statistics
+ */
+void cyw43_frame_pool_get_stats(cyw43_frame_class_t frame_class, cyw43_frame_pool_stats_t *stats);
+
+/*!
+ * \brief Reset the high water marks and counters, leaving allocated frames alone
+ * \ingroup cyw43_frame_pool
+ */
+void cyw43_frame_pool_reset_stats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
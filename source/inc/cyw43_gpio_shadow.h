@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _CYW43_GPIO_SHADOW_H
+#define _CYW43_GPIO_SHADOW_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file cyw43_gpio_shadow.h
+ *  \defgroup cyw43_gpio_shadow cyw43_gpio_shadow
+ *  \ingroup pico_cyw43_arch
+ *
+ * Copy of the wireless chip GPIO outputs, used by \ref cyw43_arch_gpio_put and
+ * \ref cyw43_arch_gpio_get when \ref CYW43_ARCH_GPIO_SHADOW is enabled. It tracks which pins have
+ * been put and which still have to be written to the chip, so that puts of the value a pin already
+ * has are skipped and several puts can be written with one "gpioout" call.
+ *
+ * This file has no dependencies on the RTOS or the cyw43_driver so that it can be built and
+ * exercised on a host; the caller does the locking and the writes.
+ */
+
+/**
+ * \brief Wireless chip GPIO counters
+ * \ingroup cyw43_gpio_shadow
+ */
+typedef struct cyw43_gpio_shadow_stats {
+    uint32_t puts;         ///< pins put
+    uint32_t puts_skipped; ///< puts of the value the pin already had
+    uint32_t writes;       ///< writes to the chip, each covering one or more puts
+    uint32_t write_errors; ///< writes which failed, after which the pins written are no longer known
+    uint32_t gets;         ///< pins read
+    uint32_t gets_cached;  ///< gets answered without reading the chip
+} cyw43_gpio_shadow_stats_t;
+
+/**
+ * \brief Shadow state
+ * \ingroup cyw43_gpio_shadow
+ */
+typedef struct cyw43_gpio_shadow {
+    uint32_t out;     ///< the value last put on each pin
+    uint32_t known;   ///< pins which have been put, whose value is in \c out
+    uint32_t pending; ///< pins put since the chip was last written
+    cyw43_gpio_shadow_stats_t stats;
+} cyw43_gpio_shadow_t;
+
+/*!
+ * \brief Initialize a shadow with no pins known
+ * \ingroup cyw43_gpio_shadow
+ */
+void cyw43_gpio_shadow_init(cyw43_gpio_shadow_t *shadow);
+
+/*!
+ * \brief Record a put of a pin
+ * \ingroup cyw43_gpio_shadow
+ *
+ * \param shadow the shadow
+ * \param pin the GPIO number on the wireless chip, less than 32
+ * \param value the value put
+ * \return true if the pin now has to be written, false if it already had the value
+ */
+bool cyw43_gpio_shadow_put(cyw43_gpio_shadow_t *shadow, unsigned int pin, bool value);
+
+/*!
+ * \brief Answer a get of a pin from the shadow
+ * \ingroup cyw43_gpio_shadow
+ *
+ * \param shadow the shadow
+ * \param pin the GPIO number on the wireless chip, less than 32
+ * \param value set to the value last put, if the pin is known
+ * \return true if the pin is known, false if it has to be read from the chip
+ */
+bool cyw43_gpio_shadow_get(cyw43_gpio_shadow_t *shadow, unsigned int pin, bool *value);
+
+/*!
+ * \brief Take the pins to be written to the chip
+ * \ingroup cyw43_gpio_shadow
+ *
+ * The pins are no longer pending afterwards; \ref cyw43_gpio_shadow_write_done must be called with
+ * the result of the write.
+ *
+ * \param shadow the shadow
+ * \param mask set to the pins to write
+ * \param value set to the values of those pins
+ * \return true if there is anything to write
+ */
+bool cyw43_gpio_shadow_take(cyw43_gpio_shadow_t *shadow, uint32_t *mask, uint32_t *value);
+
+/*!
+ * \brief Record the result of a write taken with \ref cyw43_gpio_shadow_take
+ * \ingroup cyw43_gpio_shadow
+ *
+ * After a failed write the pins are no longer known, so the next put of each of them is written
+ * whatever its value and gets read the chip.
+ *
+ * \param shadow the shadow
+ * \param mask the pins written
+ * \param ok true if the write succeeded
+ */
+void cyw43_gpio_shadow_write_done(cyw43_gpio_shadow_t *shadow, uint32_t mask, bool ok);
+
+/*!
+ * \brief Forget every pin, e.g. because the chip was reset to its defaults
+ * \ingroup cyw43_gpio_shadow
+ */
+void cyw43_gpio_shadow_forget(cyw43_gpio_shadow_t *shadow);
+
+/*!
+ * \brief Mark every known pin as to be written again, e.g. because the chip was reset
+ * \ingroup cyw43_gpio_shadow
+ *
+ * \return true if there is anything to write
+ */
+bool cyw43_gpio_shadow_restore(cyw43_gpio_shadow_t *shadow);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,147 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _CYW43_LATENCY_H
+#define _CYW43_LATENCY_H
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file cyw43_latency.h
+ *  \defgroup cyw43_latency cyw43_latency
+ *  \ingroup pico_cyw43_arch
+ *
+ * Optional per-stage latency instrumentation of the cyw43 data path. Each stage is timestamped
+ * with the microsecond timer and accumulated into a log2 histogram; the most recent samples are
+ * also kept in a small ring.
+ *
+ * Stages:
+ * * \c IRQ_TO_WAKE - host wake IRQ until the async_context task has woken up
+ * * \c WAKE_TO_LOCK - task woken until it holds the async_context lock
+ * * \c PROCESS - time spent in one pass of the async_context workers (includes SPI reads)
+ * * \c RX_DELIVER - start of the pass until a received frame is handed to lwIP
+ * * \c TX_SEND - time taken by \c cyw43_send_ethernet, including waiting for the lock and the SPI write
+ *
+ * When \ref CYW43_LATENCY_TRACE is 0 all of the macros expand to nothing.
+ */
+
+// PICO_CONFIG: CYW43_LATENCY_TRACE, Enable per-stage latency histograms of the data path, type=bool, default=0, group=pico_cyw43_arch
+#ifndef CYW43_LATENCY_TRACE
+#define CYW43_LATENCY_TRACE 0
+#endif
+
+// PICO_CONFIG: CYW43_LATENCY_RING_LEN, Number of recent samples kept by the latency instrumentation, type=int, default=32, group=pico_cyw43_arch
+#ifndef CYW43_LATENCY_RING_LEN
+#define CYW43_LATENCY_RING_LEN 32
+#endif
+
+#define CYW43_LATENCY_BUCKETS 32
+
+typedef enum cyw43_latency_stage {
+    CYW43_LATENCY_IRQ_TO_WAKE,
+    CYW43_LATENCY_WAKE_TO_LOCK,
+    CYW43_LATENCY_PROCESS,
+    CYW43_LATENCY_RX_DELIVER,
+    CYW43_LATENCY_TX_SEND,
+    CYW43_LATENCY_STAGE_COUNT
+} cyw43_latency_stage_t;
+
+/**
+ * \brief Latency histogram of one stage
+ * \ingroup cyw43_latency
+ *
+ * Bucket n counts samples in the range [2^n, 2^(n+1)) microseconds, bucket 0 also counts 0us.
+ */
+typedef struct cyw43_latency_hist {
+    uint32_t count;
+    uint32_t min_us;
+    uint32_t max_us;
+    uint64_t total_us;
+    uint32_t buckets[CYW43_LATENCY_BUCKETS];
+} cyw43_latency_hist_t;
+
+/**
+ * \brief A single recent sample
+ * \ingroup cyw43_latency
+ */
+typedef struct cyw43_latency_sample {
+    uint32_t time_us;
+    uint32_t latency_us;
+    cyw43_latency_stage_t stage;
+} cyw43_latency_sample_t;
+
+#if CYW43_LATENCY_TRACE
+#include "pico/time.h"
+
+// time of the first host wake IRQ which has not been serviced yet, 0 if none
+extern volatile uint32_t cyw43_latency_irq_us;
+// time at which the current async_context pass started
+extern uint32_t cyw43_latency_pass_us;
+
+/*!
+ * \brief Record a sample for a stage
+ * \ingroup cyw43_latency
+ *
+ * \param stage the stage
+ * \param start_us the time the stage started, as returned by \c time_us_32()
+ */
+void cyw43_latency_record(cyw43_latency_stage_t stage, uint32_t start_us);
+
+/*!
+ * \brief Return a copy of the histogram of a stage
+ * \ingroup cyw43_latency
+ */
+void cyw43_latency_get(cyw43_latency_stage_t stage, cyw43_latency_hist_t *hist);
+
+/*!
+ * \brief Copy the most recent samples, oldest first
+ * \ingroup cyw43_latency
+ *
+ * \param samples buffer for the samples
+ * \param max maximum number of samples to copy
+ * \return the number of samples copied
+ */
+uint32_t cyw43_latency_get_recent(cyw43_latency_sample_t *samples, uint32_t max);
+
+/*!
+ * \brief Clear all histograms and recent samples
+ * \ingroup cyw43_latency
+ */
+void cyw43_latency_reset(void);
+
+/*!
+ * \brief Return the name of a stage
+ * \ingroup cyw43_latency
+ */
+const char *cyw43_latency_stage_name(cyw43_latency_stage_t stage);
+
+#define CYW43_LATENCY_START(var) uint32_t var = time_us_32()
+#define CYW43_LATENCY_END(stage, var) cyw43_latency_record(stage, var)
+#define CYW43_LATENCY_IRQ() do { if (!cyw43_latency_irq_us) cyw43_latency_irq_us = time_us_32() | 1; } while (0)
+#define CYW43_LATENCY_WOKEN() do { \
+    cyw43_latency_pass_us = time_us_32(); \
+    if (cyw43_latency_irq_us) { \
+        cyw43_latency_record(CYW43_LATENCY_IRQ_TO_WAKE, cyw43_latency_irq_us); \
+        cyw43_latency_irq_us = 0; \
+    } \
+} while (0)
+#define CYW43_LATENCY_RX() cyw43_latency_record(CYW43_LATENCY_RX_DELIVER, cyw43_latency_pass_us)
+#else
+#define CYW43_LATENCY_START(var) ((void)0)
+#define CYW43_LATENCY_END(stage, var) ((void)0)
+#define CYW43_LATENCY_IRQ() ((void)0)
+#define CYW43_LATENCY_WOKEN() ((void)0)
+#define CYW43_LATENCY_RX() ((void)0)
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
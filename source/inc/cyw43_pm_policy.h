@@ -0,0 +1,223 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _CYW43_PM_POLICY_H
+#define _CYW43_PM_POLICY_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file cyw43_pm_policy.h
+ *  \defgroup cyw43_pm_policy cyw43_pm_policy
+ *  \ingroup pico_cyw43_arch
+ *
+ * Traffic adaptive power save governor. The governor watches TX/RX packets and the TX queue depth,
+ * decides when the wireless chip should leave power save ("boost") because a burst of traffic
+ * started, and when it may return to the configured power save mode after an idle window.
+ *
+ * A burst is detected when \c burst_packets packets arrive with less than \c frame_us between each
+ * of them, so power save is disabled at most one frame time after the burst started. A TX queue
+ * depth of \c queue_depth or more boosts immediately.
+ *
+ * This file has no dependencies on the RTOS or the cyw43_driver so that it can be built and
+ * exercised on a host; time is always passed in by the caller. \ref cyw43_pm_policy_replay
+ * replays a trace of packet timestamps against a simple radio model to compare configurations.
+ */
+
+// PICO_CONFIG: CYW43_PM_POLICY_FRAME_US, Packets closer together than this many microseconds belong to the same burst, type=int, default=2000, group=pico_cyw43_arch
+#ifndef CYW43_PM_POLICY_FRAME_US
+#define CYW43_PM_POLICY_FRAME_US 2000
+#endif
+
+// PICO_CONFIG: CYW43_PM_POLICY_BURST_PACKETS, Number of back to back packets which start a burst, type=int, default=2, group=pico_cyw43_arch
+#ifndef CYW43_PM_POLICY_BURST_PACKETS
+#define CYW43_PM_POLICY_BURST_PACKETS 2
+#endif
+
+// PICO_CONFIG: CYW43_PM_POLICY_QUEUE_DEPTH, TX queue depth which boosts immediately, type=int, default=2, group=pico_cyw43_arch
+#ifndef CYW43_PM_POLICY_QUEUE_DEPTH
+#define CYW43_PM_POLICY_QUEUE_DEPTH 2
+#endif
+
+// PICO_CONFIG: CYW43_PM_POLICY_IDLE_US, Idle time in microseconds after which power save is re-enabled, type=int, default=200000, group=pico_cyw43_arch
+#ifndef CYW43_PM_POLICY_IDLE_US
+#define CYW43_PM_POLICY_IDLE_US 200000
+#endif
+
+/**
+ * \brief Configuration for a \ref cyw43_pm_policy_t
+ * \ingroup cyw43_pm_policy
+ */
+typedef struct cyw43_pm_policy_config {
+    uint32_t frame_us;      ///< packets closer together than this belong to the same burst
+    uint32_t burst_packets; ///< back to back packets which start a burst
+    uint32_t queue_depth;   ///< TX queue depth which starts a burst
+    uint32_t idle_us;       ///< idle window after which power save is re-enabled
+} cyw43_pm_policy_config_t;
+
+/**
+ * \brief Governor state
+ * \ingroup cyw43_pm_policy
+ */
+typedef struct cyw43_pm_policy {
+    cyw43_pm_policy_config_t config;
+    uint64_t last_packet_us;
+    uint32_t run_packets;
+    uint32_t queue_depth;
+    bool boosted;
+    // statistics
+    uint32_t tx_packets;
+    uint32_t rx_packets;
+    uint32_t boosts;
+} cyw43_pm_policy_t;
+
+/**
+ * \brief Simple radio model used by \ref cyw43_pm_policy_replay
+ * \ingroup cyw43_pm_policy
+ */
+typedef struct cyw43_pm_policy_radio_model {
+    uint32_t ps_wake_latency_us; ///< latency added to a packet handled while in power save
+    uint32_t ps_awake_us;        ///< time the radio stays on after a packet handled in power save
+    uint32_t ps_idle_duty_ppm;   ///< radio on time while idle in power save (beacon reception), parts per million
+} cyw43_pm_policy_radio_model_t;
+
+/**
+ * \brief Result of \ref cyw43_pm_policy_replay
+ * \ingroup cyw43_pm_policy
+ */
+typedef struct cyw43_pm_policy_replay_report {
+    uint32_t packets;              ///< packets replayed
+    uint32_t packets_in_ps;        ///< packets which arrived while power save was on
+    uint32_t boosts;               ///< number of times power save was disabled
+    uint32_t max_added_latency_us; ///< worst added latency of a single packet
+    uint64_t added_latency_us;     ///< total latency added by power save
+    uint64_t radio_on_us;          ///< estimated radio on time
+    uint64_t duration_us;          ///< length of the trace
+} cyw43_pm_policy_replay_report_t;
+
+/*!
+ * \brief Return the default governor configuration
+ * \ingroup cyw43_pm_policy
+ */
+static inline cyw43_pm_policy_config_t cyw43_pm_policy_default_config(void) {
+    cyw43_pm_policy_config_t config = {
+            .frame_us = CYW43_PM_POLICY_FRAME_US,
+            .burst_packets = CYW43_PM_POLICY_BURST_PACKETS,
+            .queue_depth = CYW43_PM_POLICY_QUEUE_DEPTH,
+            .idle_us = CYW43_PM_POLICY_IDLE_US,
+    };
+    return config;
+}
+
+/*!
+ * \brief Return a radio model roughly matching PM2 with a 100 TU beacon interval
+ * \ingroup cyw43_pm_policy
+ */
+static inline cyw43_pm_policy_radio_model_t cyw43_pm_policy_default_radio_model(void) {
+    cyw43_pm_policy_radio_model_t model = {
+            .ps_wake_latency_us = 51200,
+            .ps_awake_us = 200000,
+            .ps_idle_duty_ppm = 30000,
+    };
+    return model;
+}
+
+/*!
+ * \brief Initialize a governor instance
+ * \ingroup cyw43_pm_policy
+ *
+ * \param policy the governor to initialize
+ * \param config the configuration to use, or NULL for the defaults
+ */
+void cyw43_pm_policy_init(cyw43_pm_policy_t *policy, const cyw43_pm_policy_config_t *config);
+
+/*!
+ * \brief Forget the packet history and counters of a governor, keeping its configuration
+ * \ingroup cyw43_pm_policy
+ *
+ * \param policy the governor
+ */
+void cyw43_pm_policy_reset(cyw43_pm_policy_t *policy);
+
+/*!
+ * \brief Account for a packet sent or received at the given time
+ * \ingroup cyw43_pm_policy
+ *
+ * \param policy the governor instance
+ * \param rx true for a received packet, false for a transmitted one
+ * \param now_us the current time in microseconds
+ * \return true if the boost state changed as a result of this packet
+ */
+bool cyw43_pm_policy_packet(cyw43_pm_policy_t *policy, bool rx, uint64_t now_us);
+
+/*!
+ * \brief Update the TX queue depth
+ * \ingroup cyw43_pm_policy
+ *
+ * \param policy the governor instance
+ * \param depth the number of frames waiting to be sent
+ * \param now_us the current time in microseconds
+ * \return true if the boost state changed
+ */
+bool cyw43_pm_policy_queue_depth(cyw43_pm_policy_t *policy, uint32_t depth, uint64_t now_us);
+
+/*!
+ * \brief Re-evaluate the governor in the absence of traffic
+ * \ingroup cyw43_pm_policy
+ *
+ * \param policy the governor instance
+ * \param now_us the current time in microseconds
+ * \return true if the boost state changed
+ */
+bool cyw43_pm_policy_poll(cyw43_pm_policy_t *policy, uint64_t now_us);
+
+/*!
+ * \brief Return the time at which \ref cyw43_pm_policy_poll should next be called
+ * \ingroup cyw43_pm_policy
+ *
+ * \param policy the governor instance
+ * \return the time in microseconds, or 0 if the governor is not boosted and needs no polling
+ */
+uint64_t cyw43_pm_policy_next_poll_us(const cyw43_pm_policy_t *policy);
+
+/*!
+ * \brief Return whether the governor currently wants power save disabled
+ * \ingroup cyw43_pm_policy
+ */
+static inline bool cyw43_pm_policy_boosted(const cyw43_pm_policy_t *policy) {
+    return policy->boosted;
+}
+
+/*!
+ * \brief Replay a trace of packet timestamps through a governor
+ * \ingroup cyw43_pm_policy
+ *
+ * The timestamps must be in ascending order. A packet arriving in power save keeps the radio on for
+ * \c ps_awake_us; if the radio was asleep it is charged \c ps_wake_latency_us of added latency, and
+ * if it was still awake from an earlier packet nothing is added. While boosted the radio is on and no
+ * latency is added. The trace runs from its first to its last timestamp and neither boosted nor
+ * awake time is counted beyond it; for the rest of the trace the radio is on for
+ * \c ps_idle_duty_ppm of the time.
+ *
+ * \param config the governor configuration to evaluate, or NULL for the defaults
+ * \param model the radio model, or NULL for \ref cyw43_pm_policy_default_radio_model
+ * \param timestamps_us packet timestamps in microseconds
+ * \param count number of timestamps
+ * \param report filled in with the result
+ */
+void cyw43_pm_policy_replay(const cyw43_pm_policy_config_t *config, const cyw43_pm_policy_radio_model_t *model,
+                            const uint64_t *timestamps_us, size_t count, cyw43_pm_policy_replay_report_t *report);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
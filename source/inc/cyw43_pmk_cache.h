@@ -0,0 +1,218 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _CYW43_PMK_CACHE_H
+#define _CYW43_PMK_CACHE_H
+
+#include "pico.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/** \file cyw43_pmk_cache.h
+ *  \defgroup cyw43_pmk_cache cyw43_pmk_cache
+ *  \ingroup pico_cyw43_arch
+ *
+ * A cache of WPA2 pairwise master keys. Given a passphrase, the firmware derives the PMK with
+ * PBKDF2-SHA1 over 4096 iterations on every join. Given 64 hex digits instead, it uses them as the
+ * PMK directly, so caching the PMK on the host takes the derivation out of every join after the
+ * first.
+ *
+ * Entries are keyed by the SSID and a hash of the SSID and passphrase; the passphrase itself is
+ * never stored. On a miss the join goes ahead with the passphrase and the PMK is derived in the
+ * background, so the first join is no slower than without the cache.
+ */
+
+// PICO_CONFIG: CYW43_PMK_CACHE, Enable the WPA2 PMK cache, type=bool, default=0, group=pico_cyw43_arch
+#ifndef CYW43_PMK_CACHE
+#define CYW43_PMK_CACHE 0
+#endif
+
+// PICO_CONFIG: CYW43_PMK_CACHE_ENTRIES, Number of networks the PMK cache remembers, type=int, default=4, group=pico_cyw43_arch
+#ifndef CYW43_PMK_CACHE_ENTRIES
+#define CYW43_PMK_CACHE_ENTRIES 4
+#endif
+
+// PICO_CONFIG: CYW43_PMK_THREAD_STACK_SIZE, Stack size of the thread deriving keys in the background, type=int, default=1024, group=pico_cyw43_arch
+#ifndef CYW43_PMK_THREAD_STACK_SIZE
+#define CYW43_PMK_THREAD_STACK_SIZE 1024
+#endif
+
+// PICO_CONFIG: CYW43_PMK_THREAD_PRIORITY, Priority of the thread deriving keys in the background, type=int, default=RT_THREAD_PRIORITY_MAX - 2, group=pico_cyw43_arch
+#ifndef CYW43_PMK_THREAD_PRIORITY
+#define CYW43_PMK_THREAD_PRIORITY (RT_THREAD_PRIORITY_MAX - 2)
+#endif
+
+// PICO_CONFIG: PARAM_ASSERTIONS_ENABLED_CYW43_PMK_CACHE, Enable/disable assertions in the cyw43_pmk_cache module, type=bool, default=0, group=pico_cyw43_arch
+#ifndef PARAM_ASSERTIONS_ENABLED_CYW43_PMK_CACHE
+#define PARAM_ASSERTIONS_ENABLED_CYW43_PMK_CACHE 0
+#endif
+
+#define CYW43_PMK_LEN          32
+#define CYW43_PMK_HEX_LEN      (CYW43_PMK_LEN * 2)
+#define CYW43_PMK_KEY_HASH_LEN 20
+
+/**
+ * \brief A cache entry, as handed to the store callback and back to \ref cyw43_pmk_cache_add
+ * \ingroup cyw43_pmk_cache
+ */
+typedef struct cyw43_pmk_entry {
+    uint8_t ssid_len;
+    uint8_t ssid[32];
+    uint8_t key_hash[CYW43_PMK_KEY_HASH_LEN]; ///< SHA1 of the SSID followed by the passphrase
+    uint8_t pmk[CYW43_PMK_LEN];
+} cyw43_pmk_entry_t;
+
+/**
+ * \brief Join time counters, split by whether the join used a cached PMK
+ * \ingroup cyw43_pmk_cache
+ */
+typedef struct cyw43_pmk_join_stats {
+    uint32_t joins;
+    uint32_t last_us;
+    uint32_t max_us;
+    uint64_t total_us;
+} cyw43_pmk_join_stats_t;
+
+/**
+ * \brief PMK cache counters
+ * \ingroup cyw43_pmk_cache
+ */
+typedef struct cyw43_pmk_cache_stats {
+    uint32_t hits;
+    uint32_t misses;
+    uint32_t derivations;
+    uint32_t derive_us;                ///< time taken by the last derivation
+    cyw43_pmk_join_stats_t join[2];    ///< indexed by whether the cache was used
+} cyw43_pmk_cache_stats_t;
+
+/*!
+ * \brief Initialize the PMK cache
+ * \ingroup cyw43_pmk_cache
+ *
+ * Safe to call more than once; later calls do nothing.
+ */
+void cyw43_pmk_cache_init(void);
+
+/*!
+ * \brief Check whether a key is a PMK given as 64 hex digits rather than a passphrase
+ * \ingroup cyw43_pmk_cache
+ *
+ * \param key the key
+ * \param len length of key
+ * \return true if the key is a PMK
+ */
+bool cyw43_pmk_cache_is_pmk(const uint8_t *key, size_t len);
+
+/*!
+ * \brief Derive a PMK from a passphrase
+ * \ingroup cyw43_pmk_cache
+ *
+ * This is PBKDF2-SHA1 with 4096 iterations and takes the better part of a second, so it should
+ * not be called from the async_context.
+ *
+ * \param ssid the network name
+ * \param ssid_len length of ssid, at most 32
+ * \param passphrase the passphrase
+ * \param passphrase_len length of passphrase, 8 to 63
+ * \param pmk filled in with the key
+ */
+void cyw43_pmk_derive(const uint8_t *ssid, size_t ssid_len, const uint8_t *passphrase, size_t passphrase_len,
+                      uint8_t pmk[CYW43_PMK_LEN]);
+
+/*!
+ * \brief Choose the key to join a network with
+ * \ingroup cyw43_pmk_cache
+ *
+ * If the PMK for the network and passphrase is cached, it is written to pmk_hex and used as the key.
+ * Otherwise the passphrase is used, and the PMK is derived in the background for next time.
+ * Passphrases which are already 64 hex digits are used as they are.
+ *
+ * \param ssid the network name
+ * \param ssid_len length of ssid
+ * \param passphrase the passphrase
+ * \param key_len on entry the length of passphrase, on return the length of the key to use
+ * \param pmk_hex buffer for the cached key
+ * \return the key to pass to cyw43_wifi_join, either passphrase or pmk_hex
+ */
+const uint8_t *cyw43_pmk_cache_join_key(const uint8_t *ssid, size_t ssid_len, const uint8_t *passphrase,
+                                        size_t *key_len, uint8_t pmk_hex[CYW43_PMK_HEX_LEN]);
+
+/*!
+ * \brief Hash a network name and passphrase the way the cache identifies its entries
+ * \ingroup cyw43_pmk_cache
+ *
+ * This lets a caller find the PMK again later with \ref cyw43_pmk_cache_lookup without keeping the
+ * passphrase.
+ *
+ * \param ssid the network name
+ * \param ssid_len length of ssid, at most 32
+ * \param passphrase the passphrase
+ * \param passphrase_len length of passphrase, at most 64
+ * \param hash filled in with the hash
+ */
+void cyw43_pmk_cache_key_hash(const uint8_t *ssid, size_t ssid_len, const uint8_t *passphrase, size_t passphrase_len,
+                              uint8_t hash[CYW43_PMK_KEY_HASH_LEN]);
+
+/*!
+ * \brief Look up the PMK for a network by the hash of its passphrase
+ * \ingroup cyw43_pmk_cache
+ *
+ * Unlike \ref cyw43_pmk_cache_join_key this doesn't count as a hit or a miss, and nothing is
+ * derived if the entry is missing.
+ *
+ * \param ssid the network name
+ * \param ssid_len length of ssid
+ * \param hash the hash from \ref cyw43_pmk_cache_key_hash
+ * \param pmk_hex filled in with the key if it is cached
+ * \return true if the key is cached
+ */
+bool cyw43_pmk_cache_lookup(const uint8_t *ssid, size_t ssid_len, const uint8_t hash[CYW43_PMK_KEY_HASH_LEN],
+                            uint8_t pmk_hex[CYW43_PMK_HEX_LEN]);
+
+/*!
+ * \brief Add an entry, for example one restored from flash
+ * \ingroup cyw43_pmk_cache
+ *
+ * The least recently used entry is replaced if the cache is full.
+ */
+void cyw43_pmk_cache_add(const cyw43_pmk_entry_t *entry);
+
+/*!
+ * \brief Forget every entry
+ * \ingroup cyw43_pmk_cache
+ */
+void cyw43_pmk_cache_clear(void);
+
+/*!
+ * \brief Set a function to be called with every newly derived entry, so it can be persisted
+ * \ingroup cyw43_pmk_cache
+ *
+ * The callback is called from the thread deriving the key.
+ */
+void cyw43_pmk_cache_set_store_callback(void (*store)(const cyw43_pmk_entry_t *entry));
+
+/*!
+ * \brief Record how long a join took
+ * \ingroup cyw43_pmk_cache
+ *
+ * \param cached whether the join used a key from \ref cyw43_pmk_cache_join_key
+ * \param join_us time from starting the join to the link coming up
+ */
+void cyw43_pmk_cache_note_join(bool cached, uint32_t join_us);
+
+/*!
+ * \brief Return the cache counters
+ * \ingroup cyw43_pmk_cache
+ */
+void cyw43_pmk_cache_get_stats(cyw43_pmk_cache_stats_t *stats);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -4,11 +4,13 @@
  * SPDX-License-Identifier: BSD-3-Clause
  */
 
+#include <stddef.h>
 #include <string.h>
 #include "async_context_rtthread.h"
 #include "pico/async_context_base.h"
 #include "pico/sync.h"
 #include "hardware/irq.h"
+#include "cyw43_latency.h"
 
 #if configNUM_CORES > 1 && !defined(configUSE_CORE_AFFINITY)
 #error async_context_rtthread requires configUSE_CORE_AFFINITY under SMP
@@ -45,16 +47,19 @@ static void process_under_lock(async_context_rtthread_t *self) {
     do {
         repeat = false;
         absolute_time_t next_time = async_context_base_execute_once(&self->core);
-        rt_uint32_t ticks;
+        self->next_deadline = next_time;
         if (is_at_the_end_of_time(next_time)) {
-            ticks = RT_TICK_MAX / 2 - 1;
-        } else {
-            ticks = sensible_ticks_until(next_time);
+            // nothing is scheduled, so don't leave a timer armed; that lets a tickless idle
+            // sleep for as long as the rest of the system allows
+            rt_timer_stop(self->timer_handle);
+            continue;
         }
+        rt_uint32_t ticks = sensible_ticks_until(next_time);
         if (ticks) {
-            // last parameter (timeout) is also 'ticks', since there is no point waiting to change the period
-            // for longer than the period itself!
-            repeat = RT_EOK != rt_timer_control(self->timer_handle, RT_TIMER_CTRL_SET_TIME, &ticks);
+            // the timer is one-shot and re-armed on every pass, so the next timeout the kernel
+            // (and hence RT-Thread PM) sees is exactly our next deadline
+            rt_timer_control(self->timer_handle, RT_TIMER_CTRL_SET_TIME, &ticks);
+            repeat = RT_EOK != rt_timer_start(self->timer_handle);
         } else {
             repeat = true;
         }
@@ -65,14 +70,38 @@ static void async_context_task(void *param) {
     async_context_rtthread_t *self = (async_context_rtthread_t *)param;
     rt_uint32_t e;
     do {
-        rt_event_recv(self->notify_event, 1, RT_EVENT_FLAG_CLEAR | RT_EVENT_FLAG_AND, RT_TICK_MAX / 2 - 1, &e);
+        rt_event_recv(self->notify_event, 1, RT_EVENT_FLAG_CLEAR | RT_EVENT_FLAG_AND, RT_WAITING_FOREVER, &e);
         if (self->task_should_exit) break;
+        uint64_t woken_us = time_us_64();
+        self->wakeups++;
+        CYW43_LATENCY_WOKEN();
+        CYW43_LATENCY_START(lock_start_us);
         async_context_rtthread_acquire_lock_blocking(&self->core);
+        CYW43_LATENCY_END(CYW43_LATENCY_WAKE_TO_LOCK, lock_start_us);
+        CYW43_LATENCY_START(process_start_us);
         process_under_lock(self);
+        CYW43_LATENCY_END(CYW43_LATENCY_PROCESS, process_start_us);
         async_context_rtthread_release_lock(&self->core);
+        self->busy_us += time_us_64() - woken_us;
         __sev(); // it is possible regular code is waiting on a WFE on the other core
     } while (!self->task_should_exit);
+#if ASYNC_CONTEXT_RTTHREAD_STATIC
+    // the thread object and our stack belong to self, which may be reused once deinit returns, so
+    // we must not run again once it has been told we are done; it detaches us while we are suspended
+    rt_enter_critical();
+    rt_sem_release(self->task_exit_sem);
+    rt_thread_suspend(rt_thread_self());
+    rt_exit_critical();
+#else
+    // deinit deletes the objects we were using once we are done with them
+    rt_sem_release(self->task_exit_sem);
     rt_thread_delete(rt_thread_self());
+#endif
+}
+
+static void signal_task(async_context_rtthread_t *self) {
+    rt_sem_release(self->work_needed_sem);
+    rt_event_send(self->notify_event, 1);
 }
 
 static void async_context_rtthread_wake_up(async_context_t *self_base) {
@@ -80,15 +109,22 @@ static void async_context_rtthread_wake_up(async_context_t *self_base) {
     if (self->task_handle) {
         rt_bool_t in_isr = rt_interrupt_get_nest() > 0;
         if (in_isr) {
-            rt_sem_release(self->work_needed_sem);
-            rt_event_send(self->notify_event, 1);
+            CYW43_LATENCY_IRQ();
+            uint32_t save = save_and_disable_interrupts();
+            bool defer = self->irq_polling;
+            if (defer) {
+                // poll_timer_handler picks this up
+                self->irq_pending = true;
+                self->irqs_deferred++;
+            }
+            restore_interrupts(save);
+            if (!defer) signal_task(self);
         } else {
             // We don't want to wake ourselves up (we will only ever be called
             // from the async_context_task if we own the lock, in which case processing
             // will already happen when the lock is finally unlocked.
             if (rt_thread_self() != self->task_handle) {
-                rt_sem_release(self->work_needed_sem);
-                rt_event_send(self->notify_event, 1);
+                signal_task(self);
             } else {
     #ifndef NDEBUG
                 async_context_rtthread_lock_check(self_base);
@@ -101,7 +137,28 @@ static void async_context_rtthread_wake_up(async_context_t *self_base) {
 static void timer_handler(void *parameter)
 {
     async_context_rtthread_t *self = (async_context_rtthread_t *)parameter;
-    async_context_rtthread_wake_up(&self->core);
+    // at-time workers are due, which is never deferred even in IRQ polling mode
+    if (self->task_handle) signal_task(self);
+}
+
+static void poll_timer_handler(void *parameter)
+{
+    async_context_rtthread_t *self = (async_context_rtthread_t *)parameter;
+    uint32_t save = save_and_disable_interrupts();
+    bool pending = self->irq_pending;
+    self->irq_pending = false;
+    if (!pending) {
+        // a whole interval without an interrupt, so the source has gone quiet
+        self->irq_polling = false;
+        self->poll_exits++;
+    }
+    restore_interrupts(save);
+    if (!pending) {
+        rt_timer_stop(self->poll_timer);
+    }
+    // signal on the way out of polling mode too, so an interrupt deferred by the other core while
+    // we were switching back can't be left waiting
+    signal_task(self);
 }
 
 bool async_context_rtthread_init(async_context_rtthread_t *self, async_context_rtthread_config_t *config) {
@@ -109,18 +166,42 @@ bool async_context_rtthread_init(async_context_rtthread_t *self, async_context_r
     self->core.type = &template;
     self->core.flags = ASYNC_CONTEXT_FLAG_CALLBACK_FROM_NON_IRQ;
     self->core.core_num = get_core_num();
+    rt_tick_t poll_ticks = config->irq_poll_ticks ? config->irq_poll_ticks : 1;
+#if ASYNC_CONTEXT_RTTHREAD_STATIC
+    // none of these can fail on statically allocated objects
+    rt_mutex_init(&self->lock_mutex_obj, "async_lock", RT_IPC_FLAG_PRIO);
+    self->lock_mutex = &self->lock_mutex_obj;
+    rt_sem_init(&self->work_needed_sem_obj, "async_sem", 0, RT_IPC_FLAG_PRIO);
+    self->work_needed_sem = &self->work_needed_sem_obj;
+    rt_event_init(&self->notify_event_obj, "notify_event", RT_IPC_FLAG_PRIO);
+    self->notify_event = &self->notify_event_obj;
+    rt_sem_init(&self->task_exit_sem_obj, "async_exit", 0, RT_IPC_FLAG_PRIO);
+    self->task_exit_sem = &self->task_exit_sem_obj;
+    rt_thread_init(&self->task_obj, "async_context_task", async_context_task, self, self->task_stack, sizeof(self->task_stack), config->task_priority, 20);
+    self->task_handle = &self->task_obj;
+    rt_timer_init(&self->timer_obj, "async_context_timer", timer_handler, self, 1, RT_TIMER_FLAG_ONE_SHOT);
+    self->timer_handle = &self->timer_obj;
+    rt_timer_init(&self->poll_timer_obj, "async_poll_timer", poll_timer_handler, self, poll_ticks, RT_TIMER_FLAG_PERIODIC);
+    self->poll_timer = &self->poll_timer_obj;
+#else
     self->lock_mutex = rt_mutex_create("async_lock", RT_IPC_FLAG_PRIO);
     self->work_needed_sem = rt_sem_create("async_sem", 0, RT_IPC_FLAG_PRIO);
     self->notify_event = rt_event_create("notify_event", RT_IPC_FLAG_PRIO);
+    self->task_exit_sem = rt_sem_create("async_exit", 0, RT_IPC_FLAG_PRIO);
     self->task_handle = rt_thread_create("async_context_task", async_context_task, self, config->task_stack_size, config->task_priority, 20);
-    self->timer_handle = rt_timer_create("async_context_timer", timer_handler, self, RT_TICK_MAX / 2 - 1, RT_TIMER_FLAG_PERIODIC);
-    rt_timer_start(self->timer_handle);
+    // the timer is only started once there is an at-time worker to run
+    self->timer_handle = rt_timer_create("async_context_timer", timer_handler, self, 1, RT_TIMER_FLAG_ONE_SHOT);
+    self->poll_timer = rt_timer_create("async_poll_timer", poll_timer_handler, self, poll_ticks, RT_TIMER_FLAG_PERIODIC);
+#endif
+    self->next_deadline = at_the_end_of_time;
     rt_thread_startup(self->task_handle);
 
     if (!self->lock_mutex ||
         !self->work_needed_sem ||
         !self->notify_event ||
+        !self->task_exit_sem ||
         !self->timer_handle ||
+        !self->poll_timer ||
         !self->task_handle
         ) {
         async_context_deinit(&self->core);
@@ -148,11 +229,51 @@ void async_context_rtthread_deinit(async_context_t *self_base) {
     async_context_rtthread_t *self = (async_context_rtthread_t *)self_base;
     if (self->task_handle) {
         async_context_execute_sync(self_base, end_task_func, self_base);
+        // the sync call returns while the task still holds the lock, so wait for it to be done
+        // with the lock and everything else before they go
+        if (self->task_exit_sem) rt_sem_take(self->task_exit_sem, RT_WAITING_FOREVER);
+    }
+#if ASYNC_CONTEXT_RTTHREAD_STATIC
+    if (self->task_handle) {
+        rt_thread_detach(&self->task_obj);
+        // the idle thread still has to take the detached thread off its defunct list; until it
+        // has, the thread object and stack are the kernel's, and can't be initialized again
+        while (!rt_list_isempty(&self->task_obj.tlist)) {
+            rt_thread_mdelay(1);
+        }
+    }
+    if (self->task_exit_sem) {
+        rt_sem_detach(self->task_exit_sem);
+    }
+    if (self->timer_handle) {
+        rt_timer_stop(self->timer_handle);
+        rt_timer_detach(self->timer_handle);
+    }
+    if (self->poll_timer) {
+        rt_timer_stop(self->poll_timer);
+        rt_timer_detach(self->poll_timer);
+    }
+    if (self->lock_mutex) {
+        rt_mutex_detach(self->lock_mutex);
+    }
+    if (self->work_needed_sem) {
+        rt_sem_detach(self->work_needed_sem);
+    }
+    if (self->notify_event) {
+        rt_event_detach(self->notify_event);
+    }
+#else
+    if (self->task_exit_sem) {
+        rt_sem_delete(self->task_exit_sem);
     }
     if (self->timer_handle) {
         rt_timer_stop(self->timer_handle);
         rt_timer_delete(self->timer_handle);
     }
+    if (self->poll_timer) {
+        rt_timer_stop(self->poll_timer);
+        rt_timer_delete(self->poll_timer);
+    }
     if (self->lock_mutex) {
         rt_mutex_delete(self->lock_mutex);
     }
@@ -162,15 +283,139 @@ void async_context_rtthread_deinit(async_context_t *self_base) {
     if (self->notify_event) {
         rt_event_delete(self->notify_event);
     }
+#endif
+#if ASYNC_CONTEXT_RTTHREAD_STATIC
+    // the kernel objects at the end are detached, and rt_*_init sets them up again from scratch
+    memset(self, 0, offsetof(async_context_rtthread_t, lock_mutex_obj));
+#else
     memset(self, 0, sizeof(*self));
+#endif
+}
+
+// RT-Thread fills a new thread's stack with this
+#define STACK_FILL '#'
+
+uint32_t async_context_rtthread_get_stack_high_water(async_context_rtthread_t *self) {
+    rt_thread_t thread = self->task_handle;
+    if (!thread) return 0;
+    // the stack grows down, so the untouched part is at the bottom
+    const rt_uint8_t *p = (const rt_uint8_t *)thread->stack_addr;
+    const rt_uint8_t *end = p + thread->stack_size;
+    while (p < end && *p == STACK_FILL) p++;
+    return (uint32_t)(end - p);
+}
+
+void async_context_rtthread_reset_stack_high_water(async_context_rtthread_t *self) {
+#ifndef RT_USING_SMP
+    rt_thread_t thread = self->task_handle;
+    if (!thread || thread == rt_thread_self()) return;
+    rt_enter_critical();
+    // the task is not running, so nothing below its saved stack pointer is in use
+    rt_uint8_t *bottom = (rt_uint8_t *)thread->stack_addr;
+    rt_uint8_t *sp = (rt_uint8_t *)thread->sp;
+    if (sp > bottom && sp <= bottom + thread->stack_size) {
+        memset(bottom, STACK_FILL, (size_t)(sp - bottom));
+    }
+    rt_exit_critical();
+#else
+    (void)self;
+#endif
 }
 
+void async_context_rtthread_enter_irq_polling(async_context_rtthread_t *self) {
+    uint32_t save = save_and_disable_interrupts();
+    bool entered = !self->irq_polling;
+    if (entered) {
+        self->irq_polling = true;
+        self->irq_pending = false;
+        self->poll_enters++;
+    }
+    restore_interrupts(save);
+    if (entered) rt_timer_start(self->poll_timer);
+}
+
+void async_context_rtthread_get_poll_stats(async_context_rtthread_t *self, async_context_rtthread_poll_stats_t *stats) {
+    uint32_t save = save_and_disable_interrupts();
+    stats->polling = self->irq_polling;
+    stats->enters = self->poll_enters;
+    stats->exits = self->poll_exits;
+    stats->irqs_deferred = self->irqs_deferred;
+    restore_interrupts(save);
+}
+
+#if ASYNC_CONTEXT_RTTHREAD_LOCK_PROFILE
+// must be called with the lock held
+static async_context_rtthread_lock_stats_t *lock_stats_for(async_context_rtthread_t *self, rt_thread_t thread) {
+    uint i;
+    for (i = 0; i < ASYNC_CONTEXT_RTTHREAD_LOCK_PROFILE_THREADS; i++) {
+        async_context_rtthread_lock_stats_t *stats = &self->lock_stats[i];
+        if (stats->thread == thread) return stats;
+        if (!stats->thread) {
+            stats->thread = thread;
+            rt_strncpy(stats->name, thread->name, RT_NAME_MAX);
+            return stats;
+        }
+    }
+    // out of slots; everyone else shares the last one
+    return &self->lock_stats[i];
+}
+
+static void lock_profile_acquired(async_context_rtthread_t *self, bool nested, bool contended, uint32_t wait_start_us) {
+    async_context_rtthread_lock_stats_t *stats = lock_stats_for(self, rt_thread_self());
+    if (nested) {
+        stats->nested++;
+        return;
+    }
+    uint32_t now_us = time_us_32();
+    uint32_t wait_us = now_us - wait_start_us;
+    stats->acquires++;
+    if (contended) stats->contended++;
+    stats->wait_us += wait_us;
+    if (wait_us > stats->max_wait_us) stats->max_wait_us = wait_us;
+    self->hold_start_us = now_us;
+}
+
+static void lock_profile_releasing(async_context_rtthread_t *self) {
+    async_context_rtthread_lock_stats_t *stats = lock_stats_for(self, rt_thread_self());
+    uint32_t hold_us = time_us_32() - self->hold_start_us;
+    stats->hold_us += hold_us;
+    if (hold_us > stats->max_hold_us) stats->max_hold_us = hold_us;
+}
+
+uint32_t async_context_rtthread_lock_profile_get(async_context_rtthread_t *self, async_context_rtthread_lock_stats_t *stats, uint32_t max) {
+    uint32_t count = 0;
+    async_context_rtthread_acquire_lock_blocking(&self->core);
+    for (uint i = 0; i <= ASYNC_CONTEXT_RTTHREAD_LOCK_PROFILE_THREADS && count < max; i++) {
+        if (self->lock_stats[i].acquires || self->lock_stats[i].nested) {
+            stats[count++] = self->lock_stats[i];
+        }
+    }
+    async_context_rtthread_release_lock(&self->core);
+    return count;
+}
+
+void async_context_rtthread_lock_profile_reset(async_context_rtthread_t *self) {
+    async_context_rtthread_acquire_lock_blocking(&self->core);
+    memset(self->lock_stats, 0, sizeof(self->lock_stats));
+    async_context_rtthread_release_lock(&self->core);
+}
+#endif
+
 void async_context_rtthread_acquire_lock_blocking(async_context_t *self_base) {
     async_context_rtthread_t *self = (async_context_rtthread_t *)self_base;
     // Lock the other core and stop low_prio_irq running
     RT_ASSERT(!rt_interrupt_get_nest());
-    rt_mutex_take(self->lock_mutex, RT_TICK_MAX / 2 - 1);
+#if ASYNC_CONTEXT_RTTHREAD_LOCK_PROFILE
+    rt_thread_t owner = self->lock_mutex->owner;
+    bool nested = owner == rt_thread_self();
+    bool contended = owner && !nested;
+    uint32_t wait_start_us = time_us_32();
+#endif
+    rt_mutex_take(self->lock_mutex, RT_WAITING_FOREVER);
     self->nesting++;
+#if ASYNC_CONTEXT_RTTHREAD_LOCK_PROFILE
+    lock_profile_acquired(self, nested, contended, wait_start_us);
+#endif
 }
 
 void async_context_rtthread_lock_check(__unused async_context_t *self_base) {
@@ -183,6 +428,9 @@ void async_context_rtthread_lock_check(__unused async_context_t *self_base) {
 
 typedef struct sync_func_call{
     async_when_pending_worker_t worker;
+#if ASYNC_CONTEXT_RTTHREAD_STATIC
+    struct rt_semaphore sem_obj;
+#endif
     rt_sem_t sem;
     uint32_t (*func)(void *param);
     void *param;
@@ -192,8 +440,9 @@ typedef struct sync_func_call{
 static void handle_sync_func_call(async_context_t *context, async_when_pending_worker_t *worker) {
     sync_func_call_t *call = (sync_func_call_t *)worker;
     call->rc = call->func(call->param);
-    rt_sem_release(call->sem);
+    // the caller's stack holds the call, so it must not be touched once the caller is released
     async_context_remove_when_pending_worker(context, worker);
+    rt_sem_release(call->sem);
 }
 
 uint32_t async_context_rtthread_execute_sync(async_context_t *self_base, uint32_t (*func)(void *param), void *param) {
@@ -201,15 +450,25 @@ uint32_t async_context_rtthread_execute_sync(async_context_t *self_base, uint32_
     // Use RT-Thread's assertion mechanism
     RT_ASSERT(self->lock_mutex->owner != rt_thread_self());
 
-    sync_func_call_t call;
+    sync_func_call_t call = {0};
     call.worker.do_work = handle_sync_func_call;
     call.func = func;
     call.param = param;
+#if ASYNC_CONTEXT_RTTHREAD_STATIC
+    // nothing is allocated from the heap in this configuration
+    rt_sem_init(&call.sem_obj, "sync_sem", 0, RT_IPC_FLAG_PRIO);
+    call.sem = &call.sem_obj;
+#else
     call.sem = rt_sem_create("sync_sem", 0, RT_IPC_FLAG_PRIO);
+#endif
     async_context_add_when_pending_worker(self_base, &call.worker);
     async_context_set_work_pending(self_base, &call.worker);
-    rt_sem_take(call.sem, RT_TICK_MAX / 2 - 1);
+    rt_sem_take(call.sem, RT_WAITING_FOREVER);
+#if ASYNC_CONTEXT_RTTHREAD_STATIC
+    rt_sem_detach(call.sem);
+#else
     rt_sem_delete(call.sem);
+#endif
     return call.rc;
 }
 
@@ -231,6 +490,11 @@ void async_context_rtthread_release_lock(async_context_t *self_base) {
         }
     }
 
+#if ASYNC_CONTEXT_RTTHREAD_LOCK_PROFILE
+    if (self->nesting == 1) {
+        lock_profile_releasing(self);
+    }
+#endif
     --self->nesting;
     rt_mutex_release(self->lock_mutex);
 
@@ -272,6 +536,20 @@ static void async_context_rtthread_set_work_pending(async_context_t *self_base,
     async_context_rtthread_wake_up(self_base);
 }
 
+absolute_time_t async_context_rtthread_next_deadline(async_context_rtthread_t *self) {
+    return self->next_deadline;
+}
+
+uint64_t async_context_rtthread_get_busy_us(async_context_rtthread_t *self) {
+    // only written by the task, but 64 bit reads aren't atomic
+    volatile uint64_t *p = &self->busy_us;
+    uint64_t busy_us;
+    do {
+        busy_us = *p;
+    } while (busy_us != *p);
+    return busy_us;
+}
+
 static void async_context_rtthread_wait_until(async_context_t *self_base, absolute_time_t until) {
     RT_ASSERT(!rt_interrupt_get_nest());
 
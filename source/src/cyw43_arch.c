@@ -13,6 +13,18 @@
 #include "cyw43_arch.h"
 #include "cyw43_ll.h"
 #include "cyw43_stats.h"
+#include "cyw43_pm_policy.h"
+#include "cyw43_arch_datapath.h"
+#include "cyw43_arch_stats.h"
+#include "cyw43_arch_info.h"
+#include "cyw43_arch_ioctl.h"
+#include "cyw43_pmk_cache.h"
+#include "cyw43_dhcp_cache.h"
+#include "cyw43_arch_ap.h"
+#include "cyw43_arch_acs.h"
+#include "cyw43_arch_offload.h"
+#include "cyw43_arch_health.h"
+#include "cyw43_gpio_shadow.h"
 
 #if PICO_CYW43_ARCH_DEBUG_ENABLED
 #define CYW43_ARCH_DEBUG(...) printf(__VA_ARGS__)
@@ -24,13 +36,292 @@ static uint32_t country_code = PICO_CYW43_ARCH_DEFAULT_COUNTRY_CODE;
 
 static async_context_t *async_context;
 
+// CYW43_PERFORMANCE_PM is what the firmware is configured with when the interface comes up
+static cyw43_arch_pm_mode_t pm_mode = CYW43_ARCH_PM_PERFORMANCE;
+static uint32_t pm_custom_value = CYW43_PERFORMANCE_PM;
+static bool pm_auto_boost = CYW43_ARCH_PM_AUTO_BOOST;
+static cyw43_pm_policy_t pm_policy;
+
+static void pm_apply_worker_func(async_context_t *context, async_when_pending_worker_t *worker);
+static void pm_policy_timeout_func(async_context_t *context, async_at_time_worker_t *worker);
+
+static async_when_pending_worker_t pm_apply_worker = {
+        .do_work = pm_apply_worker_func,
+};
+
+static async_at_time_worker_t pm_policy_timeout = {
+        .do_work = pm_policy_timeout_func,
+};
+
 void cyw43_arch_set_async_context(async_context_t *context) {
     async_context = context;
 }
 
+static uint32_t pm_value_for_mode(cyw43_arch_pm_mode_t mode) {
+    switch (mode) {
+        case CYW43_ARCH_PM_NONE:
+            return CYW43_NONE_PM;
+        case CYW43_ARCH_PM_AGGRESSIVE:
+            return CYW43_AGGRESSIVE_PM;
+        case CYW43_ARCH_PM_CUSTOM:
+            return pm_custom_value;
+        default:
+            return CYW43_PERFORMANCE_PM;
+    }
+}
+
+static bool pm_boost_active(void) {
+    // there is nothing to boost if power save is already off
+    return pm_auto_boost && pm_mode != CYW43_ARCH_PM_NONE;
+}
+
+// must be called with the async_context lock held
+static int pm_apply(void) {
+    // nothing to do until an interface is up; the mode is applied when it comes up
+    if (!cyw43_is_initialized(&cyw43_state) || !cyw43_state.itf_state) return 0;
+    uint32_t value = pm_value_for_mode(pm_mode);
+    if (pm_boost_active() && cyw43_pm_policy_boosted(&pm_policy)) {
+        value = CYW43_NONE_PM;
+    }
+    uint32_t start_us = time_us_32();
+    return cyw43_arch_stats_ioctl(start_us, cyw43_wifi_pm(&cyw43_state, value));
+}
+
+static void pm_apply_worker_func(__unused async_context_t *context, __unused async_when_pending_worker_t *worker) {
+    int err = pm_apply();
+    if (err) CYW43_ARCH_DEBUG("failed to set power mode: %d\n", err);
+}
+
+static void pm_policy_timeout_func(async_context_t *context, async_at_time_worker_t *worker) {
+    if (cyw43_pm_policy_poll(&pm_policy, time_us_64())) {
+        if (pm_boost_active()) {
+            pm_apply_worker_func(context, &pm_apply_worker);
+        }
+    } else {
+        uint64_t next_us = cyw43_pm_policy_next_poll_us(&pm_policy);
+        if (next_us) {
+            async_context_add_at_time_worker_at(context, worker, from_us_since_boot(next_us));
+        }
+    }
+}
+
+int cyw43_arch_set_pm_mode(cyw43_arch_pm_mode_t mode) {
+    if (mode > CYW43_ARCH_PM_CUSTOM) return PICO_ERROR_INVALID_ARG;
+    cyw43_thread_enter();
+    pm_mode = mode;
+    int err = pm_apply();
+    cyw43_thread_exit();
+    return err;
+}
+
+int cyw43_arch_set_pm_custom(uint32_t pm2_sleep_ret_ms, uint8_t listen_interval, uint8_t dtim_period) {
+    if (pm2_sleep_ret_ms < 10 || pm2_sleep_ret_ms > 2550 ||
+        listen_interval < 1 || listen_interval > 15 ||
+        dtim_period < 1 || dtim_period > 15) {
+        return PICO_ERROR_INVALID_ARG;
+    }
+    cyw43_thread_enter();
+    pm_custom_value = cyw43_pm_value(CYW43_PM2_POWERSAVE_MODE, pm2_sleep_ret_ms, listen_interval, dtim_period, 10);
+    pm_mode = CYW43_ARCH_PM_CUSTOM;
+    int err = pm_apply();
+    cyw43_thread_exit();
+    return err;
+}
+
+cyw43_arch_pm_mode_t cyw43_arch_get_pm_mode(void) {
+    return pm_mode;
+}
+
+static void pm_policy_ensure_init(void) {
+    if (!pm_policy.config.burst_packets) {
+        cyw43_pm_policy_init(&pm_policy, NULL);
+    }
+}
+
+void cyw43_arch_set_pm_auto_boost(bool enable) {
+    cyw43_thread_enter();
+    pm_policy_ensure_init();
+    bool was_boosted = pm_boost_active() && cyw43_pm_policy_boosted(&pm_policy);
+    pm_auto_boost = enable;
+    cyw43_pm_policy_reset(&pm_policy);
+    if (was_boosted) {
+        pm_apply();
+    }
+    cyw43_thread_exit();
+}
+
+int cyw43_arch_set_pm_governor_config(const cyw43_pm_policy_config_t *config) {
+    if (!config || !config->frame_us || !config->idle_us) return PICO_ERROR_INVALID_ARG;
+    cyw43_thread_enter();
+    bool was_boosted = pm_boost_active() && cyw43_pm_policy_boosted(&pm_policy);
+    cyw43_pm_policy_init(&pm_policy, config);
+    if (was_boosted) {
+        pm_apply();
+    }
+    cyw43_thread_exit();
+    return 0;
+}
+
+void cyw43_arch_get_pm_governor(cyw43_pm_policy_t *policy) {
+    cyw43_thread_enter();
+    pm_policy_ensure_init();
+    *policy = pm_policy;
+    cyw43_thread_exit();
+}
+
+#if CYW43_ARCH_PM_TRACE_LEN
+static uint64_t pm_trace[CYW43_ARCH_PM_TRACE_LEN];
+static uint32_t pm_trace_count;
+
+void cyw43_arch_pm_trace_reset(void) {
+    cyw43_thread_enter();
+    pm_trace_count = 0;
+    cyw43_thread_exit();
+}
+
+uint32_t cyw43_arch_pm_trace_replay(const cyw43_pm_policy_config_t *config, const cyw43_pm_policy_radio_model_t *model,
+                                    cyw43_pm_policy_replay_report_t *report) {
+    cyw43_thread_enter();
+    uint32_t count = pm_trace_count;
+    cyw43_thread_exit();
+    // entries below count are never written again until the trace is reset
+    cyw43_pm_policy_replay(config, model, pm_trace, count, report);
+    return count;
+}
+
+uint32_t cyw43_arch_pm_trace_get(const uint64_t **timestamps_us) {
+    cyw43_thread_enter();
+    uint32_t count = pm_trace_count;
+    cyw43_thread_exit();
+    *timestamps_us = pm_trace;
+    return count;
+}
+#endif
+
+static void pm_policy_changed(void) {
+    if (!cyw43_pm_policy_boosted(&pm_policy)) return;
+    if (pm_boost_active()) {
+        // apply from the async_context rather than making the caller wait for the ioctl
+        async_context_add_when_pending_worker(async_context, &pm_apply_worker);
+        async_context_set_work_pending(async_context, &pm_apply_worker);
+    }
+    // the governor is polled even when the boost is not applied, so it can't get stuck boosted
+    async_context_remove_at_time_worker(async_context, &pm_policy_timeout);
+    async_context_add_at_time_worker_at(async_context, &pm_policy_timeout,
+                                        from_us_since_boot(cyw43_pm_policy_next_poll_us(&pm_policy)));
+}
+
+void cyw43_arch_pm_note_traffic(bool rx) {
+    // the caller holds the lock for the send or receive itself, so we piggy-back on it
+    async_context_lock_check(async_context);
+    uint64_t now_us = time_us_64();
+#if CYW43_ARCH_PM_TRACE_LEN
+    if (pm_trace_count < CYW43_ARCH_PM_TRACE_LEN) {
+        pm_trace[pm_trace_count++] = now_us;
+    }
+#endif
+    pm_policy_ensure_init();
+    if (cyw43_pm_policy_packet(&pm_policy, rx, now_us)) {
+        pm_policy_changed();
+    }
+}
+
+void cyw43_arch_pm_note_queue_depth(uint32_t depth) {
+    async_context_lock_check(async_context);
+    pm_policy_ensure_init();
+    if (cyw43_pm_policy_queue_depth(&pm_policy, depth, time_us_64())) {
+        pm_policy_changed();
+    }
+}
+
+#define APSTA_ITFS ((1 << CYW43_ITF_STA) | (1 << CYW43_ITF_AP))
+
+static cyw43_arch_ap_channel_policy_t ap_channel_policy = CYW43_ARCH_AP_CHANNEL_POLICY;
+static uint32_t ap_channel_follows;
+
+static void apsta_poll_func(async_context_t *context, async_at_time_worker_t *worker);
+
+static async_at_time_worker_t apsta_poll_worker = {
+        .do_work = apsta_poll_func
+};
+
+static bool apsta_sta_connected(void) {
+#if CYW43_LWIP
+    return cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA) >= CYW43_LINK_NOIP;
+#else
+    return cyw43_wifi_link_status(&cyw43_state, CYW43_ITF_STA) == CYW43_LINK_JOIN;
+#endif
+}
+
+// a roam to another access point of the same network doesn't take the link down, so while both
+// interfaces are up the station's channel is polled; a change is picked up by the info cache,
+// which reports it back through cyw43_arch_note_sta_channel
+static void apsta_poll_func(async_context_t *context, async_at_time_worker_t *worker) {
+    if ((cyw43_state.itf_state & APSTA_ITFS) != APSTA_ITFS) return;
+    if (ap_channel_policy == CYW43_ARCH_AP_CHANNEL_FOLLOW_STA && apsta_sta_connected()) {
+        uint32_t channel_info[3]; // hw_channel, target_channel, scan_channel
+        cyw43_arch_info_t info;
+        cyw43_arch_info_get(&info);
+        if (!cyw43_arch_ioctl(CYW43_WLC_GET(CYW43_WLC_GET_CHANNEL), channel_info, sizeof(channel_info), CYW43_ITF_STA) &&
+                channel_info[0] != info.sta_channel) {
+            cyw43_arch_info_refresh();
+        }
+    }
+    async_context_add_at_time_worker_in_ms(context, worker, CYW43_ARCH_APSTA_POLL_MS);
+}
+
+static void apsta_attach(void) {
+    async_context_t *context = cyw43_arch_async_context();
+    cyw43_thread_enter();
+    if ((cyw43_state.itf_state & APSTA_ITFS) == APSTA_ITFS) {
+        async_context_remove_at_time_worker(context, &apsta_poll_worker);
+        async_context_add_at_time_worker_in_ms(context, &apsta_poll_worker, CYW43_ARCH_APSTA_POLL_MS);
+    }
+    cyw43_thread_exit();
+}
+
+void cyw43_arch_set_ap_channel_policy(cyw43_arch_ap_channel_policy_t policy) {
+    ap_channel_policy = policy;
+    // catch up with a station which is already on another channel
+    cyw43_arch_info_refresh();
+}
+
+cyw43_arch_ap_channel_policy_t cyw43_arch_get_ap_channel_policy(void) {
+    return ap_channel_policy;
+}
+
+uint32_t cyw43_arch_get_ap_channel_follows(void) {
+    return ap_channel_follows;
+}
+
+bool cyw43_arch_note_sta_channel(uint32_t channel) {
+    if (ap_channel_policy != CYW43_ARCH_AP_CHANNEL_FOLLOW_STA || !channel) return false;
+    if (!(cyw43_state.itf_state & (1 << CYW43_ITF_AP)) || channel == cyw43_state.ap_channel) return false;
+    CYW43_ARCH_DEBUG("access point follows the station from channel %u to %u\n",
+                     (unsigned)cyw43_state.ap_channel, (unsigned)channel);
+    cyw43_wifi_ap_set_channel(&cyw43_state, channel);
+    // the channel is applied when the access point is started
+    cyw43_wifi_set_up(&cyw43_state, CYW43_ITF_AP, false, cyw43_arch_get_country_code());
+    cyw43_wifi_set_up(&cyw43_state, CYW43_ITF_AP, true, cyw43_arch_get_country_code());
+    ap_channel_follows++;
+    return true;
+}
+
 void cyw43_arch_enable_sta_mode(void) {
     assert(cyw43_is_initialized(&cyw43_state));
     cyw43_wifi_set_up(&cyw43_state, CYW43_ITF_STA, true, cyw43_arch_get_country_code());
+    cyw43_arch_datapath_attach(CYW43_ITF_STA);
+    cyw43_arch_info_attach(CYW43_ITF_STA);
+#if CYW43_ARCH_OFFLOAD
+    cyw43_arch_offload_attach();
+#endif
+#if CYW43_ARCH_HEALTH
+    cyw43_arch_health_attach();
+#endif
+    apsta_attach();
+    cyw43_thread_enter();
+    pm_apply();
+    cyw43_thread_exit();
 }
 
 void cyw43_arch_disable_sta_mode(void) {
@@ -42,6 +333,9 @@ void cyw43_arch_disable_sta_mode(void) {
     if (cyw43_state.wifi_join_state) {
         cyw43_wifi_leave(&cyw43_state, CYW43_ITF_STA);
     }
+#if CYW43_ARCH_HEALTH
+    cyw43_arch_health_note_leave();
+#endif
 }
 
 void cyw43_arch_enable_ap_mode(const char *ssid, const char *password, uint32_t auth) {
@@ -53,13 +347,41 @@ void cyw43_arch_enable_ap_mode(const char *ssid, const char *password, uint32_t
     } else {
         cyw43_wifi_ap_set_auth(&cyw43_state, CYW43_AUTH_OPEN);
     }
+    if (ap_channel_policy == CYW43_ARCH_AP_CHANNEL_FOLLOW_STA) {
+        // start where the station already is, rather than moving straight away
+        cyw43_arch_info_t info;
+        cyw43_arch_info_get(&info);
+        if (info.sta_connected && info.sta_channel) cyw43_wifi_ap_set_channel(&cyw43_state, info.sta_channel);
+    }
     cyw43_wifi_set_up(&cyw43_state, CYW43_ITF_AP, true, cyw43_arch_get_country_code());
+    cyw43_arch_datapath_attach(CYW43_ITF_AP);
+    cyw43_arch_info_attach(CYW43_ITF_AP);
+#if CYW43_ARCH_AP_STATIONS
+    cyw43_arch_ap_attach();
+#endif
+#if CYW43_ARCH_ACS
+    cyw43_arch_acs_attach();
+#endif
+#if CYW43_ARCH_HEALTH
+    cyw43_arch_health_note_ap(true);
+    cyw43_arch_health_attach();
+#endif
+    apsta_attach();
+    cyw43_thread_enter();
+    pm_apply();
+    cyw43_thread_exit();
 }
 
 void cyw43_arch_disable_ap_mode(void) {
     assert(cyw43_is_initialized(&cyw43_state));
+#if CYW43_ARCH_AP_STATIONS
+    cyw43_arch_ap_detach();
+#endif
     cyw43_wifi_set_up(&cyw43_state, CYW43_ITF_AP, false, cyw43_arch_get_country_code());
     cyw43_state.itf_state &= ~(1 << CYW43_ITF_AP);
+#if CYW43_ARCH_HEALTH
+    cyw43_arch_health_note_ap(false);
+#endif
 }
 
 #if PICO_CYW43_ARCH_DEBUG_ENABLED
@@ -87,10 +409,102 @@ static const char* cyw43_tcpip_link_status_name(int status)
 #endif
 
 
-int cyw43_arch_wifi_connect_bssid_async(const char *ssid, const uint8_t *bssid, const char *pw, uint32_t auth) {
+static cyw43_arch_connect_times_t connect_times;
+static uint32_t connect_start_us;
+static uint32_t connect_joined_us;
+static bool connect_joined;
+static bool connect_timing;
+#if CYW43_PMK_CACHE
+static bool join_cached;
+static bool join_note_pmk;
+#endif
+
+// follows a connection from the join to the address, whichever way it was started; must be called
+// with the async_context lock held, and returns false once there is nothing more to time
+static bool connect_timing_check(void) {
+    if (!connect_timing) return false;
+    uint32_t now_us = time_us_32();
+    int status = cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA);
+    // with a cached address the link may go straight to CYW43_LINK_UP
+    if (!connect_joined && (status == CYW43_LINK_NOIP || status == CYW43_LINK_UP)) {
+        connect_joined = true;
+        connect_joined_us = now_us;
+#if CYW43_PMK_CACHE
+        if (join_note_pmk) cyw43_pmk_cache_note_join(join_cached, now_us - connect_start_us);
+#endif
+    }
+    if (status == CYW43_LINK_UP) {
+        connect_times.join_us = connect_joined_us - connect_start_us;
+        connect_times.ip_us = now_us - connect_joined_us;
+#if CYW43_DHCP_CACHE
+        cyw43_dhcp_cache_note_bound();
+#endif
+        connect_timing = false;
+    } else if (status == CYW43_LINK_FAIL || status == CYW43_LINK_BADAUTH ||
+               now_us - connect_start_us >= CYW43_ARCH_CONNECT_TIMING_MAX_MS * 1000u) {
+        // a missing network is retried by the blocking connect functions, so that doesn't end it
+        connect_timing = false;
+    }
+    return connect_timing;
+}
+
+static void connect_timing_func(async_context_t *context, async_at_time_worker_t *worker) {
+    if (connect_timing_check()) {
+        async_context_add_at_time_worker_in_ms(context, worker, CYW43_ARCH_CONNECT_POLL_MS);
+    }
+}
+
+static async_at_time_worker_t connect_timing_worker = {
+        .do_work = connect_timing_func
+};
+
+static void connect_timing_start(void) {
+    cyw43_thread_enter();
+    connect_start_us = time_us_32();
+    connect_joined = false;
+    connect_timing = true;
+    async_context_remove_at_time_worker(async_context, &connect_timing_worker);
+    async_context_add_at_time_worker_in_ms(async_context, &connect_timing_worker, CYW43_ARCH_CONNECT_POLL_MS);
+    cyw43_thread_exit();
+}
+
+void cyw43_arch_wifi_time_connect(void) {
+#if CYW43_PMK_CACHE
+    // the caller chose the key, so it accounts for the PMK cache itself
+    join_note_pmk = false;
+#endif
+    connect_timing_start();
+}
+
+static int wifi_join(const char *ssid, const uint8_t *bssid, const char *pw, uint32_t auth) {
     if (!pw) auth = CYW43_AUTH_OPEN;
+    size_t key_len = pw ? strlen(pw) : 0;
+    const uint8_t *key = (const uint8_t *)pw;
+#if CYW43_PMK_CACHE
+    uint8_t pmk_hex[CYW43_PMK_HEX_LEN];
+    if (auth != CYW43_AUTH_OPEN) {
+        key = cyw43_pmk_cache_join_key((const uint8_t *)ssid, strlen(ssid), key, &key_len, pmk_hex);
+    }
+    join_cached = key == pmk_hex;
+    join_note_pmk = true;
+#endif
+#if CYW43_DHCP_CACHE
+    cyw43_dhcp_cache_join((const uint8_t *)ssid, strlen(ssid));
+#endif
+#if CYW43_ARCH_HEALTH
+    cyw43_arch_health_note_join((const uint8_t *)ssid, strlen(ssid), key, key_len, auth, bssid);
+#endif
     // Connect to wireless
-    return cyw43_wifi_join(&cyw43_state, strlen(ssid), (const uint8_t *)ssid, pw ? strlen(pw) : 0, (const uint8_t *)pw, auth, bssid, CYW43_CHANNEL_NONE);
+    int err = cyw43_wifi_join(&cyw43_state, strlen(ssid), (const uint8_t *)ssid, key_len, key, auth, bssid, CYW43_CHANNEL_NONE);
+#if CYW43_PMK_CACHE
+    memset(pmk_hex, 0, sizeof(pmk_hex));
+#endif
+    return err;
+}
+
+int cyw43_arch_wifi_connect_bssid_async(const char *ssid, const uint8_t *bssid, const char *pw, uint32_t auth) {
+    connect_timing_start();
+    return wifi_join(ssid, bssid, pw, auth);
 }
 
 int cyw43_arch_wifi_connect_async(const char *ssid, const char *pw, uint32_t auth) {
@@ -107,10 +521,15 @@ static int cyw43_arch_wifi_connect_bssid_until(const char *ssid, const uint8_t *
         // If there was no network, keep trying
         if (new_status == CYW43_LINK_NONET) {
             new_status = CYW43_LINK_JOIN;
-            err = cyw43_arch_wifi_connect_bssid_async(ssid, bssid, pw, auth);
+            // the retry is part of the same connection, so it isn't timed afresh
+            err = wifi_join(ssid, bssid, pw, auth);
             if (err) return err;
         }
         if (new_status != status) {
+            // time the change now rather than at the next check, and have the times ready on return
+            cyw43_thread_enter();
+            connect_timing_check();
+            cyw43_thread_exit();
             status = new_status;
             CYW43_ARCH_DEBUG("connect status: %s\n", cyw43_tcpip_link_status_name(status));
         }
@@ -153,6 +572,10 @@ int cyw43_arch_wifi_connect_bssid_timeout_ms(const char *ssid, const uint8_t *bs
     return cyw43_arch_wifi_connect_bssid_until(ssid, bssid, pw, auth, make_timeout_time_ms(timeout_ms));
 }
 
+void cyw43_arch_wifi_get_connect_times(cyw43_arch_connect_times_t *times) {
+    *times = connect_times;
+}
+
 uint32_t cyw43_arch_get_country_code(void) {
     return country_code;
 }
@@ -162,6 +585,87 @@ int cyw43_arch_init_with_country(uint32_t country) {
     return cyw43_arch_init();
 }
 
+#if CYW43_ARCH_GPIO_SHADOW
+// protected by the async_context lock
+static cyw43_gpio_shadow_t gpio_shadow;
+static bool gpio_flush_worker_added;
+
+static void gpio_flush_worker_func(async_context_t *context, async_when_pending_worker_t *worker);
+
+static async_when_pending_worker_t gpio_flush_worker = {
+        .do_work = gpio_flush_worker_func,
+};
+
+// must be called with the async_context lock held
+static int gpio_flush(void) {
+    uint32_t mask_value[2];
+    if (!cyw43_gpio_shadow_take(&gpio_shadow, &mask_value[0], &mask_value[1])) return 0;
+    int err = cyw43_arch_ioctl_set_var("gpioout", mask_value, sizeof(mask_value), CYW43_ITF_STA);
+    cyw43_gpio_shadow_write_done(&gpio_shadow, mask_value[0], !err);
+    if (err) CYW43_ARCH_DEBUG("writing wl gpio 0x%x failed: %d\n", (unsigned)mask_value[0], err);
+    return err;
+}
+
+static void gpio_flush_worker_func(__unused async_context_t *context, __unused async_when_pending_worker_t *worker) {
+    gpio_flush();
+}
+
+// must be called with the async_context lock held
+static void gpio_write(void) {
+    if (!cyw43_arch_in_async_context_task()) {
+        // the caller sees the pin change before the put returns, as without the shadow
+        gpio_flush();
+        return;
+    }
+    // from a worker or callback the pins are written once the current pass of the async_context is
+    // done, along with any others put in the meantime
+    if (!gpio_flush_worker_added) {
+        gpio_flush_worker_added = async_context_add_when_pending_worker(async_context, &gpio_flush_worker);
+    }
+    async_context_set_work_pending(async_context, &gpio_flush_worker);
+}
+
+void cyw43_arch_gpio_put(uint wl_gpio, bool value) {
+    invalid_params_if(CYW43_ARCH, wl_gpio >= CYW43_WL_GPIO_COUNT);
+    cyw43_thread_enter();
+    if (cyw43_gpio_shadow_put(&gpio_shadow, wl_gpio, value)) gpio_write();
+    cyw43_thread_exit();
+}
+
+bool cyw43_arch_gpio_get(uint wl_gpio) {
+    invalid_params_if(CYW43_ARCH, wl_gpio >= CYW43_WL_GPIO_COUNT);
+    bool value = false;
+    cyw43_thread_enter();
+    if (!cyw43_gpio_shadow_get(&gpio_shadow, wl_gpio, &value)) {
+        cyw43_gpio_get(&cyw43_state, (int)wl_gpio, &value);
+    }
+    cyw43_thread_exit();
+    return value;
+}
+
+void cyw43_arch_gpio_forget(void) {
+    cyw43_thread_enter();
+    cyw43_gpio_shadow_forget(&gpio_shadow);
+    // the async_context may be about to go away
+    if (gpio_flush_worker_added) {
+        async_context_remove_when_pending_worker(async_context, &gpio_flush_worker);
+        gpio_flush_worker_added = false;
+    }
+    cyw43_thread_exit();
+}
+
+void cyw43_arch_gpio_restore(void) {
+    cyw43_thread_enter();
+    if (cyw43_gpio_shadow_restore(&gpio_shadow)) gpio_write();
+    cyw43_thread_exit();
+}
+
+void cyw43_arch_gpio_get_stats(cyw43_arch_gpio_stats_t *stats) {
+    cyw43_thread_enter();
+    *stats = gpio_shadow.stats;
+    cyw43_thread_exit();
+}
+#else
 void cyw43_arch_gpio_put(uint wl_gpio, bool value) {
     invalid_params_if(CYW43_ARCH, wl_gpio >= CYW43_WL_GPIO_COUNT);
     cyw43_gpio_set(&cyw43_state, (int)wl_gpio, value);
@@ -173,6 +677,7 @@ bool cyw43_arch_gpio_get(uint wl_gpio) {
     cyw43_gpio_get(&cyw43_state, (int)wl_gpio, &value);
     return value;
 }
+#endif
 
 async_context_t *cyw43_arch_async_context(void) {
     return async_context;
@@ -0,0 +1,202 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include "cyw43_arch_acs.h"
+#include "cyw43_arch_info.h"
+#include "cyw43_arch_stats.h"
+
+// networks beyond this many are still counted, just without removing duplicate reports
+#define ACS_MAX_NETWORKS 32
+
+// a 20MHz channel overlaps the four channels either side of it, by a fifth less each channel away
+#define ACS_OVERLAP 5
+
+// interval at which a running survey scan is checked for completion
+#define ACS_SCAN_POLL_MS 100
+
+typedef struct acs_network {
+    uint8_t bssid[6];
+    uint8_t channel;
+    int8_t rssi;
+} acs_network_t;
+
+// all of this is protected by the async_context lock, which the scan callback is called with
+static acs_network_t networks[ACS_MAX_NETWORKS];
+static uint32_t network_count;
+static uint32_t extra_weight[CYW43_ARCH_ACS_MAX_CHANNEL + 1];
+static cyw43_arch_acs_result_t last_result;
+static bool have_last_result;
+static uint32_t acs_interval_ms = CYW43_ARCH_ACS_INTERVAL_MS;
+static bool periodic_scanning;
+
+static void acs_periodic_func(async_context_t *context, async_at_time_worker_t *worker);
+
+static async_at_time_worker_t acs_periodic_worker = {
+        .do_work = acs_periodic_func
+};
+
+// doubles for every 10dB above -100dBm
+static uint32_t rssi_weight(int rssi) {
+    int db = rssi + 100;
+    if (db < 0) db = 0;
+    if (db > 70) db = 70;
+    return 1u << (db / 10);
+}
+
+static void add_load(uint32_t *load, uint channel, uint32_t weight) {
+    for (uint c = 1; c <= CYW43_ARCH_ACS_MAX_CHANNEL; c++) {
+        uint distance = c > channel ? c - channel : channel - c;
+        if (distance < ACS_OVERLAP) load[c] += weight * (ACS_OVERLAP - distance);
+    }
+}
+
+static int acs_scan_result(__unused void *env, const cyw43_ev_scan_result_t *result) {
+    if (!result->channel || result->channel > 14) return 0;
+    for (uint32_t i = 0; i < network_count && i < ACS_MAX_NETWORKS; i++) {
+        if (!memcmp(networks[i].bssid, result->bssid, 6)) {
+            // the same network is usually reported more than once; keep the strongest report
+            if (result->rssi > networks[i].rssi) networks[i].rssi = (int8_t)result->rssi;
+            return 0;
+        }
+    }
+    if (network_count < ACS_MAX_NETWORKS) {
+        memcpy(networks[network_count].bssid, result->bssid, 6);
+        networks[network_count].channel = (uint8_t)result->channel;
+        networks[network_count].rssi = (int8_t)result->rssi;
+    } else {
+        add_load(extra_weight, result->channel, rssi_weight(result->rssi));
+    }
+    network_count++;
+    return 0;
+}
+
+// must be called with the lock held
+static int acs_scan_start(void) {
+    cyw43_wifi_scan_options_t scan_options = {0};
+    network_count = 0;
+    memset(extra_weight, 0, sizeof(extra_weight));
+    uint32_t start_us = time_us_32();
+    return cyw43_arch_stats_ioctl(start_us, cyw43_wifi_scan(&cyw43_state, &scan_options, NULL, acs_scan_result));
+}
+
+static bool preferred_channel(uint channel) {
+    return channel == 1 || channel == 6 || channel == 11;
+}
+
+// must be called with the lock held
+static void acs_scan_finish(cyw43_arch_acs_result_t *result) {
+    memset(result, 0, sizeof(*result));
+    memcpy(result->load, extra_weight, sizeof(result->load));
+    result->networks = network_count;
+    for (uint32_t i = 0; i < network_count && i < ACS_MAX_NETWORKS; i++) {
+        if (networks[i].channel <= CYW43_ARCH_ACS_MAX_CHANNEL) result->networks_on[networks[i].channel]++;
+        add_load(result->load, networks[i].channel, rssi_weight(networks[i].rssi));
+    }
+    // 1, 6 and 11 leave the most room for the networks around us, so another channel has to be
+    // clearly quieter to win
+    uint32_t best_cost = UINT32_MAX;
+    for (uint c = 1; c <= CYW43_ARCH_ACS_MAX_CHANNEL; c++) {
+        uint32_t cost = preferred_channel(c) ? result->load[c] : result->load[c] * 5 / 4 + ACS_OVERLAP;
+        if (cost < best_cost) {
+            best_cost = cost;
+            result->channel = c;
+        }
+    }
+    last_result = *result;
+    have_last_result = true;
+}
+
+int cyw43_arch_acs_select(cyw43_arch_acs_result_t *result) {
+    // scanning needs an interface to be up
+    bool sta_started = !cyw43_state.itf_state;
+    if (sta_started) cyw43_arch_enable_sta_mode();
+    cyw43_thread_enter();
+    int err = acs_scan_start();
+    cyw43_thread_exit();
+    if (!err) {
+        absolute_time_t until = make_timeout_time_ms(CYW43_ARCH_ACS_SCAN_TIMEOUT_MS);
+        while (cyw43_wifi_scan_active(&cyw43_state) && !time_reached(until)) {
+            cyw43_arch_poll();
+            cyw43_arch_wait_for_work_until(make_timeout_time_ms(ACS_SCAN_POLL_MS));
+        }
+        // a scan which ran out of time still covered some of the channels, so use what it found
+        cyw43_thread_enter();
+        acs_scan_finish(result);
+        cyw43_thread_exit();
+    }
+    if (sta_started) cyw43_arch_disable_sta_mode();
+    return err;
+}
+
+bool cyw43_arch_acs_get_last(cyw43_arch_acs_result_t *result) {
+    cyw43_thread_enter();
+    bool have = have_last_result;
+    *result = last_result;
+    cyw43_thread_exit();
+    return have;
+}
+
+static bool ap_idle(void) {
+    uint8_t macs[6 * 4];
+    int num = 4;
+    uint32_t start_us = time_us_32();
+    if (cyw43_arch_stats_ioctl(start_us, cyw43_wifi_ap_get_stas(&cyw43_state, &num, macs))) return false;
+    return num == 0;
+}
+
+// while the access point follows a connected station, the station's network decides the channel
+static bool sta_holds_channel(void) {
+    if (cyw43_arch_get_ap_channel_policy() != CYW43_ARCH_AP_CHANNEL_FOLLOW_STA) return false;
+    cyw43_arch_info_t info;
+    cyw43_arch_info_get(&info);
+    return info.sta_connected;
+}
+
+static void acs_periodic_func(async_context_t *context, async_at_time_worker_t *worker) {
+    if (!acs_interval_ms) return;
+    uint32_t next_ms = acs_interval_ms;
+    if (!(cyw43_state.itf_state & (1 << CYW43_ITF_AP)) || sta_holds_channel()) {
+        periodic_scanning = false;
+    } else if (periodic_scanning) {
+        if (cyw43_wifi_scan_active(&cyw43_state)) {
+            next_ms = ACS_SCAN_POLL_MS;
+        } else {
+            cyw43_arch_acs_result_t result;
+            periodic_scanning = false;
+            acs_scan_finish(&result);
+            uint32_t current = cyw43_state.ap_channel;
+            // only move for a clear improvement, and only while nobody would be disconnected
+            if (result.channel != current && current <= CYW43_ARCH_ACS_MAX_CHANNEL &&
+                result.load[result.channel] * 4 < result.load[current] * 3 && ap_idle()) {
+                cyw43_wifi_ap_set_channel(&cyw43_state, result.channel);
+                // the channel is applied when the access point is started
+                cyw43_wifi_set_up(&cyw43_state, CYW43_ITF_AP, false, cyw43_arch_get_country_code());
+                cyw43_wifi_set_up(&cyw43_state, CYW43_ITF_AP, true, cyw43_arch_get_country_code());
+                cyw43_arch_info_refresh();
+            }
+        }
+    } else if (ap_idle() && !acs_scan_start()) {
+        periodic_scanning = true;
+        next_ms = ACS_SCAN_POLL_MS;
+    }
+    async_context_add_at_time_worker_in_ms(context, worker, next_ms);
+}
+
+void cyw43_arch_acs_set_interval(uint32_t interval_ms) {
+    async_context_t *context = cyw43_arch_async_context();
+    cyw43_thread_enter();
+    acs_interval_ms = interval_ms;
+    async_context_remove_at_time_worker(context, &acs_periodic_worker);
+    if (interval_ms) {
+        async_context_add_at_time_worker_in_ms(context, &acs_periodic_worker, interval_ms);
+    }
+    cyw43_thread_exit();
+}
+
+void cyw43_arch_acs_attach(void) {
+    if (acs_interval_ms) cyw43_arch_acs_set_interval(acs_interval_ms);
+}
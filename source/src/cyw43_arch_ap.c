@@ -0,0 +1,366 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include "cyw43_arch_ap.h"
+#include "cyw43_arch_ioctl.h"
+#include "cyw43_arch_datapath.h"
+#include "cyw43_arch_stats.h"
+#include "cyw43_frame_pool.h"
+#include "hardware/sync.h"
+
+#if CYW43_ARCH_AP_TX_SCHED && !CYW43_FRAME_POOL
+#error CYW43_ARCH_AP_TX_SCHED requires CYW43_FRAME_POOL
+#endif
+
+#if CYW43_ARCH_AP_TX_SCHED
+typedef struct tx_frame {
+    struct tx_frame *next;
+    uint16_t len;
+    uint8_t flow;
+    uint8_t data[];
+} tx_frame_t;
+
+#define TX_FRAME_DATA_SIZE (CYW43_FRAME_POOL_FRAME_SIZE - sizeof(tx_frame_t))
+
+typedef struct tx_flow {
+    tx_frame_t *head;
+    tx_frame_t *tail;
+    uint32_t count;
+    int32_t deficit;
+} tx_flow_t;
+
+// one flow per station, plus one for group addressed frames and unknown stations
+#define GROUP_FLOW CYW43_ARCH_AP_MAX_STAS
+static tx_flow_t flows[CYW43_ARCH_AP_MAX_STAS + 1];
+static uint32_t tx_backlog;
+static uint tx_cursor;
+static bool tx_turn_started;
+
+static void tx_drain_func(async_context_t *context, async_when_pending_worker_t *worker);
+
+static async_when_pending_worker_t tx_drain_worker = {
+        .do_work = tx_drain_func
+};
+#endif
+
+typedef struct sta_entry {
+    bool in_use;
+    bool listed; // seen in the latest association list
+    cyw43_arch_ap_sta_t info;
+} sta_entry_t;
+
+// the table is read and written from several threads, so every access is under sta_lock
+static sta_entry_t stas[CYW43_ARCH_AP_MAX_STAS];
+static spin_lock_t *sta_lock;
+static void (*sta_callback)(const uint8_t mac[6], bool associated);
+
+static void ap_poll_func(async_context_t *context, async_at_time_worker_t *worker);
+
+static async_at_time_worker_t ap_poll_worker = {
+        .do_work = ap_poll_func
+};
+
+static uint32_t now_ms(void) {
+    return to_ms_since_boot(get_absolute_time());
+}
+
+// must be called with sta_lock held
+static int find_sta(const uint8_t *mac) {
+    for (int i = 0; i < CYW43_ARCH_AP_MAX_STAS; i++) {
+        if (stas[i].in_use && !memcmp(stas[i].info.mac, mac, 6)) return i;
+    }
+    return -1;
+}
+
+#if CYW43_ARCH_AP_TX_SCHED
+// must be called with sta_lock held; returns the frames to the caller to free outside the lock
+static tx_frame_t *flow_flush(tx_flow_t *flow) {
+    tx_frame_t *frames = flow->head;
+    tx_backlog -= flow->count;
+    flow->head = flow->tail = NULL;
+    flow->count = 0;
+    flow->deficit = 0;
+    return frames;
+}
+
+static void free_frames(tx_frame_t *frame) {
+    while (frame) {
+        tx_frame_t *next = frame->next;
+        cyw43_frame_free(frame);
+        frame = next;
+    }
+}
+#endif
+
+static void remove_sta(int i) {
+    uint8_t mac[6];
+    uint32_t save = spin_lock_blocking(sta_lock);
+    memcpy(mac, stas[i].info.mac, sizeof(mac));
+    stas[i].in_use = false;
+#if CYW43_ARCH_AP_TX_SCHED
+    tx_frame_t *frames = flow_flush(&flows[i]);
+#endif
+    spin_unlock(sta_lock, save);
+#if CYW43_ARCH_AP_TX_SCHED
+    free_frames(frames);
+#endif
+    if (sta_callback) sta_callback(mac, false);
+}
+
+static void add_sta(const uint8_t *mac) {
+    uint32_t save = spin_lock_blocking(sta_lock);
+    int i = 0;
+    while (i < CYW43_ARCH_AP_MAX_STAS && stas[i].in_use) i++;
+    if (i == CYW43_ARCH_AP_MAX_STAS) {
+        spin_unlock(sta_lock, save);
+        return;
+    }
+    memset(&stas[i], 0, sizeof(stas[i]));
+    stas[i].in_use = true;
+    stas[i].listed = true;
+    memcpy(stas[i].info.mac, mac, 6);
+    stas[i].info.assoc_ms = now_ms();
+    stas[i].info.last_seen_ms = stas[i].info.assoc_ms;
+    spin_unlock(sta_lock, save);
+    if (sta_callback) sta_callback(mac, true);
+}
+
+static void clear_stas(void) {
+    for (int i = 0; i < CYW43_ARCH_AP_MAX_STAS; i++) {
+        if (stas[i].in_use) remove_sta(i);
+    }
+}
+
+static void ap_poll_func(async_context_t *context, async_at_time_worker_t *worker) {
+    uint8_t macs[CYW43_ARCH_AP_MAX_STAS * 6];
+    int num = CYW43_ARCH_AP_MAX_STAS;
+
+    if (!(cyw43_state.itf_state & (1 << CYW43_ITF_AP))) {
+        // the access point has gone; cyw43_arch_ap_attach starts polling again
+        clear_stas();
+        return;
+    }
+    uint32_t start_us = time_us_32();
+    if (cyw43_arch_stats_ioctl(start_us, cyw43_wifi_ap_get_stas(&cyw43_state, &num, macs))) {
+        num = -1;
+    }
+    if (num >= 0) {
+        uint32_t save = spin_lock_blocking(sta_lock);
+        for (int i = 0; i < CYW43_ARCH_AP_MAX_STAS; i++) {
+            stas[i].listed = false;
+        }
+        spin_unlock(sta_lock, save);
+        for (int n = 0; n < num; n++) {
+            save = spin_lock_blocking(sta_lock);
+            int i = find_sta(&macs[n * 6]);
+            if (i >= 0) stas[i].listed = true;
+            spin_unlock(sta_lock, save);
+            if (i < 0) add_sta(&macs[n * 6]);
+        }
+        for (int i = 0; i < CYW43_ARCH_AP_MAX_STAS; i++) {
+            save = spin_lock_blocking(sta_lock);
+            bool gone = stas[i].in_use && !stas[i].listed;
+            spin_unlock(sta_lock, save);
+            if (gone) remove_sta(i);
+        }
+    }
+    async_context_add_at_time_worker_in_ms(context, worker, CYW43_ARCH_AP_POLL_MS);
+}
+
+void cyw43_arch_ap_attach(void) {
+    async_context_t *context = cyw43_arch_async_context();
+    cyw43_thread_enter();
+    if (!sta_lock) {
+        sta_lock = spin_lock_instance(spin_lock_claim_unused(true));
+    }
+    async_context_remove_at_time_worker(context, &ap_poll_worker);
+    async_context_add_at_time_worker_in_ms(context, &ap_poll_worker, 0);
+#if CYW43_ARCH_AP_TX_SCHED
+    async_context_add_when_pending_worker(context, &tx_drain_worker);
+#endif
+    cyw43_thread_exit();
+}
+
+void cyw43_arch_ap_detach(void) {
+    if (!sta_lock) return;
+    cyw43_thread_enter();
+    async_context_remove_at_time_worker(cyw43_arch_async_context(), &ap_poll_worker);
+    clear_stas();
+#if CYW43_ARCH_AP_TX_SCHED
+    async_context_remove_when_pending_worker(cyw43_arch_async_context(), &tx_drain_worker);
+    uint32_t save = spin_lock_blocking(sta_lock);
+    tx_frame_t *frames = flow_flush(&flows[GROUP_FLOW]);
+    spin_unlock(sta_lock, save);
+    free_frames(frames);
+#endif
+    cyw43_thread_exit();
+}
+
+int cyw43_arch_ap_get_stas(cyw43_arch_ap_sta_t *out, int max) {
+    int count = 0;
+    if (!sta_lock) return 0;
+    uint32_t save = spin_lock_blocking(sta_lock);
+    for (int i = 0; i < CYW43_ARCH_AP_MAX_STAS && count < max; i++) {
+        if (!stas[i].in_use) continue;
+        out[count] = stas[i].info;
+#if CYW43_ARCH_AP_TX_SCHED
+        out[count].tx_queued = flows[i].count;
+#endif
+        count++;
+    }
+    spin_unlock(sta_lock, save);
+    return count;
+}
+
+int cyw43_arch_ap_get_sta_link(const uint8_t mac[6], int32_t *rssi, uint32_t *tx_rate_kbps) {
+    struct {
+        int32_t val;
+        uint8_t ea[6];
+    } scb_val;
+    // sta_info_t up to and including tx_rate, in kbps; the request is the iovar name and the address
+    uint8_t sta_info[72];
+    cyw43_arch_ioctl_req_t reqs[2] = {
+            { .cmd = CYW43_WLC_GET(CYW43_WLC_GET_RSSI), .buf = &scb_val, .len = sizeof(scb_val), .itf = CYW43_ITF_AP },
+            { .cmd = CYW43_IOCTL_GET_VAR, .buf = sta_info, .len = sizeof(sta_info), .itf = CYW43_ITF_AP },
+    };
+
+    memset(&scb_val, 0, sizeof(scb_val));
+    memcpy(scb_val.ea, mac, 6);
+    memset(sta_info, 0, sizeof(sta_info));
+    memcpy(sta_info, "sta_info", sizeof("sta_info"));
+    memcpy(sta_info + sizeof("sta_info"), mac, 6);
+    // queued rather than issued in line, so the caller doesn't need the lock; the group goes out in order
+    cyw43_arch_ioctl_submit_group(reqs, count_of(reqs));
+    cyw43_arch_ioctl_wait(&reqs[1]);
+    *rssi = reqs[0].err ? 0 : scb_val.val;
+    *tx_rate_kbps = 0;
+    if (!reqs[1].err) {
+        uint16_t len = sta_info[2] | (sta_info[3] << 8);
+        if (len >= sizeof(sta_info)) {
+            *tx_rate_kbps = sta_info[68] | (sta_info[69] << 8) | (sta_info[70] << 16) | ((uint32_t)sta_info[71] << 24);
+        }
+    }
+    return reqs[0].err;
+}
+
+void cyw43_arch_ap_set_sta_callback(void (*callback)(const uint8_t mac[6], bool associated)) {
+    sta_callback = callback;
+}
+
+void cyw43_arch_ap_note_rx(const uint8_t *frame, size_t len) {
+    if (!sta_lock || len < 12) return;
+    uint32_t save = spin_lock_blocking(sta_lock);
+    int i = find_sta(frame + 6);
+    if (i >= 0) {
+        stas[i].info.rx_packets++;
+        stas[i].info.rx_bytes += len;
+        stas[i].info.last_seen_ms = now_ms();
+    }
+    spin_unlock(sta_lock, save);
+}
+
+// must be called with sta_lock held
+static void note_tx(int i, size_t len, int err) {
+    if (i < 0 || i >= CYW43_ARCH_AP_MAX_STAS || !stas[i].in_use) return;
+    if (err) {
+        stas[i].info.tx_dropped++;
+    } else {
+        stas[i].info.tx_packets++;
+        stas[i].info.tx_bytes += len;
+    }
+}
+
+#if CYW43_ARCH_AP_TX_SCHED
+// take the next frame in deficit round-robin order, or NULL if nothing is queued
+static tx_frame_t *tx_dequeue(void) {
+    uint32_t save = spin_lock_blocking(sta_lock);
+    while (tx_backlog) {
+        tx_flow_t *flow = &flows[tx_cursor];
+        if (flow->head) {
+            if (!tx_turn_started) {
+                flow->deficit += CYW43_ARCH_AP_TX_QUANTUM;
+                tx_turn_started = true;
+            }
+            if (flow->deficit >= flow->head->len) {
+                tx_frame_t *frame = flow->head;
+                flow->head = frame->next;
+                if (!flow->head) flow->tail = NULL;
+                flow->count--;
+                flow->deficit -= frame->len;
+                tx_backlog--;
+                spin_unlock(sta_lock, save);
+                return frame;
+            }
+        } else {
+            // an idle flow doesn't bank credit
+            flow->deficit = 0;
+        }
+        tx_cursor = (tx_cursor + 1) % count_of(flows);
+        tx_turn_started = false;
+    }
+    spin_unlock(sta_lock, save);
+    return NULL;
+}
+
+// a pass of its own, so frames queued by every sender since the last pass are served in turn
+static void tx_drain_func(__unused async_context_t *context, __unused async_when_pending_worker_t *worker) {
+    tx_frame_t *frame;
+    while ((frame = tx_dequeue()) != NULL) {
+        int err = cyw43_arch_datapath_send(CYW43_ITF_AP, frame->len, frame->data);
+        uint32_t save = spin_lock_blocking(sta_lock);
+        // the station may have left, and its slot been reused, while the frame was being sent
+        int i = frame->flow;
+        if (i != GROUP_FLOW && memcmp(stas[i].info.mac, frame->data, 6)) i = -1;
+        note_tx(i, frame->len, err);
+        spin_unlock(sta_lock, save);
+        cyw43_frame_free(frame);
+    }
+}
+#endif
+
+int cyw43_arch_ap_send(size_t len, const void *buf) {
+    const uint8_t *dest = buf;
+    if (!sta_lock) return cyw43_arch_datapath_send(CYW43_ITF_AP, len, buf);
+#if CYW43_ARCH_AP_TX_SCHED
+    tx_frame_t *frame = len <= TX_FRAME_DATA_SIZE ? cyw43_frame_alloc(CYW43_FRAME_TX) : NULL;
+    if (frame) {
+        frame->next = NULL;
+        frame->len = (uint16_t)len;
+        memcpy(frame->data, buf, len);
+        uint32_t save = spin_lock_blocking(sta_lock);
+        int i = (dest[0] & 1) ? -1 : find_sta(dest);
+        frame->flow = i < 0 ? GROUP_FLOW : (uint8_t)i;
+        tx_flow_t *flow = &flows[frame->flow];
+        bool full = flow->count >= CYW43_ARCH_AP_TX_QUEUE_FRAMES;
+        if (full) {
+            note_tx(i, len, PICO_ERROR_RESOURCE_IN_USE);
+        } else {
+            if (flow->tail) {
+                flow->tail->next = frame;
+            } else {
+                flow->head = frame;
+            }
+            flow->tail = frame;
+            flow->count++;
+            tx_backlog++;
+        }
+        spin_unlock(sta_lock, save);
+        if (full) {
+            cyw43_frame_free(frame);
+            return PICO_ERROR_RESOURCE_IN_USE;
+        }
+        async_context_set_work_pending(cyw43_arch_async_context(), &tx_drain_worker);
+        return 0;
+    }
+    // out of frames, or too big to copy: fall back to sending in line, outside the scheduler
+#endif
+    int err = cyw43_arch_datapath_send(CYW43_ITF_AP, len, buf);
+    uint32_t save = spin_lock_blocking(sta_lock);
+    note_tx((dest[0] & 1) ? -1 : find_sta(dest), len, err);
+    spin_unlock(sta_lock, save);
+    return err;
+}
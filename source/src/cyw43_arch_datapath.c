@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "cyw43_arch_datapath.h"
+#include "cyw43_arch_stats.h"
+#include "hardware/sync.h"
+#include "cyw43_latency.h"
+#include "cyw43_frame_pool.h"
+#include "cyw43_arch_ap.h"
+#include "cyw43_arch_mcast.h"
+
+#if CYW43_LWIP
+#include "lwip/netif.h"
+#endif
+
+#if PICO_CYW43_ARCH_RTTHREAD
+#include "async_context_rtthread.h"
+#endif
+
+// number of senders which are in, or waiting to get into, cyw43_send_ethernet; in total and for
+// each interface, so a backlog on one interface shows up against that interface
+static volatile uint32_t tx_queue_depth;
+static volatile uint32_t tx_queue_depth_itf[CYW43_ITF_AP + 1];
+
+static uint32_t tx_queue_depth_add(int itf, int32_t delta) {
+    uint32_t save = save_and_disable_interrupts();
+    tx_queue_depth_itf[itf] += delta;
+    uint32_t depth = tx_queue_depth += delta;
+    restore_interrupts(save);
+    return depth;
+}
+
+uint32_t cyw43_arch_datapath_tx_queued(void) {
+    return tx_queue_depth;
+}
+
+uint32_t cyw43_arch_datapath_tx_queued_itf(int itf) {
+    return tx_queue_depth_itf[itf];
+}
+
+int cyw43_arch_datapath_send(int itf, size_t len, const void *buf) {
+    CYW43_LATENCY_START(send_start_us);
+    tx_queue_depth_add(itf, 1);
+    cyw43_thread_enter();
+    // sample the depth once we have the lock, so it includes anyone who queued up behind us
+    uint32_t depth = tx_queue_depth;
+    uint32_t itf_depth = tx_queue_depth_itf[itf];
+    cyw43_arch_pm_note_queue_depth(depth);
+    cyw43_arch_pm_note_traffic(false);
+    uint32_t driver_start_us = time_us_32();
+    int err = cyw43_send_ethernet(&cyw43_state, itf, len, buf, false);
+    cyw43_arch_stats_tx(itf, len, err, time_us_32() - driver_start_us, depth, itf_depth);
+    cyw43_arch_pm_note_queue_depth(tx_queue_depth_add(itf, -1));
+    cyw43_thread_exit();
+    CYW43_LATENCY_END(CYW43_LATENCY_TX_SEND, send_start_us);
+    return err;
+}
+
+#if CYW43_LWIP
+static netif_input_fn netif_input_next[CYW43_ITF_AP + 1];
+
+#if PICO_CYW43_ARCH_RTTHREAD
+static uint32_t irq_poll_frames = CYW43_ARCH_IRQ_POLL_FRAMES;
+static uint32_t rx_pass_wakeup;
+static uint32_t rx_pass_frames;
+
+// count the frames drained by one pass of the async_context, and stop taking an interrupt per
+// pass once a single pass sees a burst
+static void irq_poll_note_rx(void) {
+    if (!irq_poll_frames) return;
+    // in this port cyw43_arch always runs on an async_context_rtthread
+    async_context_rtthread_t *context = (async_context_rtthread_t *)cyw43_arch_async_context();
+    uint32_t wakeup = async_context_rtthread_get_wakeups(context);
+    if (wakeup != rx_pass_wakeup) {
+        rx_pass_wakeup = wakeup;
+        rx_pass_frames = 0;
+    }
+    if (++rx_pass_frames == irq_poll_frames) {
+        async_context_rtthread_enter_irq_polling(context);
+    }
+}
+#endif
+
+#if CYW43_FRAME_POOL
+#if !LWIP_SUPPORT_CUSTOM_PBUF
+#error CYW43_FRAME_POOL requires LWIP_SUPPORT_CUSTOM_PBUF
+#endif
+
+typedef struct rx_frame {
+    struct pbuf_custom pbuf; // must be first, the pbuf is freed as the frame
+    uint8_t payload[];
+} rx_frame_t;
+
+#define RX_FRAME_PAYLOAD_SIZE (CYW43_FRAME_POOL_FRAME_SIZE - sizeof(rx_frame_t))
+
+static void rx_frame_free(struct pbuf *p) {
+    cyw43_frame_free(p);
+}
+
+// A frame which didn't fit in one PBUF_POOL buffer holds several of them for as long as it is
+// queued up in lwIP (e.g. in a socket receive buffer); move it into a single frame of the driver's
+// own pool instead. A frame in a single pbuf is passed on as it is, as copying it gains nothing.
+// Returns NULL if the frame has to stay where it is.
+static struct pbuf *rx_frame_take(struct pbuf *p) {
+    if (!p->next || p->tot_len > RX_FRAME_PAYLOAD_SIZE) return NULL;
+    rx_frame_t *frame = cyw43_frame_alloc(CYW43_FRAME_RX);
+    if (!frame) return NULL;
+    frame->pbuf.custom_free_function = rx_frame_free;
+    struct pbuf *q = pbuf_alloced_custom(PBUF_RAW, p->tot_len, PBUF_REF, &frame->pbuf, frame->payload, RX_FRAME_PAYLOAD_SIZE);
+    pbuf_copy_partial(p, frame->payload, p->tot_len, 0);
+    pbuf_free(p);
+    return q;
+}
+#endif
+
+// called by the cyw43_driver from the async_context with the lock held
+static err_t datapath_netif_input(struct pbuf *p, struct netif *netif) {
+    int itf = netif == &cyw43_state.netif[CYW43_ITF_AP] ? CYW43_ITF_AP : CYW43_ITF_STA;
+    CYW43_LATENCY_RX();
+    // the driver copies each frame out of its bus buffer into a PBUF_POOL chain; a chained frame
+    // means PBUF_POOL_BUFSIZE is too small to hold a full frame, costing extra allocations
+    cyw43_arch_stats_rx(itf, p->tot_len, p->next != NULL);
+#if CYW43_ARCH_MCAST_FILTER
+    // a group nobody joined, which the chip couldn't filter
+    if (!cyw43_arch_mcast_accept(itf, p->payload)) {
+        pbuf_free(p);
+        return ERR_OK;
+    }
+#endif
+    cyw43_arch_pm_note_traffic(true);
+#if CYW43_ARCH_AP_STATIONS
+    if (itf == CYW43_ITF_AP) cyw43_arch_ap_note_rx(p->payload, p->tot_len);
+#endif
+#if PICO_CYW43_ARCH_RTTHREAD
+    irq_poll_note_rx();
+#endif
+#if CYW43_FRAME_POOL
+    struct pbuf *q = rx_frame_take(p);
+    if (q) {
+        // the driver frees the pbuf it passed in if we fail, but that one is already gone
+        if (netif_input_next[itf](q, netif) != ERR_OK) {
+            pbuf_free(q);
+        }
+        return ERR_OK;
+    }
+#endif
+    return netif_input_next[itf](p, netif);
+}
+#endif
+
+void cyw43_arch_datapath_attach(int itf) {
+#if CYW43_LWIP
+    struct netif *netif = &cyw43_state.netif[itf];
+    cyw43_thread_enter();
+    if (netif->input && netif->input != datapath_netif_input) {
+        netif_input_next[itf] = netif->input;
+        netif->input = datapath_netif_input;
+    }
+    cyw43_thread_exit();
+#if CYW43_ARCH_MCAST_FILTER
+    cyw43_arch_mcast_attach(itf);
+#endif
+#else
+    (void)itf;
+#endif
+}
+
+void cyw43_arch_datapath_set_irq_poll_frames(uint32_t frames) {
+#if CYW43_LWIP && PICO_CYW43_ARCH_RTTHREAD
+    cyw43_thread_enter();
+    irq_poll_frames = frames;
+    cyw43_thread_exit();
+#else
+    (void)frames;
+#endif
+}
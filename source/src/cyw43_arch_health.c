@@ -0,0 +1,367 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "cyw43_arch_health.h"
+#include "cyw43_arch_info.h"
+#include "cyw43_arch_ioctl.h"
+#include "cyw43_arch_stats.h"
+#include "cyw43_ll.h"
+#include "cyw43_pmk_cache.h"
+#if CYW43_ARCH_AP_STATIONS
+#include "cyw43_arch_ap.h"
+#endif
+#if CYW43_ARCH_OFFLOAD
+#include "cyw43_arch_offload.h"
+#endif
+#if CYW43_ARCH_MCAST_FILTER
+#include "cyw43_arch_mcast.h"
+#endif
+
+#if PICO_CYW43_ARCH_DEBUG_ENABLED
+#define CYW43_ARCH_DEBUG(...) printf(__VA_ARGS__)
+#else
+#define CYW43_ARCH_DEBUG(...) ((void)0)
+#endif
+
+// while a recovery is being timed the station's link is checked this often
+#define REJOIN_POLL_MS 100
+
+#define STA_ITF (1 << CYW43_ITF_STA)
+#define AP_ITF (1 << CYW43_ITF_AP)
+
+#if !CYW43_PMK_CACHE
+#error CYW43_ARCH_HEALTH needs CYW43_PMK_CACHE to rejoin without keeping the passphrase
+#endif
+
+// the passphrase is never kept; a network joined with one is rejoined with its PMK from the cache
+typedef struct join_config {
+    bool valid;
+    uint8_t ssid_len;
+    uint8_t ssid[32];
+    uint8_t pmk_len; // CYW43_PMK_HEX_LEN if the PMK was given, 0 for none
+    uint8_t pmk_hex[CYW43_PMK_HEX_LEN];
+    bool has_key_hash; // the PMK is to be looked up in the cache
+    uint8_t key_hash[CYW43_PMK_KEY_HASH_LEN];
+    uint32_t auth;
+    bool has_bssid;
+    uint8_t bssid[6];
+} join_config_t;
+
+// all of this is protected by the async_context lock
+static join_config_t join;
+static bool ap_up;
+static bool attached;
+static cyw43_arch_health_stats_t health_stats;
+static uint32_t attempts; // recoveries since the chip was last found healthy
+static uint64_t unhealthy_since_us;
+static cyw43_arch_health_reason_t unhealthy_reason;
+static bool recovery_pending; // a recovery is being timed until the station is back
+static uint32_t recovery_start_us;
+static bool recovery_rejoin;
+static uint32_t last_tx_packets;
+static uint32_t last_tx_dropped;
+static uint32_t last_tx_stalls;
+static uint32_t last_ioctl_ok;
+static uint32_t last_ioctl_errors;
+
+static void health_poll_func(async_context_t *context, async_at_time_worker_t *worker);
+
+static async_at_time_worker_t health_poll_worker = {
+        .do_work = health_poll_func
+};
+
+static bool sta_connected(void) {
+#if CYW43_LWIP
+    return cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA) >= CYW43_LINK_NOIP;
+#else
+    return cyw43_wifi_link_status(&cyw43_state, CYW43_ITF_STA) == CYW43_LINK_JOIN;
+#endif
+}
+
+static void health_schedule(uint32_t ms) {
+    async_context_t *context = cyw43_arch_async_context();
+    async_context_remove_at_time_worker(context, &health_poll_worker);
+    async_context_add_at_time_worker_in_ms(context, &health_poll_worker, ms);
+}
+
+static void take_baseline(void) {
+    cyw43_arch_stats_t stats;
+    cyw43_arch_stats_get(&stats);
+    last_tx_packets = 0;
+    last_tx_dropped = 0;
+    for (int itf = 0; itf <= CYW43_ITF_AP; itf++) {
+        last_tx_packets += stats.itf[itf].tx_packets;
+        last_tx_dropped += stats.itf[itf].tx_dropped;
+    }
+    last_tx_stalls = stats.tx_stalls;
+    last_ioctl_ok = stats.ioctls - stats.ioctl_errors;
+    last_ioctl_errors = stats.ioctl_errors;
+}
+
+static int probe(void) {
+    uint8_t mac[6];
+    return cyw43_arch_ioctl_get_var("cur_etheraddr", mac, sizeof(mac), CYW43_ITF_STA);
+}
+
+// Clearing cyw43_poll would make the next control call reload the firmware through the driver, but
+// that removes both netifs first. Do the same power cycle and bus bring up ourselves instead,
+// leaving the driver and lwIP believing the interfaces are still up.
+static int reload_firmware(void) {
+    cyw43_ll_deinit(&cyw43_state.cyw43_ll);
+    cyw43_hal_pin_low(CYW43_PIN_WL_REG_ON);
+    cyw43_delay_ms(20);
+    cyw43_hal_pin_high(CYW43_PIN_WL_REG_ON);
+    cyw43_delay_ms(50);
+    uint8_t mac[6];
+    cyw43_hal_get_mac(CYW43_HAL_MAC_WLAN0, mac);
+    return cyw43_ll_bus_init(&cyw43_state.cyw43_ll, mac);
+}
+
+// must be called with the async_context lock held
+static int rejoin(void) {
+    uint8_t pmk_hex[CYW43_PMK_HEX_LEN];
+    const uint8_t *key = join.pmk_len ? join.pmk_hex : NULL;
+    size_t key_len = join.pmk_len;
+    if (join.has_key_hash) {
+        if (!cyw43_pmk_cache_lookup(join.ssid, join.ssid_len, join.key_hash, pmk_hex)) {
+            // still being derived, or pushed out of the cache since
+            CYW43_ARCH_DEBUG("no PMK cached for the network, not rejoining\n");
+            return PICO_ERROR_NO_DATA;
+        }
+        key = pmk_hex;
+        key_len = sizeof(pmk_hex);
+    }
+    uint32_t start_us = time_us_32();
+    int err = cyw43_arch_stats_ioctl(start_us, cyw43_wifi_join(&cyw43_state, join.ssid_len, join.ssid, key_len, key,
+                                                              join.auth, join.has_bssid ? join.bssid : NULL,
+                                                              CYW43_CHANNEL_NONE));
+    memset(pmk_hex, 0, sizeof(pmk_hex));
+    return err;
+}
+
+// must be called with the async_context lock held
+static int health_reset(cyw43_arch_health_reason_t reason) {
+    uint32_t itfs = cyw43_state.itf_state;
+    if (!itfs) return PICO_ERROR_NOT_PERMITTED;
+    uint32_t start_us = time_us_32();
+    uint32_t country = cyw43_arch_get_country_code();
+    CYW43_ARCH_DEBUG("resetting the wireless chip, reason %d\n", reason);
+    health_stats.recoveries++;
+    health_stats.last_reason = reason;
+    health_stats.last_recovery_us = 0;
+    attempts++;
+
+    // a chip being reset sends no link down event; the netifs themselves stay where they are
+    if (itfs & STA_ITF) cyw43_cb_tcpip_set_link_down(&cyw43_state, CYW43_ITF_STA);
+    cyw43_state.wifi_join_state = 0;
+    int err = reload_firmware();
+    // the interfaces are still marked up, so cyw43_wifi_set_up won't do this for us
+    if (!err) err = cyw43_ll_wifi_on(&cyw43_state.cyw43_ll, country);
+    if (err) {
+        CYW43_ARCH_DEBUG("wireless chip didn't come back up: %d\n", err);
+        health_stats.failures++;
+        recovery_pending = false;
+        // with the bus gone only the driver's own bring up is left, on the next control call; that
+        // takes the netifs down, so there is nothing more for the monitor to do
+        cyw43_poll = NULL;
+        health_stats.gave_up = true;
+        attached = false;
+        return err;
+    }
+
+    // replay the configuration; for an interface which is already up this only starts the access point
+    if (ap_up && (itfs & AP_ITF)) cyw43_wifi_set_up(&cyw43_state, CYW43_ITF_AP, true, country);
+    cyw43_arch_set_pm_mode(cyw43_arch_get_pm_mode());
+#if CYW43_ARCH_AP_STATIONS
+    if (ap_up) {
+        // its stations have to associate again
+        cyw43_arch_ap_detach();
+        cyw43_arch_ap_attach();
+    }
+#endif
+#if CYW43_ARCH_OFFLOAD
+    if (itfs & STA_ITF) cyw43_arch_offload_attach();
+#endif
+#if CYW43_ARCH_MCAST_FILTER
+    cyw43_arch_mcast_reprogram();
+#endif
+#if CYW43_ARCH_GPIO_SHADOW
+    cyw43_arch_gpio_restore();
+#endif
+    recovery_rejoin = join.valid && (itfs & STA_ITF);
+    if (recovery_rejoin) {
+        err = rejoin();
+        if (err) CYW43_ARCH_DEBUG("rejoin failed to start: %d\n", err);
+        // there is nothing to wait for
+        if (err == PICO_ERROR_NO_DATA) recovery_rejoin = false;
+    }
+    health_stats.last_reset_us = time_us_32() - start_us;
+    recovery_start_us = start_us;
+    recovery_pending = true;
+    cyw43_arch_info_refresh();
+    health_schedule(REJOIN_POLL_MS);
+    return err;
+}
+
+static void recovery_check(void) {
+    uint32_t elapsed_us = time_us_32() - recovery_start_us;
+    bool done = !recovery_rejoin || sta_connected();
+    if (!done && elapsed_us <= CYW43_ARCH_HEALTH_BUDGET_MS * 1000u) return;
+    recovery_pending = false;
+    if (done) {
+        health_stats.last_recovery_us = elapsed_us;
+        if (elapsed_us > health_stats.max_recovery_us) health_stats.max_recovery_us = elapsed_us;
+    } else {
+        CYW43_ARCH_DEBUG("station not back within %ums of the reset\n", CYW43_ARCH_HEALTH_BUDGET_MS);
+    }
+    if (elapsed_us > CYW43_ARCH_HEALTH_BUDGET_MS * 1000u) health_stats.over_budget++;
+}
+
+static void health_poll_func(__unused async_context_t *context, __unused async_at_time_worker_t *worker) {
+    if (!attached) {
+        // given up while this poll was pending, e.g. by a failed cyw43_arch_health_recover
+        return;
+    }
+    if (!cyw43_state.itf_state) {
+        // all interfaces are down; cyw43_arch_health_attach starts over when one comes up
+        attached = false;
+        return;
+    }
+    if (recovery_pending) {
+        // let the rejoin finish, or run out of time, before judging the chip again
+        recovery_check();
+        if (recovery_pending) {
+            health_schedule(REJOIN_POLL_MS);
+            return;
+        }
+        take_baseline();
+        health_schedule(CYW43_ARCH_HEALTH_POLL_MS);
+        return;
+    }
+
+    cyw43_arch_stats_t stats;
+    cyw43_arch_stats_get(&stats);
+    uint32_t tx_packets = 0;
+    uint32_t tx_dropped = 0;
+    for (int itf = 0; itf <= CYW43_ITF_AP; itf++) {
+        tx_packets += stats.itf[itf].tx_packets;
+        tx_dropped += stats.itf[itf].tx_dropped;
+    }
+    uint32_t ioctl_ok = stats.ioctls - stats.ioctl_errors;
+    cyw43_arch_health_reason_t reason = CYW43_ARCH_HEALTH_NONE;
+    // an idle chip is left alone, so as not to keep it out of power save; it is only probed when
+    // control calls failed, or frames are waiting, and nothing has got through since
+    bool ioctl_failing = stats.ioctl_errors != last_ioctl_errors && ioctl_ok == last_ioctl_ok;
+    bool tx_waiting = (stats.tx_queued || stats.tx_stalls != last_tx_stalls) && tx_packets == last_tx_packets;
+    if (ioctl_failing || tx_waiting) {
+        if (probe()) reason = CYW43_ARCH_HEALTH_IOCTL;
+        // count the probe, so that its own failure keeps the next poll probing
+        cyw43_arch_stats_get(&stats);
+    }
+    // sends waited for credits in vain and nothing went out
+    if (tx_dropped != last_tx_dropped && stats.tx_stalls != last_tx_stalls && tx_packets == last_tx_packets) {
+        reason = CYW43_ARCH_HEALTH_TX_STALL;
+    }
+    last_tx_packets = tx_packets;
+    last_tx_dropped = tx_dropped;
+    last_tx_stalls = stats.tx_stalls;
+    last_ioctl_ok = stats.ioctls - stats.ioctl_errors;
+    last_ioctl_errors = stats.ioctl_errors;
+
+    uint64_t now_us = time_us_64();
+    if (reason == CYW43_ARCH_HEALTH_NONE) {
+        unhealthy_since_us = 0;
+        attempts = 0;
+    } else if (!unhealthy_since_us) {
+        unhealthy_since_us = now_us;
+        unhealthy_reason = reason;
+    } else if (now_us - unhealthy_since_us >= CYW43_ARCH_HEALTH_STALL_MS * 1000ull) {
+        unhealthy_since_us = 0;
+        if (attempts >= CYW43_ARCH_HEALTH_MAX_ATTEMPTS) {
+            CYW43_ARCH_DEBUG("wireless chip still unhealthy after %u resets, giving up\n", (unsigned)attempts);
+            health_stats.gave_up = true;
+            attached = false;
+            return;
+        }
+        // reschedules the monitor itself if the chip comes back; if it doesn't, the monitor stays
+        // stopped until cyw43_arch_health_recover or the next cyw43_arch_health_attach
+        health_reset(unhealthy_reason);
+        return;
+    }
+    health_schedule(CYW43_ARCH_HEALTH_POLL_MS);
+}
+
+void cyw43_arch_health_attach(void) {
+    cyw43_thread_enter();
+    health_stats.gave_up = false;
+    attempts = 0;
+    if (!attached) {
+        attached = true;
+        unhealthy_since_us = 0;
+        take_baseline();
+        health_schedule(CYW43_ARCH_HEALTH_POLL_MS);
+    }
+    cyw43_thread_exit();
+}
+
+void cyw43_arch_health_note_join(const uint8_t *ssid, size_t ssid_len, const uint8_t *key, size_t key_len,
+                                 uint32_t auth, const uint8_t *bssid) {
+    join_config_t config;
+    memset(&config, 0, sizeof(config));
+    if (ssid_len <= sizeof(config.ssid) && key_len <= 64) {
+        config.valid = true;
+        config.ssid_len = (uint8_t)ssid_len;
+        memcpy(config.ssid, ssid, ssid_len);
+        if (cyw43_pmk_cache_is_pmk(key, key_len)) {
+            config.pmk_len = (uint8_t)key_len;
+            memcpy(config.pmk_hex, key, key_len);
+        } else if (key_len) {
+            // hashed outside the lock; the cache derives the PMK for this passphrase in the background
+            config.has_key_hash = true;
+            cyw43_pmk_cache_key_hash(ssid, ssid_len, key, key_len, config.key_hash);
+        }
+        config.auth = auth;
+        config.has_bssid = bssid != NULL;
+        if (bssid) memcpy(config.bssid, bssid, sizeof(config.bssid));
+    }
+    cyw43_thread_enter();
+    join = config;
+    cyw43_thread_exit();
+    memset(&config, 0, sizeof(config));
+}
+
+void cyw43_arch_health_note_leave(void) {
+    cyw43_thread_enter();
+    memset(&join, 0, sizeof(join));
+    cyw43_thread_exit();
+}
+
+void cyw43_arch_health_note_ap(bool up) {
+    cyw43_thread_enter();
+    ap_up = up;
+    cyw43_thread_exit();
+}
+
+int cyw43_arch_health_recover(void) {
+    cyw43_thread_enter();
+    int err = health_reset(CYW43_ARCH_HEALTH_MANUAL);
+    // the monitor times the recovery, whether or not it was running, and starts over if it had given up
+    if (recovery_pending) {
+        attached = true;
+        health_stats.gave_up = false;
+        attempts = 0;
+    }
+    cyw43_thread_exit();
+    return err;
+}
+
+void cyw43_arch_health_get_stats(cyw43_arch_health_stats_t *stats) {
+    cyw43_thread_enter();
+    *stats = health_stats;
+    cyw43_thread_exit();
+}
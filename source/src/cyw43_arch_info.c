@@ -0,0 +1,179 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include "cyw43_arch_info.h"
+#include "cyw43_arch_ioctl.h"
+#include "cyw43_arch_stats.h"
+#include "hardware/sync.h"
+
+#if CYW43_LWIP
+#include "lwip/netif.h"
+#endif
+
+static cyw43_arch_info_t info_cache;
+static spin_lock_t *info_lock;
+static uint32_t join_auth;
+static uint32_t ap_auth;
+static void (*link_callback)(bool connected);
+
+static void info_refresh_worker_func(async_context_t *context, async_when_pending_worker_t *worker);
+
+static async_when_pending_worker_t info_refresh_worker = {
+        .do_work = info_refresh_worker_func
+};
+
+#if CYW43_LWIP && LWIP_NETIF_LINK_CALLBACK
+static netif_status_callback_fn netif_link_next[CYW43_ITF_AP + 1];
+#else
+static void info_poll_func(async_context_t *context, async_at_time_worker_t *worker);
+
+static async_at_time_worker_t info_poll_worker = {
+        .do_work = info_poll_func
+};
+static bool polled_link_up;
+static uint32_t polled_itf_state;
+#endif
+
+// cyw43_wifi_link_status() reports CYW43_LINK_JOIN from the moment a join starts, whereas the
+// netif link only comes up once the join has completed, keys included
+static bool sta_link_up(void) {
+#if CYW43_LWIP
+    return cyw43_tcpip_link_status(&cyw43_state, CYW43_ITF_STA) >= CYW43_LINK_NOIP;
+#else
+    return cyw43_wifi_link_status(&cyw43_state, CYW43_ITF_STA) == CYW43_LINK_JOIN;
+#endif
+}
+
+void cyw43_arch_info_get(cyw43_arch_info_t *info) {
+    if (!info_lock) {
+        memset(info, 0, sizeof(*info));
+        return;
+    }
+    uint32_t save = spin_lock_blocking(info_lock);
+    *info = info_cache;
+    spin_unlock(info_lock, save);
+}
+
+static void info_publish(const cyw43_arch_info_t *info) {
+    uint32_t save = spin_lock_blocking(info_lock);
+    info_cache = *info;
+    info_cache.generation++;
+    spin_unlock(info_lock, save);
+}
+
+static void info_refresh_worker_func(__unused async_context_t *context, __unused async_when_pending_worker_t *worker) {
+    cyw43_arch_info_t info;
+    cyw43_arch_info_get(&info);
+    bool was_connected = info.sta_connected;
+
+    // these never change once read, so they cost one ioctl each for the lifetime of the driver
+    if (!info.mac_valid) {
+        uint32_t start_us = time_us_32();
+        info.mac_valid = !cyw43_arch_stats_ioctl(start_us, cyw43_wifi_get_mac(&cyw43_state, CYW43_ITF_STA, info.mac));
+    }
+    if (!info.fw_version[0]) {
+        char ver[sizeof(info.fw_version)];
+        if (!cyw43_arch_ioctl_get_var("ver", ver, sizeof(ver), CYW43_ITF_STA)) {
+            ver[sizeof(ver) - 1] = '\0';
+            ver[strcspn(ver, "\r\n")] = '\0';
+            strcpy(info.fw_version, ver);
+        }
+    }
+    info.country = cyw43_arch_get_country_code();
+
+    info.sta_connected = sta_link_up();
+    if (info.sta_connected) {
+        uint32_t channel_info[3]; // hw_channel, target_channel, scan_channel
+        if (cyw43_arch_ioctl(CYW43_WLC_GET(CYW43_WLC_GET_BSSID), info.bssid, sizeof(info.bssid), CYW43_ITF_STA)) {
+            memset(info.bssid, 0, sizeof(info.bssid));
+        }
+        if (!cyw43_arch_ioctl(CYW43_WLC_GET(CYW43_WLC_GET_CHANNEL), channel_info, sizeof(channel_info), CYW43_ITF_STA)) {
+            info.sta_channel = channel_info[0];
+        }
+        info.sta_auth = join_auth;
+        cyw43_arch_note_sta_channel(info.sta_channel);
+    } else {
+        memset(info.bssid, 0, sizeof(info.bssid));
+        info.sta_channel = 0;
+        info.sta_auth = 0;
+    }
+    if (cyw43_state.itf_state & (1 << CYW43_ITF_AP)) {
+        info.ap_channel = cyw43_state.ap_channel;
+        info.ap_auth = ap_auth;
+    } else {
+        info.ap_channel = 0;
+        info.ap_auth = 0;
+    }
+    info_publish(&info);
+
+    if (link_callback && info.sta_connected != was_connected) {
+        link_callback(info.sta_connected);
+    }
+}
+
+void cyw43_arch_info_refresh(void) {
+    async_context_t *context = cyw43_arch_async_context();
+    if (context && info_lock) {
+        async_context_set_work_pending(context, &info_refresh_worker);
+    }
+}
+
+#if CYW43_LWIP && LWIP_NETIF_LINK_CALLBACK
+// called by lwIP, from the async_context, when the driver takes the link of a netif up or down
+static void info_netif_link_callback(struct netif *netif) {
+    int itf = netif == &cyw43_state.netif[CYW43_ITF_AP] ? CYW43_ITF_AP : CYW43_ITF_STA;
+    cyw43_arch_info_refresh();
+    if (netif_link_next[itf]) netif_link_next[itf](netif);
+}
+#else
+// without a link callback the link state is cheap enough to poll, as it doesn't touch the bus
+static void info_poll_func(async_context_t *context, async_at_time_worker_t *worker) {
+    bool link_up = sta_link_up();
+    if (link_up != polled_link_up || cyw43_state.itf_state != polled_itf_state) {
+        polled_link_up = link_up;
+        polled_itf_state = cyw43_state.itf_state;
+        info_refresh_worker_func(context, &info_refresh_worker);
+    }
+    async_context_add_at_time_worker_in_ms(context, worker, CYW43_ARCH_INFO_POLL_MS);
+}
+#endif
+
+void cyw43_arch_info_attach(int itf) {
+    async_context_t *context = cyw43_arch_async_context();
+    cyw43_thread_enter();
+    if (!info_lock) {
+        info_lock = spin_lock_instance(spin_lock_claim_unused(true));
+        async_context_add_when_pending_worker(context, &info_refresh_worker);
+#if !(CYW43_LWIP && LWIP_NETIF_LINK_CALLBACK)
+        async_context_add_at_time_worker_in_ms(context, &info_poll_worker, CYW43_ARCH_INFO_POLL_MS);
+#endif
+    }
+#if CYW43_LWIP && LWIP_NETIF_LINK_CALLBACK
+    struct netif *netif = &cyw43_state.netif[itf];
+    if (netif->link_callback != info_netif_link_callback) {
+        netif_link_next[itf] = netif->link_callback;
+        netif_set_link_callback(netif, info_netif_link_callback);
+    }
+#else
+    (void)itf;
+#endif
+    cyw43_thread_exit();
+    cyw43_arch_info_refresh();
+}
+
+void cyw43_arch_info_note_join(uint32_t auth) {
+    join_auth = auth;
+}
+
+void cyw43_arch_info_note_ap(uint32_t auth) {
+    ap_auth = auth;
+    cyw43_arch_info_refresh();
+}
+
+void cyw43_arch_info_set_link_callback(void (*callback)(bool connected)) {
+    link_callback = callback;
+}
@@ -0,0 +1,152 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include "cyw43_arch_ioctl.h"
+#include "cyw43_arch_stats.h"
+#include "hardware/sync.h"
+
+// iovar requests are the name, a NUL, then the value; replies overwrite the request
+static uint8_t ioctl_buf[CYW43_ARCH_IOCTL_BUF_SIZE] __attribute__((aligned(4)));
+
+int cyw43_arch_ioctl(uint32_t cmd, void *buf, size_t len, int itf) {
+    async_context_lock_check(cyw43_arch_async_context());
+    uint32_t start_us = time_us_32();
+    return cyw43_arch_stats_ioctl(start_us, cyw43_ioctl(&cyw43_state, cmd, len, buf, itf));
+}
+
+int cyw43_arch_ioctl_get_var(const char *name, void *buf, size_t len, int itf) {
+    return cyw43_arch_ioctl_get_var_param(name, NULL, 0, buf, len, itf);
+}
+
+int cyw43_arch_ioctl_get_var_param(const char *name, const void *param, size_t param_len, void *buf, size_t len, int itf) {
+    size_t name_len = strlen(name) + 1;
+    size_t req_len = name_len + param_len > len ? name_len + param_len : len;
+    if (req_len > sizeof(ioctl_buf)) return PICO_ERROR_INVALID_ARG;
+    memset(ioctl_buf, 0, req_len);
+    memcpy(ioctl_buf, name, name_len);
+    if (param_len) memcpy(ioctl_buf + name_len, param, param_len);
+    int err = cyw43_arch_ioctl(CYW43_IOCTL_GET_VAR, ioctl_buf, req_len, itf);
+    if (!err) memcpy(buf, ioctl_buf, len);
+    return err;
+}
+
+int cyw43_arch_ioctl_set_var(const char *name, const void *data, size_t len, int itf) {
+    size_t name_len = strlen(name) + 1;
+    if (name_len + len > sizeof(ioctl_buf)) return PICO_ERROR_INVALID_ARG;
+    memcpy(ioctl_buf, name, name_len);
+    memcpy(ioctl_buf + name_len, data, len);
+    return cyw43_arch_ioctl(CYW43_IOCTL_SET_VAR, ioctl_buf, name_len + len, itf);
+}
+
+// the queue is protected by a spin lock, so requests can be queued without the async_context lock
+static spin_lock_t *queue_lock;
+static cyw43_arch_ioctl_req_t *queue_head;
+static cyw43_arch_ioctl_req_t *queue_tail;
+// the context the worker is added to, between cyw43_arch_ioctl_init and cyw43_arch_ioctl_deinit
+static async_context_t *queue_context;
+
+static void ioctl_queue_worker_func(async_context_t *context, async_when_pending_worker_t *worker);
+
+static async_when_pending_worker_t ioctl_queue_worker = {
+        .do_work = ioctl_queue_worker_func
+};
+
+static void queue_lock_init(void) {
+    uint32_t save = save_and_disable_interrupts();
+    if (!queue_lock) queue_lock = spin_lock_instance(spin_lock_claim_unused(true));
+    restore_interrupts(save);
+}
+
+void cyw43_arch_ioctl_init(async_context_t *context) {
+    queue_lock_init();
+    async_context_acquire_lock_blocking(context);
+    queue_context = context;
+    async_context_add_when_pending_worker(context, &ioctl_queue_worker);
+    // requests submitted while there was no context are issued now
+    if (queue_head) async_context_set_work_pending(context, &ioctl_queue_worker);
+    async_context_release_lock(context);
+}
+
+void cyw43_arch_ioctl_deinit(async_context_t *context) {
+    async_context_acquire_lock_blocking(context);
+    if (queue_context == context) {
+        async_context_remove_when_pending_worker(context, &ioctl_queue_worker);
+        queue_context = NULL;
+    }
+    async_context_release_lock(context);
+}
+
+// issues the next queued group; must be called with the async_context lock held. returns false if
+// the queue was empty
+static bool queue_run_group(void) {
+    bool group_end = false;
+    while (!group_end) {
+        uint32_t save = spin_lock_blocking(queue_lock);
+        cyw43_arch_ioctl_req_t *req = queue_head;
+        if (req) {
+            queue_head = req->next;
+            if (!queue_head) queue_tail = NULL;
+        }
+        spin_unlock(queue_lock, save);
+        // a group is queued in one go, so this can only happen before its first request
+        if (!req) return false;
+        req->err = cyw43_arch_ioctl(req->cmd, req->buf, req->len, req->itf);
+        // the done function may submit the request again, so it isn't touched after that
+        group_end = req->group_end;
+        __mem_fence_release();
+        req->complete = true;
+        if (req->done) req->done(req);
+    }
+    return true;
+}
+
+static void ioctl_queue_worker_func(async_context_t *context, async_when_pending_worker_t *worker) {
+    for (uint issued = 0; issued < CYW43_ARCH_IOCTL_BURST; issued++) {
+        if (!queue_run_group()) return;
+    }
+    // let anyone waiting for the lock in before carrying on
+    if (queue_head) async_context_set_work_pending(context, worker);
+}
+
+void cyw43_arch_ioctl_submit_group(cyw43_arch_ioctl_req_t *reqs, uint count) {
+    if (!count) return;
+    if (!queue_lock) queue_lock_init();
+    for (uint i = 0; i < count; i++) {
+        reqs[i].complete = false;
+        reqs[i].err = 0;
+        reqs[i].next = i + 1 < count ? &reqs[i + 1] : NULL;
+        reqs[i].group_end = i + 1 == count;
+    }
+    uint32_t save = spin_lock_blocking(queue_lock);
+    if (queue_tail) {
+        queue_tail->next = reqs;
+    } else {
+        queue_head = reqs;
+    }
+    queue_tail = &reqs[count - 1];
+    async_context_t *context = queue_context;
+    spin_unlock(queue_lock, save);
+    // without a context the requests wait for cyw43_arch_ioctl_wait or the next cyw43_arch_ioctl_init
+    if (context) async_context_set_work_pending(context, &ioctl_queue_worker);
+}
+
+void cyw43_arch_ioctl_submit(cyw43_arch_ioctl_req_t *req) {
+    cyw43_arch_ioctl_submit_group(req, 1);
+}
+
+int cyw43_arch_ioctl_wait(cyw43_arch_ioctl_req_t *req) {
+    // one group per turn with the lock, so a long queue ahead doesn't hold up senders
+    while (!req->complete) {
+        cyw43_thread_enter();
+        // the queue can only be empty if the request was issued while we waited for the lock
+        bool issued = queue_run_group();
+        cyw43_thread_exit();
+        if (!issued) break;
+    }
+    __mem_fence_acquire();
+    return req->err;
+}
@@ -0,0 +1,270 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include "cyw43_arch_mcast.h"
+#include "cyw43_arch_ioctl.h"
+#include "cyw43_arch_stats.h"
+#if CYW43_ARCH_OFFLOAD
+#include "cyw43_arch_offload.h"
+#endif
+#include "lwip/netif.h"
+#include "lwip/igmp.h"
+#include "lwip/mld6.h"
+
+typedef struct mcast_group {
+    uint8_t mac[6];
+    bool on_chip;
+    uint16_t refs; // IPv4 groups map 32 to one MAC address
+} mcast_group_t;
+
+typedef struct mcast_itf {
+    mcast_group_t groups[CYW43_ARCH_MCAST_MAX_GROUPS];
+    uint32_t count;
+    uint32_t chip_count;
+    uint32_t untracked; // groups added while the table was full, and not removed again
+    bool chip_all_multicast;
+    bool chip_all_multicast_valid;
+    uint32_t rx_accepted;
+    uint32_t rx_dropped;
+} mcast_itf_t;
+
+// all of this is protected by the async_context lock, which is also the lwIP core lock
+static mcast_itf_t mcast_itfs[CYW43_ITF_AP + 1];
+
+static int itf_of(struct netif *netif) {
+    return netif == &cyw43_state.netif[CYW43_ITF_AP] ? CYW43_ITF_AP : CYW43_ITF_STA;
+}
+
+static int find_group(const mcast_itf_t *m, const uint8_t *mac) {
+    for (uint i = 0; i < m->count; i++) {
+        if (!memcmp(m->groups[i].mac, mac, 6)) return (int)i;
+    }
+    return -1;
+}
+
+static bool chip_update(uint8_t *mac, bool add) {
+    uint32_t start_us = time_us_32();
+    return !cyw43_arch_stats_ioctl(start_us, cyw43_wifi_update_multicast_filter(&cyw43_state, mac, add));
+}
+
+// only the station interface has a multicast list in the firmware
+static void chip_sync(mcast_itf_t *m) {
+    if (m != &mcast_itfs[CYW43_ITF_STA]) return;
+    for (uint i = 0; i < m->count && m->chip_count < CYW43_ARCH_MCAST_CHIP_GROUPS; i++) {
+        mcast_group_t *g = &m->groups[i];
+        if (!g->on_chip && chip_update(g->mac, true)) {
+            g->on_chip = true;
+            m->chip_count++;
+        }
+    }
+    bool all_multicast = m->untracked || m->chip_count < m->count;
+    if ((all_multicast != m->chip_all_multicast || !m->chip_all_multicast_valid) &&
+        !cyw43_arch_ioctl_set_var_u32("allmulti", all_multicast, CYW43_ITF_STA)) {
+        m->chip_all_multicast = all_multicast;
+        m->chip_all_multicast_valid = true;
+    }
+}
+
+static void group_add(mcast_itf_t *m, const uint8_t *mac) {
+    int i = find_group(m, mac);
+    if (i >= 0) {
+        m->groups[i].refs++;
+        return;
+    }
+    if (m->count == CYW43_ARCH_MCAST_MAX_GROUPS) {
+        m->untracked++;
+    } else {
+        mcast_group_t *g = &m->groups[m->count++];
+        memcpy(g->mac, mac, 6);
+        g->on_chip = false;
+        g->refs = 1;
+    }
+    chip_sync(m);
+}
+
+static void group_remove(mcast_itf_t *m, const uint8_t *mac) {
+    int i = find_group(m, mac);
+    if (i < 0) {
+        if (m->untracked) m->untracked--;
+        chip_sync(m);
+        return;
+    }
+    mcast_group_t *g = &m->groups[i];
+    if (--g->refs) return;
+    if (g->on_chip) {
+        chip_update(g->mac, false);
+        m->chip_count--;
+    }
+    *g = m->groups[--m->count];
+    // a slot on the chip may have come free for a group which didn't fit
+    chip_sync(m);
+}
+
+static void group_update(struct netif *netif, const uint8_t *mac, enum netif_mac_filter_action action) {
+    int itf = itf_of(netif);
+    mcast_itf_t *m = &mcast_itfs[itf];
+    if (action == NETIF_ADD_MAC_FILTER) {
+        group_add(m, mac);
+    } else {
+        group_remove(m, mac);
+    }
+#if CYW43_ARCH_OFFLOAD
+    // a drop filter may have to come off for the group, or may go back on
+    if (itf == CYW43_ITF_STA) cyw43_arch_offload_groups_changed();
+#endif
+}
+
+#if LWIP_IGMP
+static void ip4_group_mac(const ip4_addr_t *group, uint8_t *mac) {
+    const uint8_t *ip = (const uint8_t *)&group->addr;
+    mac[0] = 0x01;
+    mac[1] = 0x00;
+    mac[2] = 0x5e;
+    mac[3] = ip[1] & 0x7f;
+    mac[4] = ip[2];
+    mac[5] = ip[3];
+}
+
+// called by lwIP with the lwIP core lock held
+static err_t mcast_igmp_mac_filter(struct netif *netif, const ip4_addr_t *group, enum netif_mac_filter_action action) {
+    uint8_t mac[6];
+    ip4_group_mac(group, mac);
+    group_update(netif, mac, action);
+    return ERR_OK;
+}
+#endif
+
+#if LWIP_IPV6 && LWIP_IPV6_MLD
+static void ip6_group_mac(const ip6_addr_t *group, uint8_t *mac) {
+    const uint8_t *ip = (const uint8_t *)&group->addr[3];
+    mac[0] = 0x33;
+    mac[1] = 0x33;
+    memcpy(mac + 2, ip, 4);
+}
+
+// called by lwIP with the lwIP core lock held
+static err_t mcast_mld_mac_filter(struct netif *netif, const ip6_addr_t *group, enum netif_mac_filter_action action) {
+    uint8_t mac[6];
+    ip6_group_mac(group, mac);
+    group_update(netif, mac, action);
+    return ERR_OK;
+}
+#endif
+
+// the netif is recreated whenever the interface is brought up, which drops the hooks
+static bool hooked(struct netif *netif) {
+#if LWIP_IGMP
+    return netif->igmp_mac_filter == mcast_igmp_mac_filter;
+#elif LWIP_IPV6 && LWIP_IPV6_MLD
+    return netif->mld_mac_filter == mcast_mld_mac_filter;
+#else
+    (void)netif;
+    return true;
+#endif
+}
+
+void cyw43_arch_mcast_attach(int itf) {
+    struct netif *netif = &cyw43_state.netif[itf];
+    mcast_itf_t *m = &mcast_itfs[itf];
+    cyw43_thread_enter();
+    if (hooked(netif)) {
+        cyw43_thread_exit();
+        return;
+    }
+    // a new netif, so start over with what it has joined so far
+    for (uint i = 0; i < m->count; i++) {
+        if (m->groups[i].on_chip) chip_update(m->groups[i].mac, false);
+    }
+    uint32_t rx_accepted = m->rx_accepted;
+    uint32_t rx_dropped = m->rx_dropped;
+    memset(m, 0, sizeof(*m));
+    m->rx_accepted = rx_accepted;
+    m->rx_dropped = rx_dropped;
+    uint8_t mac[6];
+#if LWIP_IGMP
+    netif_set_igmp_mac_filter(netif, mcast_igmp_mac_filter);
+    if (netif->flags & NETIF_FLAG_IGMP) {
+        for (struct igmp_group *g = netif_igmp_data(netif); g; g = g->next) {
+            ip4_group_mac(&g->group_address, mac);
+            group_add(m, mac);
+        }
+    } else {
+        // joins the all systems group through the hook
+        netif->flags |= NETIF_FLAG_IGMP;
+        igmp_start(netif);
+    }
+#endif
+#if LWIP_IPV6 && LWIP_IPV6_MLD
+    netif_set_mld_mac_filter(netif, mcast_mld_mac_filter);
+    netif->flags |= NETIF_FLAG_MLD6;
+    // lwIP listens to all nodes without joining it
+    ip6_addr_t all_nodes;
+    ip6_addr_set_allnodes_linklocal(&all_nodes);
+    ip6_group_mac(&all_nodes, mac);
+    group_add(m, mac);
+    for (struct mld_group *g = netif_mld6_data(netif); g; g = g->next) {
+        ip6_group_mac(&g->group_address, mac);
+        group_add(m, mac);
+    }
+#endif
+    (void)mac;
+    chip_sync(m);
+    cyw43_thread_exit();
+}
+
+void cyw43_arch_mcast_reprogram(void) {
+    mcast_itf_t *m = &mcast_itfs[CYW43_ITF_STA];
+    cyw43_thread_enter();
+    for (uint i = 0; i < m->count; i++) m->groups[i].on_chip = false;
+    m->chip_count = 0;
+    m->chip_all_multicast_valid = false;
+    chip_sync(m);
+    cyw43_thread_exit();
+}
+
+bool cyw43_arch_mcast_accept(int itf, const uint8_t *frame) {
+    static const uint8_t broadcast[6] = { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff };
+    if (!(frame[0] & 1) || !memcmp(frame, broadcast, 6)) return true;
+    mcast_itf_t *m = &mcast_itfs[itf];
+#if LWIP_IPV6 && !LWIP_IPV6_MLD
+    // without MLD lwIP takes in IPv6 multicast without ever joining it
+    if (frame[0] == 0x33 && frame[1] == 0x33) {
+        m->rx_accepted++;
+        return true;
+    }
+#endif
+    if (m->untracked || find_group(m, frame) >= 0) {
+        m->rx_accepted++;
+        return true;
+    }
+    m->rx_dropped++;
+    return false;
+}
+
+int cyw43_arch_mcast_get_groups(int itf, uint8_t (*macs)[6], int max) {
+    cyw43_thread_enter();
+    const mcast_itf_t *m = &mcast_itfs[itf];
+    int count = 0;
+    for (uint i = 0; i < m->count && count < max; i++) {
+        memcpy(macs[count++], m->groups[i].mac, 6);
+    }
+    cyw43_thread_exit();
+    return count;
+}
+
+void cyw43_arch_mcast_get_stats(int itf, cyw43_arch_mcast_stats_t *stats) {
+    cyw43_thread_enter();
+    const mcast_itf_t *m = &mcast_itfs[itf];
+    stats->groups = m->count;
+    stats->chip_groups = m->chip_count;
+    // the access point passes on whatever its stations send
+    stats->all_multicast = itf == CYW43_ITF_AP || m->chip_all_multicast;
+    stats->overflow = m->untracked != 0;
+    stats->rx_accepted = m->rx_accepted;
+    stats->rx_dropped = m->rx_dropped;
+    cyw43_thread_exit();
+}
@@ -0,0 +1,509 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include "cyw43_arch_offload.h"
+#include "cyw43_arch_ioctl.h"
+#include "lwip/netif.h"
+#include "lwip/etharp.h"
+#include "lwip/igmp.h"
+#include "lwip/mld6.h"
+#include "lwip/inet_chksum.h"
+#include "lwip/tcp.h"
+#include "lwip/priv/tcp_priv.h"
+#include "lwip/prot/udp.h"
+
+#if !LWIP_IPV4 || !LWIP_ARP
+#error cyw43_arch_offload requires LWIP_IPV4 and LWIP_ARP
+#endif
+
+static_assert(CYW43_ARCH_OFFLOAD_KEEPALIVES <= 4, "the firmware sends at most 4 keep-alives");
+static_assert(CYW43_ARCH_OFFLOAD_KEEPALIVE_PAYLOAD <= 48, "keep-alive payload doesn't fit in an iovar request");
+
+// packet filter ids used by this module, one per CYW43_ARCH_OFFLOAD_DROP_ flag
+#define FILTER_ID_BASE 200
+#define FILTER_PATTERN_MAX 38
+
+// the firmware either forwards or drops what matches a filter; everything here is dropped
+#define PKT_FILTER_MODE_DROP_ON_MATCH 0
+
+// wl_mkeep_alive_pkt_t: version, length of the fixed part, period, frame length, id, then the frame
+#define MKEEP_ALIVE_VERSION 1
+#define MKEEP_ALIVE_FIXED_LEN 11
+
+#define KEEPALIVE_FRAME_MAX (SIZEOF_ETH_HDR + IP_HLEN + LWIP_MAX(UDP_HLEN + CYW43_ARCH_OFFLOAD_KEEPALIVE_PAYLOAD, TCP_HLEN))
+
+// a keep-alive whose next hop isn't in the ARP table yet is tried again after this long
+#define KEEPALIVE_RETRY_MS 500
+
+typedef enum keepalive_type {
+    KEEPALIVE_NONE,
+    KEEPALIVE_UDP,
+    KEEPALIVE_TCP,
+} keepalive_type_t;
+
+typedef struct keepalive {
+    keepalive_type_t type;
+    bool programmed;
+    uint32_t period_ms;
+    ip4_addr_t dest;
+    uint16_t src_port;
+    uint16_t dest_port;
+    uint32_t seq;
+    uint32_t ack;
+    uint16_t wnd;
+    uint8_t payload_len;
+    uint8_t payload[CYW43_ARCH_OFFLOAD_KEEPALIVE_PAYLOAD];
+} keepalive_t;
+
+typedef struct filter_pattern {
+    uint8_t len;
+    uint8_t mask[FILTER_PATTERN_MAX];
+    uint8_t pattern[FILTER_PATTERN_MAX];
+} filter_pattern_t;
+
+// matched from the start of the ethernet frame, in CYW43_ARCH_OFFLOAD_DROP_ flag order
+static const filter_pattern_t filter_patterns[CYW43_ARCH_OFFLOAD_FILTER_COUNT] = {
+        // destination MAC of 224.0.0.251
+        { 6, { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff }, { 0x01, 0x00, 0x5e, 0x00, 0x00, 0xfb } },
+        // destination MAC of 239.255.255.250
+        { 6, { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff }, { 0x01, 0x00, 0x5e, 0x7f, 0xff, 0xfa } },
+        // any IPv6 multicast MAC
+        { 2, { 0xff, 0xff }, { 0x33, 0x33 } },
+        // broadcast IPv4 UDP to ports 136-139, of which 137 and 138 are NetBIOS over UDP
+        { 38, { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, [12] = 0xff, 0xff, [23] = 0xff, [36] = 0xff, 0xfc },
+              { 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, [12] = 0x08, 0x00, [23] = IP_PROTO_UDP, [36] = 0x00, 0x88 } },
+};
+
+// all of this is protected by the async_context lock, which is also the lwIP core lock
+static bool attached;
+static bool arp_enabled = true;
+static uint32_t filters = CYW43_ARCH_OFFLOAD_FILTERS;
+static uint32_t filters_programmed;
+static bool filters_valid;
+static ip4_addr_t applied_ip;
+static bool applied_valid;
+static bool applied_arp;
+static keepalive_t keepalives[CYW43_ARCH_OFFLOAD_KEEPALIVES];
+static uint32_t reconfigs;
+
+static void offload_apply_worker_func(async_context_t *context, async_when_pending_worker_t *worker);
+static void offload_timer_func(async_context_t *context, async_at_time_worker_t *worker);
+
+static async_when_pending_worker_t offload_apply_worker = {
+        .do_work = offload_apply_worker_func
+};
+
+// retries keep-alives waiting for ARP, and polls the address when there's no status callback
+static async_at_time_worker_t offload_timer = {
+        .do_work = offload_timer_func
+};
+
+#if LWIP_NETIF_STATUS_CALLBACK
+static netif_status_callback_fn netif_status_next;
+#endif
+
+static struct netif *sta_netif(void) {
+    return &cyw43_state.netif[CYW43_ITF_STA];
+}
+
+static void put_u16_le(uint8_t *buf, uint16_t value) {
+    buf[0] = (uint8_t)value;
+    buf[1] = (uint8_t)(value >> 8);
+}
+
+static void put_u32_le(uint8_t *buf, uint32_t value) {
+    put_u16_le(buf, (uint16_t)value);
+    put_u16_le(buf + 2, (uint16_t)(value >> 16));
+}
+
+static void put_u16_be(uint8_t *buf, uint16_t value) {
+    buf[0] = (uint8_t)(value >> 8);
+    buf[1] = (uint8_t)value;
+}
+
+static void put_u32_be(uint8_t *buf, uint32_t value) {
+    put_u16_be(buf, (uint16_t)(value >> 16));
+    put_u16_be(buf + 2, (uint16_t)value);
+}
+
+static void offload_schedule(void) {
+    async_context_t *context = cyw43_arch_async_context();
+    if (context && attached) async_context_set_work_pending(context, &offload_apply_worker);
+}
+
+static int set_var_u32(const char *name, uint32_t value) {
+    return cyw43_arch_ioctl_set_var(name, &value, sizeof(value), CYW43_ITF_STA);
+}
+
+static void program_filter(uint index, bool enable) {
+    uint32_t id = FILTER_ID_BASE + index;
+    // re-adding an id the firmware already has fails, so start from a clean slate
+    set_var_u32("pkt_filter_delete", id);
+    if (!enable) return;
+
+    const filter_pattern_t *p = &filter_patterns[index];
+    // wl_pkt_filter_t with a pattern: id, type, negate, offset, size, then the mask and the pattern
+    uint8_t buf[20 + 2 * FILTER_PATTERN_MAX];
+    put_u32_le(buf, id);
+    put_u32_le(buf + 4, 0);
+    put_u32_le(buf + 8, 0);
+    put_u32_le(buf + 12, 0);
+    put_u32_le(buf + 16, p->len);
+    memcpy(buf + 20, p->mask, p->len);
+    memcpy(buf + 20 + p->len, p->pattern, p->len);
+    if (cyw43_arch_ioctl_set_var("pkt_filter_add", buf, 20 + 2 * p->len, CYW43_ITF_STA)) return;
+
+    uint8_t en[8];
+    put_u32_le(en, id);
+    put_u32_le(en + 4, 1);
+    cyw43_arch_ioctl_set_var("pkt_filter_enable", en, sizeof(en), CYW43_ITF_STA);
+}
+
+#if LWIP_IGMP
+static bool filter_matches(const filter_pattern_t *p, const uint8_t *frame, size_t len) {
+    if (p->len > len) return false;
+    for (uint i = 0; i < p->len; i++) {
+        if ((frame[i] & p->mask[i]) != p->pattern[i]) return false;
+    }
+    return true;
+}
+#endif
+
+// The filters which would drop traffic for a group the station has joined. Those are left off for
+// as long as the group is joined, whatever was asked for; the multicast hooks reschedule us when
+// the groups change.
+static uint32_t filters_joined(void) {
+    struct netif *netif = sta_netif();
+    uint32_t joined = 0;
+#if LWIP_IGMP
+    for (struct igmp_group *g = netif_igmp_data(netif); g; g = g->next) {
+        const uint8_t *ip = (const uint8_t *)&g->group_address.addr;
+        uint8_t mac[6] = { 0x01, 0x00, 0x5e, ip[1] & 0x7f, ip[2], ip[3] };
+        for (uint i = 0; i < CYW43_ARCH_OFFLOAD_FILTER_COUNT; i++) {
+            if (filter_matches(&filter_patterns[i], mac, sizeof(mac))) joined |= 1u << i;
+        }
+    }
+#endif
+#if LWIP_IPV6 && LWIP_IPV6_MLD
+    // each address joins its solicited node group, which neighbour discovery can't do without
+    if (netif_mld6_data(netif)) joined |= CYW43_ARCH_OFFLOAD_DROP_IPV6_MCAST;
+#endif
+    (void)netif;
+    return joined;
+}
+
+static void apply_filters(void) {
+    if (!filters_valid) {
+        set_var_u32("pkt_filter_mode", PKT_FILTER_MODE_DROP_ON_MATCH);
+        filters_programmed = 0;
+    }
+    uint32_t wanted = filters & ~filters_joined();
+    for (uint i = 0; i < CYW43_ARCH_OFFLOAD_FILTER_COUNT; i++) {
+        bool enable = wanted & (1u << i);
+        if (filters_valid && enable == !!(filters_programmed & (1u << i))) continue;
+        program_filter(i, enable);
+    }
+    filters_programmed = wanted;
+    filters_valid = true;
+}
+
+static void apply_arp(const ip4_addr_t *ip) {
+    // the firmware keeps a list of host addresses, and learns peers while snooping
+    cyw43_arch_ioctl_set_var("arp_hostip_clear", "", 0, CYW43_ITF_STA);
+    cyw43_arch_ioctl_set_var("arp_table_clear", "", 0, CYW43_ITF_STA);
+    if (arp_enabled && !ip4_addr_isany(ip)) {
+        set_var_u32("arp_ol", CYW43_ARCH_OFFLOAD_ARP_MODE);
+        set_var_u32("arpoe", 1);
+        cyw43_arch_ioctl_set_var("arp_hostip", &ip->addr, sizeof(ip->addr), CYW43_ITF_STA);
+    } else {
+        set_var_u32("arpoe", 0);
+    }
+}
+
+static int program_keepalive(uint slot, uint32_t period_ms, const uint8_t *frame, size_t len) {
+    uint8_t buf[MKEEP_ALIVE_FIXED_LEN + KEEPALIVE_FRAME_MAX];
+    put_u16_le(buf, MKEEP_ALIVE_VERSION);
+    put_u16_le(buf + 2, MKEEP_ALIVE_FIXED_LEN);
+    put_u32_le(buf + 4, period_ms);
+    put_u16_le(buf + 8, (uint16_t)len);
+    buf[10] = (uint8_t)slot;
+    if (len) memcpy(buf + MKEEP_ALIVE_FIXED_LEN, frame, len);
+    return cyw43_arch_ioctl_set_var("mkeep_alive", buf, MKEEP_ALIVE_FIXED_LEN + len, CYW43_ITF_STA);
+}
+
+// returns the length of the frame, or 0 if the MAC address of the next hop isn't known yet
+static size_t build_keepalive(const keepalive_t *ka, struct netif *netif, uint8_t *frame) {
+    const ip4_addr_t *next_hop = &ka->dest;
+    if (!ip4_addr_netcmp(&ka->dest, netif_ip4_addr(netif), netif_ip4_netmask(netif))) {
+        next_hop = netif_ip4_gw(netif);
+    }
+    struct eth_addr *hw;
+    const ip4_addr_t *unused;
+    if (etharp_find_addr(netif, next_hop, &hw, &unused) < 0) {
+        etharp_request(netif, next_hop);
+        return 0;
+    }
+
+    size_t l4_len = ka->type == KEEPALIVE_UDP ? UDP_HLEN + ka->payload_len : TCP_HLEN;
+    uint8_t *ip = frame + SIZEOF_ETH_HDR;
+    uint8_t *l4 = ip + IP_HLEN;
+
+    memcpy(frame, hw->addr, ETH_HWADDR_LEN);
+    memcpy(frame + ETH_HWADDR_LEN, netif->hwaddr, ETH_HWADDR_LEN);
+    put_u16_be(frame + 12, ETHTYPE_IP);
+
+    memset(ip, 0, IP_HLEN);
+    ip[0] = 0x45;
+    put_u16_be(ip + 2, (uint16_t)(IP_HLEN + l4_len));
+    put_u16_be(ip + 6, 0x4000); // don't fragment
+    ip[8] = IP_DEFAULT_TTL;
+    ip[9] = ka->type == KEEPALIVE_UDP ? IP_PROTO_UDP : IP_PROTO_TCP;
+    memcpy(ip + 12, &netif_ip4_addr(netif)->addr, 4);
+    memcpy(ip + 16, &ka->dest.addr, 4);
+    u16_t sum = inet_chksum(ip, IP_HLEN);
+    memcpy(ip + 10, &sum, sizeof(sum));
+
+    put_u16_be(l4, ka->src_port);
+    put_u16_be(l4 + 2, ka->dest_port);
+    if (ka->type == KEEPALIVE_UDP) {
+        // the checksum is optional for UDP over IPv4, and left out
+        put_u16_be(l4 + 4, (uint16_t)l4_len);
+        put_u16_be(l4 + 6, 0);
+        memcpy(l4 + UDP_HLEN, ka->payload, ka->payload_len);
+    } else {
+        memset(l4 + 4, 0, TCP_HLEN - 4);
+        put_u32_be(l4 + 4, ka->seq);
+        put_u32_be(l4 + 8, ka->ack);
+        l4[12] = (TCP_HLEN / 4) << 4;
+        l4[13] = TCP_ACK;
+        put_u16_be(l4 + 14, ka->wnd);
+        // checksummed together with the pseudo header
+        uint8_t pseudo[12 + TCP_HLEN];
+        memcpy(pseudo, ip + 12, 8);
+        pseudo[8] = 0;
+        pseudo[9] = IP_PROTO_TCP;
+        put_u16_be(pseudo + 10, TCP_HLEN);
+        memcpy(pseudo + 12, l4, TCP_HLEN);
+        sum = inet_chksum(pseudo, sizeof(pseudo));
+        memcpy(l4 + 16, &sum, sizeof(sum));
+    }
+    return SIZEOF_ETH_HDR + IP_HLEN + l4_len;
+}
+
+// returns false if a keep-alive is waiting for the MAC address of its next hop
+static bool apply_keepalives(struct netif *netif, bool address_changed) {
+    bool have_address = !ip4_addr_isany(netif_ip4_addr(netif));
+    bool complete = true;
+    for (uint i = 0; i < CYW43_ARCH_OFFLOAD_KEEPALIVES; i++) {
+        keepalive_t *ka = &keepalives[i];
+        if (address_changed) {
+            // a TCP connection is bound to the address it was made from
+            if (ka->type == KEEPALIVE_TCP) ka->type = KEEPALIVE_NONE;
+            if (ka->programmed) {
+                program_keepalive(i, 0, NULL, 0);
+                ka->programmed = false;
+            }
+        }
+        if (ka->programmed || ka->type == KEEPALIVE_NONE || !have_address) continue;
+        uint8_t frame[KEEPALIVE_FRAME_MAX];
+        size_t len = build_keepalive(ka, netif, frame);
+        if (!len) {
+            complete = false;
+            continue;
+        }
+        ka->programmed = !program_keepalive(i, ka->period_ms, frame, len);
+    }
+    return complete;
+}
+
+static void offload_apply_worker_func(async_context_t *context, __unused async_when_pending_worker_t *worker) {
+    if (!attached) return;
+    struct netif *netif = sta_netif();
+    apply_filters();
+
+    ip4_addr_t ip = *netif_ip4_addr(netif);
+    if (!netif_is_up(netif)) ip4_addr_set_any(&ip);
+    bool address_changed = !applied_valid || !ip4_addr_cmp(&ip, &applied_ip);
+    if (address_changed || applied_arp != arp_enabled) {
+        apply_arp(&ip);
+        if (address_changed && !ip4_addr_isany(&ip)) reconfigs++;
+        applied_ip = ip;
+        applied_valid = true;
+        applied_arp = arp_enabled;
+    }
+
+    bool complete = apply_keepalives(netif, address_changed);
+#if LWIP_NETIF_STATUS_CALLBACK
+    if (!complete) async_context_add_at_time_worker_in_ms(context, &offload_timer, KEEPALIVE_RETRY_MS);
+#else
+    (void)complete;
+    (void)context;
+#endif
+}
+
+#if LWIP_NETIF_STATUS_CALLBACK
+// called by lwIP, from the async_context, when the netif goes up or down or its address changes
+static void offload_netif_status_callback(struct netif *netif) {
+    offload_schedule();
+    if (netif_status_next) netif_status_next(netif);
+}
+
+static void offload_timer_func(__unused async_context_t *context, __unused async_at_time_worker_t *worker) {
+    offload_schedule();
+}
+#else
+// without a status callback, looking at the address is cheap enough to poll
+static void offload_timer_func(async_context_t *context, async_at_time_worker_t *worker) {
+    offload_apply_worker_func(context, &offload_apply_worker);
+    async_context_add_at_time_worker_in_ms(context, worker, CYW43_ARCH_OFFLOAD_POLL_MS);
+}
+#endif
+
+void cyw43_arch_offload_attach(void) {
+    async_context_t *context = cyw43_arch_async_context();
+    cyw43_thread_enter();
+    if (!attached) {
+        attached = true;
+        async_context_add_when_pending_worker(context, &offload_apply_worker);
+#if !LWIP_NETIF_STATUS_CALLBACK
+        async_context_add_at_time_worker_in_ms(context, &offload_timer, CYW43_ARCH_OFFLOAD_POLL_MS);
+#endif
+    }
+#if LWIP_NETIF_STATUS_CALLBACK
+    struct netif *netif = sta_netif();
+    if (netif->status_callback != offload_netif_status_callback) {
+        netif_status_next = netif->status_callback;
+        netif_set_status_callback(netif, offload_netif_status_callback);
+    }
+#endif
+    // the firmware may have been restarted, so program everything again
+    filters_valid = false;
+    applied_valid = false;
+    for (uint i = 0; i < CYW43_ARCH_OFFLOAD_KEEPALIVES; i++) keepalives[i].programmed = false;
+    cyw43_thread_exit();
+    offload_schedule();
+}
+
+void cyw43_arch_offload_set_arp(bool enable) {
+    cyw43_thread_enter();
+    arp_enabled = enable;
+    cyw43_thread_exit();
+    offload_schedule();
+}
+
+void cyw43_arch_offload_groups_changed(void) {
+    offload_schedule();
+}
+
+void cyw43_arch_offload_set_filters(uint32_t new_filters) {
+    cyw43_thread_enter();
+    filters = new_filters & ((1u << CYW43_ARCH_OFFLOAD_FILTER_COUNT) - 1);
+    cyw43_thread_exit();
+    offload_schedule();
+}
+
+static int set_keepalive(uint slot, const keepalive_t *ka) {
+    if (slot >= CYW43_ARCH_OFFLOAD_KEEPALIVES) return PICO_ERROR_INVALID_ARG;
+    cyw43_thread_enter();
+    keepalive_t *old = &keepalives[slot];
+    if (old->programmed && attached) program_keepalive(slot, 0, NULL, 0);
+    *old = *ka;
+    cyw43_thread_exit();
+    offload_schedule();
+    return 0;
+}
+
+int cyw43_arch_offload_set_udp_keepalive(uint slot, const ip4_addr_t *dest, uint16_t src_port, uint16_t dest_port,
+                                         const void *payload, size_t len, uint32_t period_ms) {
+    if (len > CYW43_ARCH_OFFLOAD_KEEPALIVE_PAYLOAD) return PICO_ERROR_INVALID_ARG;
+    keepalive_t ka;
+    memset(&ka, 0, sizeof(ka));
+    if (period_ms) {
+        ka.type = KEEPALIVE_UDP;
+        ka.period_ms = period_ms;
+        ka.dest = *dest;
+        ka.src_port = src_port;
+        ka.dest_port = dest_port;
+        ka.payload_len = (uint8_t)len;
+        if (len) memcpy(ka.payload, payload, len);
+    }
+    return set_keepalive(slot, &ka);
+}
+
+int cyw43_arch_offload_set_tcp_keepalive(uint slot, const struct tcp_pcb *pcb, uint32_t period_ms) {
+    keepalive_t ka;
+    memset(&ka, 0, sizeof(ka));
+    if (period_ms) {
+        if (pcb->state != ESTABLISHED || !IP_IS_V4(&pcb->remote_ip)) return PICO_ERROR_INVALID_ARG;
+        ka.type = KEEPALIVE_TCP;
+        ka.period_ms = period_ms;
+        ka.dest = *ip_2_ip4(&pcb->remote_ip);
+        ka.src_port = pcb->local_port;
+        ka.dest_port = pcb->remote_port;
+        // the same probe lwIP's tcp_keepalive() sends: one byte behind, so the peer has to ACK it
+        ka.seq = pcb->snd_nxt - 1;
+        ka.ack = pcb->rcv_nxt;
+        ka.wnd = TCPWND_MIN16(RCV_WND_SCALE(pcb, pcb->rcv_ann_wnd));
+    }
+    return set_keepalive(slot, &ka);
+}
+
+int cyw43_arch_offload_get_stats(cyw43_arch_offload_stats_t *stats) {
+    // arp_ol_stats_t as laid out by the firmware
+    struct {
+        uint32_t host_ip_entries;
+        uint32_t host_ip_overflow;
+        uint32_t arp_table_entries;
+        uint32_t arp_table_overflow;
+        uint32_t host_request;
+        uint32_t host_reply;
+        uint32_t host_service;
+        uint32_t peer_request;
+        uint32_t peer_request_drop;
+        uint32_t peer_reply;
+        uint32_t peer_reply_drop;
+        uint32_t peer_service;
+    } arp;
+    // wl_pkt_filter_stats_t
+    struct {
+        uint32_t matched;
+        uint32_t forwarded;
+        uint32_t discarded;
+    } filter;
+
+    memset(stats, 0, sizeof(*stats));
+    cyw43_thread_enter();
+    int err = 0;
+    if (applied_arp) {
+        if (cyw43_arch_ioctl_get_var("arp_stats", &arp, sizeof(arp), CYW43_ITF_STA)) {
+            err = PICO_ERROR_IO;
+        } else {
+            stats->arp_replies = arp.peer_service;
+            stats->arp_dropped = arp.peer_request_drop;
+        }
+    }
+    for (uint i = 0; i < CYW43_ARCH_OFFLOAD_FILTER_COUNT; i++) {
+        if (!(filters_programmed & (1u << i))) continue;
+        uint32_t id = FILTER_ID_BASE + i;
+        if (cyw43_arch_ioctl_get_var_param("pkt_filter_stats", &id, sizeof(id), &filter, sizeof(filter), CYW43_ITF_STA)) {
+            err = PICO_ERROR_IO;
+            continue;
+        }
+        stats->filter_dropped[i] = filter.discarded;
+    }
+    for (uint i = 0; i < CYW43_ARCH_OFFLOAD_KEEPALIVES; i++) {
+        if (keepalives[i].programmed) stats->keepalives++;
+    }
+    stats->reconfigs = reconfigs;
+    cyw43_thread_exit();
+
+    stats->wakeups_avoided = stats->arp_replies + stats->arp_dropped;
+    for (uint i = 0; i < CYW43_ARCH_OFFLOAD_FILTER_COUNT; i++) {
+        stats->wakeups_avoided += stats->filter_dropped[i];
+    }
+    return err;
+}
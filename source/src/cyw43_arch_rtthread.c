@@ -7,8 +7,11 @@
 #if PICO_CYW43_ARCH_RTTHREAD
 
 #include "cyw43_arch.h"
+#include "cyw43_arch_ioctl.h"
 #include "pico/cyw43_driver.h"
 #include "async_context_rtthread.h"
+#include "cyw43_frame_pool.h"
+#include "cyw43_pmk_cache.h"
 
 #if CYW43_LWIP
 #include "lwip_rtthread.h"
@@ -32,6 +35,9 @@ async_context_t *cyw43_arch_init_default_async_context(void) {
 #endif
 #ifdef CYW43_TASK_STACK_SIZE
     config.task_stack_size = CYW43_TASK_STACK_SIZE;
+#endif
+#ifdef CYW43_IRQ_POLL_TICKS
+    config.irq_poll_ticks = CYW43_IRQ_POLL_TICKS;
 #endif
     if (async_context_rtthread_init(&cyw43_async_context_rtthread, &config))
         return &cyw43_async_context_rtthread.core;
@@ -45,6 +51,13 @@ int cyw43_arch_init(void) {
         if (!context) return PICO_ERROR_GENERIC;
         cyw43_arch_set_async_context(context);
     }
+#if CYW43_FRAME_POOL
+    cyw43_frame_pool_init();
+#endif
+#if CYW43_PMK_CACHE
+    cyw43_pmk_cache_init();
+#endif
+    cyw43_arch_ioctl_init(context);
     bool ok = cyw43_driver_init(context);
 #if CYW43_LWIP
 //    ok &= lwip_rtthread_init(context);
@@ -71,6 +84,10 @@ void cyw43_arch_deinit(void) {
     // todo add a "pause" method to async_context if we need to provide some atomicity (we
     //      don't want to take the lock as these methods may invoke execute_sync()
     cyw43_driver_deinit(context);
+    cyw43_arch_ioctl_deinit(context);
+#if CYW43_ARCH_GPIO_SHADOW
+    cyw43_arch_gpio_forget();
+#endif
 #if CYW43_LWIP
 //    lwip_rtthread_deinit(context);
 #endif
@@ -81,4 +98,120 @@ void cyw43_arch_deinit(void) {
     }
 }
 
+bool cyw43_arch_in_async_context_task(void) {
+    return cyw43_arch_async_context() == &cyw43_async_context_rtthread.core &&
+           cyw43_async_context_rtthread.task_handle && rt_thread_self() == cyw43_async_context_rtthread.task_handle;
+}
+
+static cyw43_arch_stack_phase_t stack_phase;
+static uint32_t stack_high_water[CYW43_ARCH_STACK_PHASE_COUNT];
+
+// must be called with the lock held
+static void stack_phase_update(void) {
+    uint32_t used = async_context_rtthread_get_stack_high_water(&cyw43_async_context_rtthread);
+    if (used > stack_high_water[stack_phase]) stack_high_water[stack_phase] = used;
+}
+
+void cyw43_arch_set_stack_phase(cyw43_arch_stack_phase_t phase) {
+    if (cyw43_arch_async_context() != &cyw43_async_context_rtthread.core) return;
+    cyw43_thread_enter();
+    stack_phase_update();
+    // the task can't be running while we hold the lock, other than on its way to waiting for it
+    async_context_rtthread_reset_stack_high_water(&cyw43_async_context_rtthread);
+    stack_phase = phase;
+    cyw43_thread_exit();
+}
+
+cyw43_arch_stack_phase_t cyw43_arch_get_stack_phase(void) {
+    return stack_phase;
+}
+
+uint32_t cyw43_arch_get_stack_high_water(cyw43_arch_stack_phase_t phase) {
+    if (phase >= CYW43_ARCH_STACK_PHASE_COUNT) return 0;
+    if (cyw43_arch_async_context() == &cyw43_async_context_rtthread.core) {
+        cyw43_thread_enter();
+        stack_phase_update();
+        cyw43_thread_exit();
+    }
+    return stack_high_water[phase];
+}
+
+#ifdef RT_USING_FINSH
+static void cyw43_stack(int argc, char **argv)
+{
+    static const char *phase_name[] = {"init", "scan", "join", "data"};
+    uint32_t peak = 0;
+
+    rt_kprintf("phase  peak stack use of %u bytes\n", cyw43_async_context_rtthread.task_handle ?
+            (uint32_t)cyw43_async_context_rtthread.task_handle->stack_size : 0);
+    for (int i = 0; i < CYW43_ARCH_STACK_PHASE_COUNT; i++)
+    {
+        uint32_t used = cyw43_arch_get_stack_high_water((cyw43_arch_stack_phase_t)i);
+
+        rt_kprintf("%-5s  %6u%s\n", phase_name[i], used, i == (int)stack_phase ? " (current)" : "");
+        if (used > peak) peak = used;
+    }
+    // feed this back into the build to size the stack from the measurement
+    rt_kprintf("measured profile: PKG_CYW43439_TASK_STACK_MEASURED=%u\n", peak);
+}
+MSH_CMD_EXPORT(cyw43_stack, show the peak stack use of the cyw43 task per phase);
+
+static void cyw43_mem(int argc, char **argv)
+{
+    rt_size_t total = sizeof(cyw43_async_context_rtthread);
+
+    // sizes are worked out from this build's configuration; heap sizes exclude allocator overhead
+    rt_kprintf("async_context_rtthread_t   %6u static\n", sizeof(cyw43_async_context_rtthread));
+#if ASYNC_CONTEXT_RTTHREAD_STATIC
+    rt_kprintf("  task stack               %6u\n", sizeof(cyw43_async_context_rtthread.task_stack));
+    rt_kprintf("  kernel objects           %6u\n", sizeof(struct rt_mutex) + 2 * sizeof(struct rt_semaphore) +
+            sizeof(struct rt_event) + 2 * sizeof(struct rt_timer) + sizeof(struct rt_thread));
+#else
+    rt_size_t objects = sizeof(struct rt_mutex) + sizeof(struct rt_semaphore) + sizeof(struct rt_event) +
+            2 * sizeof(struct rt_timer) + sizeof(struct rt_thread);
+    rt_kprintf("task stack                 %6u heap\n", CYW43_TASK_STACK_SIZE);
+    rt_kprintf("kernel objects             %6u heap\n", objects);
+    total += CYW43_TASK_STACK_SIZE + objects;
+#endif
+#if ASYNC_CONTEXT_RTTHREAD_LOCK_PROFILE
+    rt_kprintf("  lock profiler            %6u\n", sizeof(cyw43_async_context_rtthread.lock_stats));
+#endif
+#if CYW43_FRAME_POOL
+    rt_kprintf("frame pool                 %6u static\n",
+            (CYW43_FRAME_POOL_RX_FRAMES + CYW43_FRAME_POOL_TX_FRAMES) * ((CYW43_FRAME_POOL_FRAME_SIZE + 3) & ~3));
+    total += (CYW43_FRAME_POOL_RX_FRAMES + CYW43_FRAME_POOL_TX_FRAMES) * ((CYW43_FRAME_POOL_FRAME_SIZE + 3) & ~3);
+#endif
+    rt_kprintf("total                      %6u\n", total);
+}
+MSH_CMD_EXPORT(cyw43_mem, show the RAM used by the cyw43 async_context);
+#endif
+
+#if ASYNC_CONTEXT_RTTHREAD_LOCK_PROFILE && defined(RT_USING_FINSH)
+static void async_lock_prof(int argc, char **argv)
+{
+    async_context_rtthread_lock_stats_t stats[ASYNC_CONTEXT_RTTHREAD_LOCK_PROFILE_THREADS + 1];
+    uint32_t count;
+
+    if (cyw43_arch_async_context() != &cyw43_async_context_rtthread.core)
+    {
+        rt_kprintf("the cyw43 async_context is not running\n");
+        return;
+    }
+    if (argc > 1 && !rt_strcmp(argv[1], "reset"))
+    {
+        async_context_rtthread_lock_profile_reset(&cyw43_async_context_rtthread);
+        return;
+    }
+    count = async_context_rtthread_lock_profile_get(&cyw43_async_context_rtthread, stats, ASYNC_CONTEXT_RTTHREAD_LOCK_PROFILE_THREADS + 1);
+    rt_kprintf("%-*.*s acquires  nested contended  wait(us) maxwait  hold(us) maxhold\n", RT_NAME_MAX, RT_NAME_MAX, "thread");
+    for (uint32_t i = 0; i < count; i++)
+    {
+        rt_kprintf("%-*.*s %8u %7u %9u %9u %7u %9u %7u\n", RT_NAME_MAX, RT_NAME_MAX,
+                stats[i].thread ? stats[i].name : "(other)", stats[i].acquires, stats[i].nested, stats[i].contended,
+                (uint32_t)stats[i].wait_us, stats[i].max_wait_us, (uint32_t)stats[i].hold_us, stats[i].max_hold_us);
+    }
+}
+MSH_CMD_EXPORT(async_lock_prof, show cyw43 async_context lock contention: [reset]);
+#endif
+
 #endif
@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include "cyw43_arch_stats.h"
+#include "cyw43_arch_datapath.h"
+#include "hardware/sync.h"
+
+#if PICO_CYW43_ARCH_RTTHREAD
+#include "async_context_rtthread.h"
+#endif
+
+static cyw43_arch_stats_t core_stats[NUM_CORES];
+static uint64_t reset_us;
+static uint32_t reset_wakeups;
+
+static uint32_t get_wakeups(void) {
+#if PICO_CYW43_ARCH_RTTHREAD
+    // in this port cyw43_arch always runs on an async_context_rtthread
+    async_context_t *context = cyw43_arch_async_context();
+    if (context) return async_context_rtthread_get_wakeups((async_context_rtthread_t *)context);
+#endif
+    return 0;
+}
+
+void cyw43_arch_stats_tx(int itf, size_t len, int err, uint32_t send_us, uint32_t depth, uint32_t itf_depth) {
+    uint32_t save = save_and_disable_interrupts();
+    cyw43_arch_stats_t *stats = &core_stats[get_core_num()];
+    if (err) {
+        stats->itf[itf].tx_dropped++;
+    } else {
+        stats->itf[itf].tx_packets++;
+        stats->itf[itf].tx_bytes += len;
+    }
+    if (send_us >= CYW43_ARCH_STATS_STALL_US) {
+        stats->tx_stalls++;
+        stats->itf[itf].tx_stalls++;
+    }
+    if (send_us > stats->tx_max_us) stats->tx_max_us = send_us;
+    if (depth > stats->tx_queued_max) stats->tx_queued_max = depth;
+    if (itf_depth > stats->itf[itf].tx_queued_max) stats->itf[itf].tx_queued_max = itf_depth;
+    restore_interrupts(save);
+}
+
+void cyw43_arch_stats_rx(int itf, size_t len, bool chained) {
+    uint32_t save = save_and_disable_interrupts();
+    cyw43_arch_stats_t *stats = &core_stats[get_core_num()];
+    stats->itf[itf].rx_packets++;
+    stats->itf[itf].rx_bytes += len;
+    if (chained) stats->itf[itf].rx_chained++;
+    restore_interrupts(save);
+}
+
+int cyw43_arch_stats_ioctl(uint32_t start_us, int err) {
+    uint32_t elapsed_us = time_us_32() - start_us;
+    uint32_t save = save_and_disable_interrupts();
+    cyw43_arch_stats_t *stats = &core_stats[get_core_num()];
+    stats->ioctls++;
+    if (err) stats->ioctl_errors++;
+    stats->ioctl_us += elapsed_us;
+    if (elapsed_us > stats->ioctl_max_us) stats->ioctl_max_us = elapsed_us;
+    restore_interrupts(save);
+    return err;
+}
+
+static uint32_t max_u32(uint32_t a, uint32_t b) {
+    return a > b ? a : b;
+}
+
+void cyw43_arch_stats_get(cyw43_arch_stats_t *stats) {
+    memset(stats, 0, sizeof(*stats));
+    for (uint core = 0; core < NUM_CORES; core++) {
+        uint32_t save = save_and_disable_interrupts();
+        cyw43_arch_stats_t copy = core_stats[core];
+        restore_interrupts(save);
+        for (int itf = 0; itf <= CYW43_ITF_AP; itf++) {
+            stats->itf[itf].tx_packets += copy.itf[itf].tx_packets;
+            stats->itf[itf].tx_bytes += copy.itf[itf].tx_bytes;
+            stats->itf[itf].tx_dropped += copy.itf[itf].tx_dropped;
+            stats->itf[itf].rx_packets += copy.itf[itf].rx_packets;
+            stats->itf[itf].rx_bytes += copy.itf[itf].rx_bytes;
+            stats->itf[itf].rx_chained += copy.itf[itf].rx_chained;
+            stats->itf[itf].tx_queued_max = max_u32(stats->itf[itf].tx_queued_max, copy.itf[itf].tx_queued_max);
+            stats->itf[itf].tx_stalls += copy.itf[itf].tx_stalls;
+        }
+        stats->tx_queued_max = max_u32(stats->tx_queued_max, copy.tx_queued_max);
+        stats->tx_stalls += copy.tx_stalls;
+        stats->tx_max_us = max_u32(stats->tx_max_us, copy.tx_max_us);
+        stats->ioctls += copy.ioctls;
+        stats->ioctl_errors += copy.ioctl_errors;
+        stats->ioctl_max_us = max_u32(stats->ioctl_max_us, copy.ioctl_max_us);
+        stats->ioctl_us += copy.ioctl_us;
+    }
+    stats->tx_queued = cyw43_arch_datapath_tx_queued();
+    for (int itf = 0; itf <= CYW43_ITF_AP; itf++) {
+        stats->itf[itf].tx_queued = cyw43_arch_datapath_tx_queued_itf(itf);
+    }
+    stats->wakeups = get_wakeups() - reset_wakeups;
+    stats->period_us = time_us_64() - reset_us;
+}
+
+void cyw43_arch_stats_reset(void) {
+    for (uint core = 0; core < NUM_CORES; core++) {
+        uint32_t save = save_and_disable_interrupts();
+        memset(&core_stats[core], 0, sizeof(core_stats[core]));
+        restore_interrupts(save);
+    }
+    reset_wakeups = get_wakeups();
+    reset_us = time_us_64();
+}
@@ -0,0 +1,555 @@
+/*
+ * Copyright (c) 2006-2023, RT-Thread Development Team
+ *
+ * SPDX-License-Identifier: Apache-2.0
+ */
+#include <rtthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <netdb.h>
+#include "pico/time.h"
+#include "cyw43_arch.h"
+#include "cyw43_arch_stats.h"
+#include "async_context_rtthread.h"
+
+#define DBG_TAG "cyw43.bench"
+#define DBG_LVL DBG_INFO
+#include <rtdbg.h>
+
+#ifdef RT_USING_FINSH
+
+#ifndef CYW43_BENCH_BUF_SIZE
+#define CYW43_BENCH_BUF_SIZE        1460
+#endif
+
+#ifndef CYW43_BENCH_SERVER_STACK_SIZE
+#define CYW43_BENCH_SERVER_STACK_SIZE   2048
+#endif
+
+#ifndef CYW43_BENCH_SERVER_PRIORITY
+#define CYW43_BENCH_SERVER_PRIORITY     (RT_THREAD_PRIORITY_MAX - 4)
+#endif
+
+struct bench_result
+{
+    rt_uint64_t bytes;
+    rt_uint32_t packets;
+    rt_uint32_t errors;
+    rt_uint64_t start_us;
+    rt_uint64_t busy_start_us;
+    cyw43_arch_stats_t stats_start;
+};
+
+static rt_uint64_t bench_busy_us(void)
+{
+    /* in this port cyw43_arch always runs on an async_context_rtthread */
+    async_context_t *context = cyw43_arch_async_context();
+
+    return context ? async_context_rtthread_get_busy_us((async_context_rtthread_t *)context) : 0;
+}
+
+/* frames the driver failed to send, and sends which waited for credits, since the snapshot */
+static void bench_driver_report(const cyw43_arch_stats_t *before)
+{
+    cyw43_arch_stats_t after;
+    rt_uint32_t dropped = 0;
+    int itf;
+
+    cyw43_arch_stats_get(&after);
+    for (itf = 0; itf <= CYW43_ITF_AP; itf++)
+    {
+        dropped += after.itf[itf].tx_dropped - before->itf[itf].tx_dropped;
+    }
+    rt_kprintf("driver: %u tx dropped, %u tx stalls\n", dropped, after.tx_stalls - before->tx_stalls);
+}
+
+static void bench_start(struct bench_result *res)
+{
+    rt_memset(res, 0, sizeof(*res));
+    cyw43_arch_stats_get(&res->stats_start);
+    res->start_us = time_us_64();
+    res->busy_start_us = bench_busy_us();
+}
+
+static void bench_report(const char *name, struct bench_result *res)
+{
+    rt_uint64_t elapsed_us = time_us_64() - res->start_us;
+    rt_uint64_t busy_us = bench_busy_us() - res->busy_start_us;
+    rt_uint32_t kbps, load;
+
+    if (elapsed_us == 0)
+    {
+        elapsed_us = 1;
+    }
+    kbps = (rt_uint32_t)(res->bytes * 8000 / elapsed_us);
+    load = (rt_uint32_t)(busy_us * 1000 / elapsed_us);
+    rt_kprintf("%s: %u packets, %u bytes in %u ms, %u.%03u Mbit/s, %u errors\n", name, res->packets,
+               (rt_uint32_t)res->bytes, (rt_uint32_t)(elapsed_us / 1000), kbps / 1000, kbps % 1000, res->errors);
+    rt_kprintf("async_context_task load: %u.%u%%\n", load / 10, load % 10);
+    bench_driver_report(&res->stats_start);
+}
+
+static rt_bool_t bench_running(struct bench_result *res, int secs)
+{
+    return time_us_64() - res->start_us < (rt_uint64_t)secs * 1000000;
+}
+
+static int bench_addr(const char *host, int port, struct sockaddr_in *addr)
+{
+    rt_memset(addr, 0, sizeof(*addr));
+    addr->sin_family = AF_INET;
+    addr->sin_port = htons(port);
+    if (host == RT_NULL)
+    {
+        addr->sin_addr.s_addr = INADDR_ANY;
+        return 0;
+    }
+
+    struct hostent *he = gethostbyname(host);
+    if (he == RT_NULL)
+    {
+        LOG_E("unknown host %s", host);
+        return -1;
+    }
+    rt_memcpy(&addr->sin_addr, he->h_addr, sizeof(addr->sin_addr));
+    /* loopback traffic stays inside lwIP, so it only exercises the command, never the driver */
+    if ((ntohl(addr->sin_addr.s_addr) >> 24) == 127)
+    {
+        LOG_W("%s is a loopback address: the traffic does not go through the cyw43 driver", host);
+    }
+    return 0;
+}
+
+static void bench_set_timeout(int sock, int ms)
+{
+    struct timeval tv;
+
+    tv.tv_sec = ms / 1000;
+    tv.tv_usec = (ms % 1000) * 1000;
+    setsockopt(sock, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+}
+
+static void bench_udp_tx(const char *host, int port, int secs, int size, rt_uint8_t *buf)
+{
+    struct sockaddr_in addr;
+    struct bench_result res;
+    int sock;
+
+    if (bench_addr(host, port, &addr) < 0 || (sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+    {
+        return;
+    }
+    bench_start(&res);
+    while (bench_running(&res, secs))
+    {
+        if (sendto(sock, buf, size, 0, (struct sockaddr *)&addr, sizeof(addr)) == size)
+        {
+            res.packets++;
+            res.bytes += size;
+        }
+        else
+        {
+            /* out of pbufs; give the stack a chance to catch up */
+            res.errors++;
+            rt_thread_mdelay(1);
+        }
+    }
+    bench_report("udp tx", &res);
+    closesocket(sock);
+}
+
+static void bench_udp_rx(int port, int secs, rt_uint8_t *buf)
+{
+    struct sockaddr_in addr;
+    struct bench_result res;
+    int sock, len;
+
+    if (bench_addr(RT_NULL, port, &addr) < 0 || (sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+    {
+        return;
+    }
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        LOG_E("bind to port %d failed", port);
+        closesocket(sock);
+        return;
+    }
+    bench_set_timeout(sock, 100);
+    bench_start(&res);
+    while (bench_running(&res, secs))
+    {
+        len = recv(sock, buf, CYW43_BENCH_BUF_SIZE, 0);
+        if (len > 0)
+        {
+            res.packets++;
+            res.bytes += len;
+        }
+    }
+    bench_report("udp rx", &res);
+    closesocket(sock);
+}
+
+static void bench_tcp_tx(const char *host, int port, int secs, int size, rt_uint8_t *buf)
+{
+    struct sockaddr_in addr;
+    struct bench_result res;
+    int sock, len;
+
+    if (bench_addr(host, port, &addr) < 0 || (sock = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    {
+        return;
+    }
+    if (connect(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        LOG_E("connect to %s:%d failed", host, port);
+        closesocket(sock);
+        return;
+    }
+    bench_start(&res);
+    while (bench_running(&res, secs))
+    {
+        len = send(sock, buf, size, 0);
+        if (len <= 0)
+        {
+            res.errors++;
+            break;
+        }
+        res.packets++;
+        res.bytes += len;
+    }
+    bench_report("tcp tx", &res);
+    closesocket(sock);
+}
+
+static void bench_tcp_rx(int port, int secs, rt_uint8_t *buf)
+{
+    struct sockaddr_in addr;
+    struct bench_result res;
+    int server, sock, len;
+
+    if (bench_addr(RT_NULL, port, &addr) < 0 || (server = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    {
+        return;
+    }
+    if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(server, 1) < 0)
+    {
+        LOG_E("listen on port %d failed", port);
+        closesocket(server);
+        return;
+    }
+    rt_kprintf("waiting for connection on port %d\n", port);
+    sock = accept(server, RT_NULL, RT_NULL);
+    closesocket(server);
+    if (sock < 0)
+    {
+        return;
+    }
+    bench_set_timeout(sock, 100);
+    bench_start(&res);
+    while (bench_running(&res, secs))
+    {
+        len = recv(sock, buf, CYW43_BENCH_BUF_SIZE, 0);
+        if (len == 0)
+        {
+            break;
+        }
+        if (len > 0)
+        {
+            res.packets++;
+            res.bytes += len;
+        }
+    }
+    bench_report("tcp rx", &res);
+    closesocket(sock);
+}
+
+static void bench_ping(const char *host, int port, int count, int size, rt_uint8_t *buf)
+{
+    struct sockaddr_in addr;
+    cyw43_arch_stats_t stats_start;
+    rt_uint32_t rtt_us, min_us = ~0u, max_us = 0, lost = 0;
+    rt_uint64_t total_us = 0, start_us;
+    int sock, i;
+
+    if (bench_addr(host, port, &addr) < 0 || (sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+    {
+        return;
+    }
+    bench_set_timeout(sock, 1000);
+    cyw43_arch_stats_get(&stats_start);
+    for (i = 0; i < count; i++)
+    {
+        rt_memcpy(buf, &i, sizeof(i));
+        start_us = time_us_64();
+        if (sendto(sock, buf, size, 0, (struct sockaddr *)&addr, sizeof(addr)) != size)
+        {
+            lost++;
+            continue;
+        }
+        /* skip stale replies from earlier timed out requests */
+        do
+        {
+            if (recv(sock, buf, CYW43_BENCH_BUF_SIZE, 0) < (int)sizeof(i))
+            {
+                break;
+            }
+        } while (rt_memcmp(buf, &i, sizeof(i)) != 0);
+        if (rt_memcmp(buf, &i, sizeof(i)) != 0)
+        {
+            lost++;
+            continue;
+        }
+        rtt_us = (rt_uint32_t)(time_us_64() - start_us);
+        total_us += rtt_us;
+        if (rtt_us < min_us) min_us = rtt_us;
+        if (rtt_us > max_us) max_us = rtt_us;
+    }
+    if (lost == (rt_uint32_t)count)
+    {
+        rt_kprintf("ping: all %d requests lost\n", count);
+    }
+    else
+    {
+        rt_kprintf("ping: %d requests, %u lost, rtt min/avg/max %u/%u/%u us\n", count, lost, min_us,
+                   (rt_uint32_t)(total_us / (count - lost)), max_us);
+    }
+    bench_driver_report(&stats_start);
+    closesocket(sock);
+}
+
+/* peer side: echo UDP datagrams and sink TCP streams on the same port */
+static int bench_server_port;
+static volatile int bench_server_threads;
+
+/* a server thread which failed to start lets another server be started once both have gone */
+static void bench_server_thread_exit(void)
+{
+    rt_enter_critical();
+    if (--bench_server_threads == 0)
+    {
+        bench_server_port = 0;
+    }
+    rt_exit_critical();
+}
+
+static void bench_udp_echo_entry(void *parameter)
+{
+    int port = (int)(rt_ubase_t)parameter;
+    struct sockaddr_in addr, from;
+    socklen_t from_len;
+    rt_uint8_t *buf;
+    int sock, len;
+
+    buf = rt_malloc(CYW43_BENCH_BUF_SIZE);
+    if (buf == RT_NULL || bench_addr(RT_NULL, port, &addr) < 0 || (sock = socket(AF_INET, SOCK_DGRAM, 0)) < 0)
+    {
+        rt_free(buf);
+        bench_server_thread_exit();
+        return;
+    }
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0)
+    {
+        LOG_E("bind to port %d failed", port);
+        closesocket(sock);
+        rt_free(buf);
+        bench_server_thread_exit();
+        return;
+    }
+    while (1)
+    {
+        from_len = sizeof(from);
+        len = recvfrom(sock, buf, CYW43_BENCH_BUF_SIZE, 0, (struct sockaddr *)&from, &from_len);
+        if (len > 0)
+        {
+            sendto(sock, buf, len, 0, (struct sockaddr *)&from, from_len);
+        }
+    }
+}
+
+static void bench_tcp_sink_entry(void *parameter)
+{
+    int port = (int)(rt_ubase_t)parameter;
+    struct sockaddr_in addr;
+    rt_uint8_t *buf;
+    int server, sock;
+
+    buf = rt_malloc(CYW43_BENCH_BUF_SIZE);
+    if (buf == RT_NULL || bench_addr(RT_NULL, port, &addr) < 0 || (server = socket(AF_INET, SOCK_STREAM, 0)) < 0)
+    {
+        rt_free(buf);
+        bench_server_thread_exit();
+        return;
+    }
+    if (bind(server, (struct sockaddr *)&addr, sizeof(addr)) < 0 || listen(server, 1) < 0)
+    {
+        LOG_E("listen on port %d failed", port);
+        closesocket(server);
+        rt_free(buf);
+        bench_server_thread_exit();
+        return;
+    }
+    while (1)
+    {
+        sock = accept(server, RT_NULL, RT_NULL);
+        if (sock < 0)
+        {
+            continue;
+        }
+        while (recv(sock, buf, CYW43_BENCH_BUF_SIZE, 0) > 0);
+        closesocket(sock);
+    }
+}
+
+static void bench_server(int port)
+{
+    rt_thread_t udp, tcp;
+
+    /* the threads run until reset, so a second server would only fail to bind */
+    if (bench_server_port)
+    {
+        LOG_E("the server is already running on port %d", bench_server_port);
+        return;
+    }
+    udp = rt_thread_create("bench_udp", bench_udp_echo_entry, (void *)(rt_ubase_t)port,
+                           CYW43_BENCH_SERVER_STACK_SIZE, CYW43_BENCH_SERVER_PRIORITY, 10);
+    tcp = rt_thread_create("bench_tcp", bench_tcp_sink_entry, (void *)(rt_ubase_t)port,
+                           CYW43_BENCH_SERVER_STACK_SIZE, CYW43_BENCH_SERVER_PRIORITY, 10);
+    if (udp == RT_NULL || tcp == RT_NULL)
+    {
+        LOG_E("failed to create the server threads");
+        if (udp) rt_thread_delete(udp);
+        if (tcp) rt_thread_delete(tcp);
+        return;
+    }
+    bench_server_port = port;
+    bench_server_threads = 2;
+    rt_thread_startup(udp);
+    rt_thread_startup(tcp);
+    rt_kprintf("udp echo and tcp sink running on port %d\n", port);
+}
+
+/*
+ * Traffic forwarded between the station and the access point never reaches a socket, so the
+ * forwarding benchmark watches the driver counters instead while an external tool, such as iperf
+ * between a client of the access point and a host on the station's network, pushes traffic through.
+ */
+static void bench_forward_report(const char *name, const cyw43_arch_itf_stats_t *in_before,
+                                 const cyw43_arch_itf_stats_t *in_after, const cyw43_arch_itf_stats_t *out_before,
+                                 const cyw43_arch_itf_stats_t *out_after, rt_uint64_t elapsed_us)
+{
+    rt_uint32_t rx_packets = in_after->rx_packets - in_before->rx_packets;
+    rt_uint32_t tx_packets = out_after->tx_packets - out_before->tx_packets;
+    rt_uint32_t tx_bytes = out_after->tx_bytes - out_before->tx_bytes;
+    rt_uint32_t kbps = (rt_uint32_t)((rt_uint64_t)tx_bytes * 8000 / elapsed_us);
+
+    rt_kprintf("%s: %u packets in, %u packets out, %u.%03u Mbit/s, %u dropped, %u stalls\n", name, rx_packets,
+               tx_packets, kbps / 1000, kbps % 1000, out_after->tx_dropped - out_before->tx_dropped,
+               out_after->tx_stalls - out_before->tx_stalls);
+}
+
+static void bench_forward(int secs)
+{
+    cyw43_arch_stats_t before, after;
+    rt_uint64_t start_us, busy_start_us, elapsed_us, busy_us;
+    rt_uint32_t load;
+
+    if ((cyw43_state.itf_state & ((1 << CYW43_ITF_STA) | (1 << CYW43_ITF_AP))) != ((1 << CYW43_ITF_STA) | (1 << CYW43_ITF_AP)))
+    {
+        LOG_E("forwarding needs both the station and the access point up");
+        return;
+    }
+    cyw43_arch_stats_get(&before);
+    start_us = time_us_64();
+    busy_start_us = bench_busy_us();
+    rt_thread_mdelay(secs * 1000);
+    cyw43_arch_stats_get(&after);
+    elapsed_us = time_us_64() - start_us;
+    busy_us = bench_busy_us() - busy_start_us;
+
+    bench_forward_report("sta -> ap", &before.itf[CYW43_ITF_STA], &after.itf[CYW43_ITF_STA],
+                         &before.itf[CYW43_ITF_AP], &after.itf[CYW43_ITF_AP], elapsed_us);
+    bench_forward_report("ap -> sta", &before.itf[CYW43_ITF_AP], &after.itf[CYW43_ITF_AP],
+                         &before.itf[CYW43_ITF_STA], &after.itf[CYW43_ITF_STA], elapsed_us);
+    load = (rt_uint32_t)(busy_us * 1000 / elapsed_us);
+    rt_kprintf("async_context_task load: %u.%u%%\n", load / 10, load % 10);
+}
+
+static void bench_usage(void)
+{
+    rt_kprintf("usage: cyw43_bench udp_tx|tcp_tx <host> <port> [secs] [size]\n");
+    rt_kprintf("       cyw43_bench udp_rx|tcp_rx <port> [secs]\n");
+    rt_kprintf("       cyw43_bench ping <host> <port> [count] [size]\n");
+    rt_kprintf("       cyw43_bench server <port>\n");
+    rt_kprintf("       cyw43_bench forward <secs>\n");
+}
+
+static void cyw43_bench(int argc, char **argv)
+{
+    rt_uint8_t *buf;
+    int secs, size;
+
+    if (argc < 3)
+    {
+        bench_usage();
+        return;
+    }
+    if (!rt_strcmp(argv[1], "server"))
+    {
+        bench_server(atoi(argv[2]));
+        return;
+    }
+    if (!rt_strcmp(argv[1], "forward"))
+    {
+        secs = atoi(argv[2]);
+        bench_forward(secs > 0 ? secs : 10);
+        return;
+    }
+
+    buf = rt_malloc(CYW43_BENCH_BUF_SIZE);
+    if (buf == RT_NULL)
+    {
+        LOG_E("out of memory");
+        return;
+    }
+    rt_memset(buf, 0x5a, CYW43_BENCH_BUF_SIZE);
+    size = argc > 5 ? atoi(argv[5]) : CYW43_BENCH_BUF_SIZE;
+    if (size <= (int)sizeof(int) || size > CYW43_BENCH_BUF_SIZE)
+    {
+        size = CYW43_BENCH_BUF_SIZE;
+    }
+
+    if (!rt_strcmp(argv[1], "udp_tx") && argc > 3)
+    {
+        secs = argc > 4 ? atoi(argv[4]) : 10;
+        bench_udp_tx(argv[2], atoi(argv[3]), secs, size, buf);
+    }
+    else if (!rt_strcmp(argv[1], "tcp_tx") && argc > 3)
+    {
+        secs = argc > 4 ? atoi(argv[4]) : 10;
+        bench_tcp_tx(argv[2], atoi(argv[3]), secs, size, buf);
+    }
+    else if (!rt_strcmp(argv[1], "udp_rx"))
+    {
+        secs = argc > 3 ? atoi(argv[3]) : 10;
+        bench_udp_rx(atoi(argv[2]), secs, buf);
+    }
+    else if (!rt_strcmp(argv[1], "tcp_rx"))
+    {
+        secs = argc > 3 ? atoi(argv[3]) : 10;
+        bench_tcp_rx(atoi(argv[2]), secs, buf);
+    }
+    else if (!rt_strcmp(argv[1], "ping") && argc > 3)
+    {
+        size = argc > 5 ? size : 64;
+        bench_ping(argv[2], atoi(argv[3]), argc > 4 ? atoi(argv[4]) : 10, size, buf);
+    }
+    else
+    {
+        bench_usage();
+    }
+    rt_free(buf);
+}
+MSH_CMD_EXPORT(cyw43_bench, cyw43 wifi throughput and latency benchmark);
+#endif /* RT_USING_FINSH */
@@ -0,0 +1,215 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include "cyw43_dhcp_cache.h"
+#include "lwip/netif.h"
+#include "lwip/dhcp.h"
+#include "lwip/prot/dhcp.h"
+
+#if !LWIP_DHCP
+#error cyw43_dhcp_cache requires LWIP_DHCP
+#endif
+
+typedef struct dhcp_lease {
+    uint8_t ssid_len;
+    uint8_t ssid[32];
+    ip4_addr_t ip;
+    ip4_addr_t netmask;
+    ip4_addr_t gw;
+    ip4_addr_t server;
+    uint32_t lease_s;
+    uint32_t renew_s;
+    uint32_t rebind_s;
+    int64_t bound_us;   // before boot for a lease restored from flash
+    uint32_t last_used; // 0 means the entry is free
+} dhcp_lease_t;
+
+// all of this is protected by the async_context lock, which is also the lwIP core lock
+static dhcp_lease_t leases[CYW43_DHCP_CACHE_ENTRIES];
+static uint32_t use_counter;
+static uint8_t current_ssid[32];
+static uint8_t current_ssid_len;
+static cyw43_dhcp_cache_stats_t cache_stats;
+static void (*store_callback)(const cyw43_dhcp_cache_entry_t *entry);
+
+static dhcp_lease_t *find_lease(const uint8_t *ssid, size_t ssid_len) {
+    for (int i = 0; i < CYW43_DHCP_CACHE_ENTRIES; i++) {
+        if (leases[i].last_used && leases[i].ssid_len == ssid_len && !memcmp(leases[i].ssid, ssid, ssid_len)) {
+            return &leases[i];
+        }
+    }
+    return NULL;
+}
+
+static uint16_t secs_to_ticks(uint32_t secs) {
+    uint32_t ticks = (secs + DHCP_COARSE_TIMER_SECS / 2) / DHCP_COARSE_TIMER_SECS;
+    if (ticks > 0xffff) ticks = 0xffff;
+    return ticks ? (uint16_t)ticks : 1;
+}
+
+static dhcp_lease_t *find_or_replace_lease(const uint8_t *ssid, size_t ssid_len) {
+    dhcp_lease_t *lease = find_lease(ssid, ssid_len);
+    if (!lease) {
+        lease = &leases[0];
+        for (int i = 1; i < CYW43_DHCP_CACHE_ENTRIES; i++) {
+            if (leases[i].last_used < lease->last_used) lease = &leases[i];
+        }
+    }
+    return lease;
+}
+
+static uint32_t lease_used_s(const dhcp_lease_t *lease) {
+    return (uint32_t)(((int64_t)time_us_64() - lease->bound_us) / 1000000);
+}
+
+static void store_lease(const dhcp_lease_t *lease) {
+    if (!store_callback) return;
+    cyw43_dhcp_cache_entry_t entry;
+    memset(&entry, 0, sizeof(entry));
+    entry.ssid_len = lease->ssid_len;
+    memcpy(entry.ssid, lease->ssid, sizeof(entry.ssid));
+    entry.ip = lease->ip;
+    entry.netmask = lease->netmask;
+    entry.gw = lease->gw;
+    entry.server = lease->server;
+    entry.lease_s = lease->lease_s;
+    entry.renew_s = lease->renew_s;
+    entry.rebind_s = lease->rebind_s;
+    entry.used_s = lease_used_s(lease);
+    store_callback(&entry);
+}
+
+static void save_lease(struct netif *netif, struct dhcp *dhcp) {
+    if (!current_ssid_len || !dhcp_supplied_address(netif)) return;
+    dhcp_lease_t *lease = find_or_replace_lease(current_ssid, current_ssid_len);
+    lease->ssid_len = current_ssid_len;
+    memcpy(lease->ssid, current_ssid, sizeof(lease->ssid));
+    lease->ip = dhcp->offered_ip_addr;
+    lease->netmask = dhcp->offered_sn_mask;
+    lease->gw = dhcp->offered_gw_addr;
+    lease->server = *ip_2_ip4(&dhcp->server_ip_addr);
+    lease->lease_s = dhcp->offered_t0_lease;
+    lease->renew_s = dhcp->offered_t1_renew;
+    lease->rebind_s = dhcp->offered_t2_rebind;
+    lease->bound_us = (int64_t)time_us_64() - (int64_t)dhcp->lease_used * DHCP_COARSE_TIMER_SECS * 1000000;
+    lease->last_used = ++use_counter;
+    store_lease(lease);
+}
+
+// returns false if the lease has run out
+static bool load_lease(struct netif *netif, struct dhcp *dhcp, const dhcp_lease_t *lease) {
+    uint32_t used_s = lease_used_s(lease);
+    if (lease->lease_s != 0xffffffff && used_s >= lease->lease_s) return false;
+    dhcp->offered_ip_addr = lease->ip;
+    dhcp->offered_sn_mask = lease->netmask;
+    dhcp->offered_gw_addr = lease->gw;
+    ip_addr_copy_from_ip4(dhcp->server_ip_addr, lease->server);
+    dhcp->subnet_mask_given = 1;
+    dhcp->offered_t0_lease = lease->lease_s;
+    dhcp->offered_t1_renew = lease->renew_s;
+    dhcp->offered_t2_rebind = lease->rebind_s;
+    // the timers count coarse ticks from when the lease was bound
+    dhcp->lease_used = secs_to_ticks(used_s) - 1;
+    dhcp->t0_timeout = secs_to_ticks(lease->lease_s);
+    dhcp->t1_timeout = secs_to_ticks(lease->renew_s);
+    dhcp->t2_timeout = secs_to_ticks(lease->rebind_s);
+    dhcp->t1_renew_time = dhcp->t1_timeout > dhcp->lease_used ? dhcp->t1_timeout - dhcp->lease_used : 1;
+    dhcp->t2_rebind_time = dhcp->t2_timeout > dhcp->lease_used ? dhcp->t2_timeout - dhcp->lease_used : 1;
+    // lwIP does an INIT-REBOOT for a bound client when the link comes up
+    dhcp->state = DHCP_STATE_BOUND;
+    dhcp->tries = 0;
+#if CYW43_DHCP_CACHE_USE_ADDRESS
+    netif_set_addr(netif, &lease->ip, &lease->netmask, &lease->gw);
+#else
+    (void)netif;
+#endif
+    return true;
+}
+
+void cyw43_dhcp_cache_join(const uint8_t *ssid, size_t ssid_len) {
+    if (ssid_len > sizeof(current_ssid)) return;
+    cyw43_thread_enter();
+    struct netif *netif = &cyw43_state.netif[CYW43_ITF_STA];
+    struct dhcp *dhcp = netif_dhcp_data(netif);
+    if (!dhcp) {
+        // the DHCP client is set up along with the interface; nothing to do before then
+        cyw43_thread_exit();
+        return;
+    }
+    bool same_network = current_ssid_len == ssid_len && !memcmp(current_ssid, ssid, ssid_len);
+    save_lease(netif, dhcp);
+    if (dhcp->state == DHCP_STATE_OFF) {
+        // the application has taken over addressing
+    } else if (same_network && dhcp_supplied_address(netif)) {
+        // lwIP still holds the lease of this network and will confirm it itself
+        cache_stats.hits++;
+    } else {
+        // never leave the previous network's address configured, or the link would look usable
+        netif_set_addr(netif, IP4_ADDR_ANY4, IP4_ADDR_ANY4, IP4_ADDR_ANY4);
+        dhcp_lease_t *lease = find_lease(ssid, ssid_len);
+        if (lease && load_lease(netif, dhcp, lease)) {
+            lease->last_used = ++use_counter;
+            cache_stats.hits++;
+        } else {
+            if (lease) {
+                lease->last_used = 0;
+                cache_stats.expired++;
+            } else {
+                cache_stats.misses++;
+            }
+            dhcp->state = DHCP_STATE_INIT;
+            dhcp->tries = 0;
+        }
+    }
+    memset(current_ssid, 0, sizeof(current_ssid));
+    memcpy(current_ssid, ssid, ssid_len);
+    current_ssid_len = (uint8_t)ssid_len;
+    cyw43_thread_exit();
+}
+
+void cyw43_dhcp_cache_note_bound(void) {
+    cyw43_thread_enter();
+    struct netif *netif = &cyw43_state.netif[CYW43_ITF_STA];
+    struct dhcp *dhcp = netif_dhcp_data(netif);
+    if (dhcp) save_lease(netif, dhcp);
+    cyw43_thread_exit();
+}
+
+void cyw43_dhcp_cache_add(const cyw43_dhcp_cache_entry_t *entry) {
+    if (entry->ssid_len > sizeof(entry->ssid)) return;
+    cyw43_thread_enter();
+    dhcp_lease_t *lease = find_or_replace_lease(entry->ssid, entry->ssid_len);
+    memset(lease, 0, sizeof(*lease));
+    lease->ssid_len = entry->ssid_len;
+    memcpy(lease->ssid, entry->ssid, entry->ssid_len);
+    lease->ip = entry->ip;
+    lease->netmask = entry->netmask;
+    lease->gw = entry->gw;
+    lease->server = entry->server;
+    lease->lease_s = entry->lease_s;
+    lease->renew_s = entry->renew_s;
+    lease->rebind_s = entry->rebind_s;
+    lease->bound_us = (int64_t)time_us_64() - (int64_t)entry->used_s * 1000000;
+    lease->last_used = ++use_counter;
+    cyw43_thread_exit();
+}
+
+void cyw43_dhcp_cache_set_store_callback(void (*store)(const cyw43_dhcp_cache_entry_t *entry)) {
+    store_callback = store;
+}
+
+void cyw43_dhcp_cache_clear(void) {
+    cyw43_thread_enter();
+    memset(leases, 0, sizeof(leases));
+    cyw43_thread_exit();
+}
+
+void cyw43_dhcp_cache_get_stats(cyw43_dhcp_cache_stats_t *stats) {
+    cyw43_thread_enter();
+    *stats = cache_stats;
+    cyw43_thread_exit();
+}
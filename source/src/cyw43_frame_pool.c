@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include "cyw43_frame_pool.h"
+#include "hardware/sync.h"
+
+#define FRAME_WORDS ((CYW43_FRAME_POOL_FRAME_SIZE + 3) / 4)
+#define FRAME_COUNT (CYW43_FRAME_POOL_RX_FRAMES + CYW43_FRAME_POOL_TX_FRAMES)
+#define NO_FRAME 0xffff
+
+static_assert(FRAME_COUNT < NO_FRAME, "too many frames in the cyw43 frame pool");
+
+static uint32_t frames[FRAME_COUNT][FRAME_WORDS];
+// free lists of frame indexes, one per class, threaded through next_free
+static uint16_t next_free[FRAME_COUNT];
+static uint16_t free_head[CYW43_FRAME_CLASS_COUNT];
+static cyw43_frame_pool_stats_t pool_stats[CYW43_FRAME_CLASS_COUNT];
+static spin_lock_t *pool_lock;
+
+static void build_free_list(cyw43_frame_class_t frame_class, uint first, uint count) {
+    free_head[frame_class] = count ? first : NO_FRAME;
+    for (uint i = 0; i < count; i++) {
+        next_free[first + i] = i + 1 < count ? first + i + 1 : NO_FRAME;
+    }
+    pool_stats[frame_class].size = count;
+}
+
+void cyw43_frame_pool_init(void) {
+    if (pool_lock) return;
+    build_free_list(CYW43_FRAME_RX, 0, CYW43_FRAME_POOL_RX_FRAMES);
+    build_free_list(CYW43_FRAME_TX, CYW43_FRAME_POOL_RX_FRAMES, CYW43_FRAME_POOL_TX_FRAMES);
+    pool_lock = spin_lock_instance(spin_lock_claim_unused(true));
+}
+
+static cyw43_frame_class_t class_of(uint index) {
+    return index < CYW43_FRAME_POOL_RX_FRAMES ? CYW43_FRAME_RX : CYW43_FRAME_TX;
+}
+
+void *cyw43_frame_alloc(cyw43_frame_class_t frame_class) {
+    invalid_params_if(CYW43_FRAME_POOL, frame_class >= CYW43_FRAME_CLASS_COUNT);
+    if (!pool_lock) return NULL;
+    cyw43_frame_pool_stats_t *stats = &pool_stats[frame_class];
+    uint32_t save = spin_lock_blocking(pool_lock);
+    uint16_t index = free_head[frame_class];
+    if (index == NO_FRAME) {
+        stats->failures++;
+        spin_unlock(pool_lock, save);
+        return NULL;
+    }
+    free_head[frame_class] = next_free[index];
+    stats->allocs++;
+    if (++stats->in_use > stats->high_water) stats->high_water = stats->in_use;
+    spin_unlock(pool_lock, save);
+    return frames[index];
+}
+
+void cyw43_frame_free(void *frame) {
+    uint index = (uint)((uint32_t *)frame - frames[0]) / FRAME_WORDS;
+    invalid_params_if(CYW43_FRAME_POOL, index >= FRAME_COUNT || frames[index] != frame);
+    cyw43_frame_class_t frame_class = class_of(index);
+    uint32_t save = spin_lock_blocking(pool_lock);
+    next_free[index] = free_head[frame_class];
+    free_head[frame_class] = (uint16_t)index;
+    pool_stats[frame_class].in_use--;
+    spin_unlock(pool_lock, save);
+}
+
+void cyw43_frame_pool_get_stats(cyw43_frame_class_t frame_class, cyw43_frame_pool_stats_t *stats) {
+    invalid_params_if(CYW43_FRAME_POOL, frame_class >= CYW43_FRAME_CLASS_COUNT);
+    if (!pool_lock) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    uint32_t save = spin_lock_blocking(pool_lock);
+    *stats = pool_stats[frame_class];
+    spin_unlock(pool_lock, save);
+}
+
+void cyw43_frame_pool_reset_stats(void) {
+    if (!pool_lock) return;
+    uint32_t save = spin_lock_blocking(pool_lock);
+    for (int i = 0; i < CYW43_FRAME_CLASS_COUNT; i++) {
+        pool_stats[i].high_water = pool_stats[i].in_use;
+        pool_stats[i].allocs = 0;
+        pool_stats[i].failures = 0;
+    }
+    spin_unlock(pool_lock, save);
+}
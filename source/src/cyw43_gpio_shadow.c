@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include "cyw43_gpio_shadow.h"
+
+void cyw43_gpio_shadow_init(cyw43_gpio_shadow_t *shadow) {
+    memset(shadow, 0, sizeof(*shadow));
+}
+
+bool cyw43_gpio_shadow_put(cyw43_gpio_shadow_t *shadow, unsigned int pin, bool value) {
+    uint32_t bit = 1u << pin;
+    shadow->stats.puts++;
+    if ((shadow->known & bit) && !(shadow->out & bit) == !value) {
+        shadow->stats.puts_skipped++;
+        return false;
+    }
+    shadow->out = value ? shadow->out | bit : shadow->out & ~bit;
+    shadow->known |= bit;
+    shadow->pending |= bit;
+    return true;
+}
+
+bool cyw43_gpio_shadow_get(cyw43_gpio_shadow_t *shadow, unsigned int pin, bool *value) {
+    uint32_t bit = 1u << pin;
+    shadow->stats.gets++;
+    if (!(shadow->known & bit)) return false;
+    // an output pin reads back what was put on it
+    *value = shadow->out & bit;
+    shadow->stats.gets_cached++;
+    return true;
+}
+
+bool cyw43_gpio_shadow_take(cyw43_gpio_shadow_t *shadow, uint32_t *mask, uint32_t *value) {
+    if (!shadow->pending) return false;
+    // one write covers every pin put since the last one
+    *mask = shadow->pending;
+    *value = shadow->out & shadow->pending;
+    shadow->pending = 0;
+    return true;
+}
+
+void cyw43_gpio_shadow_write_done(cyw43_gpio_shadow_t *shadow, uint32_t mask, bool ok) {
+    shadow->stats.writes++;
+    if (!ok) {
+        // we don't know what the pins are now, so the next put goes to the chip whatever its value
+        shadow->stats.write_errors++;
+        shadow->known &= ~mask;
+    }
+}
+
+void cyw43_gpio_shadow_forget(cyw43_gpio_shadow_t *shadow) {
+    shadow->known = 0;
+    shadow->pending = 0;
+}
+
+bool cyw43_gpio_shadow_restore(cyw43_gpio_shadow_t *shadow) {
+    shadow->pending = shadow->known;
+    return shadow->pending != 0;
+}
@@ -0,0 +1,124 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include "pico/time.h"
+#include "hardware/sync.h"
+#include "cyw43_latency.h"
+
+#if CYW43_LATENCY_TRACE
+
+volatile uint32_t cyw43_latency_irq_us;
+uint32_t cyw43_latency_pass_us;
+
+static cyw43_latency_hist_t hists[CYW43_LATENCY_STAGE_COUNT];
+static cyw43_latency_sample_t ring[CYW43_LATENCY_RING_LEN];
+static uint32_t ring_next;
+static uint32_t ring_count;
+
+static const char *stage_names[CYW43_LATENCY_STAGE_COUNT] = {
+        "irq_to_wake",
+        "wake_to_lock",
+        "process",
+        "rx_deliver",
+        "tx_send",
+};
+
+static uint bucket_for(uint32_t latency_us) {
+    return latency_us ? 31 - __builtin_clz(latency_us) : 0;
+}
+
+void cyw43_latency_record(cyw43_latency_stage_t stage, uint32_t start_us) {
+    uint32_t now_us = time_us_32();
+    uint32_t latency_us = now_us - start_us;
+    uint32_t save = save_and_disable_interrupts();
+    cyw43_latency_hist_t *hist = &hists[stage];
+    if (!hist->count || latency_us < hist->min_us) hist->min_us = latency_us;
+    if (latency_us > hist->max_us) hist->max_us = latency_us;
+    hist->count++;
+    hist->total_us += latency_us;
+    hist->buckets[bucket_for(latency_us)]++;
+    cyw43_latency_sample_t *sample = &ring[ring_next];
+    sample->time_us = now_us;
+    sample->latency_us = latency_us;
+    sample->stage = stage;
+    ring_next = (ring_next + 1) % CYW43_LATENCY_RING_LEN;
+    if (ring_count < CYW43_LATENCY_RING_LEN) ring_count++;
+    restore_interrupts(save);
+}
+
+void cyw43_latency_get(cyw43_latency_stage_t stage, cyw43_latency_hist_t *hist) {
+    uint32_t save = save_and_disable_interrupts();
+    *hist = hists[stage];
+    restore_interrupts(save);
+}
+
+uint32_t cyw43_latency_get_recent(cyw43_latency_sample_t *samples, uint32_t max) {
+    uint32_t save = save_and_disable_interrupts();
+    uint32_t count = ring_count < max ? ring_count : max;
+    uint32_t index = (ring_next + CYW43_LATENCY_RING_LEN - count) % CYW43_LATENCY_RING_LEN;
+    for (uint32_t i = 0; i < count; i++) {
+        samples[i] = ring[index];
+        index = (index + 1) % CYW43_LATENCY_RING_LEN;
+    }
+    restore_interrupts(save);
+    return count;
+}
+
+void cyw43_latency_reset(void) {
+    uint32_t save = save_and_disable_interrupts();
+    memset(hists, 0, sizeof(hists));
+    ring_next = 0;
+    ring_count = 0;
+    restore_interrupts(save);
+}
+
+const char *cyw43_latency_stage_name(cyw43_latency_stage_t stage) {
+    return stage < CYW43_LATENCY_STAGE_COUNT ? stage_names[stage] : "unknown";
+}
+
+#ifdef RT_USING_FINSH
+#include <rtthread.h>
+
+static void cyw43_latency(int argc, char **argv)
+{
+    cyw43_latency_hist_t hist;
+
+    if (argc > 1 && !rt_strcmp(argv[1], "reset"))
+    {
+        cyw43_latency_reset();
+        return;
+    }
+    if (argc > 1 && !rt_strcmp(argv[1], "recent"))
+    {
+        cyw43_latency_sample_t samples[CYW43_LATENCY_RING_LEN];
+        uint32_t count = cyw43_latency_get_recent(samples, CYW43_LATENCY_RING_LEN);
+
+        for (uint32_t i = 0; i < count; i++)
+        {
+            rt_kprintf("%10u %-12s %uus\n", samples[i].time_us, cyw43_latency_stage_name(samples[i].stage),
+                    samples[i].latency_us);
+        }
+        return;
+    }
+    for (int stage = 0; stage < CYW43_LATENCY_STAGE_COUNT; stage++)
+    {
+        cyw43_latency_get(stage, &hist);
+        rt_kprintf("%-12s count %u min %uus avg %uus max %uus\n", cyw43_latency_stage_name(stage), hist.count,
+                hist.min_us, hist.count ? (uint32_t)(hist.total_us / hist.count) : 0, hist.max_us);
+        for (int b = 0; b < CYW43_LATENCY_BUCKETS; b++)
+        {
+            if (hist.buckets[b])
+            {
+                rt_kprintf("    < %8uus: %u\n", 2u << b, hist.buckets[b]);
+            }
+        }
+    }
+}
+MSH_CMD_EXPORT(cyw43_latency, show cyw43 data path latency histograms: [reset|recent]);
+#endif /* RT_USING_FINSH */
+
+#endif
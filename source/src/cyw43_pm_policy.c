@@ -0,0 +1,130 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include "cyw43_pm_policy.h"
+
+void cyw43_pm_policy_init(cyw43_pm_policy_t *policy, const cyw43_pm_policy_config_t *config) {
+    // config may point into the policy itself, so take the copy before clearing it
+    cyw43_pm_policy_config_t new_config = config ? *config : cyw43_pm_policy_default_config();
+    memset(policy, 0, sizeof(*policy));
+    policy->config = new_config;
+    if (!policy->config.burst_packets) policy->config.burst_packets = 1;
+}
+
+void cyw43_pm_policy_reset(cyw43_pm_policy_t *policy) {
+    cyw43_pm_policy_init(policy, &policy->config);
+}
+
+static bool boost(cyw43_pm_policy_t *policy) {
+    if (policy->boosted) return false;
+    policy->boosted = true;
+    policy->boosts++;
+    return true;
+}
+
+bool cyw43_pm_policy_packet(cyw43_pm_policy_t *policy, bool rx, uint64_t now_us) {
+    if (rx) {
+        policy->rx_packets++;
+    } else {
+        policy->tx_packets++;
+    }
+    if (policy->run_packets && now_us - policy->last_packet_us < policy->config.frame_us) {
+        policy->run_packets++;
+    } else {
+        policy->run_packets = 1;
+    }
+    policy->last_packet_us = now_us;
+    if (policy->run_packets >= policy->config.burst_packets) {
+        return boost(policy);
+    }
+    return false;
+}
+
+bool cyw43_pm_policy_queue_depth(cyw43_pm_policy_t *policy, uint32_t depth, uint64_t now_us) {
+    policy->queue_depth = depth;
+    if (policy->config.queue_depth && depth >= policy->config.queue_depth) {
+        policy->last_packet_us = now_us;
+        return boost(policy);
+    }
+    return false;
+}
+
+bool cyw43_pm_policy_poll(cyw43_pm_policy_t *policy, uint64_t now_us) {
+    // don't go back to sleep with frames still waiting to be sent
+    if (policy->boosted && !policy->queue_depth && now_us - policy->last_packet_us >= policy->config.idle_us) {
+        policy->boosted = false;
+        policy->run_packets = 0;
+        return true;
+    }
+    return false;
+}
+
+uint64_t cyw43_pm_policy_next_poll_us(const cyw43_pm_policy_t *policy) {
+    if (!policy->boosted) return 0;
+    return policy->last_packet_us + policy->config.idle_us;
+}
+
+void cyw43_pm_policy_replay(const cyw43_pm_policy_config_t *config, const cyw43_pm_policy_radio_model_t *model,
+                            const uint64_t *timestamps_us, size_t count, cyw43_pm_policy_replay_report_t *report) {
+    cyw43_pm_policy_radio_model_t default_model = cyw43_pm_policy_default_radio_model();
+    if (!model) model = &default_model;
+    memset(report, 0, sizeof(*report));
+    if (!count) return;
+
+    cyw43_pm_policy_t policy;
+    cyw43_pm_policy_init(&policy, config);
+    uint64_t start_us = timestamps_us[0];
+    uint64_t end_us = timestamps_us[count - 1];
+    uint64_t boost_start_us = 0;
+    uint64_t boosted_us = 0;
+    // the radio is on in power save from awake_from_us until awake_until_us
+    uint64_t awake_from_us = start_us;
+    uint64_t awake_until_us = start_us;
+    uint64_t awake_us = 0;
+
+    for (size_t i = 0; i < count; i++) {
+        uint64_t now_us = timestamps_us[i];
+        if (policy.boosted) {
+            // the boost ends exactly at the end of the idle window, not when we notice
+            uint64_t unboost_us = cyw43_pm_policy_next_poll_us(&policy);
+            if (cyw43_pm_policy_poll(&policy, now_us)) {
+                boosted_us += unboost_us - boost_start_us;
+            }
+        }
+        if (!policy.boosted) {
+            // the packet is handled in power save; it only waits if the radio has gone back to sleep
+            report->packets_in_ps++;
+            if (now_us >= awake_until_us) {
+                awake_us += awake_until_us - awake_from_us;
+                awake_from_us = now_us;
+                report->added_latency_us += model->ps_wake_latency_us;
+                if (model->ps_wake_latency_us > report->max_added_latency_us) {
+                    report->max_added_latency_us = model->ps_wake_latency_us;
+                }
+            }
+            awake_until_us = now_us + model->ps_awake_us;
+        }
+        if (cyw43_pm_policy_packet(&policy, false, now_us) && policy.boosted) {
+            // from here on the radio is on because of the boost
+            boost_start_us = now_us;
+            if (awake_until_us > now_us) awake_until_us = now_us;
+        }
+    }
+    // neither the boost nor the time awake in power save count beyond the end of the trace
+    if (policy.boosted) {
+        uint64_t unboost_us = cyw43_pm_policy_next_poll_us(&policy);
+        boosted_us += (unboost_us < end_us ? unboost_us : end_us) - boost_start_us;
+    }
+    if (awake_until_us > end_us) awake_until_us = end_us;
+    awake_us += awake_until_us - awake_from_us;
+
+    report->packets = (uint32_t)count;
+    report->boosts = policy.boosts;
+    report->duration_us = end_us - start_us;
+    report->radio_on_us = boosted_us + awake_us;
+    report->radio_on_us += (report->duration_us - boosted_us - awake_us) * model->ps_idle_duty_ppm / 1000000;
+}
@@ -0,0 +1,383 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include "pico/time.h"
+#include "hardware/sync.h"
+#include "cyw43_pmk_cache.h"
+
+#if PICO_CYW43_ARCH_RTTHREAD
+#include <rtthread.h>
+#endif
+
+#define PBKDF2_ITERATIONS 4096
+
+#define ROL(x, n) (((x) << (n)) | ((x) >> (32 - (n))))
+
+static void sha1_init(uint32_t h[5]) {
+    h[0] = 0x67452301;
+    h[1] = 0xefcdab89;
+    h[2] = 0x98badcfe;
+    h[3] = 0x10325476;
+    h[4] = 0xc3d2e1f0;
+}
+
+static void sha1_compress(uint32_t h[5], const uint32_t block[16]) {
+    uint32_t w[16];
+    memcpy(w, block, sizeof(w));
+    uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+    for (int i = 0; i < 80; i++) {
+        uint32_t f, k;
+        if (i >= 16) {
+            uint32_t t = w[(i + 13) & 15] ^ w[(i + 8) & 15] ^ w[(i + 2) & 15] ^ w[i & 15];
+            w[i & 15] = ROL(t, 1);
+        }
+        if (i < 20) {
+            f = (b & c) | (~b & d);
+            k = 0x5a827999;
+        } else if (i < 40) {
+            f = b ^ c ^ d;
+            k = 0x6ed9eba1;
+        } else if (i < 60) {
+            f = (b & c) | (b & d) | (c & d);
+            k = 0x8f1bbcdc;
+        } else {
+            f = b ^ c ^ d;
+            k = 0xca62c1d6;
+        }
+        uint32_t t = ROL(a, 5) + f + e + k + w[i & 15];
+        e = d;
+        d = c;
+        c = ROL(b, 30);
+        b = a;
+        a = t;
+    }
+    h[0] += a;
+    h[1] += b;
+    h[2] += c;
+    h[3] += d;
+    h[4] += e;
+}
+
+static void load_be(uint32_t *words, const uint8_t *bytes, size_t count) {
+    for (size_t i = 0; i < count; i++, bytes += 4) {
+        words[i] = ((uint32_t)bytes[0] << 24) | ((uint32_t)bytes[1] << 16) | ((uint32_t)bytes[2] << 8) | bytes[3];
+    }
+}
+
+static void store_be(uint8_t *bytes, const uint32_t *words, size_t count) {
+    for (size_t i = 0; i < count; i++, bytes += 4) {
+        bytes[0] = (uint8_t)(words[i] >> 24);
+        bytes[1] = (uint8_t)(words[i] >> 16);
+        bytes[2] = (uint8_t)(words[i] >> 8);
+        bytes[3] = (uint8_t)words[i];
+    }
+}
+
+// hash the remaining len bytes of a message on top of h, which has already absorbed prefix_len bytes
+static void sha1_final(uint32_t h[5], size_t prefix_len, const uint8_t *data, size_t len) {
+    uint32_t block[16];
+    uint8_t buf[64];
+    uint64_t bits = (uint64_t)(prefix_len + len) * 8;
+    for (; len >= 64; data += 64, len -= 64) {
+        load_be(block, data, 16);
+        sha1_compress(h, block);
+    }
+    memset(buf, 0, sizeof(buf));
+    memcpy(buf, data, len);
+    buf[len] = 0x80;
+    if (len >= 56) {
+        load_be(block, buf, 16);
+        sha1_compress(h, block);
+        memset(buf, 0, sizeof(buf));
+    }
+    for (int i = 0; i < 8; i++) {
+        buf[63 - i] = (uint8_t)(bits >> (i * 8));
+    }
+    load_be(block, buf, 16);
+    sha1_compress(h, block);
+}
+
+// the inner and outer HMAC states after absorbing the padded key, which is no longer than a block
+static void hmac_sha1_init(uint32_t inner[5], uint32_t outer[5], const uint8_t *key, size_t key_len) {
+    uint8_t pad[64];
+    uint32_t block[16];
+    sha1_init(inner);
+    memset(pad, 0x36, sizeof(pad));
+    for (size_t i = 0; i < key_len; i++) pad[i] ^= key[i];
+    load_be(block, pad, 16);
+    sha1_compress(inner, block);
+    sha1_init(outer);
+    memset(pad, 0x5c, sizeof(pad));
+    for (size_t i = 0; i < key_len; i++) pad[i] ^= key[i];
+    load_be(block, pad, 16);
+    sha1_compress(outer, block);
+    memset(pad, 0, sizeof(pad));
+    memset(block, 0, sizeof(block));
+}
+
+void cyw43_pmk_derive(const uint8_t *ssid, size_t ssid_len, const uint8_t *passphrase, size_t passphrase_len,
+                      uint8_t pmk[CYW43_PMK_LEN]) {
+    uint32_t inner[5], outer[5], h[5], u[5], t[5];
+    // every iteration after the first hashes a 20 byte digest, so the padding of its single block is fixed
+    uint32_t block[16] = {0};
+    uint8_t salt[32 + 4];
+    uint8_t digest[20];
+
+    invalid_params_if(CYW43_PMK_CACHE, ssid_len > 32 || passphrase_len > 64);
+    hmac_sha1_init(inner, outer, passphrase, passphrase_len);
+    block[5] = 0x80000000;
+    block[15] = (64 + 20) * 8;
+    memcpy(salt, ssid, ssid_len);
+    for (uint32_t n = 1; n * 20 < CYW43_PMK_LEN + 20; n++) {
+        uint32_t be_n = n;
+        store_be(salt + ssid_len, &be_n, 1);
+        memcpy(h, inner, sizeof(h));
+        sha1_final(h, 64, salt, ssid_len + 4);
+        store_be(digest, h, 5);
+        memcpy(u, outer, sizeof(u));
+        sha1_final(u, 64, digest, sizeof(digest));
+        memcpy(t, u, sizeof(t));
+        for (int i = 1; i < PBKDF2_ITERATIONS; i++) {
+            memcpy(block, u, sizeof(u));
+            memcpy(h, inner, sizeof(h));
+            sha1_compress(h, block);
+            memcpy(block, h, sizeof(h));
+            memcpy(u, outer, sizeof(u));
+            sha1_compress(u, block);
+            for (int j = 0; j < 5; j++) t[j] ^= u[j];
+        }
+        store_be(digest, t, 5);
+        size_t offset = (n - 1) * 20;
+        size_t len = CYW43_PMK_LEN - offset < 20 ? CYW43_PMK_LEN - offset : 20;
+        memcpy(pmk + offset, digest, len);
+    }
+    memset(inner, 0, sizeof(inner));
+    memset(outer, 0, sizeof(outer));
+    memset(h, 0, sizeof(h));
+    memset(u, 0, sizeof(u));
+    memset(t, 0, sizeof(t));
+    memset(block, 0, sizeof(block));
+    memset(digest, 0, sizeof(digest));
+}
+
+static cyw43_pmk_entry_t entries[CYW43_PMK_CACHE_ENTRIES];
+static uint32_t entry_last_used[CYW43_PMK_CACHE_ENTRIES]; // 0 means the entry is free
+static uint32_t use_counter;
+static cyw43_pmk_cache_stats_t cache_stats;
+static void (*store_callback)(const cyw43_pmk_entry_t *entry);
+static spin_lock_t *cache_lock;
+
+void cyw43_pmk_cache_key_hash(const uint8_t *ssid, size_t ssid_len, const uint8_t *passphrase, size_t passphrase_len,
+                              uint8_t hash[CYW43_PMK_KEY_HASH_LEN]) {
+    invalid_params_if(CYW43_PMK_CACHE, ssid_len > 32 || passphrase_len > 64);
+    uint8_t buf[32 + 64];
+    uint32_t h[5];
+    memcpy(buf, ssid, ssid_len);
+    memcpy(buf + ssid_len, passphrase, passphrase_len);
+    sha1_init(h);
+    sha1_final(h, 0, buf, ssid_len + passphrase_len);
+    store_be(hash, h, 5);
+    memset(buf, 0, sizeof(buf));
+}
+
+// must be called with cache_lock held
+static int find_entry(const uint8_t *ssid, size_t ssid_len, const uint8_t hash[CYW43_PMK_KEY_HASH_LEN]) {
+    for (int i = 0; i < CYW43_PMK_CACHE_ENTRIES; i++) {
+        if (entry_last_used[i] && entries[i].ssid_len == ssid_len && !memcmp(entries[i].ssid, ssid, ssid_len) &&
+            !memcmp(entries[i].key_hash, hash, CYW43_PMK_KEY_HASH_LEN)) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+void cyw43_pmk_cache_add(const cyw43_pmk_entry_t *entry) {
+    // entries may be restored from flash before the driver is initialized
+    cyw43_pmk_cache_init();
+    uint32_t save = spin_lock_blocking(cache_lock);
+    int slot = find_entry(entry->ssid, entry->ssid_len, entry->key_hash);
+    if (slot < 0) {
+        slot = 0;
+        for (int i = 1; i < CYW43_PMK_CACHE_ENTRIES; i++) {
+            if (entry_last_used[i] < entry_last_used[slot]) slot = i;
+        }
+    }
+    entries[slot] = *entry;
+    entry_last_used[slot] = ++use_counter;
+    spin_unlock(cache_lock, save);
+}
+
+void cyw43_pmk_cache_clear(void) {
+    if (!cache_lock) return;
+    uint32_t save = spin_lock_blocking(cache_lock);
+    memset(entries, 0, sizeof(entries));
+    memset(entry_last_used, 0, sizeof(entry_last_used));
+    spin_unlock(cache_lock, save);
+}
+
+void cyw43_pmk_cache_set_store_callback(void (*store)(const cyw43_pmk_entry_t *entry)) {
+    store_callback = store;
+}
+
+static void derive_entry(cyw43_pmk_entry_t *entry, const uint8_t *passphrase, size_t passphrase_len) {
+    uint32_t start_us = time_us_32();
+    cyw43_pmk_derive(entry->ssid, entry->ssid_len, passphrase, passphrase_len, entry->pmk);
+    uint32_t derive_us = time_us_32() - start_us;
+    uint32_t save = spin_lock_blocking(cache_lock);
+    cache_stats.derivations++;
+    cache_stats.derive_us = derive_us;
+    spin_unlock(cache_lock, save);
+    cyw43_pmk_cache_add(entry);
+    if (store_callback) store_callback(entry);
+}
+
+#if PICO_CYW43_ARCH_RTTHREAD
+// a single pending request is enough, as only the most recent join matters
+static struct {
+    bool valid;
+    cyw43_pmk_entry_t entry;
+    uint8_t passphrase_len;
+    uint8_t passphrase[64];
+} pending;
+static struct rt_semaphore derive_sem;
+static struct rt_thread derive_thread;
+static uint8_t derive_thread_stack[CYW43_PMK_THREAD_STACK_SIZE] __attribute__((aligned(8)));
+
+static void derive_thread_entry(__unused void *parameter) {
+    cyw43_pmk_entry_t entry;
+    uint8_t passphrase[64];
+    size_t passphrase_len;
+    while (true) {
+        rt_sem_take(&derive_sem, RT_WAITING_FOREVER);
+        uint32_t save = spin_lock_blocking(cache_lock);
+        bool valid = pending.valid;
+        entry = pending.entry;
+        passphrase_len = pending.passphrase_len;
+        memcpy(passphrase, pending.passphrase, passphrase_len);
+        memset(&pending, 0, sizeof(pending));
+        spin_unlock(cache_lock, save);
+        if (valid) derive_entry(&entry, passphrase, passphrase_len);
+        memset(passphrase, 0, sizeof(passphrase));
+    }
+}
+#endif
+
+static void derive_later(const cyw43_pmk_entry_t *entry, const uint8_t *passphrase, size_t passphrase_len) {
+#if PICO_CYW43_ARCH_RTTHREAD
+    uint32_t save = spin_lock_blocking(cache_lock);
+    pending.valid = true;
+    pending.entry = *entry;
+    pending.passphrase_len = (uint8_t)passphrase_len;
+    memcpy(pending.passphrase, passphrase, passphrase_len);
+    spin_unlock(cache_lock, save);
+    rt_sem_release(&derive_sem);
+#else
+    // without a thread to hand the work to, the next join pays for the derivation instead
+    cyw43_pmk_entry_t copy = *entry;
+    derive_entry(&copy, passphrase, passphrase_len);
+#endif
+}
+
+void cyw43_pmk_cache_init(void) {
+    if (cache_lock) return;
+    cache_lock = spin_lock_instance(spin_lock_claim_unused(true));
+#if PICO_CYW43_ARCH_RTTHREAD
+    rt_sem_init(&derive_sem, "cyw43_pmk", 0, RT_IPC_FLAG_FIFO);
+    rt_thread_init(&derive_thread, "cyw43_pmk", derive_thread_entry, NULL, derive_thread_stack,
+                   sizeof(derive_thread_stack), CYW43_PMK_THREAD_PRIORITY, 10);
+    rt_thread_startup(&derive_thread);
+#endif
+}
+
+bool cyw43_pmk_cache_is_pmk(const uint8_t *key, size_t len) {
+    if (len != CYW43_PMK_HEX_LEN) return false;
+    for (size_t i = 0; i < len; i++) {
+        uint8_t c = key[i];
+        if (!((c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F'))) return false;
+    }
+    return true;
+}
+
+static void to_hex(uint8_t pmk_hex[CYW43_PMK_HEX_LEN], const uint8_t pmk[CYW43_PMK_LEN]) {
+    static const char hex[] = "0123456789abcdef";
+    for (int i = 0; i < CYW43_PMK_LEN; i++) {
+        pmk_hex[i * 2] = hex[pmk[i] >> 4];
+        pmk_hex[i * 2 + 1] = hex[pmk[i] & 0xf];
+    }
+}
+
+const uint8_t *cyw43_pmk_cache_join_key(const uint8_t *ssid, size_t ssid_len, const uint8_t *passphrase,
+                                        size_t *key_len, uint8_t pmk_hex[CYW43_PMK_HEX_LEN]) {
+    size_t passphrase_len = *key_len;
+    if (!cache_lock || !passphrase || passphrase_len < 8 || passphrase_len > 63 || ssid_len > 32 ||
+        cyw43_pmk_cache_is_pmk(passphrase, passphrase_len)) {
+        return passphrase;
+    }
+    cyw43_pmk_entry_t entry;
+    entry.ssid_len = (uint8_t)ssid_len;
+    memset(entry.ssid, 0, sizeof(entry.ssid));
+    memcpy(entry.ssid, ssid, ssid_len);
+    cyw43_pmk_cache_key_hash(ssid, ssid_len, passphrase, passphrase_len, entry.key_hash);
+
+    uint32_t save = spin_lock_blocking(cache_lock);
+    int slot = find_entry(ssid, ssid_len, entry.key_hash);
+    if (slot >= 0) {
+        entry_last_used[slot] = ++use_counter;
+        memcpy(entry.pmk, entries[slot].pmk, sizeof(entry.pmk));
+        cache_stats.hits++;
+    } else {
+        cache_stats.misses++;
+    }
+    spin_unlock(cache_lock, save);
+
+    if (slot < 0) {
+        derive_later(&entry, passphrase, passphrase_len);
+        return passphrase;
+    }
+    to_hex(pmk_hex, entry.pmk);
+    memset(entry.pmk, 0, sizeof(entry.pmk));
+    *key_len = CYW43_PMK_HEX_LEN;
+    return pmk_hex;
+}
+
+bool cyw43_pmk_cache_lookup(const uint8_t *ssid, size_t ssid_len, const uint8_t hash[CYW43_PMK_KEY_HASH_LEN],
+                            uint8_t pmk_hex[CYW43_PMK_HEX_LEN]) {
+    uint8_t pmk[CYW43_PMK_LEN];
+    if (!cache_lock) return false;
+    uint32_t save = spin_lock_blocking(cache_lock);
+    int slot = find_entry(ssid, ssid_len, hash);
+    if (slot >= 0) {
+        entry_last_used[slot] = ++use_counter;
+        memcpy(pmk, entries[slot].pmk, sizeof(pmk));
+    }
+    spin_unlock(cache_lock, save);
+    if (slot < 0) return false;
+    to_hex(pmk_hex, pmk);
+    memset(pmk, 0, sizeof(pmk));
+    return true;
+}
+
+void cyw43_pmk_cache_note_join(bool cached, uint32_t join_us) {
+    if (!cache_lock) return;
+    uint32_t save = spin_lock_blocking(cache_lock);
+    cyw43_pmk_join_stats_t *join = &cache_stats.join[cached];
+    join->joins++;
+    join->last_us = join_us;
+    join->total_us += join_us;
+    if (join_us > join->max_us) join->max_us = join_us;
+    spin_unlock(cache_lock, save);
+}
+
+void cyw43_pmk_cache_get_stats(cyw43_pmk_cache_stats_t *stats) {
+    if (!cache_lock) {
+        memset(stats, 0, sizeof(*stats));
+        return;
+    }
+    uint32_t save = spin_lock_blocking(cache_lock);
+    *stats = cache_stats;
+    spin_unlock(cache_lock, save);
+}
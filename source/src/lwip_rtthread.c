@@ -34,7 +34,7 @@ bool lwip_rtthread_init(async_context_t *context) {
         rt_sem_t init_sem = rt_sem_create("lwip_init_sem", 0, RT_IPC_FLAG_PRIO);
         tcpip_task_blocker = rt_sem_create("tcpip_task_blocker", 0, RT_IPC_FLAG_PRIO);
         tcpip_init(tcpip_init_done, init_sem);
-        rt_sem_take(init_sem, RT_TICK_MAX / 2 - 1);
+        rt_sem_take(init_sem, RT_WAITING_FOREVER);
         rt_sem_delete(init_sem);
     } else {
         rt_sem_release(tcpip_task_blocker);
@@ -54,7 +54,7 @@ void lwip_rtthread_deinit(__unused async_context_t *context) {
 
 void pico_lwip_custom_lock_tcpip_core(void) {
     while (!lwip_context) {
-        rt_sem_take(tcpip_task_blocker, RT_TICK_MAX / 2 - 1);
+        rt_sem_take(tcpip_task_blocker, RT_WAITING_FOREVER);
     }
     async_context_acquire_lock_blocking(lwip_context);
 }
@@ -0,0 +1,34 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#ifndef _HOST_TEST_H
+#define _HOST_TEST_H
+
+#include <stdio.h>
+
+static int host_test_failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            printf("%s:%d: check failed: %s\n", __FILE__, __LINE__, #cond); \
+            host_test_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_EQ(a, b) do { \
+        unsigned long long _a = (unsigned long long)(a), _b = (unsigned long long)(b); \
+        if (_a != _b) { \
+            printf("%s:%d: check failed: %s == %s (%llu != %llu)\n", __FILE__, __LINE__, #a, #b, _a, _b); \
+            host_test_failures++; \
+        } \
+    } while (0)
+
+static inline int host_test_result(const char *name) {
+    printf("%s: %s\n", name, host_test_failures ? "FAILED" : "passed");
+    return host_test_failures ? 1 : 0;
+}
+
+#endif
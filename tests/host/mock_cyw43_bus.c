@@ -0,0 +1,311 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <errno.h>
+#include <string.h>
+#include <time.h>
+#include "rtthread.h"
+#include "mock_cyw43_bus.h"
+#include "hardware/sync.h"
+
+#define FRAME_SEQ_OFFSET 14 // after the Ethernet header
+#define FRAME_MIN_LEN (FRAME_SEQ_OFFSET + 4)
+#define FRAME_MAX_LEN 1514
+
+cyw43_t cyw43_state;
+void (*cyw43_poll)(void);
+
+static async_context_t *arch_context;
+static mock_cyw43_bus_config_t bus_config;
+static mock_cyw43_bus_stats_t bus_stats;
+
+// the chip: everything below is shared between the air thread and the driver, under chip_lock
+static pthread_mutex_t chip_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t credit_cond = PTHREAD_COND_INITIALIZER;
+static pthread_t air_thread;
+static bool air_running;
+static uint64_t rx_start_us;
+static uint32_t rx_generated; // since rx_start_us
+static uint32_t rx_next_seq;  // of the next frame to arrive
+static uint32_t rx_buffered;  // frames held for the host, the oldest being rx_next_seq - rx_buffered
+static uint64_t tx_start_us;
+static uint32_t tx_returned;  // credits returned since tx_start_us
+static uint32_t tx_credits;
+static bool tx_stalled;
+static bool irq_enabled;
+
+// the cyw43_driver's poll worker, which the host wake interrupt sets pending
+static void poll_worker_func(async_context_t *context, async_when_pending_worker_t *worker);
+static async_when_pending_worker_t poll_worker = { .do_work = poll_worker_func };
+
+static void stat_add(uint32_t *stat, uint32_t n) {
+    __atomic_fetch_add(stat, n, __ATOMIC_RELAXED);
+}
+
+async_context_t *cyw43_arch_async_context(void) {
+    return arch_context;
+}
+
+void cyw43_arch_set_async_context(async_context_t *context) {
+    arch_context = context;
+}
+
+void cyw43_thread_enter(void) {
+    async_context_acquire_lock_blocking(arch_context);
+}
+
+void cyw43_thread_exit(void) {
+    async_context_release_lock(arch_context);
+}
+
+void cyw43_thread_lock_check(void) {
+    async_context_lock_check(arch_context);
+}
+
+void cyw43_arch_pm_note_traffic(bool rx) {
+    stat_add(rx ? &bus_stats.pm_rx_notes : &bus_stats.pm_tx_notes, 1);
+}
+
+void cyw43_arch_pm_note_queue_depth(uint32_t depth) {
+    uint32_t max = __atomic_load_n(&bus_stats.pm_max_queue_depth, __ATOMIC_RELAXED);
+    while (depth > max && !__atomic_compare_exchange_n(&bus_stats.pm_max_queue_depth, &max, depth, true,
+                                                       __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+static void frame_fill(uint8_t *frame, uint32_t len, uint32_t seq) {
+    memset(frame, 0xff, 6);              // broadcast
+    memcpy(frame + 6, cyw43_state.mac, 6);
+    frame[12] = 0x88;                    // local experimental ethertype
+    frame[13] = 0xb5;
+    memcpy(frame + FRAME_SEQ_OFFSET, &seq, 4);
+    for (uint32_t i = FRAME_MIN_LEN; i < len; i++) frame[i] = (uint8_t)(seq + i);
+}
+
+uint32_t mock_cyw43_bus_frame_seq(const uint8_t *frame) {
+    uint32_t seq;
+    memcpy(&seq, frame + FRAME_SEQ_OFFSET, 4);
+    return seq;
+}
+
+bool mock_cyw43_bus_frame_check(const uint8_t *frame, uint32_t len) {
+    if (len != bus_config.rx_frame_len) return false;
+    uint32_t seq = mock_cyw43_bus_frame_seq(frame);
+    for (uint32_t i = FRAME_MIN_LEN; i < len; i++) {
+        if (frame[i] != (uint8_t)(seq + i)) return false;
+    }
+    return true;
+}
+
+// the cyw43_driver's cyw43_poll: read every frame the chip holds off the bus, into a PBUF_POOL
+// chain as the driver does, and pass it up with the lock held
+static void bus_poll(void) {
+    cyw43_thread_lock_check();
+    uint8_t frame[FRAME_MAX_LEN];
+    uint32_t len = bus_config.rx_frame_len;
+    for (;;) {
+        pthread_mutex_lock(&chip_lock);
+        if (!rx_buffered) {
+            pthread_mutex_unlock(&chip_lock);
+            break;
+        }
+        uint32_t seq = rx_next_seq - rx_buffered--;
+        pthread_mutex_unlock(&chip_lock);
+        frame_fill(frame, len, seq);
+        struct netif *netif = &cyw43_state.netif[CYW43_ITF_STA];
+        struct pbuf *p = pbuf_alloc(PBUF_RAW, (u16_t)len, PBUF_POOL);
+        if (!p) continue;
+        pbuf_take(p, frame, (u16_t)len);
+        if ((netif->flags & NETIF_FLAG_LINK_UP) && netif->input) {
+            if (netif->input(p, netif) != ERR_OK) pbuf_free(p);
+            stat_add(&bus_stats.rx_delivered, 1);
+        } else {
+            pbuf_free(p);
+        }
+    }
+}
+
+static void poll_worker_func(__unused async_context_t *context, __unused async_when_pending_worker_t *worker) {
+    stat_add(&bus_stats.polls, 1);
+    if (cyw43_poll) cyw43_poll();
+    // cyw43_post_poll_hook: take the next interrupt
+    pthread_mutex_lock(&chip_lock);
+    irq_enabled = true;
+    pthread_mutex_unlock(&chip_lock);
+}
+
+// the GPIO interrupt handler of the host wake pin
+static void bus_irq(void) {
+    stat_add(&bus_stats.irqs, 1);
+    uint32_t save = save_and_disable_interrupts();
+    rt_interrupt_enter();
+    async_context_set_work_pending(arch_context, &poll_worker);
+    rt_interrupt_leave();
+    restore_interrupts(save);
+}
+
+void mock_cyw43_bus_raise_irq(void) {
+    pthread_mutex_lock(&chip_lock);
+    irq_enabled = false;
+    pthread_mutex_unlock(&chip_lock);
+    bus_irq();
+}
+
+// frames due at rate per second after elapsed_us
+static uint32_t frames_due(uint32_t rate, uint64_t elapsed_us) {
+    return (uint32_t)(elapsed_us * rate / 1000000);
+}
+
+// one millisecond of the air: frames arrive and frames go out, and the host wake pin is level
+// triggered, so it interrupts again once re-enabled for as long as frames are held
+static void *air_thread_func(__unused void *arg) {
+    for (;;) {
+        sleep_ms(1);
+        uint64_t now_us = time_us_64();
+        pthread_mutex_lock(&chip_lock);
+        if (!air_running) {
+            pthread_mutex_unlock(&chip_lock);
+            break;
+        }
+        uint32_t rx_due = frames_due(bus_config.rx_frames_per_sec, now_us - rx_start_us);
+        if (bus_config.rx_frames && rx_due > bus_config.rx_frames) rx_due = bus_config.rx_frames;
+        for (; rx_generated < rx_due; rx_generated++) {
+            stat_add(&bus_stats.rx_frames, 1);
+            if (rx_buffered == bus_config.rx_buffer_frames) {
+                stat_add(&bus_stats.rx_dropped, 1);
+            } else {
+                rx_buffered++;
+            }
+            rx_next_seq++;
+        }
+        if (tx_stalled) {
+            tx_start_us = now_us;
+            tx_returned = 0;
+        } else {
+            uint32_t tx_due = frames_due(bus_config.tx_frames_per_sec, now_us - tx_start_us);
+            if (tx_due != tx_returned) {
+                tx_credits += tx_due - tx_returned;
+                if (tx_credits > bus_config.tx_credits) tx_credits = bus_config.tx_credits;
+                tx_returned = tx_due;
+                pthread_cond_broadcast(&credit_cond);
+            }
+        }
+        bool irq = rx_buffered && irq_enabled;
+        if (irq) irq_enabled = false;
+        pthread_mutex_unlock(&chip_lock);
+        if (irq) bus_irq();
+    }
+    return NULL;
+}
+
+// the cyw43_driver's send: wait with the lock held for the chip to grant a credit
+int cyw43_send_ethernet(__unused cyw43_t *self, int itf, size_t len, __unused const void *buf, bool is_pbuf) {
+    cyw43_thread_lock_check();
+    if (itf != CYW43_ITF_STA || is_pbuf || len > FRAME_MAX_LEN) return -CYW43_EINVAL;
+    struct timespec deadline;
+    clock_gettime(CLOCK_REALTIME, &deadline);
+    uint64_t ns = deadline.tv_nsec + (uint64_t)bus_config.tx_credit_timeout_ms * 1000000;
+    deadline.tv_sec += ns / 1000000000;
+    deadline.tv_nsec = ns % 1000000000;
+    int err = 0;
+    pthread_mutex_lock(&chip_lock);
+    if (!tx_credits) stat_add(&bus_stats.tx_credit_waits, 1);
+    while (!tx_credits) {
+        if (pthread_cond_timedwait(&credit_cond, &chip_lock, &deadline) == ETIMEDOUT) break;
+    }
+    if (tx_credits) {
+        tx_credits--;
+        stat_add(&bus_stats.tx_frames, 1);
+    } else {
+        stat_add(&bus_stats.tx_timeouts, 1);
+        err = -CYW43_EIO;
+    }
+    pthread_mutex_unlock(&chip_lock);
+    return err;
+}
+
+mock_cyw43_bus_config_t mock_cyw43_bus_default_config(void) {
+    return (mock_cyw43_bus_config_t) {
+        .rx_frames_per_sec = 0,
+        .rx_frame_len = 1514,
+        .rx_frames = 0,
+        .rx_buffer_frames = 256,
+        .tx_credits = 8,
+        .tx_frames_per_sec = 10000,
+        .tx_credit_timeout_ms = 100,
+    };
+}
+
+void mock_cyw43_bus_restart_rx(const mock_cyw43_bus_config_t *config) {
+    hard_assert(config->rx_frame_len >= FRAME_MIN_LEN && config->rx_frame_len <= FRAME_MAX_LEN);
+    pthread_mutex_lock(&chip_lock);
+    bus_config.rx_frames_per_sec = config->rx_frames_per_sec;
+    bus_config.rx_frame_len = config->rx_frame_len;
+    bus_config.rx_frames = config->rx_frames;
+    bus_config.rx_buffer_frames = config->rx_buffer_frames;
+    rx_start_us = time_us_64();
+    rx_generated = 0;
+    pthread_mutex_unlock(&chip_lock);
+}
+
+void mock_cyw43_bus_init(async_context_t *context, const mock_cyw43_bus_config_t *config) {
+    memset(&cyw43_state, 0, sizeof(cyw43_state));
+    memset(&bus_stats, 0, sizeof(bus_stats));
+    static const uint8_t mac[6] = { 0x28, 0xcd, 0xc1, 0x00, 0x00, 0x01 };
+    memcpy(cyw43_state.mac, mac, sizeof(mac));
+    cyw43_state.itf_state = 1 << CYW43_ITF_STA;
+    struct netif *netif = &cyw43_state.netif[CYW43_ITF_STA];
+    netif->mtu = 1500;
+    memcpy(netif->hwaddr, mac, sizeof(mac));
+    netif->flags = NETIF_FLAG_UP | NETIF_FLAG_BROADCAST | NETIF_FLAG_LINK_UP;
+    cyw43_arch_set_async_context(context);
+    cyw43_poll = bus_poll;
+    async_context_add_when_pending_worker(context, &poll_worker);
+
+    bus_config = *config;
+    rx_next_seq = 0;
+    rx_buffered = 0;
+    tx_credits = config->tx_credits;
+    tx_stalled = false;
+    tx_start_us = time_us_64();
+    tx_returned = 0;
+    irq_enabled = true;
+    air_running = true;
+    mock_cyw43_bus_restart_rx(config);
+    hard_assert(!pthread_create(&air_thread, NULL, air_thread_func, NULL));
+}
+
+void mock_cyw43_bus_deinit(void) {
+    pthread_mutex_lock(&chip_lock);
+    air_running = false;
+    pthread_mutex_unlock(&chip_lock);
+    pthread_join(air_thread, NULL);
+    async_context_remove_when_pending_worker(arch_context, &poll_worker);
+    cyw43_poll = NULL;
+    cyw43_arch_set_async_context(NULL);
+}
+
+void mock_cyw43_bus_stall_tx(bool stall) {
+    pthread_mutex_lock(&chip_lock);
+    tx_stalled = stall;
+    pthread_mutex_unlock(&chip_lock);
+}
+
+bool mock_cyw43_bus_wait_delivered(uint32_t frames, uint32_t timeout_ms) {
+    uint64_t deadline_us = time_us_64() + (uint64_t)timeout_ms * 1000;
+    while (__atomic_load_n(&bus_stats.rx_delivered, __ATOMIC_RELAXED) < frames) {
+        if (time_us_64() > deadline_us) return false;
+        sleep_ms(1);
+    }
+    return true;
+}
+
+void mock_cyw43_bus_get_stats(mock_cyw43_bus_stats_t *stats) {
+    // every counter is a uint32_t updated on its own
+    const uint32_t *from = (const uint32_t *)&bus_stats;
+    uint32_t *to = (uint32_t *)stats;
+    for (size_t i = 0; i < sizeof(*stats) / sizeof(uint32_t); i++) to[i] = __atomic_load_n(&from[i], __ATOMIC_RELAXED);
+}
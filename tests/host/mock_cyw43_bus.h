@@ -0,0 +1,70 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// A stand-in for the CYW43439 and the cyw43-driver below cyw43_arch, for running the data path on
+// the host: frames arrive at a configured rate into the chip's buffer and raise the host wake
+// interrupt, the driver's poll worker passes them to the netif, and sends take a bus credit, which
+// the chip returns at the rate it gets frames out. It provides what the pico-sdk's cyw43_driver
+// and cyw43_arch.c would (cyw43_state, cyw43_thread_enter, cyw43_arch_async_context, ...), and the
+// power management notes of cyw43_arch.c, which it records.
+
+#ifndef _MOCK_CYW43_BUS_H
+#define _MOCK_CYW43_BUS_H
+
+#include "cyw43_arch.h"
+
+typedef struct mock_cyw43_bus_config {
+    uint32_t rx_frames_per_sec;    // rate frames arrive from the air, 0 for none
+    uint32_t rx_frame_len;         // length of each received frame
+    uint32_t rx_frames;            // frames to receive before stopping, 0 for no limit
+    uint32_t rx_buffer_frames;     // frames the chip holds for the host before dropping them
+    uint32_t tx_credits;           // frames the chip takes before it has to return credits
+    uint32_t tx_frames_per_sec;    // rate the chip sends frames and returns their credits
+    uint32_t tx_credit_timeout_ms; // time a send waits for a credit before failing
+} mock_cyw43_bus_config_t;
+
+typedef struct mock_cyw43_bus_stats {
+    uint32_t rx_frames;       // frames which arrived from the air
+    uint32_t rx_dropped;      // frames which arrived to a full buffer
+    uint32_t rx_delivered;    // frames passed to the netif
+    uint32_t irqs;            // host wake interrupts raised
+    uint32_t polls;           // runs of the driver's poll worker
+    uint32_t tx_frames;       // frames sent
+    uint32_t tx_credit_waits; // sends which found no credit
+    uint32_t tx_timeouts;     // sends which failed for want of a credit
+    uint32_t pm_rx_notes;     // cyw43_arch_pm_note_traffic calls for received frames
+    uint32_t pm_tx_notes;     // cyw43_arch_pm_note_traffic calls for sent frames
+    uint32_t pm_max_queue_depth; // deepest TX queue passed to cyw43_arch_pm_note_queue_depth
+} mock_cyw43_bus_stats_t;
+
+mock_cyw43_bus_config_t mock_cyw43_bus_default_config(void);
+
+// sets the context as the cyw43_arch one and brings the station interface up with its link up;
+// the netif input is left to the caller. The interrupts start once this returns
+void mock_cyw43_bus_init(async_context_t *context, const mock_cyw43_bus_config_t *config);
+void mock_cyw43_bus_deinit(void);
+
+// frames start arriving again at the configured rate, up to another config.rx_frames
+void mock_cyw43_bus_restart_rx(const mock_cyw43_bus_config_t *config);
+
+// while stalled the chip returns no credits
+void mock_cyw43_bus_stall_tx(bool stall);
+
+// raise the host wake interrupt whether or not the chip has anything
+void mock_cyw43_bus_raise_irq(void);
+
+// waits for this many frames in total to be delivered; returns false on a timeout
+bool mock_cyw43_bus_wait_delivered(uint32_t frames, uint32_t timeout_ms);
+
+void mock_cyw43_bus_get_stats(mock_cyw43_bus_stats_t *stats);
+
+// the sequence number the mock puts in a received frame, from 0
+uint32_t mock_cyw43_bus_frame_seq(const uint8_t *frame);
+
+// whether a received frame has the length and contents the mock gave it
+bool mock_cyw43_bus_frame_check(const uint8_t *frame, uint32_t len);
+
+#endif
@@ -0,0 +1,67 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// Replays a trace of packet timestamps through the power save governor and prints the report.
+//
+//     pm_replay [frame_us burst_packets queue_depth idle_us] < trace
+//
+// The trace has one timestamp in microseconds per line, in ascending order, as printed by
+// "cyw43_pm trace dump" on the device.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include "cyw43_pm_policy.h"
+
+int main(int argc, char **argv) {
+    cyw43_pm_policy_config_t config = cyw43_pm_policy_default_config();
+    if (argc != 1 && argc != 5) {
+        fprintf(stderr, "usage: %s [frame_us burst_packets queue_depth idle_us] < trace\n", argv[0]);
+        return 2;
+    }
+    if (argc == 5) {
+        config.frame_us = (uint32_t)strtoul(argv[1], NULL, 0);
+        config.burst_packets = (uint32_t)strtoul(argv[2], NULL, 0);
+        config.queue_depth = (uint32_t)strtoul(argv[3], NULL, 0);
+        config.idle_us = (uint32_t)strtoul(argv[4], NULL, 0);
+    }
+
+    size_t count = 0;
+    size_t size = 1024;
+    uint64_t *timestamps_us = malloc(size * sizeof(*timestamps_us));
+    unsigned long long timestamp_us;
+    while (timestamps_us && scanf("%llu", &timestamp_us) == 1) {
+        if (count == size) {
+            size *= 2;
+            uint64_t *grown = realloc(timestamps_us, size * sizeof(*timestamps_us));
+            if (!grown) free(timestamps_us);
+            timestamps_us = grown;
+            if (!timestamps_us) break;
+        }
+        if (count && timestamp_us < timestamps_us[count - 1]) {
+            fprintf(stderr, "timestamp %llu is out of order\n", timestamp_us);
+            free(timestamps_us);
+            return 1;
+        }
+        timestamps_us[count++] = timestamp_us;
+    }
+    if (!timestamps_us) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+    }
+
+    cyw43_pm_policy_replay_report_t report;
+    cyw43_pm_policy_replay(&config, NULL, timestamps_us, count, &report);
+    free(timestamps_us);
+    printf("frame %uus, burst %u packets, queue depth %u, idle %uus\n", (unsigned)config.frame_us,
+           (unsigned)config.burst_packets, (unsigned)config.queue_depth, (unsigned)config.idle_us);
+    printf("packets %u, in power save %u, boosts %u\n", (unsigned)report.packets, (unsigned)report.packets_in_ps,
+           (unsigned)report.boosts);
+    printf("added latency %lluus total, %uus worst\n", (unsigned long long)report.added_latency_us,
+           (unsigned)report.max_added_latency_us);
+    printf("radio on %lluus of %lluus\n", (unsigned long long)report.radio_on_us,
+           (unsigned long long)report.duration_us);
+    return 0;
+}
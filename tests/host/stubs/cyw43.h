@@ -0,0 +1,69 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// host stand-in for the parts of the cyw43-driver's cyw43.h the host built modules use; the
+// driver side of it is the mock bus, see mock_cyw43_bus.h
+
+#ifndef _CYW43_H
+#define _CYW43_H
+
+#include "pico.h"
+
+#if CYW43_LWIP
+#include "lwip/netif.h"
+#endif
+
+#define CYW43_ITF_STA 0
+#define CYW43_ITF_AP  1
+
+#define CYW43_EPERM   1
+#define CYW43_EIO     5
+#define CYW43_EINVAL  22
+#define CYW43_ETIMEDOUT 110
+
+#define CYW43_LINK_DOWN    0
+#define CYW43_LINK_JOIN    1
+#define CYW43_LINK_NOIP    2
+#define CYW43_LINK_UP      3
+#define CYW43_LINK_FAIL    (-1)
+#define CYW43_LINK_NONET   (-2)
+#define CYW43_LINK_BADAUTH (-3)
+
+#define CYW43_AUTH_OPEN             0
+#define CYW43_AUTH_WPA_TKIP_PSK     0x00200002
+#define CYW43_AUTH_WPA2_AES_PSK     0x00400004
+#define CYW43_AUTH_WPA2_MIXED_PSK   0x00400006
+#define CYW43_AUTH_WPA3_SAE_AES_PSK 0x01000004
+#define CYW43_AUTH_WPA3_WPA2_AES_PSK 0x01400004
+
+#define CYW43_CHANNEL_NONE 0xffffffff
+
+typedef struct _cyw43_ll_t {
+    uint32_t opaque[8];
+} cyw43_ll_t;
+
+typedef struct _cyw43_t {
+    cyw43_ll_t cyw43_ll;
+    uint8_t itf_state;
+    uint32_t trace_flags;
+    volatile uint32_t wifi_join_state;
+    uint8_t mac[6];
+#if CYW43_LWIP
+    struct netif netif[2];
+#endif
+} cyw43_t;
+
+extern cyw43_t cyw43_state;
+extern void (*cyw43_poll)(void);
+
+int cyw43_send_ethernet(cyw43_t *self, int itf, size_t len, const void *buf, bool is_pbuf);
+
+void cyw43_thread_enter(void);
+void cyw43_thread_exit(void);
+void cyw43_thread_lock_check(void);
+void cyw43_schedule_internal_poll_dispatch(void (*func)(void));
+
+#endif
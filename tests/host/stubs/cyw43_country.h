@@ -0,0 +1,16 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// host stand-in for the cyw43-driver's cyw43_country.h
+
+#ifndef _CYW43_COUNTRY_H
+#define _CYW43_COUNTRY_H
+
+#define CYW43_COUNTRY(A, B, REV) ((unsigned char)(A) | ((unsigned char)(B) << 8) | ((REV) << 16))
+
+#define CYW43_COUNTRY_WORLDWIDE CYW43_COUNTRY('X', 'X', 0)
+
+#endif
@@ -0,0 +1,48 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// host stand-in for hardware/sync.h: spin locks are mutexes, and disabling interrupts takes a
+// process wide recursive lock, which the host's interrupt sources (timer callbacks and the mock
+// bus) hold while they run. That makes the host behave like a single core.
+
+#ifndef _HARDWARE_SYNC_H
+#define _HARDWARE_SYNC_H
+
+#include <pthread.h>
+#include "pico.h"
+
+typedef pthread_mutex_t spin_lock_t;
+
+int spin_lock_claim_unused(bool required);
+spin_lock_t *spin_lock_instance(uint lock_num);
+
+uint32_t save_and_disable_interrupts(void);
+void restore_interrupts(uint32_t status);
+
+static inline uint32_t spin_lock_blocking(spin_lock_t *lock) {
+    // as on the target, interrupts are disabled first, which also keeps the lock order fixed
+    uint32_t save = save_and_disable_interrupts();
+    pthread_mutex_lock(lock);
+    return save;
+}
+
+static inline void spin_unlock(spin_lock_t *lock, uint32_t saved_irq) {
+    pthread_mutex_unlock(lock);
+    restore_interrupts(saved_irq);
+}
+
+static inline void __mem_fence_acquire(void) {
+    __atomic_thread_fence(__ATOMIC_ACQUIRE);
+}
+
+static inline void __mem_fence_release(void) {
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+}
+
+static inline void __sev(void) {
+}
+
+#endif
@@ -0,0 +1,114 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// the pbuf functions of lwIP used by the host built modules; see lwip/pbuf.h
+
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "lwip/pbuf.h"
+
+static uint32_t pbufs_in_use;
+
+struct pbuf *pbuf_alloc(__attribute__((unused)) pbuf_layer l, u16_t length, pbuf_type type) {
+    assert(type == PBUF_POOL || type == PBUF_RAM);
+    u16_t seg_size = type == PBUF_POOL ? PBUF_POOL_BUFSIZE : length;
+    struct pbuf *head = NULL;
+    struct pbuf **tail = &head;
+    u16_t left = length;
+    do {
+        u16_t seg_len = left < seg_size ? left : seg_size;
+        struct pbuf *p = malloc(sizeof(struct pbuf) + seg_size);
+        if (!p) {
+            if (head) pbuf_free(head);
+            return NULL;
+        }
+        memset(p, 0, sizeof(*p));
+        p->payload = p + 1;
+        p->len = seg_len;
+        p->tot_len = left;
+        p->type_internal = (u8_t)type;
+        p->ref = 1;
+        __atomic_fetch_add(&pbufs_in_use, 1, __ATOMIC_RELAXED);
+        *tail = p;
+        tail = &p->next;
+        left -= seg_len;
+    } while (left);
+    return head;
+}
+
+struct pbuf *pbuf_alloced_custom(__attribute__((unused)) pbuf_layer l, u16_t length, pbuf_type type,
+                                 struct pbuf_custom *p, void *payload_mem, u16_t payload_mem_len) {
+    if (length > payload_mem_len) return NULL;
+    memset(&p->pbuf, 0, sizeof(p->pbuf));
+    p->pbuf.payload = payload_mem;
+    p->pbuf.len = p->pbuf.tot_len = length;
+    p->pbuf.type_internal = (u8_t)type;
+    p->pbuf.flags = PBUF_FLAG_IS_CUSTOM;
+    p->pbuf.ref = 1;
+    return &p->pbuf;
+}
+
+u8_t pbuf_free(struct pbuf *p) {
+    u8_t count = 0;
+    while (p) {
+        assert(p->ref > 0);
+        if (__atomic_sub_fetch(&p->ref, 1, __ATOMIC_ACQ_REL)) break;
+        struct pbuf *next = p->next;
+        if (p->flags & PBUF_FLAG_IS_CUSTOM) {
+            ((struct pbuf_custom *)p)->custom_free_function(p);
+        } else {
+            __atomic_fetch_sub(&pbufs_in_use, 1, __ATOMIC_RELAXED);
+            free(p);
+        }
+        count++;
+        p = next;
+    }
+    return count;
+}
+
+void pbuf_ref(struct pbuf *p) {
+    __atomic_fetch_add(&p->ref, 1, __ATOMIC_RELAXED);
+}
+
+u16_t pbuf_clen(const struct pbuf *p) {
+    u16_t len = 0;
+    for (; p; p = p->next) len++;
+    return len;
+}
+
+err_t pbuf_take(struct pbuf *buf, const void *dataptr, u16_t len) {
+    if (buf->tot_len < len) return ERR_ARG;
+    const u8_t *src = dataptr;
+    for (struct pbuf *p = buf; len; p = p->next) {
+        u16_t n = len < p->len ? len : p->len;
+        memcpy(p->payload, src, n);
+        src += n;
+        len -= n;
+    }
+    return ERR_OK;
+}
+
+u16_t pbuf_copy_partial(const struct pbuf *p, void *dataptr, u16_t len, u16_t offset) {
+    u8_t *dst = dataptr;
+    u16_t copied = 0;
+    for (; p && len; p = p->next) {
+        if (offset >= p->len) {
+            offset -= p->len;
+            continue;
+        }
+        u16_t n = p->len - offset < len ? p->len - offset : len;
+        memcpy(dst + copied, (const u8_t *)p->payload + offset, n);
+        copied += n;
+        len -= n;
+        offset = 0;
+    }
+    return copied;
+}
+
+uint32_t host_lwip_pbufs_in_use(void) {
+    return __atomic_load_n(&pbufs_in_use, __ATOMIC_RELAXED);
+}
@@ -0,0 +1,499 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// RT-Thread kernel objects on pthreads; see rtthread.h
+
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+#include "hardware/sync.h"
+#include "rtthread.h"
+
+// RT-Thread fills a new thread's stack with this
+#define STACK_FILL '#'
+
+static __thread rt_thread_t current_thread;
+static __thread rt_uint8_t interrupt_nest;
+static __thread int critical_nest;
+
+static uint64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000u + (uint64_t)ts.tv_nsec / 1000000u;
+}
+
+rt_tick_t rt_tick_get(void) {
+    return (rt_tick_t)monotonic_ms();
+}
+
+// deadline for a wait of timeout ticks, on the clock pthread_cond_timedwait uses
+static struct timespec deadline(rt_int32_t timeout) {
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    if (timeout > 0) {
+        until.tv_sec += timeout / 1000;
+        until.tv_nsec += (long)(timeout % 1000) * 1000000;
+        if (until.tv_nsec >= 1000000000) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000;
+        }
+    }
+    return until;
+}
+
+// waits on cond for the given ticks; returns false on a timeout
+static bool wait(pthread_cond_t *cond, pthread_mutex_t *mutex, rt_int32_t timeout, const struct timespec *until) {
+    if (timeout == RT_WAITING_NO) return false;
+    if (timeout == RT_WAITING_FOREVER) {
+        pthread_cond_wait(cond, mutex);
+        return true;
+    }
+    return pthread_cond_timedwait(cond, mutex, until) != ETIMEDOUT;
+}
+
+static void *alloc_object(size_t size) {
+    void *object = calloc(1, size);
+    assert(object);
+    return object;
+}
+
+rt_err_t rt_sem_init(rt_sem_t sem, __unused const char *name, rt_uint32_t value, __unused rt_uint8_t flag) {
+    pthread_mutex_init(&sem->mutex, NULL);
+    pthread_cond_init(&sem->cond, NULL);
+    sem->value = value;
+    sem->allocated = false;
+    return RT_EOK;
+}
+
+rt_err_t rt_sem_detach(rt_sem_t sem) {
+    pthread_cond_destroy(&sem->cond);
+    pthread_mutex_destroy(&sem->mutex);
+    return RT_EOK;
+}
+
+rt_sem_t rt_sem_create(const char *name, rt_uint32_t value, rt_uint8_t flag) {
+    rt_sem_t sem = alloc_object(sizeof(*sem));
+    rt_sem_init(sem, name, value, flag);
+    sem->allocated = true;
+    return sem;
+}
+
+rt_err_t rt_sem_delete(rt_sem_t sem) {
+    assert(sem->allocated);
+    rt_sem_detach(sem);
+    free(sem);
+    return RT_EOK;
+}
+
+rt_err_t rt_sem_take(rt_sem_t sem, rt_int32_t timeout) {
+    struct timespec until = deadline(timeout);
+    rt_err_t err = RT_EOK;
+    pthread_mutex_lock(&sem->mutex);
+    while (!sem->value) {
+        if (!wait(&sem->cond, &sem->mutex, timeout, &until)) {
+            err = -RT_ETIMEOUT;
+            break;
+        }
+    }
+    if (!err) sem->value--;
+    pthread_mutex_unlock(&sem->mutex);
+    return err;
+}
+
+rt_err_t rt_sem_release(rt_sem_t sem) {
+    pthread_mutex_lock(&sem->mutex);
+    sem->value++;
+    pthread_cond_signal(&sem->cond);
+    pthread_mutex_unlock(&sem->mutex);
+    return RT_EOK;
+}
+
+rt_err_t rt_mutex_init(rt_mutex_t mutex, __unused const char *name, __unused rt_uint8_t flag) {
+    pthread_mutex_init(&mutex->mutex, NULL);
+    pthread_cond_init(&mutex->cond, NULL);
+    mutex->owner = NULL;
+    mutex->hold = 0;
+    mutex->allocated = false;
+    return RT_EOK;
+}
+
+rt_err_t rt_mutex_detach(rt_mutex_t mutex) {
+    assert(!mutex->owner);
+    pthread_cond_destroy(&mutex->cond);
+    pthread_mutex_destroy(&mutex->mutex);
+    return RT_EOK;
+}
+
+rt_mutex_t rt_mutex_create(const char *name, rt_uint8_t flag) {
+    rt_mutex_t mutex = alloc_object(sizeof(*mutex));
+    rt_mutex_init(mutex, name, flag);
+    mutex->allocated = true;
+    return mutex;
+}
+
+rt_err_t rt_mutex_delete(rt_mutex_t mutex) {
+    assert(mutex->allocated);
+    rt_mutex_detach(mutex);
+    free(mutex);
+    return RT_EOK;
+}
+
+rt_err_t rt_mutex_take(rt_mutex_t mutex, rt_int32_t timeout) {
+    // RT-Thread mutexes are recursive, and can't be taken from an interrupt
+    assert(!interrupt_nest);
+    rt_thread_t self = rt_thread_self();
+    struct timespec until = deadline(timeout);
+    rt_err_t err = RT_EOK;
+    pthread_mutex_lock(&mutex->mutex);
+    while (mutex->owner && mutex->owner != self) {
+        if (!wait(&mutex->cond, &mutex->mutex, timeout, &until)) {
+            err = -RT_ETIMEOUT;
+            break;
+        }
+    }
+    if (!err) {
+        mutex->owner = self;
+        mutex->hold++;
+    }
+    pthread_mutex_unlock(&mutex->mutex);
+    return err;
+}
+
+rt_err_t rt_mutex_release(rt_mutex_t mutex) {
+    pthread_mutex_lock(&mutex->mutex);
+    if (mutex->owner != rt_thread_self()) {
+        pthread_mutex_unlock(&mutex->mutex);
+        return -RT_ERROR;
+    }
+    if (!--mutex->hold) {
+        mutex->owner = NULL;
+        pthread_cond_signal(&mutex->cond);
+    }
+    pthread_mutex_unlock(&mutex->mutex);
+    return RT_EOK;
+}
+
+rt_err_t rt_event_init(rt_event_t event, __unused const char *name, __unused rt_uint8_t flag) {
+    pthread_mutex_init(&event->mutex, NULL);
+    pthread_cond_init(&event->cond, NULL);
+    event->set = 0;
+    event->allocated = false;
+    return RT_EOK;
+}
+
+rt_err_t rt_event_detach(rt_event_t event) {
+    pthread_cond_destroy(&event->cond);
+    pthread_mutex_destroy(&event->mutex);
+    return RT_EOK;
+}
+
+rt_event_t rt_event_create(const char *name, rt_uint8_t flag) {
+    rt_event_t event = alloc_object(sizeof(*event));
+    rt_event_init(event, name, flag);
+    event->allocated = true;
+    return event;
+}
+
+rt_err_t rt_event_delete(rt_event_t event) {
+    assert(event->allocated);
+    rt_event_detach(event);
+    free(event);
+    return RT_EOK;
+}
+
+rt_err_t rt_event_send(rt_event_t event, rt_uint32_t set) {
+    pthread_mutex_lock(&event->mutex);
+    event->set |= set;
+    pthread_cond_broadcast(&event->cond);
+    pthread_mutex_unlock(&event->mutex);
+    return RT_EOK;
+}
+
+rt_err_t rt_event_recv(rt_event_t event, rt_uint32_t set, rt_uint8_t option, rt_int32_t timeout, rt_uint32_t *recved) {
+    struct timespec until = deadline(timeout);
+    rt_err_t err = RT_EOK;
+    pthread_mutex_lock(&event->mutex);
+    for (;;) {
+        bool satisfied = option & RT_EVENT_FLAG_AND ? (event->set & set) == set : (event->set & set) != 0;
+        if (satisfied) break;
+        if (!wait(&event->cond, &event->mutex, timeout, &until)) {
+            err = -RT_ETIMEOUT;
+            break;
+        }
+    }
+    if (!err) {
+        if (recved) *recved = event->set & set;
+        if (option & RT_EVENT_FLAG_CLEAR) event->set &= ~set;
+    }
+    pthread_mutex_unlock(&event->mutex);
+    return err;
+}
+
+// the running timers; the tick thread takes the ones which are due off the list, and runs them
+// holding timer_run_lock, so that a timer being detached can wait for its callback to finish
+static pthread_mutex_t timer_list_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_mutex_t timer_run_lock;
+static rt_timer_t timer_list;
+static pthread_once_t timer_once = PTHREAD_ONCE_INIT;
+
+#define TIMERS_PER_TICK 32
+
+static void timer_unlink(rt_timer_t timer) {
+    for (rt_timer_t *prev = &timer_list; *prev; prev = &(*prev)->next) {
+        if (*prev == timer) {
+            *prev = timer->next;
+            break;
+        }
+    }
+    timer->next = NULL;
+    timer->active = false;
+}
+
+static void *timer_thread_func(__unused void *arg) {
+    for (;;) {
+        rt_thread_mdelay(1);
+        rt_timer_t due[TIMERS_PER_TICK];
+        uint count = 0;
+        // held while the due timers run, so a timer can't be detached between being found due
+        // and run; taken before timer_list_lock, as the callbacks take that to stop timers
+        pthread_mutex_lock(&timer_run_lock);
+        pthread_mutex_lock(&timer_list_lock);
+        rt_tick_t now = rt_tick_get();
+        for (rt_timer_t timer = timer_list, next; timer && count < TIMERS_PER_TICK; timer = next) {
+            next = timer->next;
+            if ((rt_int32_t)(now - timer->timeout_tick) < 0) continue;
+            if (timer->flag & RT_TIMER_FLAG_PERIODIC) {
+                timer->timeout_tick = now + timer->init_tick;
+            } else {
+                timer_unlink(timer);
+            }
+            due[count++] = timer;
+        }
+        pthread_mutex_unlock(&timer_list_lock);
+        for (uint i = 0; i < count; i++) {
+            uint32_t save = save_and_disable_interrupts();
+            rt_interrupt_enter();
+            due[i]->timeout_func(due[i]->parameter);
+            rt_interrupt_leave();
+            restore_interrupts(save);
+        }
+        pthread_mutex_unlock(&timer_run_lock);
+    }
+    return NULL;
+}
+
+static void timer_thread_start(void) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    // a callback may stop or detach timers itself
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&timer_run_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    pthread_t thread;
+    pthread_create(&thread, NULL, timer_thread_func, NULL);
+    pthread_detach(thread);
+}
+
+void rt_timer_init(rt_timer_t timer, __unused const char *name, void (*timeout)(void *parameter), void *parameter,
+                   rt_tick_t time, rt_uint8_t flag) {
+    pthread_once(&timer_once, timer_thread_start);
+    memset(timer, 0, sizeof(*timer));
+    timer->timeout_func = timeout;
+    timer->parameter = parameter;
+    timer->init_tick = time;
+    timer->flag = flag;
+}
+
+rt_err_t rt_timer_detach(rt_timer_t timer) {
+    rt_timer_stop(timer);
+    // wait for a callback which is already running
+    pthread_mutex_lock(&timer_run_lock);
+    pthread_mutex_unlock(&timer_run_lock);
+    return RT_EOK;
+}
+
+rt_timer_t rt_timer_create(const char *name, void (*timeout)(void *parameter), void *parameter, rt_tick_t time,
+                           rt_uint8_t flag) {
+    rt_timer_t timer = alloc_object(sizeof(*timer));
+    rt_timer_init(timer, name, timeout, parameter, time, flag);
+    timer->allocated = true;
+    return timer;
+}
+
+rt_err_t rt_timer_delete(rt_timer_t timer) {
+    assert(timer->allocated);
+    rt_timer_detach(timer);
+    free(timer);
+    return RT_EOK;
+}
+
+rt_err_t rt_timer_start(rt_timer_t timer) {
+    pthread_mutex_lock(&timer_list_lock);
+    if (!timer->active) {
+        timer->next = timer_list;
+        timer_list = timer;
+        timer->active = true;
+    }
+    timer->timeout_tick = rt_tick_get() + timer->init_tick;
+    pthread_mutex_unlock(&timer_list_lock);
+    return RT_EOK;
+}
+
+rt_err_t rt_timer_stop(rt_timer_t timer) {
+    pthread_mutex_lock(&timer_list_lock);
+    bool active = timer->active;
+    if (active) timer_unlink(timer);
+    pthread_mutex_unlock(&timer_list_lock);
+    return active ? RT_EOK : -RT_ERROR;
+}
+
+rt_err_t rt_timer_control(rt_timer_t timer, int cmd, void *arg) {
+    pthread_mutex_lock(&timer_list_lock);
+    switch (cmd) {
+        case RT_TIMER_CTRL_SET_TIME:
+            // as in RT-Thread, this takes effect when the timer is next started
+            timer->init_tick = *(rt_tick_t *)arg;
+            break;
+        case RT_TIMER_CTRL_GET_TIME:
+            *(rt_tick_t *)arg = timer->init_tick;
+            break;
+    }
+    pthread_mutex_unlock(&timer_list_lock);
+    return RT_EOK;
+}
+
+static void *thread_start(void *arg) {
+    rt_thread_t thread = arg;
+    current_thread = thread;
+    thread->entry(thread->parameter);
+    // a created thread is deleted on returning from its entry, as rt_thread_exit does
+    if (thread->allocated) {
+        // there is no one to join it; this is the idle thread's cleanup
+        pthread_detach(pthread_self());
+        free(thread->stack_addr);
+        pthread_cond_destroy(&thread->cond);
+        pthread_mutex_destroy(&thread->mutex);
+        free(thread);
+    }
+    return NULL;
+}
+
+rt_err_t rt_thread_init(rt_thread_t thread, const char *name, void (*entry)(void *parameter), void *parameter,
+                        void *stack_start, rt_uint32_t stack_size, __unused rt_uint8_t priority,
+                        __unused rt_uint32_t tick) {
+    memset(thread, 0, sizeof(*thread));
+    rt_strncpy(thread->name, name, RT_NAME_MAX);
+    rt_list_init(&thread->tlist);
+    // the pthread has a stack of its own, so the stack given stays as RT-Thread leaves it
+    thread->stack_addr = stack_start;
+    thread->stack_size = stack_size;
+    if (stack_start) memset(stack_start, STACK_FILL, stack_size);
+    pthread_mutex_init(&thread->mutex, NULL);
+    pthread_cond_init(&thread->cond, NULL);
+    thread->entry = entry;
+    thread->parameter = parameter;
+    return RT_EOK;
+}
+
+rt_err_t rt_thread_detach(rt_thread_t thread) {
+    assert(thread != rt_thread_self());
+    pthread_mutex_lock(&thread->mutex);
+    thread->closed = true;
+    pthread_cond_broadcast(&thread->cond);
+    pthread_mutex_unlock(&thread->mutex);
+    // a suspended thread is woken to return from its entry, and gone once this returns
+    if (thread->started) pthread_join(thread->pthread, NULL);
+    pthread_cond_destroy(&thread->cond);
+    pthread_mutex_destroy(&thread->mutex);
+    return RT_EOK;
+}
+
+rt_thread_t rt_thread_create(const char *name, void (*entry)(void *parameter), void *parameter,
+                             rt_uint32_t stack_size, rt_uint8_t priority, rt_uint32_t tick) {
+    rt_thread_t thread = alloc_object(sizeof(*thread));
+    rt_thread_init(thread, name, entry, parameter, alloc_object(stack_size), stack_size, priority, tick);
+    thread->allocated = true;
+    return thread;
+}
+
+rt_err_t rt_thread_delete(rt_thread_t thread) {
+    // the host only supports a thread deleting itself on its way out; it is freed once it returns
+    assert(thread == rt_thread_self() && thread->allocated);
+    return RT_EOK;
+}
+
+rt_err_t rt_thread_startup(rt_thread_t thread) {
+    if (pthread_create(&thread->pthread, NULL, thread_start, thread)) return -RT_ERROR;
+    thread->started = true;
+    return RT_EOK;
+}
+
+static void suspend_self(rt_thread_t thread) {
+    pthread_mutex_lock(&thread->mutex);
+    while (thread->suspended && !thread->closed) {
+        pthread_cond_wait(&thread->cond, &thread->mutex);
+    }
+    thread->suspended = false;
+    pthread_mutex_unlock(&thread->mutex);
+}
+
+rt_err_t rt_thread_suspend(rt_thread_t thread) {
+    // the host only supports a thread suspending itself, which stays suspended until it is detached
+    assert(thread == rt_thread_self());
+    pthread_mutex_lock(&thread->mutex);
+    thread->suspended = true;
+    pthread_mutex_unlock(&thread->mutex);
+    // with the scheduler locked, the switch away happens when it is unlocked
+    if (!critical_nest) suspend_self(thread);
+    return RT_EOK;
+}
+
+rt_thread_t rt_thread_self(void) {
+    if (!current_thread) {
+        // a thread the test started itself
+        static uint foreign_threads;
+        current_thread = alloc_object(sizeof(*current_thread));
+        snprintf(current_thread->name, RT_NAME_MAX, "host%u", __atomic_fetch_add(&foreign_threads, 1, __ATOMIC_RELAXED));
+        rt_list_init(&current_thread->tlist);
+        pthread_mutex_init(&current_thread->mutex, NULL);
+        pthread_cond_init(&current_thread->cond, NULL);
+        current_thread->pthread = pthread_self();
+    }
+    return current_thread;
+}
+
+rt_err_t rt_thread_delay(rt_tick_t tick) {
+    return rt_thread_mdelay((rt_int32_t)tick);
+}
+
+rt_err_t rt_thread_mdelay(rt_int32_t ms) {
+    struct timespec ts = { .tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000 };
+    nanosleep(&ts, NULL);
+    return RT_EOK;
+}
+
+// there is no scheduler to lock; only a self suspension is held back until the unlock
+void rt_enter_critical(void) {
+    critical_nest++;
+}
+
+void rt_exit_critical(void) {
+    assert(critical_nest > 0);
+    if (!--critical_nest && current_thread && current_thread->suspended) suspend_self(current_thread);
+}
+
+void rt_interrupt_enter(void) {
+    interrupt_nest++;
+}
+
+void rt_interrupt_leave(void) {
+    assert(interrupt_nest > 0);
+    interrupt_nest--;
+}
+
+rt_uint8_t rt_interrupt_get_nest(void) {
+    return interrupt_nest;
+}
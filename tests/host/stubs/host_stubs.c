@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "hardware/sync.h"
+
+#define SPIN_LOCK_COUNT 32
+
+static spin_lock_t spin_locks[SPIN_LOCK_COUNT];
+static uint spin_locks_claimed;
+static pthread_mutex_t interrupts_lock;
+static pthread_once_t interrupts_once = PTHREAD_ONCE_INIT;
+
+static void interrupts_lock_init(void) {
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    pthread_mutex_init(&interrupts_lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+}
+
+uint32_t save_and_disable_interrupts(void) {
+    pthread_once(&interrupts_once, interrupts_lock_init);
+    pthread_mutex_lock(&interrupts_lock);
+    return 0;
+}
+
+void restore_interrupts(__unused uint32_t status) {
+    pthread_mutex_unlock(&interrupts_lock);
+}
+
+int spin_lock_claim_unused(bool required) {
+    uint32_t save = save_and_disable_interrupts();
+    int lock_num = -1;
+    if (spin_locks_claimed < SPIN_LOCK_COUNT) {
+        pthread_mutex_init(&spin_locks[spin_locks_claimed], NULL);
+        lock_num = (int)spin_locks_claimed++;
+    }
+    restore_interrupts(save);
+    assert(lock_num >= 0 || !required);
+    return lock_num;
+}
+
+spin_lock_t *spin_lock_instance(uint lock_num) {
+    assert(lock_num < spin_locks_claimed);
+    return &spin_locks[lock_num];
+}
@@ -0,0 +1,32 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// host stand-in for lwip/netif.h
+
+#ifndef _LWIP_NETIF_H
+#define _LWIP_NETIF_H
+
+#include "lwip/opt.h"
+#include "lwip/err.h"
+#include "lwip/pbuf.h"
+
+#define NETIF_FLAG_UP        0x01U
+#define NETIF_FLAG_BROADCAST 0x02U
+#define NETIF_FLAG_LINK_UP   0x04U
+
+struct netif;
+
+typedef err_t (*netif_input_fn)(struct pbuf *p, struct netif *inp);
+
+struct netif {
+    netif_input_fn input;
+    void *state;
+    u16_t mtu;
+    u8_t hwaddr[6];
+    u8_t flags;
+};
+
+#endif
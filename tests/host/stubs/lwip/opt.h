@@ -0,0 +1,23 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// host stand-in for lwip/opt.h, with the options the host built modules look at
+
+#ifndef _LWIP_OPT_H
+#define _LWIP_OPT_H
+
+#include "lwip/arch.h"
+
+#ifndef LWIP_SUPPORT_CUSTOM_PBUF
+#define LWIP_SUPPORT_CUSTOM_PBUF 1
+#endif
+
+// small enough that a full sized frame is chained, as with the pico-sdk's lwIP defaults
+#ifndef PBUF_POOL_BUFSIZE
+#define PBUF_POOL_BUFSIZE 512
+#endif
+
+#endif
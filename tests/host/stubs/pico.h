@@ -0,0 +1,45 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// host stand-in for the parts of pico.h the host built modules use
+
+#ifndef _PICO_H
+#define _PICO_H
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+typedef unsigned int uint;
+
+#ifndef __unused
+#define __unused __attribute__((unused))
+#endif
+
+enum pico_error_codes {
+    PICO_OK = 0,
+    PICO_ERROR_NONE = 0,
+    PICO_ERROR_TIMEOUT = -1,
+    PICO_ERROR_GENERIC = -2,
+    PICO_ERROR_NO_DATA = -3,
+    PICO_ERROR_NOT_PERMITTED = -4,
+    PICO_ERROR_INVALID_ARG = -5,
+    PICO_ERROR_IO = -6,
+};
+
+#define invalid_params_if(x, test) ({ if (PARAM_ASSERTIONS_ENABLED_ ## x) assert(!(test)); })
+#define valid_params_if(x, test) ({ if (PARAM_ASSERTIONS_ENABLED_ ## x) assert(test); })
+#define hard_assert(x) ({ if (!(x)) abort(); })
+
+#define NUM_CORES 2
+
+static inline uint get_core_num(void) {
+    return 0;
+}
+
+#endif
@@ -0,0 +1,14 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// host stand-in for pico/sync.h
+
+#ifndef _PICO_SYNC_H
+#define _PICO_SYNC_H
+
+#include "hardware/sync.h"
+
+#endif
@@ -0,0 +1,88 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// host stand-in for pico/time.h, on the monotonic clock
+
+#ifndef _PICO_TIME_H
+#define _PICO_TIME_H
+
+#include <time.h>
+#include "pico.h"
+
+typedef uint64_t absolute_time_t;
+
+static const absolute_time_t at_the_end_of_time = INT64_MAX;
+static const absolute_time_t nil_time = 0;
+
+static inline uint64_t time_us_64(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000u + (uint64_t)ts.tv_nsec / 1000u;
+}
+
+static inline uint32_t time_us_32(void) {
+    return (uint32_t)time_us_64();
+}
+
+static inline uint64_t to_us_since_boot(absolute_time_t t) {
+    return t;
+}
+
+static inline absolute_time_t from_us_since_boot(uint64_t us) {
+    return us;
+}
+
+static inline absolute_time_t get_absolute_time(void) {
+    return time_us_64();
+}
+
+static inline uint32_t to_ms_since_boot(absolute_time_t t) {
+    return (uint32_t)(t / 1000);
+}
+
+static inline int64_t absolute_time_diff_us(absolute_time_t from, absolute_time_t to) {
+    return (int64_t)(to - from);
+}
+
+static inline bool is_at_the_end_of_time(absolute_time_t t) {
+    return t == at_the_end_of_time;
+}
+
+static inline bool is_nil_time(absolute_time_t t) {
+    return !t;
+}
+
+static inline absolute_time_t delayed_by_us(absolute_time_t t, uint64_t us) {
+    uint64_t delayed = t + us;
+    return delayed < t || delayed >= at_the_end_of_time ? at_the_end_of_time : delayed;
+}
+
+static inline absolute_time_t delayed_by_ms(absolute_time_t t, uint32_t ms) {
+    return delayed_by_us(t, ms * 1000ull);
+}
+
+static inline absolute_time_t make_timeout_time_us(uint64_t us) {
+    return delayed_by_us(get_absolute_time(), us);
+}
+
+static inline absolute_time_t make_timeout_time_ms(uint32_t ms) {
+    return delayed_by_ms(get_absolute_time(), ms);
+}
+
+static inline bool time_reached(absolute_time_t t) {
+    return get_absolute_time() >= t;
+}
+
+static inline void sleep_us(uint64_t us) {
+    struct timespec ts = { .tv_sec = (time_t)(us / 1000000u), .tv_nsec = (long)(us % 1000000u) * 1000 };
+    nanosleep(&ts, NULL);
+}
+
+static inline void sleep_ms(uint32_t ms) {
+    sleep_us(ms * 1000ull);
+}
+
+#endif
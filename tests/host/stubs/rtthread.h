@@ -0,0 +1,192 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// host stand-in for the RT-Thread kernel objects the host built modules use, on pthreads
+//
+// One tick is a millisecond. Timers are hard timers: their callbacks run on a tick thread which
+// counts as an interrupt (rt_interrupt_get_nest() is non zero) and has interrupts disabled, as
+// the callbacks of RT-Thread's hard timers run from the tick interrupt.
+
+#ifndef _RTTHREAD_H
+#define _RTTHREAD_H
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+typedef long rt_err_t;
+typedef int32_t rt_int32_t;
+typedef uint32_t rt_uint32_t;
+typedef uint16_t rt_uint16_t;
+typedef uint8_t rt_uint8_t;
+typedef int rt_bool_t;
+typedef rt_uint32_t rt_tick_t;
+typedef size_t rt_size_t;
+
+#define RT_TRUE  1
+#define RT_FALSE 0
+#define RT_NULL  NULL
+
+#define RT_EOK       0
+#define RT_ERROR     1
+#define RT_ETIMEOUT  2
+#define RT_ENOMEM    4
+
+#define RT_WAITING_FOREVER -1
+#define RT_WAITING_NO      0
+
+#define RT_IPC_FLAG_FIFO 0x00
+#define RT_IPC_FLAG_PRIO 0x01
+
+#define RT_EVENT_FLAG_AND   0x01
+#define RT_EVENT_FLAG_OR    0x02
+#define RT_EVENT_FLAG_CLEAR 0x04
+
+#define RT_TIMER_FLAG_ONE_SHOT   0x0
+#define RT_TIMER_FLAG_PERIODIC   0x2
+#define RT_TIMER_CTRL_SET_TIME   0x0
+#define RT_TIMER_CTRL_GET_TIME   0x1
+
+#define RT_THREAD_PRIORITY_MAX 32
+#define RT_TICK_PER_SECOND     1000
+#define RT_NAME_MAX            8
+
+#define RT_ASSERT(expr) assert(expr)
+
+#define rt_kprintf printf
+#define rt_strncpy strncpy
+#define rt_strcmp strcmp
+#define rt_memset memset
+#define rt_memcpy memcpy
+
+typedef struct rt_list_node {
+    struct rt_list_node *next;
+    struct rt_list_node *prev;
+} rt_list_t;
+
+static inline void rt_list_init(rt_list_t *l) {
+    l->next = l->prev = l;
+}
+
+static inline int rt_list_isempty(const rt_list_t *l) {
+    return l->next == l;
+}
+
+struct rt_semaphore {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    uint32_t value;
+    bool allocated;
+};
+typedef struct rt_semaphore *rt_sem_t;
+
+struct rt_thread {
+    char name[RT_NAME_MAX];
+    rt_list_t tlist;        // never on a kernel list here; kept for code which waits for it to empty
+    void *sp;               // NULL, as the thread doesn't run on stack_addr
+    void *stack_addr;
+    rt_uint32_t stack_size;
+    pthread_t pthread;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    void (*entry)(void *parameter);
+    void *parameter;
+    bool started;
+    bool suspended;         // suspended itself, until it is detached
+    bool closed;
+    bool allocated;
+};
+typedef struct rt_thread *rt_thread_t;
+
+struct rt_mutex {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    rt_thread_t volatile owner;
+    rt_uint16_t hold;
+    bool allocated;
+};
+typedef struct rt_mutex *rt_mutex_t;
+
+struct rt_event {
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+    rt_uint32_t set;
+    bool allocated;
+};
+typedef struct rt_event *rt_event_t;
+
+struct rt_timer {
+    struct rt_timer *next;  // on the list of running timers
+    void (*timeout_func)(void *parameter);
+    void *parameter;
+    rt_tick_t init_tick;
+    rt_tick_t timeout_tick;
+    rt_uint8_t flag;
+    bool active;
+    bool allocated;
+};
+typedef struct rt_timer *rt_timer_t;
+
+rt_tick_t rt_tick_get(void);
+
+static inline rt_tick_t rt_tick_from_millisecond(rt_int32_t ms) {
+    return (rt_tick_t)ms;
+}
+
+rt_err_t rt_sem_init(rt_sem_t sem, const char *name, rt_uint32_t value, rt_uint8_t flag);
+rt_err_t rt_sem_detach(rt_sem_t sem);
+rt_sem_t rt_sem_create(const char *name, rt_uint32_t value, rt_uint8_t flag);
+rt_err_t rt_sem_delete(rt_sem_t sem);
+rt_err_t rt_sem_take(rt_sem_t sem, rt_int32_t timeout);
+rt_err_t rt_sem_release(rt_sem_t sem);
+
+rt_err_t rt_mutex_init(rt_mutex_t mutex, const char *name, rt_uint8_t flag);
+rt_err_t rt_mutex_detach(rt_mutex_t mutex);
+rt_mutex_t rt_mutex_create(const char *name, rt_uint8_t flag);
+rt_err_t rt_mutex_delete(rt_mutex_t mutex);
+rt_err_t rt_mutex_take(rt_mutex_t mutex, rt_int32_t timeout);
+rt_err_t rt_mutex_release(rt_mutex_t mutex);
+
+rt_err_t rt_event_init(rt_event_t event, const char *name, rt_uint8_t flag);
+rt_err_t rt_event_detach(rt_event_t event);
+rt_event_t rt_event_create(const char *name, rt_uint8_t flag);
+rt_err_t rt_event_delete(rt_event_t event);
+rt_err_t rt_event_send(rt_event_t event, rt_uint32_t set);
+rt_err_t rt_event_recv(rt_event_t event, rt_uint32_t set, rt_uint8_t option, rt_int32_t timeout, rt_uint32_t *recved);
+
+void rt_timer_init(rt_timer_t timer, const char *name, void (*timeout)(void *parameter), void *parameter,
+                   rt_tick_t time, rt_uint8_t flag);
+rt_err_t rt_timer_detach(rt_timer_t timer);
+rt_timer_t rt_timer_create(const char *name, void (*timeout)(void *parameter), void *parameter, rt_tick_t time,
+                           rt_uint8_t flag);
+rt_err_t rt_timer_delete(rt_timer_t timer);
+rt_err_t rt_timer_start(rt_timer_t timer);
+rt_err_t rt_timer_stop(rt_timer_t timer);
+rt_err_t rt_timer_control(rt_timer_t timer, int cmd, void *arg);
+
+rt_err_t rt_thread_init(rt_thread_t thread, const char *name, void (*entry)(void *parameter), void *parameter,
+                        void *stack_start, rt_uint32_t stack_size, rt_uint8_t priority, rt_uint32_t tick);
+rt_err_t rt_thread_detach(rt_thread_t thread);
+rt_thread_t rt_thread_create(const char *name, void (*entry)(void *parameter), void *parameter,
+                             rt_uint32_t stack_size, rt_uint8_t priority, rt_uint32_t tick);
+rt_err_t rt_thread_delete(rt_thread_t thread);
+rt_err_t rt_thread_startup(rt_thread_t thread);
+rt_err_t rt_thread_suspend(rt_thread_t thread);
+rt_thread_t rt_thread_self(void);
+rt_err_t rt_thread_delay(rt_tick_t tick);
+rt_err_t rt_thread_mdelay(rt_int32_t ms);
+
+void rt_enter_critical(void);
+void rt_exit_critical(void);
+
+void rt_interrupt_enter(void);
+void rt_interrupt_leave(void);
+rt_uint8_t rt_interrupt_get_nest(void);
+
+#endif
@@ -0,0 +1,177 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// async_context_rtthread on the host RT-Thread objects; built once with the kernel objects from
+// the heap and once with them embedded (ASYNC_CONTEXT_RTTHREAD_STATIC)
+
+#include "async_context_rtthread.h"
+#include "hardware/sync.h"
+#include "host_test.h"
+
+static async_context_rtthread_t context;
+
+typedef struct {
+    async_when_pending_worker_t worker;
+    struct rt_semaphore done;
+    volatile uint32_t runs;
+    volatile bool on_task;
+} test_worker_t;
+
+static bool on_task(void) {
+    return rt_thread_self() == context.task_handle;
+}
+
+static void test_worker_func(async_context_t *ctx, async_when_pending_worker_t *worker) {
+    test_worker_t *test = (test_worker_t *)worker;
+    async_context_lock_check(ctx);
+    test->runs++;
+    test->on_task = on_task();
+    rt_sem_release(&test->done);
+}
+
+static void test_worker_init(test_worker_t *test) {
+    memset(test, 0, sizeof(*test));
+    test->worker.do_work = test_worker_func;
+    rt_sem_init(&test->done, "test", 0, RT_IPC_FLAG_FIFO);
+    async_context_add_when_pending_worker(&context.core, &test->worker);
+}
+
+static void test_worker_deinit(test_worker_t *test) {
+    async_context_remove_when_pending_worker(&context.core, &test->worker);
+    rt_sem_detach(&test->done);
+}
+
+static uint32_t sync_func(void *param) {
+    *(bool *)param = on_task();
+    return 42;
+}
+
+static void test_execute_sync(void) {
+    bool ran_on_task = false;
+    CHECK_EQ(async_context_execute_sync(&context.core, sync_func, &ran_on_task), 42);
+    CHECK(ran_on_task);
+}
+
+static void test_when_pending(void) {
+    test_worker_t test;
+    test_worker_init(&test);
+    async_context_set_work_pending(&context.core, &test.worker);
+    CHECK_EQ(rt_sem_take(&test.done, 1000), RT_EOK);
+    CHECK_EQ(test.runs, 1);
+    CHECK(test.on_task);
+
+    // work set pending while the lock is held runs once it is released, and not before
+    async_context_acquire_lock_blocking(&context.core);
+    async_context_set_work_pending(&context.core, &test.worker);
+    CHECK_EQ(rt_sem_take(&test.done, 50), -RT_ETIMEOUT);
+    async_context_release_lock(&context.core);
+    CHECK_EQ(rt_sem_take(&test.done, 1000), RT_EOK);
+    CHECK_EQ(test.runs, 2);
+    test_worker_deinit(&test);
+}
+
+typedef struct {
+    async_at_time_worker_t worker;
+    struct rt_semaphore done;
+    uint64_t ran_us;
+} test_timeout_t;
+
+static void test_timeout_func(__unused async_context_t *ctx, async_at_time_worker_t *worker) {
+    test_timeout_t *test = (test_timeout_t *)worker;
+    test->ran_us = time_us_64();
+    rt_sem_release(&test->done);
+}
+
+static void test_at_time(void) {
+    test_timeout_t test = { .worker.do_work = test_timeout_func };
+    rt_sem_init(&test.done, "test", 0, RT_IPC_FLAG_FIFO);
+    uint64_t start_us = time_us_64();
+    async_context_add_at_time_worker_in_ms(&context.core, &test.worker, 20);
+    CHECK_EQ(rt_sem_take(&test.done, 1000), RT_EOK);
+    CHECK(test.ran_us - start_us >= 20000);
+    CHECK(test.ran_us - start_us < 200000);
+    // with nothing left to do no deadline is set, so the timer is left stopped
+    async_context_execute_sync(&context.core, sync_func, &(bool){false});
+    CHECK(is_at_the_end_of_time(async_context_rtthread_next_deadline(&context)));
+
+    // a worker removed before it is due never runs
+    async_context_add_at_time_worker_in_ms(&context.core, &test.worker, 20);
+    CHECK(async_context_remove_at_time_worker(&context.core, &test.worker));
+    CHECK_EQ(rt_sem_take(&test.done, 60), -RT_ETIMEOUT);
+    rt_sem_detach(&test.done);
+}
+
+// as the mock bus raises its host wake interrupt
+static void set_work_pending_from_irq(test_worker_t *test) {
+    uint32_t save = save_and_disable_interrupts();
+    rt_interrupt_enter();
+    async_context_set_work_pending(&context.core, &test->worker);
+    rt_interrupt_leave();
+    restore_interrupts(save);
+}
+
+static void test_wake_from_irq(void) {
+    test_worker_t test;
+    test_worker_init(&test);
+    uint32_t wakeups = async_context_rtthread_get_wakeups(&context);
+    set_work_pending_from_irq(&test);
+    CHECK_EQ(rt_sem_take(&test.done, 1000), RT_EOK);
+    CHECK(test.on_task);
+    CHECK(async_context_rtthread_get_wakeups(&context) != wakeups);
+    test_worker_deinit(&test);
+}
+
+static void test_irq_polling(void) {
+    test_worker_t test;
+    test_worker_init(&test);
+    async_context_rtthread_poll_stats_t before, stats;
+    async_context_rtthread_get_poll_stats(&context, &before);
+    async_context_rtthread_enter_irq_polling(&context);
+    async_context_rtthread_get_poll_stats(&context, &stats);
+    CHECK(stats.polling);
+    CHECK_EQ(stats.enters, before.enters + 1);
+
+    // interrupts are folded into the next poll rather than each waking the task
+    for (int i = 0; i < 3; i++) set_work_pending_from_irq(&test);
+    async_context_rtthread_get_poll_stats(&context, &stats);
+    CHECK_EQ(stats.irqs_deferred, before.irqs_deferred + 3);
+    CHECK_EQ(rt_sem_take(&test.done, 1000), RT_EOK);
+
+    // a poll interval without an interrupt goes back to interrupt mode
+    for (int i = 0; i < 100 && stats.polling; i++) {
+        rt_thread_mdelay(1);
+        async_context_rtthread_get_poll_stats(&context, &stats);
+    }
+    CHECK(!stats.polling);
+    CHECK_EQ(stats.exits, before.exits + 1);
+
+    set_work_pending_from_irq(&test);
+    CHECK_EQ(rt_sem_take(&test.done, 1000), RT_EOK);
+    async_context_rtthread_get_poll_stats(&context, &stats);
+    CHECK_EQ(stats.irqs_deferred, before.irqs_deferred + 3);
+    test_worker_deinit(&test);
+}
+
+static void test_deinit(void) {
+    // the task is stopped and everything released, and the instance can be set up again
+    async_context_deinit(&context.core);
+    CHECK(!context.task_handle);
+    CHECK(async_context_rtthread_init_with_defaults(&context));
+    test_execute_sync();
+    test_when_pending();
+}
+
+int main(void) {
+    CHECK(async_context_rtthread_init_with_defaults(&context));
+    test_execute_sync();
+    test_when_pending();
+    test_at_time();
+    test_wake_from_irq();
+    test_irq_polling();
+    test_deinit();
+    async_context_deinit(&context.core);
+    return host_test_result(ASYNC_CONTEXT_RTTHREAD_STATIC ? "async_context_static" : "async_context");
+}
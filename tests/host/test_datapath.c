@@ -0,0 +1,323 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+// cyw43_arch_datapath, the stats and the frame pool on an async_context_rtthread, against the mock
+// bus in place of the chip and the cyw43_driver
+
+#include "async_context_rtthread.h"
+#include "cyw43_arch_datapath.h"
+#include "cyw43_arch_stats.h"
+#include "cyw43_frame_pool.h"
+#include "mock_cyw43_bus.h"
+#include "host_test.h"
+
+#define HELD_MAX 16
+
+static async_context_rtthread_t context;
+
+// what lwIP received; only touched with the async_context lock held
+static struct {
+    uint32_t frames;
+    uint32_t next_seq;
+    uint32_t gaps;
+    uint32_t out_of_order;
+    uint32_t bad;
+    uint32_t chained;
+    uint32_t custom;
+    bool hold;
+    uint32_t held_count;
+    struct pbuf *held[HELD_MAX];
+} rx;
+
+static err_t test_input(struct pbuf *p, __unused struct netif *netif) {
+    uint8_t frame[1514];
+    uint16_t len = pbuf_copy_partial(p, frame, sizeof(frame), 0);
+    if (len != p->tot_len || !mock_cyw43_bus_frame_check(frame, len)) rx.bad++;
+    uint32_t seq = mock_cyw43_bus_frame_seq(frame);
+    if (seq < rx.next_seq) {
+        rx.out_of_order++;
+    } else {
+        if (seq > rx.next_seq) rx.gaps++;
+        rx.next_seq = seq + 1;
+    }
+    rx.frames++;
+    if (p->next) rx.chained++;
+    if (p->flags & PBUF_FLAG_IS_CUSTOM) rx.custom++;
+    if (rx.hold && rx.held_count < HELD_MAX) {
+        rx.held[rx.held_count++] = p;
+    } else {
+        pbuf_free(p);
+    }
+    return ERR_OK;
+}
+
+static void rx_reset(bool hold) {
+    async_context_acquire_lock_blocking(&context.core);
+    uint32_t next_seq = rx.next_seq;
+    memset(&rx, 0, sizeof(rx));
+    rx.next_seq = next_seq;
+    rx.hold = hold;
+    async_context_release_lock(&context.core);
+}
+
+static void rx_release_held(void) {
+    async_context_acquire_lock_blocking(&context.core);
+    for (uint32_t i = 0; i < rx.held_count; i++) pbuf_free(rx.held[i]);
+    rx.held_count = 0;
+    rx.hold = false;
+    async_context_release_lock(&context.core);
+}
+
+static uint32_t delivered(void) {
+    mock_cyw43_bus_stats_t stats;
+    mock_cyw43_bus_get_stats(&stats);
+    return stats.rx_delivered;
+}
+
+static void receive(uint32_t frames, uint32_t len, uint32_t frames_per_sec) {
+    mock_cyw43_bus_config_t config = mock_cyw43_bus_default_config();
+    config.rx_frames = frames;
+    config.rx_frame_len = len;
+    config.rx_frames_per_sec = frames_per_sec;
+    uint32_t target = delivered() + frames;
+    mock_cyw43_bus_restart_rx(&config);
+    CHECK(mock_cyw43_bus_wait_delivered(target, 5000));
+}
+
+static void check_no_leaks(void) {
+    cyw43_frame_pool_stats_t pool;
+    cyw43_frame_pool_get_stats(CYW43_FRAME_RX, &pool);
+    CHECK_EQ(pool.in_use, 0);
+    CHECK_EQ(host_lwip_pbufs_in_use(), 0);
+}
+
+// full sized frames come off the bus chained over PBUF_POOL buffers, and are moved into frames of
+// the pool on the way up
+static void test_rx_in_order(void) {
+    rx_reset(false);
+    cyw43_arch_stats_reset();
+    mock_cyw43_bus_stats_t before, after;
+    mock_cyw43_bus_get_stats(&before);
+    receive(200, 1514, 5000);
+    mock_cyw43_bus_get_stats(&after);
+    CHECK_EQ(after.rx_dropped, before.rx_dropped);
+    CHECK_EQ(after.pm_rx_notes - before.pm_rx_notes, 200);
+    async_context_acquire_lock_blocking(&context.core);
+    CHECK_EQ(rx.frames, 200);
+    CHECK_EQ(rx.gaps, 0);
+    CHECK_EQ(rx.out_of_order, 0);
+    CHECK_EQ(rx.bad, 0);
+    CHECK_EQ(rx.chained, 0);
+    CHECK_EQ(rx.custom, 200);
+    async_context_release_lock(&context.core);
+    cyw43_arch_stats_t stats;
+    cyw43_arch_stats_get(&stats);
+    CHECK_EQ(stats.itf[CYW43_ITF_STA].rx_packets, 200);
+    CHECK_EQ(stats.itf[CYW43_ITF_STA].rx_bytes, 200 * 1514);
+    CHECK_EQ(stats.itf[CYW43_ITF_STA].rx_chained, 200);
+    CHECK(stats.wakeups > 0);
+    check_no_leaks();
+}
+
+// a frame which fits a single pbuf is passed on as it is
+static void test_rx_small(void) {
+    rx_reset(false);
+    receive(50, 200, 5000);
+    async_context_acquire_lock_blocking(&context.core);
+    CHECK_EQ(rx.frames, 50);
+    CHECK_EQ(rx.bad, 0);
+    CHECK_EQ(rx.chained, 0);
+    CHECK_EQ(rx.custom, 0);
+    async_context_release_lock(&context.core);
+    check_no_leaks();
+}
+
+// while lwIP holds on to every frame of the pool, frames stay in their PBUF_POOL chains
+static void test_rx_pool_exhausted(void) {
+    cyw43_frame_pool_reset_stats();
+    rx_reset(true);
+    receive(CYW43_FRAME_POOL_RX_FRAMES + 4, 1514, 5000);
+    cyw43_frame_pool_stats_t pool;
+    cyw43_frame_pool_get_stats(CYW43_FRAME_RX, &pool);
+    CHECK_EQ(pool.in_use, CYW43_FRAME_POOL_RX_FRAMES);
+    CHECK_EQ(pool.failures, 4);
+    async_context_acquire_lock_blocking(&context.core);
+    CHECK_EQ(rx.custom, CYW43_FRAME_POOL_RX_FRAMES);
+    CHECK_EQ(rx.chained, 4);
+    CHECK_EQ(rx.bad, 0);
+    async_context_release_lock(&context.core);
+    rx_release_held();
+    check_no_leaks();
+}
+
+// frames arriving while the async_context is held up fill the chip's buffer, and the rest are
+// dropped by the chip; those buffered are all delivered once it gets going again
+static void test_rx_overflow(void) {
+    rx_reset(false);
+    mock_cyw43_bus_stats_t before, after;
+    mock_cyw43_bus_get_stats(&before);
+    mock_cyw43_bus_config_t config = mock_cyw43_bus_default_config();
+    config.rx_frames = 100;
+    config.rx_frame_len = 200;
+    config.rx_frames_per_sec = 10000;
+    config.rx_buffer_frames = 32;
+    async_context_acquire_lock_blocking(&context.core);
+    mock_cyw43_bus_restart_rx(&config);
+    sleep_ms(30);
+    async_context_release_lock(&context.core);
+    for (int i = 0; i < 1000; i++) {
+        mock_cyw43_bus_get_stats(&after);
+        if (after.rx_frames - before.rx_frames == 100 &&
+            after.rx_delivered - before.rx_delivered + after.rx_dropped - before.rx_dropped == 100) break;
+        sleep_ms(1);
+    }
+    CHECK_EQ(after.rx_frames - before.rx_frames, 100);
+    CHECK(after.rx_dropped - before.rx_dropped >= 100 - config.rx_buffer_frames - 20);
+    async_context_acquire_lock_blocking(&context.core);
+    CHECK_EQ(rx.frames, after.rx_delivered - before.rx_delivered);
+    CHECK_EQ(rx.out_of_order, 0);
+    CHECK(rx.gaps > 0);
+    async_context_release_lock(&context.core);
+    check_no_leaks();
+}
+
+// a burst of frames in one pass switches the async_context to IRQ polling, and it goes back once
+// the burst is over
+static void test_irq_polling(void) {
+    async_context_rtthread_poll_stats_t before, stats;
+    async_context_rtthread_get_poll_stats(&context, &before);
+    cyw43_arch_datapath_set_irq_poll_frames(4);
+    rx_reset(false);
+    receive(400, 200, 20000);
+    async_context_rtthread_get_poll_stats(&context, &stats);
+    CHECK(stats.enters > before.enters);
+    cyw43_arch_datapath_set_irq_poll_frames(0);
+    for (int i = 0; i < 100 && stats.polling; i++) {
+        sleep_ms(1);
+        async_context_rtthread_get_poll_stats(&context, &stats);
+    }
+    CHECK(!stats.polling);
+    async_context_acquire_lock_blocking(&context.core);
+    CHECK_EQ(rx.frames, 400);
+    CHECK_EQ(rx.gaps, 0);
+    async_context_release_lock(&context.core);
+}
+
+// the interrupt with nothing to read costs a poll, and interrupts carry on afterwards
+static void test_spurious_irq(void) {
+    mock_cyw43_bus_stats_t before, after;
+    mock_cyw43_bus_get_stats(&before);
+    after = before;
+    mock_cyw43_bus_raise_irq();
+    for (int i = 0; i < 100 && after.polls == before.polls; i++) {
+        sleep_ms(1);
+        mock_cyw43_bus_get_stats(&after);
+    }
+    CHECK_EQ(after.polls, before.polls + 1);
+    CHECK_EQ(after.rx_delivered, before.rx_delivered);
+    rx_reset(false);
+    receive(10, 200, 5000);
+}
+
+#define TX_THREADS 4
+#define TX_FRAMES 200
+
+static struct rt_semaphore tx_done;
+static volatile uint32_t tx_errors;
+
+static void tx_thread_entry(__unused void *parameter) {
+    uint8_t frame[1000] = { 0 };
+    for (int i = 0; i < TX_FRAMES; i++) {
+        if (cyw43_arch_datapath_send(CYW43_ITF_STA, sizeof(frame), frame)) {
+            __atomic_fetch_add(&tx_errors, 1, __ATOMIC_RELAXED);
+        }
+    }
+    rt_sem_release(&tx_done);
+}
+
+// senders queue up on the lock while the one holding it waits for credits
+static void test_tx_threads(void) {
+    cyw43_arch_stats_reset();
+    mock_cyw43_bus_stats_t before, after;
+    mock_cyw43_bus_get_stats(&before);
+    rt_sem_init(&tx_done, "tx_done", 0, RT_IPC_FLAG_FIFO);
+    for (int i = 0; i < TX_THREADS; i++) {
+        rt_thread_t thread = rt_thread_create("tx", tx_thread_entry, NULL, 4096, 10, 10);
+        CHECK(thread);
+        rt_thread_startup(thread);
+    }
+    for (int i = 0; i < TX_THREADS; i++) CHECK_EQ(rt_sem_take(&tx_done, 10000), RT_EOK);
+    rt_sem_detach(&tx_done);
+    mock_cyw43_bus_get_stats(&after);
+    CHECK_EQ(tx_errors, 0);
+    CHECK_EQ(after.tx_frames - before.tx_frames, TX_THREADS * TX_FRAMES);
+    CHECK_EQ(after.pm_tx_notes - before.pm_tx_notes, TX_THREADS * TX_FRAMES);
+    CHECK(after.tx_credit_waits > before.tx_credit_waits);
+    CHECK(after.pm_max_queue_depth > 1);
+    cyw43_arch_stats_t stats;
+    cyw43_arch_stats_get(&stats);
+    CHECK_EQ(stats.itf[CYW43_ITF_STA].tx_packets, TX_THREADS * TX_FRAMES);
+    CHECK_EQ(stats.itf[CYW43_ITF_STA].tx_bytes, TX_THREADS * TX_FRAMES * 1000);
+    CHECK_EQ(stats.itf[CYW43_ITF_STA].tx_dropped, 0);
+    CHECK(stats.tx_queued_max > 1);
+    CHECK_EQ(stats.tx_queued, 0);
+}
+
+static void unstall_entry(__unused void *parameter) {
+    rt_thread_mdelay(5);
+    mock_cyw43_bus_stall_tx(false);
+}
+
+// a send which waits for the chip to return credits is counted as a stall, and one which gives up
+// waiting as dropped
+static void test_tx_stall(void) {
+    uint8_t frame[100] = { 0 };
+    cyw43_arch_stats_reset();
+    mock_cyw43_bus_stall_tx(true);
+    int err;
+    // use up the credits the chip holds
+    do {
+        err = cyw43_arch_datapath_send(CYW43_ITF_STA, sizeof(frame), frame);
+    } while (!err);
+    CHECK_EQ(err, -CYW43_EIO);
+    cyw43_arch_stats_t stats;
+    cyw43_arch_stats_get(&stats);
+    CHECK_EQ(stats.itf[CYW43_ITF_STA].tx_dropped, 1);
+    CHECK_EQ(stats.tx_stalls, 1);
+    CHECK(stats.tx_max_us >= 100000);
+
+    rt_thread_t thread = rt_thread_create("unstall", unstall_entry, NULL, 4096, 10, 10);
+    CHECK(thread);
+    rt_thread_startup(thread);
+    CHECK_EQ(cyw43_arch_datapath_send(CYW43_ITF_STA, sizeof(frame), frame), 0);
+    cyw43_arch_stats_get(&stats);
+    CHECK_EQ(stats.itf[CYW43_ITF_STA].tx_dropped, 1);
+    CHECK_EQ(stats.tx_stalls, 2);
+    CHECK_EQ(stats.itf[CYW43_ITF_STA].tx_stalls, 2);
+}
+
+int main(void) {
+    CHECK(async_context_rtthread_init_with_defaults(&context));
+    mock_cyw43_bus_config_t config = mock_cyw43_bus_default_config();
+    mock_cyw43_bus_init(&context.core, &config);
+    cyw43_frame_pool_init();
+    cyw43_state.netif[CYW43_ITF_STA].input = test_input;
+    cyw43_arch_datapath_attach(CYW43_ITF_STA);
+
+    test_rx_in_order();
+    test_rx_small();
+    test_rx_pool_exhausted();
+    test_rx_overflow();
+    test_irq_polling();
+    test_spurious_irq();
+    test_tx_threads();
+    test_tx_stall();
+
+    mock_cyw43_bus_deinit();
+    async_context_deinit(&context.core);
+    check_no_leaks();
+    return host_test_result("datapath");
+}
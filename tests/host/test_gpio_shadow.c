@@ -0,0 +1,97 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "host_test.h"
+#include "cyw43_gpio_shadow.h"
+
+static void test_put_and_get(void) {
+    cyw43_gpio_shadow_t shadow;
+    uint32_t mask, value;
+    bool level;
+    cyw43_gpio_shadow_init(&shadow);
+    // nothing is known until it has been put, so the first put is always written
+    CHECK(!cyw43_gpio_shadow_get(&shadow, 0, &level));
+    CHECK(!cyw43_gpio_shadow_take(&shadow, &mask, &value));
+    CHECK(cyw43_gpio_shadow_put(&shadow, 0, false));
+    CHECK(!cyw43_gpio_shadow_put(&shadow, 0, false));
+    CHECK(cyw43_gpio_shadow_get(&shadow, 0, &level));
+    CHECK(!level);
+    CHECK(cyw43_gpio_shadow_put(&shadow, 0, true));
+    CHECK(cyw43_gpio_shadow_get(&shadow, 0, &level));
+    CHECK(level);
+    // a pin which was only read still goes to the chip
+    CHECK(!cyw43_gpio_shadow_get(&shadow, 2, &level));
+    CHECK_EQ(shadow.stats.puts, 3);
+    CHECK_EQ(shadow.stats.puts_skipped, 1);
+    CHECK_EQ(shadow.stats.gets, 4);
+    CHECK_EQ(shadow.stats.gets_cached, 2);
+}
+
+static void test_coalesced_write(void) {
+    cyw43_gpio_shadow_t shadow;
+    uint32_t mask, value;
+    cyw43_gpio_shadow_init(&shadow);
+    cyw43_gpio_shadow_put(&shadow, 0, true);
+    cyw43_gpio_shadow_put(&shadow, 0, false);
+    cyw43_gpio_shadow_put(&shadow, 1, true);
+    CHECK(cyw43_gpio_shadow_take(&shadow, &mask, &value));
+    CHECK_EQ(mask, 0x3);
+    CHECK_EQ(value, 0x2);
+    cyw43_gpio_shadow_write_done(&shadow, mask, true);
+    CHECK(!cyw43_gpio_shadow_take(&shadow, &mask, &value));
+    CHECK_EQ(shadow.stats.writes, 1);
+}
+
+static void test_write_error(void) {
+    cyw43_gpio_shadow_t shadow;
+    uint32_t mask, value;
+    bool level;
+    cyw43_gpio_shadow_init(&shadow);
+    cyw43_gpio_shadow_put(&shadow, 0, true);
+    cyw43_gpio_shadow_put(&shadow, 1, true);
+    cyw43_gpio_shadow_take(&shadow, &mask, &value);
+    cyw43_gpio_shadow_write_done(&shadow, mask, true);
+    cyw43_gpio_shadow_put(&shadow, 1, false);
+    cyw43_gpio_shadow_take(&shadow, &mask, &value);
+    CHECK_EQ(mask, 0x2);
+    cyw43_gpio_shadow_write_done(&shadow, mask, false);
+    CHECK_EQ(shadow.stats.write_errors, 1);
+    // the pin which failed is read from the chip and written on the next put, even of the same value
+    CHECK(!cyw43_gpio_shadow_get(&shadow, 1, &level));
+    CHECK(cyw43_gpio_shadow_put(&shadow, 1, false));
+    // the other one is unaffected
+    CHECK(cyw43_gpio_shadow_get(&shadow, 0, &level));
+    CHECK(level);
+}
+
+static void test_forget_and_restore(void) {
+    cyw43_gpio_shadow_t shadow;
+    uint32_t mask, value;
+    bool level;
+    cyw43_gpio_shadow_init(&shadow);
+    CHECK(!cyw43_gpio_shadow_restore(&shadow));
+    cyw43_gpio_shadow_put(&shadow, 0, true);
+    cyw43_gpio_shadow_put(&shadow, 2, false);
+    cyw43_gpio_shadow_take(&shadow, &mask, &value);
+    cyw43_gpio_shadow_write_done(&shadow, mask, true);
+    // after a chip reset every known pin is written again
+    CHECK(cyw43_gpio_shadow_restore(&shadow));
+    CHECK(cyw43_gpio_shadow_take(&shadow, &mask, &value));
+    CHECK_EQ(mask, 0x5);
+    CHECK_EQ(value, 0x1);
+    cyw43_gpio_shadow_forget(&shadow);
+    CHECK(!cyw43_gpio_shadow_get(&shadow, 0, &level));
+    CHECK(!cyw43_gpio_shadow_restore(&shadow));
+    CHECK(cyw43_gpio_shadow_put(&shadow, 0, true));
+}
+
+int main(void) {
+    test_put_and_get();
+    test_coalesced_write();
+    test_write_error();
+    test_forget_and_restore();
+    return host_test_result("gpio_shadow");
+}
@@ -0,0 +1,134 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include "host_test.h"
+#include "cyw43_pm_policy.h"
+
+static void test_burst_boosts_within_a_frame(void) {
+    cyw43_pm_policy_t policy;
+    cyw43_pm_policy_init(&policy, NULL);
+    uint32_t frame_us = policy.config.frame_us;
+    // packets further apart than a frame are not a burst
+    CHECK(!cyw43_pm_policy_packet(&policy, true, 0));
+    CHECK(!cyw43_pm_policy_packet(&policy, true, frame_us + 1));
+    CHECK(!cyw43_pm_policy_boosted(&policy));
+    // the second of two back to back packets boosts
+    CHECK(cyw43_pm_policy_packet(&policy, false, 2 * frame_us));
+    CHECK(cyw43_pm_policy_boosted(&policy));
+    CHECK_EQ(policy.boosts, 1);
+    CHECK_EQ(policy.rx_packets, 2);
+    CHECK_EQ(policy.tx_packets, 1);
+    // further packets of the burst don't boost again
+    CHECK(!cyw43_pm_policy_packet(&policy, true, 2 * frame_us + 1));
+    CHECK_EQ(policy.boosts, 1);
+}
+
+static void test_idle_window_unboosts(void) {
+    cyw43_pm_policy_t policy;
+    cyw43_pm_policy_init(&policy, NULL);
+    uint32_t idle_us = policy.config.idle_us;
+    cyw43_pm_policy_packet(&policy, true, 1000);
+    cyw43_pm_policy_packet(&policy, true, 1100);
+    CHECK(cyw43_pm_policy_boosted(&policy));
+    CHECK_EQ(cyw43_pm_policy_next_poll_us(&policy), 1100 + idle_us);
+    CHECK(!cyw43_pm_policy_poll(&policy, 1100 + idle_us - 1));
+    CHECK(cyw43_pm_policy_boosted(&policy));
+    CHECK(cyw43_pm_policy_poll(&policy, 1100 + idle_us));
+    CHECK(!cyw43_pm_policy_boosted(&policy));
+    CHECK_EQ(cyw43_pm_policy_next_poll_us(&policy), 0);
+}
+
+static void test_queue_depth(void) {
+    cyw43_pm_policy_t policy;
+    cyw43_pm_policy_init(&policy, NULL);
+    uint32_t depth = policy.config.queue_depth;
+    CHECK(!cyw43_pm_policy_queue_depth(&policy, depth - 1, 0));
+    CHECK(cyw43_pm_policy_queue_depth(&policy, depth, 10));
+    CHECK(cyw43_pm_policy_boosted(&policy));
+    // frames still queued keep the boost past the idle window
+    CHECK(!cyw43_pm_policy_poll(&policy, 10 + policy.config.idle_us));
+    cyw43_pm_policy_queue_depth(&policy, 0, 20);
+    CHECK(cyw43_pm_policy_poll(&policy, 10 + policy.config.idle_us));
+}
+
+static void test_burst_packets_of_one(void) {
+    cyw43_pm_policy_config_t config = cyw43_pm_policy_default_config();
+    config.burst_packets = 0; // treated as 1
+    cyw43_pm_policy_t policy;
+    cyw43_pm_policy_init(&policy, &config);
+    CHECK(cyw43_pm_policy_packet(&policy, true, 0));
+}
+
+static void test_replay_power_save(void) {
+    // packets closer together than the radio stays awake only wait for the first wake up
+    static const uint64_t trace[] = { 0, 50000, 100000, 150000 };
+    cyw43_pm_policy_replay_report_t report;
+    cyw43_pm_policy_replay(NULL, NULL, trace, 4, &report);
+    CHECK_EQ(report.packets, 4);
+    CHECK_EQ(report.packets_in_ps, 4);
+    CHECK_EQ(report.boosts, 0);
+    CHECK_EQ(report.added_latency_us, 51200);
+    CHECK_EQ(report.max_added_latency_us, 51200);
+    CHECK_EQ(report.duration_us, 150000);
+    CHECK_EQ(report.radio_on_us, 150000);
+}
+
+static void test_replay_boost(void) {
+    // a burst boosts on its second packet; the packet after the idle window wakes the radio again
+    static const uint64_t trace[] = { 0, 1000, 2000, 300000 };
+    cyw43_pm_policy_replay_report_t report;
+    cyw43_pm_policy_replay(NULL, NULL, trace, 4, &report);
+    CHECK_EQ(report.packets_in_ps, 3);
+    CHECK_EQ(report.boosts, 1);
+    CHECK_EQ(report.added_latency_us, 2 * 51200);
+    CHECK_EQ(report.duration_us, 300000);
+    // boosted from 1000 until 2000 + idle_us, awake in power save from 0 to 1000, idle duty after that
+    CHECK_EQ(report.radio_on_us, 201000 + 1000 + (300000 - 202000) * 30000ull / 1000000);
+}
+
+static void test_replay_never_exceeds_duration(void) {
+    static const uint64_t trace[] = { 0, 10, 20, 30, 5000, 10000 };
+    cyw43_pm_policy_replay_report_t report;
+    cyw43_pm_policy_replay(NULL, NULL, trace, 6, &report);
+    CHECK(report.radio_on_us <= report.duration_us);
+    cyw43_pm_policy_replay(NULL, NULL, trace, 1, &report);
+    CHECK_EQ(report.duration_us, 0);
+    CHECK_EQ(report.radio_on_us, 0);
+}
+
+// cyw43_arch_set_pm_auto_boost resets the governor each time it is toggled
+static void test_reset_keeps_config(void) {
+    cyw43_pm_policy_config_t config = { .frame_us = 5000, .burst_packets = 3, .queue_depth = 6, .idle_us = 250000 };
+    cyw43_pm_policy_t policy;
+    cyw43_pm_policy_init(&policy, &config);
+    CHECK(!cyw43_pm_policy_packet(&policy, true, 0));
+    cyw43_pm_policy_reset(&policy);
+    cyw43_pm_policy_reset(&policy);
+    CHECK_EQ(policy.config.frame_us, 5000);
+    CHECK_EQ(policy.config.burst_packets, 3);
+    CHECK_EQ(policy.config.queue_depth, 6);
+    CHECK_EQ(policy.config.idle_us, 250000);
+    CHECK_EQ(policy.rx_packets, 0);
+    // initializing from its own configuration is the same thing
+    cyw43_pm_policy_init(&policy, &policy.config);
+    CHECK_EQ(policy.config.frame_us, 5000);
+    CHECK_EQ(policy.config.idle_us, 250000);
+    // and a lone packet still doesn't boost afterwards
+    CHECK(!cyw43_pm_policy_packet(&policy, true, 0));
+    CHECK(!cyw43_pm_policy_boosted(&policy));
+}
+
+int main(void) {
+    test_burst_boosts_within_a_frame();
+    test_idle_window_unboosts();
+    test_queue_depth();
+    test_burst_packets_of_one();
+    test_replay_power_save();
+    test_replay_boost();
+    test_replay_never_exceeds_duration();
+    test_reset_keeps_config();
+    return host_test_result("pm_policy");
+}
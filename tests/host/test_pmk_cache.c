@@ -0,0 +1,159 @@
+/*
+ * Copyright (c) 2022 Raspberry Pi (Trading) Ltd.
+ *
+ * SPDX-License-Identifier: BSD-3-Clause
+ */
+
+#include <string.h>
+#include "host_test.h"
+#include "pico/time.h"
+#include "cyw43_pmk_cache.h"
+
+#if PICO_CYW43_ARCH_RTTHREAD
+#include <rtthread.h>
+#endif
+
+typedef struct pbkdf2_vector {
+    const char *ssid;
+    const char *passphrase;
+    uint8_t pmk[CYW43_PMK_LEN];
+} pbkdf2_vector_t;
+
+// IEEE 802.11i-2004 annex H.4
+static const pbkdf2_vector_t vectors[] = {
+    { "IEEE", "password", {
+        0xf4, 0x2c, 0x6f, 0xc5, 0x2d, 0xf0, 0xeb, 0xef, 0x9e, 0xbb, 0x4b, 0x90, 0xb3, 0x8a, 0x5f, 0x90,
+        0x2e, 0x83, 0xfe, 0x1b, 0x13, 0x5a, 0x70, 0xe2, 0x3a, 0xed, 0x76, 0x2e, 0x97, 0x10, 0xa1, 0x2e } },
+    { "ThisIsASSID", "ThisIsAPassword", {
+        0x0d, 0xc0, 0xd6, 0xeb, 0x90, 0x55, 0x5e, 0xd6, 0x41, 0x97, 0x56, 0xb9, 0xa1, 0x5e, 0xc3, 0xe3,
+        0x20, 0x9b, 0x63, 0xdf, 0x70, 0x7d, 0xd5, 0x08, 0xd1, 0x45, 0x81, 0xf8, 0x98, 0x27, 0x21, 0xaf } },
+};
+
+static void test_derive(void) {
+    for (size_t i = 0; i < sizeof(vectors) / sizeof(vectors[0]); i++) {
+        uint8_t pmk[CYW43_PMK_LEN];
+        uint64_t start_us = time_us_64();
+        cyw43_pmk_derive((const uint8_t *)vectors[i].ssid, strlen(vectors[i].ssid),
+                         (const uint8_t *)vectors[i].passphrase, strlen(vectors[i].passphrase), pmk);
+        printf("PBKDF2-SHA1 derivation took %lluus on the host\n", (unsigned long long)(time_us_64() - start_us));
+        CHECK(!memcmp(pmk, vectors[i].pmk, sizeof(pmk)));
+    }
+}
+
+static size_t join_key(const char *ssid, const char *passphrase, uint8_t pmk_hex[CYW43_PMK_HEX_LEN],
+                       const uint8_t **key) {
+    size_t key_len = strlen(passphrase);
+    *key = cyw43_pmk_cache_join_key((const uint8_t *)ssid, strlen(ssid), (const uint8_t *)passphrase, &key_len,
+                                    pmk_hex);
+    return key_len;
+}
+
+static void wait_for_derivations(uint32_t count) {
+    cyw43_pmk_cache_stats_t stats;
+    for (int i = 0; i < 5000; i++) {
+        cyw43_pmk_cache_get_stats(&stats);
+        if (stats.derivations >= count) return;
+#if PICO_CYW43_ARCH_RTTHREAD
+        rt_thread_mdelay(1);
+#endif
+    }
+}
+
+static int stored;
+
+static void store(const cyw43_pmk_entry_t *entry) {
+    stored++;
+}
+
+static void test_join_key(void) {
+    static const char hex[] = "0123456789abcdef";
+    uint8_t pmk_hex[CYW43_PMK_HEX_LEN];
+    const uint8_t *key;
+    cyw43_pmk_cache_stats_t stats;
+
+    cyw43_pmk_cache_init();
+    cyw43_pmk_cache_set_store_callback(store);
+    // a miss joins with the passphrase and derives the key for next time
+    const char *passphrase = "password";
+    size_t key_len = join_key("IEEE", passphrase, pmk_hex, &key);
+    CHECK(key == (const uint8_t *)passphrase);
+    CHECK_EQ(key_len, 8);
+    wait_for_derivations(1);
+    CHECK_EQ(stored, 1);
+
+    key_len = join_key("IEEE", "password", pmk_hex, &key);
+    CHECK(key == pmk_hex);
+    CHECK_EQ(key_len, CYW43_PMK_HEX_LEN);
+    for (int i = 0; i < CYW43_PMK_LEN; i++) {
+        CHECK(pmk_hex[i * 2] == hex[vectors[0].pmk[i] >> 4]);
+        CHECK(pmk_hex[i * 2 + 1] == hex[vectors[0].pmk[i] & 0xf]);
+    }
+
+    // another passphrase for the same network is a different entry
+    key_len = join_key("IEEE", "password2", pmk_hex, &key);
+    CHECK(key != pmk_hex);
+    wait_for_derivations(2);
+
+    // a key which is already a PMK is passed through untouched
+    const char *pmk_key = "f42c6fc52df0ebef9ebb4b90b38a5f902e83fe1b135a70e23aed762e9710a12e";
+    key_len = join_key("IEEE", pmk_key, pmk_hex, &key);
+    CHECK(key == (const uint8_t *)pmk_key);
+    CHECK_EQ(key_len, CYW43_PMK_HEX_LEN);
+
+    // the entry can be found again by a hash of the passphrase, without counting as a hit
+    uint8_t hash[CYW43_PMK_KEY_HASH_LEN];
+    cyw43_pmk_cache_key_hash((const uint8_t *)"IEEE", 4, (const uint8_t *)"password", 8, hash);
+    memset(pmk_hex, 0, sizeof(pmk_hex));
+    CHECK(cyw43_pmk_cache_lookup((const uint8_t *)"IEEE", 4, hash, pmk_hex));
+    CHECK(!memcmp(pmk_hex, pmk_key, CYW43_PMK_HEX_LEN));
+    CHECK(!cyw43_pmk_cache_lookup((const uint8_t *)"IEEF", 4, hash, pmk_hex));
+
+    cyw43_pmk_cache_get_stats(&stats);
+    CHECK_EQ(stats.hits, 1);
+    CHECK_EQ(stats.misses, 2);
+    CHECK_EQ(stats.derivations, 2);
+
+    cyw43_pmk_cache_clear();
+    key_len = join_key("IEEE", "password", pmk_hex, &key);
+    CHECK(key != pmk_hex);
+    wait_for_derivations(3);
+}
+
+static void test_lru(void) {
+    cyw43_pmk_entry_t entry;
+    uint8_t pmk_hex[CYW43_PMK_HEX_LEN];
+    const uint8_t *key;
+
+    // the entry joined last is the most recently used one...
+    CHECK_EQ(join_key("IEEE", "password", pmk_hex, &key), CYW43_PMK_HEX_LEN);
+    // ...until as many entries again are restored, as if from flash
+    memset(&entry, 0, sizeof(entry));
+    entry.ssid_len = 5;
+    memcpy(entry.ssid, "other", 5);
+    for (int i = 0; i < CYW43_PMK_CACHE_ENTRIES; i++) {
+        entry.key_hash[0] = (uint8_t)i;
+        cyw43_pmk_cache_add(&entry);
+    }
+    CHECK(join_key("IEEE", "password", pmk_hex, &key) != CYW43_PMK_HEX_LEN);
+    wait_for_derivations(4);
+}
+
+static void test_is_pmk(void) {
+    static const char pmk_key[] = "f42c6fc52df0ebef9ebb4b90b38a5f902e83fe1b135a70e23aed762e9710a12e";
+    CHECK(cyw43_pmk_cache_is_pmk((const uint8_t *)pmk_key, strlen(pmk_key)));
+    static const char upper_key[] = "F42C6FC52DF0EBEF9EBB4B90B38A5F902E83FE1B135A70E23AED762E9710A12E";
+    CHECK(cyw43_pmk_cache_is_pmk((const uint8_t *)upper_key, strlen(upper_key)));
+    // 63 characters is the longest passphrase
+    CHECK(!cyw43_pmk_cache_is_pmk((const uint8_t *)pmk_key, strlen(pmk_key) - 1));
+    static const char not_hex[] = "g42c6fc52df0ebef9ebb4b90b38a5f902e83fe1b135a70e23aed762e9710a12e";
+    CHECK(!cyw43_pmk_cache_is_pmk((const uint8_t *)not_hex, strlen(not_hex)));
+    CHECK(!cyw43_pmk_cache_is_pmk((const uint8_t *)"password", 8));
+}
+
+int main(void) {
+    test_derive();
+    test_is_pmk();
+    test_join_key();
+    test_lru();
+    return host_test_result("pmk_cache");
+}